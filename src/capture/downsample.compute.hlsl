@@ -0,0 +1,30 @@
+// Downsamples one eye of the submitted image for continuous recording.
+Texture2D u_srcTex : register(t0);
+SamplerState bilinearSampler : register(s0);
+
+RWTexture2D<unorm float4> u_dstTex : register(u0);
+
+cbuffer cb : register(b0) {
+	// texture coordinates of the top left corner of the eye's region
+	float2 u_srcOrigin;
+	// extent in texture coordinates covered by one destination pixel
+	float2 u_srcStep;
+	uint2 u_dstSize;
+	uint2 u_unused;
+};
+
+[numthreads(8, 8, 1)]
+void main(uint3 dispatchThreadId : SV_DispatchThreadID) {
+	if (any(dispatchThreadId.xy >= u_dstSize))
+		return;
+
+	// four bilinear taps at the quarter points of the destination pixel: a box filter over
+	// 4x4 source texels, which is exact for the default downsampling factor
+	float2 uv = u_srcOrigin + (dispatchThreadId.xy + 0.5) * u_srcStep;
+	float2 quarter = 0.25 * u_srcStep;
+	float3 color = u_srcTex.SampleLevel(bilinearSampler, uv + float2(-quarter.x, -quarter.y), 0).rgb
+		+ u_srcTex.SampleLevel(bilinearSampler, uv + float2(quarter.x, -quarter.y), 0).rgb
+		+ u_srcTex.SampleLevel(bilinearSampler, uv + float2(-quarter.x, quarter.y), 0).rgb
+		+ u_srcTex.SampleLevel(bilinearSampler, uv + float2(quarter.x, quarter.y), 0).rgb;
+	u_dstTex[dispatchThreadId.xy] = float4(0.25 * color, 1);
+}
@@ -32,7 +32,11 @@
     #error MinHook supports only x86 and x64 systems.
 #endif
 
-#include <windows.h>
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include "../src/platform.h"
+#endif
 
 // MinHook Error Codes.
 typedef enum MH_STATUS
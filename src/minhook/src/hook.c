@@ -26,8 +26,10 @@
  *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
-#include <windows.h>
-#include <tlhelp32.h>
+#include "platform.h"
+#ifdef _WIN32
+    #include <tlhelp32.h>
+#endif
 #include <limits.h>
 
 #include "../include/MinHook.h"
@@ -75,12 +77,19 @@ typedef struct _HOOK_ENTRY
 } HOOK_ENTRY, *PHOOK_ENTRY;
 
 // Suspended threads for Freeze()/Unfreeze().
+#ifdef _WIN32
 typedef struct _FROZEN_THREADS
 {
     LPDWORD pItems;         // Data heap
     UINT    capacity;       // Size of allocated data heap, items
     UINT    size;           // Actual number of data items
 } FROZEN_THREADS, *PFROZEN_THREADS;
+#else
+typedef struct _FROZEN_THREADS
+{
+    LPVOID  pSuspended;     // From PlatformSuspendThreads()
+} FROZEN_THREADS, *PFROZEN_THREADS;
+#endif
 
 //-------------------------------------------------------------------------
 // Global Variables:
@@ -196,23 +205,14 @@ static DWORD_PTR FindNewIP(PHOOK_ENTRY pHook, DWORD_PTR ip)
 }
 
 //-------------------------------------------------------------------------
-static void ProcessThreadIPs(HANDLE hThread, UINT pos, UINT action)
+static BOOL ProcessIP(DWORD_PTR *pIP, UINT pos, UINT action)
 {
     // If the thread suspended in the overwritten area,
     // move IP to the proper address.
 
-    CONTEXT c;
-#if defined(_M_X64) || defined(__x86_64__)
-    DWORD64 *pIP = &c.Rip;
-#else
-    DWORD   *pIP = &c.Eip;
-#endif
+    BOOL changed = FALSE;
     UINT count;
 
-    c.ContextFlags = CONTEXT_CONTROL;
-    if (!GetThreadContext(hThread, &c))
-        return;
-
     if (pos == ALL_HOOKS_POS)
     {
         pos = 0;
@@ -254,9 +254,35 @@ static void ProcessThreadIPs(HANDLE hThread, UINT pos, UINT action)
         if (ip != 0)
         {
             *pIP = ip;
-            SetThreadContext(hThread, &c);
+            changed = TRUE;
         }
     }
+
+    return changed;
+}
+
+#ifdef _WIN32
+//-------------------------------------------------------------------------
+static void ProcessThreadIPs(HANDLE hThread, UINT pos, UINT action)
+{
+    CONTEXT c;
+#if defined(_M_X64) || defined(__x86_64__)
+    DWORD64 *pIP = &c.Rip;
+#else
+    DWORD   *pIP = &c.Eip;
+#endif
+    DWORD_PTR ip;
+
+    c.ContextFlags = CONTEXT_CONTROL;
+    if (!GetThreadContext(hThread, &c))
+        return;
+
+    ip = (DWORD_PTR)*pIP;
+    if (ProcessIP(&ip, pos, action))
+    {
+        *pIP = ip;
+        SetThreadContext(hThread, &c);
+    }
 }
 
 //-------------------------------------------------------------------------
@@ -346,6 +372,36 @@ static VOID Unfreeze(PFROZEN_THREADS pThreads)
         HeapFree(g_hHeap, 0, pThreads->pItems);
     }
 }
+#else
+// Threads are stopped in a signal handler, where their instruction pointers can be moved, too.
+typedef struct _FREEZE_ACTION
+{
+    UINT pos;
+    UINT action;
+} FREEZE_ACTION;
+
+//-------------------------------------------------------------------------
+static VOID ProcessSuspendedIP(DWORD_PTR *pIP, LPVOID param)
+{
+    FREEZE_ACTION *pAction = (FREEZE_ACTION *)param;
+    ProcessIP(pIP, pAction->pos, pAction->action);
+}
+
+//-------------------------------------------------------------------------
+static VOID Freeze(PFROZEN_THREADS pThreads, UINT pos, UINT action)
+{
+    FREEZE_ACTION freezeAction;
+    freezeAction.pos    = pos;
+    freezeAction.action = action;
+    pThreads->pSuspended = PlatformSuspendThreads(ProcessSuspendedIP, &freezeAction);
+}
+
+//-------------------------------------------------------------------------
+static VOID Unfreeze(PFROZEN_THREADS pThreads)
+{
+    PlatformResumeThreads(pThreads->pSuspended);
+}
+#endif
 
 //-------------------------------------------------------------------------
 static MH_STATUS EnableHookLL(UINT pos, BOOL enable)
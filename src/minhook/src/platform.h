@@ -0,0 +1,142 @@
+/*
+ *  MinHook - The Minimalistic API Hooking Library for x64/x86
+ *
+ *  MinHook is written against the Windows API. On other systems, this
+ *  provides the types it uses and implements the functions it needs on top
+ *  of POSIX (see platform_posix.c); only Linux is supported so far.
+ */
+
+#pragma once
+
+#ifdef _WIN32
+
+#include <windows.h>
+
+#else
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <wchar.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define WINAPI
+#define VOID void
+#define TRUE  1
+#define FALSE 0
+
+typedef int            BOOL;
+typedef uint8_t        BYTE, *LPBYTE;
+typedef int8_t         INT8;
+typedef int16_t        INT16;
+typedef int32_t        INT32;
+typedef int64_t        INT64;
+typedef uint8_t        UINT8;
+typedef uint16_t       UINT16;
+typedef uint32_t       UINT32, *PUINT32;
+typedef uint64_t       UINT64;
+typedef unsigned int   UINT;
+typedef int32_t        LONG;
+typedef uint32_t       DWORD, *LPDWORD;
+typedef uint64_t       DWORD64;
+typedef uintptr_t      ULONG_PTR, DWORD_PTR;
+typedef size_t         SIZE_T;
+typedef void          *LPVOID, *HANDLE, *HMODULE;
+typedef const void    *LPCVOID;
+typedef const char    *LPCSTR;
+typedef const wchar_t *LPCWSTR;
+typedef void         (*FARPROC)(void);
+
+// Memory functions, with the subset of flags MinHook uses.
+#define MEM_COMMIT  0x00001000
+#define MEM_RESERVE 0x00002000
+#define MEM_RELEASE 0x00008000
+#define MEM_FREE    0x00010000
+
+#define PAGE_NOACCESS          0x01
+#define PAGE_READONLY          0x02
+#define PAGE_READWRITE         0x04
+#define PAGE_WRITECOPY         0x08
+#define PAGE_EXECUTE           0x10
+#define PAGE_EXECUTE_READ      0x20
+#define PAGE_EXECUTE_READWRITE 0x40
+#define PAGE_EXECUTE_WRITECOPY 0x80
+
+typedef struct _MEMORY_BASIC_INFORMATION
+{
+    LPVOID BaseAddress;
+    LPVOID AllocationBase;      // NULL for free regions
+    DWORD  AllocationProtect;
+    SIZE_T RegionSize;
+    DWORD  State;               // MEM_COMMIT or MEM_FREE
+    DWORD  Protect;
+    DWORD  Type;
+} MEMORY_BASIC_INFORMATION, *PMEMORY_BASIC_INFORMATION;
+
+typedef struct _SYSTEM_INFO
+{
+    DWORD  dwPageSize;
+    LPVOID lpMinimumApplicationAddress;
+    LPVOID lpMaximumApplicationAddress;
+    DWORD  dwAllocationGranularity;
+} SYSTEM_INFO, *LPSYSTEM_INFO;
+
+// Allocates at exactly lpAddress if given; returns NULL if that range is not free.
+LPVOID WINAPI VirtualAlloc(LPVOID lpAddress, SIZE_T dwSize, DWORD flAllocationType, DWORD flProtect);
+BOOL   WINAPI VirtualFree(LPVOID lpAddress, SIZE_T dwSize, DWORD dwFreeType);
+// These two read /proc/self/maps without allocating, as they are called while other threads are suspended.
+SIZE_T WINAPI VirtualQuery(LPCVOID lpAddress, PMEMORY_BASIC_INFORMATION lpBuffer, SIZE_T dwLength);
+BOOL   WINAPI VirtualProtect(LPVOID lpAddress, SIZE_T dwSize, DWORD flNewProtect, LPDWORD lpflOldProtect);
+VOID   WINAPI GetSystemInfo(LPSYSTEM_INFO lpSystemInfo);
+
+static inline HANDLE GetCurrentProcess(VOID)
+{
+    return NULL;
+}
+
+static inline BOOL FlushInstructionCache(HANDLE hProcess, LPCVOID lpBaseAddress, SIZE_T dwSize)
+{
+    (void)hProcess;
+    __builtin___clear_cache((char *)lpBaseAddress, (char *)lpBaseAddress + dwSize);
+    return TRUE;
+}
+
+// The private heap is the C heap; the handle only tells whether MinHook is initialized.
+HANDLE WINAPI HeapCreate(DWORD flOptions, SIZE_T dwInitialSize, SIZE_T dwMaximumSize);
+BOOL   WINAPI HeapDestroy(HANDLE hHeap);
+LPVOID WINAPI HeapAlloc(HANDLE hHeap, DWORD dwFlags, SIZE_T dwBytes);
+LPVOID WINAPI HeapReAlloc(HANDLE hHeap, DWORD dwFlags, LPVOID lpMem, SIZE_T dwBytes);
+BOOL   WINAPI HeapFree(HANDLE hHeap, DWORD dwFlags, LPVOID lpMem);
+
+static inline LONG InterlockedCompareExchange(volatile LONG *Destination, LONG Exchange, LONG Comparand)
+{
+    return __sync_val_compare_and_swap(Destination, Comparand, Exchange);
+}
+
+static inline LONG InterlockedExchange(volatile LONG *Target, LONG Value)
+{
+    // __sync_lock_test_and_set is only an acquire barrier
+    __sync_synchronize();
+    return __sync_lock_test_and_set(Target, Value);
+}
+
+VOID WINAPI Sleep(DWORD dwMilliseconds);
+
+// Modules are shared objects that are already loaded; NULL is the main program.
+HMODULE WINAPI GetModuleHandleW(LPCWSTR lpModuleName);
+FARPROC WINAPI GetProcAddress(HMODULE hModule, LPCSTR lpProcName);
+
+// Stops all other threads of the process in a signal handler, then calls processIP with the instruction
+// pointer each thread stopped at, which it may change. Returns what PlatformResumeThreads needs to let them
+// continue. Threads that do not stop within a second, e.g. because they block the signal, are left running.
+LPVOID PlatformSuspendThreads(VOID (*processIP)(DWORD_PTR *pIP, LPVOID param), LPVOID param);
+VOID   PlatformResumeThreads(LPVOID suspended);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
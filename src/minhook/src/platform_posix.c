@@ -0,0 +1,596 @@
+/*
+ *  MinHook - The Minimalistic API Hooking Library for x64/x86
+ *
+ *  The Windows functions MinHook uses, implemented for Linux.
+ */
+
+#ifndef _GNU_SOURCE
+    #define _GNU_SOURCE
+#endif
+
+#include "platform.h"
+
+#if !defined(__linux__)
+    #error The POSIX backend of MinHook only supports Linux.
+#endif
+
+#include <dirent.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#ifndef MAP_FIXED_NOREPLACE
+    // older headers; older kernels take it as a hint, which is checked below
+    #define MAP_FIXED_NOREPLACE 0x100000
+#endif
+
+// The signal that stops threads while hooks are enabled or disabled.
+#ifndef MH_SUSPEND_SIGNAL
+    #define MH_SUSPEND_SIGNAL (SIGRTMIN + 7)
+#endif
+
+//-------------------------------------------------------------------------
+// Memory
+//-------------------------------------------------------------------------
+
+static ULONG_PTR PageSize(VOID)
+{
+    static ULONG_PTR pageSize = 0;
+    if (pageSize == 0)
+        pageSize = (ULONG_PTR)sysconf(_SC_PAGESIZE);
+    return pageSize;
+}
+
+static DWORD ToPageProtection(int prot)
+{
+    if (prot & PROT_EXEC)
+    {
+        if (prot & PROT_WRITE)
+            return PAGE_EXECUTE_READWRITE;
+        return (prot & PROT_READ) ? PAGE_EXECUTE_READ : PAGE_EXECUTE;
+    }
+    if (prot & PROT_WRITE)
+        return PAGE_READWRITE;
+    return (prot & PROT_READ) ? PAGE_READONLY : PAGE_NOACCESS;
+}
+
+static int ToProt(DWORD protect)
+{
+    switch (protect)
+    {
+    case PAGE_READONLY:          return PROT_READ;
+    case PAGE_READWRITE:
+    case PAGE_WRITECOPY:         return PROT_READ | PROT_WRITE;
+    case PAGE_EXECUTE:           return PROT_EXEC;
+    case PAGE_EXECUTE_READ:      return PROT_READ | PROT_EXEC;
+    case PAGE_EXECUTE_READWRITE:
+    case PAGE_EXECUTE_WRITECOPY: return PROT_READ | PROT_WRITE | PROT_EXEC;
+    default:                     return PROT_NONE;
+    }
+}
+
+static ULONG_PTR ParseHex(const char **p)
+{
+    ULONG_PTR value = 0;
+    for (;; ++*p)
+    {
+        char c = **p;
+        if (c >= '0' && c <= '9')
+            value = value * 16 + (ULONG_PTR)(c - '0');
+        else if (c >= 'a' && c <= 'f')
+            value = value * 16 + (ULONG_PTR)(c - 'a' + 10);
+        else
+            return value;
+    }
+}
+
+typedef struct _MAPPING
+{
+    ULONG_PTR start;    // if not mapped, the free range around the address
+    ULONG_PTR end;
+    int       prot;
+    BOOL      mapped;
+} MAPPING;
+
+// Finds the mapping that contains address, or the gap between mappings it lies in. Reads /proc/self/maps
+// in place, as this runs while other threads may be suspended inside malloc.
+static BOOL FindMapping(ULONG_PTR address, MAPPING *pMapping)
+{
+    // lines are at most a path plus the fixed fields
+    char      buffer[PATH_MAX + 256];
+    size_t    filled = 0;
+    ULONG_PTR previousEnd = 0;
+    BOOL      done = FALSE;
+    BOOL      failed = FALSE;
+    int       fd = open("/proc/self/maps", O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return FALSE;
+
+    pMapping->mapped = FALSE;
+    pMapping->prot   = PROT_NONE;
+    while (!done)
+    {
+        char   *line, *newline;
+        ssize_t count = read(fd, buffer + filled, sizeof(buffer) - 1 - filled);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+        {
+            failed = count < 0;
+            break;
+        }
+        filled += (size_t)count;
+        buffer[filled] = '\0';
+
+        line = buffer;
+        while (!done && (newline = strchr(line, '\n')) != NULL)
+        {
+            const char *p = line;
+            ULONG_PTR start = ParseHex(&p);
+            ULONG_PTR end;
+            ++p;
+            end = ParseHex(&p);
+            ++p;
+            if (address < start)
+            {
+                // in the gap before this mapping
+                pMapping->start = previousEnd;
+                pMapping->end   = start;
+                done = TRUE;
+            }
+            else if (address < end)
+            {
+                pMapping->start  = start;
+                pMapping->end    = end;
+                pMapping->mapped = TRUE;
+                pMapping->prot   = (p[0] == 'r' ? PROT_READ : 0)
+                                 | (p[1] == 'w' ? PROT_WRITE : 0)
+                                 | (p[2] == 'x' ? PROT_EXEC : 0);
+                done = TRUE;
+            }
+            previousEnd = end;
+            line = newline + 1;
+        }
+        if (!done && line == buffer && filled == sizeof(buffer) - 1)
+        {
+            failed = TRUE;
+            break;
+        }
+        // keep the incomplete last line for the next read
+        filled -= (size_t)(line - buffer);
+        memmove(buffer, line, filled);
+    }
+    close(fd);
+
+    if (failed)
+        return FALSE;
+    if (!done)
+    {
+        // above the last mapping
+        pMapping->start = previousEnd;
+        pMapping->end   = (ULONG_PTR)-1 - PageSize() + 1;
+    }
+    return TRUE;
+}
+
+// the blocks VirtualAlloc handed out, as VirtualFree is not told their size
+typedef struct _ALLOCATION
+{
+    LPVOID address;
+    SIZE_T size;
+} ALLOCATION;
+
+static ALLOCATION *g_pAllocations = NULL;
+static UINT        g_allocationCount = 0;
+static UINT        g_allocationCapacity = 0;
+
+LPVOID WINAPI VirtualAlloc(LPVOID lpAddress, SIZE_T dwSize, DWORD flAllocationType, DWORD flProtect)
+{
+    int    flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    LPVOID p;
+    (void)flAllocationType;
+
+    if (g_allocationCount == g_allocationCapacity)
+    {
+        UINT capacity = g_allocationCapacity == 0 ? 16 : g_allocationCapacity * 2;
+        ALLOCATION *pAllocations = (ALLOCATION *)realloc(g_pAllocations, capacity * sizeof(ALLOCATION));
+        if (pAllocations == NULL)
+            return NULL;
+        g_pAllocations = pAllocations;
+        g_allocationCapacity = capacity;
+    }
+
+    if (lpAddress != NULL)
+        flags |= MAP_FIXED_NOREPLACE;
+    p = mmap(lpAddress, dwSize, ToProt(flProtect), flags, -1, 0);
+    if (p == MAP_FAILED)
+        return NULL;
+    if (lpAddress != NULL && p != lpAddress)
+    {
+        munmap(p, dwSize);
+        return NULL;
+    }
+
+    g_pAllocations[g_allocationCount].address = p;
+    g_pAllocations[g_allocationCount].size    = dwSize;
+    g_allocationCount++;
+    return p;
+}
+
+BOOL WINAPI VirtualFree(LPVOID lpAddress, SIZE_T dwSize, DWORD dwFreeType)
+{
+    UINT i;
+    (void)dwSize;
+    (void)dwFreeType;
+
+    for (i = 0; i < g_allocationCount; ++i)
+    {
+        if (g_pAllocations[i].address == lpAddress)
+        {
+            munmap(lpAddress, g_pAllocations[i].size);
+            g_pAllocations[i] = g_pAllocations[--g_allocationCount];
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+SIZE_T WINAPI VirtualQuery(LPCVOID lpAddress, PMEMORY_BASIC_INFORMATION lpBuffer, SIZE_T dwLength)
+{
+    MAPPING   mapping;
+    ULONG_PTR base = (ULONG_PTR)lpAddress & ~(PageSize() - 1);
+
+    memset(lpBuffer, 0, dwLength);
+    if (dwLength < sizeof(MEMORY_BASIC_INFORMATION) || !FindMapping((ULONG_PTR)lpAddress, &mapping))
+        return 0;
+
+    lpBuffer->BaseAddress = (LPVOID)base;
+    lpBuffer->RegionSize  = mapping.end - base;
+    if (mapping.mapped)
+    {
+        lpBuffer->AllocationBase    = (LPVOID)mapping.start;
+        lpBuffer->State             = MEM_COMMIT;
+        lpBuffer->Protect           = ToPageProtection(mapping.prot);
+        lpBuffer->AllocationProtect = lpBuffer->Protect;
+    }
+    else
+    {
+        lpBuffer->State   = MEM_FREE;
+        lpBuffer->Protect = PAGE_NOACCESS;
+    }
+    return sizeof(MEMORY_BASIC_INFORMATION);
+}
+
+BOOL WINAPI VirtualProtect(LPVOID lpAddress, SIZE_T dwSize, DWORD flNewProtect, LPDWORD lpflOldProtect)
+{
+    // patches are a few bytes; should they cross into a mapping with other protection, both end up with
+    // the protection of the first when it is restored
+    MAPPING   mapping;
+    ULONG_PTR start = (ULONG_PTR)lpAddress & ~(PageSize() - 1);
+    ULONG_PTR end   = ((ULONG_PTR)lpAddress + dwSize + PageSize() - 1) & ~(PageSize() - 1);
+
+    if (!FindMapping((ULONG_PTR)lpAddress, &mapping) || !mapping.mapped)
+        return FALSE;
+    if (mprotect((LPVOID)start, end - start, ToProt(flNewProtect)) != 0)
+        return FALSE;
+    *lpflOldProtect = ToPageProtection(mapping.prot);
+    return TRUE;
+}
+
+VOID WINAPI GetSystemInfo(LPSYSTEM_INFO lpSystemInfo)
+{
+    lpSystemInfo->dwPageSize                  = (DWORD)PageSize();
+    lpSystemInfo->dwAllocationGranularity     = (DWORD)PageSize();
+    lpSystemInfo->lpMinimumApplicationAddress = (LPVOID)0x10000;
+#if defined(__x86_64__)
+    lpSystemInfo->lpMaximumApplicationAddress = (LPVOID)0x7FFFFFFEFFFFULL;
+#else
+    lpSystemInfo->lpMaximumApplicationAddress = (LPVOID)0xBFFEFFFFUL;
+#endif
+}
+
+//-------------------------------------------------------------------------
+// Heap and other functions
+//-------------------------------------------------------------------------
+
+HANDLE WINAPI HeapCreate(DWORD flOptions, SIZE_T dwInitialSize, SIZE_T dwMaximumSize)
+{
+    static char heap;
+    (void)flOptions;
+    (void)dwInitialSize;
+    (void)dwMaximumSize;
+    return &heap;
+}
+
+BOOL WINAPI HeapDestroy(HANDLE hHeap)
+{
+    (void)hHeap;
+    return TRUE;
+}
+
+LPVOID WINAPI HeapAlloc(HANDLE hHeap, DWORD dwFlags, SIZE_T dwBytes)
+{
+    (void)hHeap;
+    (void)dwFlags;
+    return malloc(dwBytes);
+}
+
+LPVOID WINAPI HeapReAlloc(HANDLE hHeap, DWORD dwFlags, LPVOID lpMem, SIZE_T dwBytes)
+{
+    (void)hHeap;
+    (void)dwFlags;
+    return realloc(lpMem, dwBytes);
+}
+
+BOOL WINAPI HeapFree(HANDLE hHeap, DWORD dwFlags, LPVOID lpMem)
+{
+    (void)hHeap;
+    (void)dwFlags;
+    free(lpMem);
+    return TRUE;
+}
+
+VOID WINAPI Sleep(DWORD dwMilliseconds)
+{
+    if (dwMilliseconds == 0)
+        sched_yield();
+    else
+        usleep((useconds_t)dwMilliseconds * 1000);
+}
+
+HMODULE WINAPI GetModuleHandleW(LPCWSTR lpModuleName)
+{
+    char   name[PATH_MAX];
+    HMODULE hModule;
+
+    if (lpModuleName == NULL)
+        return dlopen(NULL, RTLD_NOW);
+    if (wcstombs(name, lpModuleName, sizeof(name)) >= sizeof(name))
+        return NULL;
+    // the module stays loaded by whoever loaded it, so the handle stays valid without our reference
+    hModule = dlopen(name, RTLD_NOW | RTLD_NOLOAD);
+    if (hModule != NULL)
+        dlclose(hModule);
+    return hModule;
+}
+
+FARPROC WINAPI GetProcAddress(HMODULE hModule, LPCSTR lpProcName)
+{
+    FARPROC proc;
+    void   *symbol = dlsym(hModule, lpProcName);
+    memcpy(&proc, &symbol, sizeof(proc));
+    return proc;
+}
+
+//-------------------------------------------------------------------------
+// Threads
+//-------------------------------------------------------------------------
+
+// A thread is sent the signal, stops in the handler, and leaves it once released. The handler and the
+// suspending thread move a thread out of THREAD_SIGNALED with a compare-exchange, so that a signal
+// arriving after the thread was given up on does not stop it.
+#define THREAD_SIGNALED 0
+#define THREAD_STOPPED  1
+#define THREAD_SKIPPED  2
+
+typedef struct _SUSPENDED_THREAD
+{
+    pid_t       tid;
+    int         state;
+    ucontext_t *pContext;
+} SUSPENDED_THREAD;
+
+typedef struct _SUSPENDED_THREADS
+{
+    SUSPENDED_THREAD *pItems;
+    UINT              size;
+    int               released;
+} SUSPENDED_THREADS;
+
+static SUSPENDED_THREADS *g_pSuspended = NULL;
+// handlers that may be looking at g_pSuspended
+static int g_handlersRunning = 0;
+// signals sent that have not been handled yet; the handler stays installed while there are any
+static int g_signalsPending = 0;
+static BOOL g_handlerInstalled = FALSE;
+static struct sigaction g_previousAction;
+
+static pid_t CurrentThreadId(VOID)
+{
+    return (pid_t)syscall(SYS_gettid);
+}
+
+static void SuspendHandler(int sig, siginfo_t *info, void *context)
+{
+    int savedErrno = errno;
+    SUSPENDED_THREADS *pSuspended;
+    (void)sig;
+    (void)info;
+
+    __atomic_add_fetch(&g_handlersRunning, 1, __ATOMIC_SEQ_CST);
+    __atomic_sub_fetch(&g_signalsPending, 1, __ATOMIC_SEQ_CST);
+    pSuspended = __atomic_load_n(&g_pSuspended, __ATOMIC_SEQ_CST);
+    if (pSuspended != NULL)
+    {
+        pid_t tid = CurrentThreadId();
+        UINT  i;
+        for (i = 0; i < pSuspended->size; ++i)
+        {
+            SUSPENDED_THREAD *pThread = &pSuspended->pItems[i];
+            int expected = THREAD_SIGNALED;
+            if (pThread->tid != tid)
+                continue;
+            pThread->pContext = (ucontext_t *)context;
+            if (__atomic_compare_exchange_n(&pThread->state, &expected, THREAD_STOPPED, FALSE, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            {
+                // changes to the context are applied when the handler returns
+                while (!__atomic_load_n(&pSuspended->released, __ATOMIC_ACQUIRE))
+                    sched_yield();
+            }
+            break;
+        }
+    }
+    __atomic_sub_fetch(&g_handlersRunning, 1, __ATOMIC_SEQ_CST);
+    errno = savedErrno;
+}
+
+static BOOL InstallSuspendHandler(VOID)
+{
+    struct sigaction action;
+    if (g_handlerInstalled)
+        return TRUE;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = SuspendHandler;
+    action.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigfillset(&action.sa_mask);
+    if (sigaction(MH_SUSPEND_SIGNAL, &action, &g_previousAction) != 0)
+        return FALSE;
+    g_handlerInstalled = TRUE;
+    return TRUE;
+}
+
+static UINT ListOtherThreads(pid_t **ppTids)
+{
+    UINT   size = 0, capacity = 0;
+    pid_t  self = CurrentThreadId();
+    struct dirent *entry;
+    DIR   *dir = opendir("/proc/self/task");
+
+    *ppTids = NULL;
+    if (dir == NULL)
+        return 0;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        pid_t tid = (pid_t)atoi(entry->d_name);
+        if (tid <= 0 || tid == self)
+            continue;
+        if (size == capacity)
+        {
+            UINT   newCapacity = capacity == 0 ? 64 : capacity * 2;
+            pid_t *p = (pid_t *)realloc(*ppTids, newCapacity * sizeof(pid_t));
+            if (p == NULL)
+                break;
+            *ppTids = p;
+            capacity = newCapacity;
+        }
+        (*ppTids)[size++] = tid;
+    }
+    closedir(dir);
+    return size;
+}
+
+static ULONG_PTR MonotonicMilliseconds(VOID)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (ULONG_PTR)now.tv_sec * 1000 + (ULONG_PTR)now.tv_nsec / 1000000;
+}
+
+LPVOID PlatformSuspendThreads(VOID (*processIP)(DWORD_PTR *pIP, LPVOID param), LPVOID param)
+{
+    SUSPENDED_THREADS *pSuspended;
+    pid_t    *pTids;
+    // not through the C library, whose functions may be the ones being hooked
+    pid_t     pid = (pid_t)syscall(SYS_getpid);
+    ULONG_PTR deadline;
+    UINT      i, count;
+
+    count = ListOtherThreads(&pTids);
+    if (count == 0 || !InstallSuspendHandler())
+    {
+        free(pTids);
+        return NULL;
+    }
+
+    pSuspended = (SUSPENDED_THREADS *)calloc(1, sizeof(SUSPENDED_THREADS));
+    if (pSuspended == NULL)
+    {
+        free(pTids);
+        return NULL;
+    }
+    pSuspended->pItems = (SUSPENDED_THREAD *)calloc(count, sizeof(SUSPENDED_THREAD));
+    if (pSuspended->pItems == NULL)
+    {
+        free(pSuspended);
+        free(pTids);
+        return NULL;
+    }
+    for (i = 0; i < count; ++i)
+    {
+        pSuspended->pItems[i].tid   = pTids[i];
+        pSuspended->pItems[i].state = THREAD_SIGNALED;
+    }
+    pSuspended->size = count;
+    free(pTids);
+    __atomic_store_n(&g_pSuspended, pSuspended, __ATOMIC_SEQ_CST);
+
+    for (i = 0; i < count; ++i)
+    {
+        SUSPENDED_THREAD *pThread = &pSuspended->pItems[i];
+        __atomic_add_fetch(&g_signalsPending, 1, __ATOMIC_SEQ_CST);
+        if (syscall(SYS_tgkill, pid, pThread->tid, MH_SUSPEND_SIGNAL) != 0)
+        {
+            // the thread has exited
+            __atomic_sub_fetch(&g_signalsPending, 1, __ATOMIC_SEQ_CST);
+            __atomic_store_n(&pThread->state, THREAD_SKIPPED, __ATOMIC_RELEASE);
+        }
+    }
+
+    deadline = MonotonicMilliseconds() + 1000;
+    for (i = 0; i < count; ++i)
+    {
+        SUSPENDED_THREAD *pThread = &pSuspended->pItems[i];
+        while (__atomic_load_n(&pThread->state, __ATOMIC_ACQUIRE) == THREAD_SIGNALED)
+        {
+            int expected = THREAD_SIGNALED;
+            BOOL exited = syscall(SYS_tgkill, pid, pThread->tid, 0) != 0;
+            if ((exited || MonotonicMilliseconds() > deadline)
+                && __atomic_compare_exchange_n(&pThread->state, &expected, THREAD_SKIPPED, FALSE, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+                break;
+            sched_yield();
+        }
+
+        if (__atomic_load_n(&pThread->state, __ATOMIC_ACQUIRE) == THREAD_STOPPED)
+        {
+#if defined(__x86_64__)
+            greg_t *pRegister = &pThread->pContext->uc_mcontext.gregs[REG_RIP];
+#else
+            greg_t *pRegister = &pThread->pContext->uc_mcontext.gregs[REG_EIP];
+#endif
+            DWORD_PTR ip = (DWORD_PTR)*pRegister;
+            processIP(&ip, param);
+            *pRegister = (greg_t)ip;
+        }
+    }
+    return pSuspended;
+}
+
+VOID PlatformResumeThreads(LPVOID suspended)
+{
+    SUSPENDED_THREADS *pSuspended = (SUSPENDED_THREADS *)suspended;
+    if (pSuspended == NULL)
+        return;
+
+    __atomic_store_n(&pSuspended->released, 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&g_pSuspended, NULL, __ATOMIC_SEQ_CST);
+    // handlers that got hold of the list before it was unpublished must be done with it before it is freed
+    while (__atomic_load_n(&g_handlersRunning, __ATOMIC_SEQ_CST) != 0)
+        sched_yield();
+    free(pSuspended->pItems);
+    free(pSuspended);
+
+    if (__atomic_load_n(&g_signalsPending, __ATOMIC_SEQ_CST) == 0)
+    {
+        sigaction(MH_SUSPEND_SIGNAL, &g_previousAction, NULL);
+        g_handlerInstalled = FALSE;
+    }
+}
@@ -74,6 +74,10 @@ struct NIS_ALIGNED(256) NISConfig
 
     uint32_t imageCentre[2];
     uint32_t radius[2];
+
+    uint32_t imageCentreRight[2];
+    uint32_t eyeSplitX;
+    uint32_t reserved2;
 };
 
 enum class NISHDRMode : uint32_t
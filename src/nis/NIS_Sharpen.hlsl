@@ -66,6 +66,10 @@ cbuffer cb : register(b0)
 
 	uint2 centre;
 	uint2 radius;
+
+	uint2 centreRight;
+	uint eyeSplitX;
+	uint reserved2;
 };
 
 SamplerState samplerLinearClamp : register(s0);
@@ -73,7 +77,25 @@ Texture2D in_texture            : register(t0);
 RWTexture2D<unorm float4> out_texture : register(u0);
 
 
-void DirectCopy(uint2 blockIdx, uint threadIdx)
+// when both eyes of a side-by-side texture are sharpened in a single dispatch, pixels from the split on
+// belong to the right eye
+bool InsideRadius(int2 pixel)
+{
+	const int2 eyeCentre = uint(pixel.x) >= eyeSplitX ? int2(centreRight) : int2(centre);
+	const int2 d = eyeCentre - pixel;
+	return dot(d, d) <= int(radius.y);
+}
+
+// the nearest and farthest distances from the eye's centre to the pixels in [lo, hi], squared
+int2 RangeDistances(int2 eyeCentre, int2 lo, int2 hi)
+{
+	const int2 nearest = eyeCentre - clamp(eyeCentre, lo, hi);
+	const int2 farthest = max(abs(eyeCentre - lo), abs(eyeCentre - hi));
+	return int2(dot(nearest, nearest), dot(farthest, farthest));
+}
+
+// copies the pixels of the block, or only those outside the sharpening radius
+void DirectCopy(uint2 blockIdx, uint threadIdx, bool outsideOnly)
 {
 	const float4 mul = float4(1, 1, 1, 1) - reserved1 * float4(0, 0.2, 0.2, 0);
 	const int dstBlockX = NIS_BLOCK_WIDTH * blockIdx.x;
@@ -81,6 +103,8 @@ void DirectCopy(uint2 blockIdx, uint threadIdx)
 	for (uint k = threadIdx; k < NIS_BLOCK_WIDTH * NIS_BLOCK_HEIGHT; k += NIS_THREAD_GROUP_SIZE)
 	{
 		const int2 pos = int2(k % NIS_BLOCK_WIDTH, k / NIS_BLOCK_WIDTH);
+		if (outsideOnly && InsideRadius(int2(dstBlockX, dstBlockY) + pos))
+			continue;
 		const int dstX = dstBlockX + pos.x + kInputViewportOriginX;
 		const int dstY = dstBlockY + pos.y + kInputViewportOriginY;
 		float3 c = in_texture[uint2(dstX, dstY)].rgb;
@@ -94,12 +118,32 @@ void DirectCopy(uint2 blockIdx, uint threadIdx)
 [numthreads(NIS_THREAD_GROUP_SIZE, 1, 1)]
 void main(uint3 blockIdx : SV_GroupID, uint3 threadIdx : SV_GroupThreadID)
 {
-	uint2 groupCentre = uint2((blockIdx.x * 32) + 16, (blockIdx.y * 32) + 16);
-	uint2 dc1 = centre.xy - groupCentre;
-	if (dot(dc1, dc1) <= radius.y) {
-		NVSharpen(blockIdx.xy, threadIdx.x);
+	// the block's columns on each side of the split are tested against their own eye's centre
+	const int2 blockMin = int2(blockIdx.xy) * int2(NIS_BLOCK_WIDTH, NIS_BLOCK_HEIGHT);
+	const int2 blockMax = blockMin + int2(NIS_BLOCK_WIDTH - 1, NIS_BLOCK_HEIGHT - 1);
+	const int splitX = int(min(eyeSplitX, uint(blockMax.x + 1)));
+	int nearest = 0x7fffffff;
+	int farthest = 0;
+	if (blockMin.x < splitX) {
+		const int2 d = RangeDistances(int2(centre), blockMin, int2(splitX - 1, blockMax.y));
+		nearest = min(nearest, d.x);
+		farthest = max(farthest, d.y);
+	}
+	if (splitX <= blockMax.x) {
+		const int2 d = RangeDistances(int2(centreRight), int2(max(splitX, blockMin.x), blockMin.y), blockMax);
+		nearest = min(nearest, d.x);
+		farthest = max(farthest, d.y);
+	}
+
+	if (nearest > int(radius.y)) {
+		DirectCopy(blockIdx.xy, threadIdx.x, false);
 	}
 	else {
-		DirectCopy(blockIdx.xy, threadIdx.x);
+		NVSharpen(blockIdx.xy, threadIdx.x);
+		if (farthest > int(radius.y)) {
+			// the block reaches past the radius, so its pixels outside are copied over the sharpened ones
+			DeviceMemoryBarrierWithGroupSync();
+			DirectCopy(blockIdx.xy, threadIdx.x, true);
+		}
 	}
 }
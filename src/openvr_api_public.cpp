@@ -9,9 +9,13 @@
 #include "hmderrors_public.h"
 #include <vrcommon/strtools_public.h>
 #include <vrcommon/vrpathregistry_public.h>
+#include <atomic>
+#include <cstring>
 #include <mutex>
 
 #include "VrHooks.h"
+#include "InterfaceCache.h"
+#include "RuntimeDiscovery.h"
 #undef interface
 
 //using vr::EVRInitError;
@@ -48,7 +52,24 @@ static std::recursive_mutex g_mutexSystem;
 
 typedef void* (*VRClientCoreFactoryFn)(const char *pInterfaceName, int *pReturnCode);
 
-static uint32_t g_nVRToken = 0;
+// read without the lock by the interface cache
+static std::atomic<uint32_t> g_nVRToken( 0 );
+
+// vrclient as loaded by VR_IsHmdPresent before init, kept so that polling launchers do not load it every time
+static void *g_pProbeModule = NULL;
+static IVRClientCore *g_pProbeSystem = NULL;
+static std::string g_sProbeRuntimePath;
+
+static void ReleaseProbe()
+{
+	if ( g_pProbeModule )
+	{
+		SharedLib_Unload( g_pProbeModule );
+		g_pProbeModule = NULL;
+		g_pProbeSystem = NULL;
+		g_sProbeRuntimePath.clear();
+	}
+}
 
 uint32_t VR_GetInitToken()
 {
@@ -65,7 +86,11 @@ uint32_t VR_InitInternal2( EVRInitError *peError, vr::EVRApplicationType eApplic
 
 	InitHooks();
 	
+	// the runtime may have been installed or moved since the last look
+	RuntimeDiscovery::Instance().Invalidate();
 	EVRInitError err = VR_LoadHmdSystemInternal();
+	// the runtime's own reference keeps vrclient loaded
+	ReleaseProbe();
 	if ( err == vr::VRInitError_None )
 	{
 		err = g_pHmdSystem->Init( eApplicationType, pStartupInfo );
@@ -97,7 +122,11 @@ void VR_ShutdownInternal()
 {
 	std::lock_guard<std::recursive_mutex> lock( g_mutexSystem );
 
+	// before the runtime goes away, so the interface cache stops handing out its interfaces
+	++g_nVRToken;
+
 	ShutdownHooks();
+	RuntimeDiscovery::Instance().Invalidate();
 	
 #if !defined( VR_API_PUBLIC )
 	CleanupInternalInterfaces();
@@ -114,15 +143,13 @@ void VR_ShutdownInternal()
 		SharedLib_Unload( g_pVRModule );
 		g_pVRModule = NULL;
 	}
-
-	++g_nVRToken;
 }
 
 EVRInitError VR_LoadHmdSystemInternal()
 {
 	std::string sRuntimePath, sConfigPath, sLogPath;
 
-	bool bReadPathRegistry = CVRPathRegistry_Public::GetPaths( &sRuntimePath, &sConfigPath, &sLogPath, NULL, NULL );
+	bool bReadPathRegistry = RuntimeDiscovery::Instance().GetPaths( &sRuntimePath, &sConfigPath, &sLogPath );
 	if( !bReadPathRegistry )
 	{
 		return vr::VRInitError_Init_PathRegistryNotFound;
@@ -182,6 +209,15 @@ EVRInitError VR_LoadHmdSystemInternal()
 
 void *VR_GetGenericInterface(const char *pchInterfaceVersion, EVRInitError *peError)
 {
+	// interfaces requested before under the current token have already been through HookVRInterface
+	void *cached = InterfaceCache::Instance().Find( pchInterfaceVersion, g_nVRToken.load( std::memory_order_acquire ) );
+	if (cached)
+	{
+		if (peError)
+			*peError = VRInitError_None;
+		return cached;
+	}
+
 	std::lock_guard<std::recursive_mutex> lock( g_mutexSystem );
 
 	if (!g_pHmdSystem)
@@ -193,15 +229,20 @@ void *VR_GetGenericInterface(const char *pchInterfaceVersion, EVRInitError *peEr
 
 	// if C interfaces were requested, make sure that we also request the underlying
 	// C++ interfaces so that our hooks get installed.
-	std::string interfaceName (pchInterfaceVersion);
-	if (interfaceName.substr(0, 7) == "FnTable") {
+	if (strncmp(pchInterfaceVersion, "FnTable:", 8) == 0) {
 		// C interfaces have names "FnTable:IVRxxx", so strip the "FnTable:"
-		VR_GetGenericInterface(interfaceName.substr(8).c_str(), nullptr);
+		VR_GetGenericInterface(pchInterfaceVersion + 8, nullptr);
 	}
 
-	void *interface = g_pHmdSystem->GetGenericInterface(pchInterfaceVersion, peError);
+	EVRInitError err = VRInitError_None;
+	void *interface = g_pHmdSystem->GetGenericInterface(pchInterfaceVersion, &err);
+	if (peError)
+		*peError = err;
 	HookVRInterface(pchInterfaceVersion, interface);
 
+	if (interface && err == VRInitError_None)
+		InterfaceCache::Instance().Store(pchInterfaceVersion, g_nVRToken, interface);
+
 	return interface;
 }
 
@@ -228,18 +269,25 @@ bool VR_IsHmdPresent()
 	}
 	else
 	{
-		// otherwise we need to do a bit more work
-		EVRInitError err = VR_LoadHmdSystemInternal();
-		if( err != VRInitError_None )
-			return false;
+		// otherwise we need to do a bit more work, unless vrclient is still loaded from the last call
+		std::string sRuntimePath;
+		if ( !RuntimeDiscovery::Instance().GetPaths( &sRuntimePath, nullptr, nullptr ) || sRuntimePath != g_sProbeRuntimePath )
+			ReleaseProbe();
 
-		bool bHasHmd = g_pHmdSystem->BIsHmdPresent();
-
-		g_pHmdSystem = NULL;
-		SharedLib_Unload( g_pVRModule );
-		g_pVRModule = NULL;
+		if ( !g_pProbeSystem )
+		{
+			EVRInitError err = VR_LoadHmdSystemInternal();
+			if( err != VRInitError_None )
+				return false;
+
+			g_pProbeSystem = g_pHmdSystem;
+			g_pProbeModule = g_pVRModule;
+			g_sProbeRuntimePath = sRuntimePath;
+			g_pHmdSystem = NULL;
+			g_pVRModule = NULL;
+		}
 
-		return bHasHmd;
+		return g_pProbeSystem->BIsHmdPresent();
 	}
 }
 
@@ -258,7 +306,7 @@ bool VR_IsRuntimeInstalled()
 		// otherwise we need to do a bit more work
 		std::string sRuntimePath, sConfigPath, sLogPath;
 
-		bool bReadPathRegistry = CVRPathRegistry_Public::GetPaths( &sRuntimePath, &sConfigPath, &sLogPath, NULL, NULL );
+		bool bReadPathRegistry = RuntimeDiscovery::Instance().GetPaths( &sRuntimePath, &sConfigPath, &sLogPath );
 		if( !bReadPathRegistry )
 		{
 			return false;
@@ -310,7 +358,7 @@ bool VR_GetRuntimePath( char *pchPathBuffer, uint32_t unBufferSize, uint32_t *pu
 
 	*punRequiredBufferSize = 0;
 
-	bool bReadPathRegistry = CVRPathRegistry_Public::GetPaths( &sRuntimePath, nullptr, nullptr, nullptr, nullptr );
+	bool bReadPathRegistry = RuntimeDiscovery::Instance().GetPaths( &sRuntimePath, nullptr, nullptr );
 	if ( !bReadPathRegistry )
 	{
 		return false;
@@ -0,0 +1,436 @@
+#include "CaptureRing.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace vr {
+	static_assert(sizeof(RingFileHeader) == 48, "ring file header layout changed");
+	static_assert(sizeof(RingFrameEntry) == 64, "ring file index layout changed");
+
+	class MappedFile {
+	public:
+		MappedFile() {}
+		MappedFile( const MappedFile & ) = delete;
+		MappedFile & operator=( const MappedFile & ) = delete;
+		~MappedFile() { Close(); }
+
+		// creates or truncates the file to the given size, mapped for writing and zero filled
+		bool Create( const CapturePath &path, uint64_t fileSize ) {
+			Close();
+#ifdef _WIN32
+			fileHandle = CreateFileW( path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr );
+			if (fileHandle == INVALID_HANDLE_VALUE)
+				return false;
+			mapping = CreateFileMappingW( fileHandle, nullptr, PAGE_READWRITE, DWORD(fileSize >> 32), DWORD(fileSize), nullptr );
+			if (mapping != nullptr)
+				data = static_cast<uint8_t*>(MapViewOfFile( mapping, FILE_MAP_WRITE, 0, 0, 0 ));
+#else
+			fd = open( path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644 );
+			if (fd < 0)
+				return false;
+			if (ftruncate( fd, off_t(fileSize) ) == 0) {
+				void *mapped = mmap( nullptr, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+				if (mapped != MAP_FAILED)
+					data = static_cast<uint8_t*>(mapped);
+			}
+#endif
+			if (data == nullptr) {
+				Close();
+				return false;
+			}
+			size = fileSize;
+			return true;
+		}
+
+		bool OpenRead( const CapturePath &path ) {
+			Close();
+#ifdef _WIN32
+			fileHandle = CreateFileW( path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr );
+			if (fileHandle == INVALID_HANDLE_VALUE)
+				return false;
+			LARGE_INTEGER fileSize;
+			if (GetFileSizeEx( fileHandle, &fileSize ) && fileSize.QuadPart > 0) {
+				mapping = CreateFileMappingW( fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr );
+				if (mapping != nullptr)
+					data = static_cast<uint8_t*>(MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 ));
+				size = uint64_t(fileSize.QuadPart);
+			}
+#else
+			fd = open( path.c_str(), O_RDONLY );
+			if (fd < 0)
+				return false;
+			struct stat status;
+			if (fstat( fd, &status ) == 0 && status.st_size > 0) {
+				void *mapped = mmap( nullptr, size_t(status.st_size), PROT_READ, MAP_SHARED, fd, 0 );
+				if (mapped != MAP_FAILED)
+					data = static_cast<uint8_t*>(mapped);
+				size = uint64_t(status.st_size);
+			}
+#endif
+			if (data == nullptr) {
+				Close();
+				return false;
+			}
+			return true;
+		}
+
+		void Close() {
+#ifdef _WIN32
+			if (data != nullptr)
+				UnmapViewOfFile( data );
+			if (mapping != nullptr)
+				CloseHandle( mapping );
+			if (fileHandle != INVALID_HANDLE_VALUE)
+				CloseHandle( fileHandle );
+			mapping = nullptr;
+			fileHandle = INVALID_HANDLE_VALUE;
+#else
+			if (data != nullptr)
+				munmap( data, size );
+			if (fd >= 0)
+				close( fd );
+			fd = -1;
+#endif
+			data = nullptr;
+			size = 0;
+		}
+
+		uint8_t * Data() const { return data; }
+		uint64_t Size() const { return size; }
+
+	private:
+		uint8_t *data = nullptr;
+		uint64_t size = 0;
+#ifdef _WIN32
+		HANDLE fileHandle = INVALID_HANDLE_VALUE;
+		HANDLE mapping = nullptr;
+#else
+		int fd = -1;
+#endif
+	};
+
+	namespace {
+		uint64_t AlignUp( uint64_t value, uint64_t alignment ) {
+			return (value + alignment - 1) / alignment * alignment;
+		}
+
+		void InitHeader( RingFileHeader &header, uint32_t slotCount, uint64_t slotBytes ) {
+			memcpy( header.magic, RingFileMagic, sizeof(header.magic) );
+			header.version = RingFileVersion;
+			header.slotCount = slotCount;
+			header.slotBytes = slotBytes;
+			header.indexOffset = AlignUp( sizeof(RingFileHeader), 64 );
+			// page aligned, so that each slot is copied to whole pages as far as the slot size allows
+			header.dataOffset = AlignUp( header.indexOffset + uint64_t(slotCount) * sizeof(RingFrameEntry), 4096 );
+			header.nextSequence = 1;
+		}
+	}
+
+	CaptureRingWriter::CaptureRingWriter() {}
+
+	CaptureRingWriter::~CaptureRingWriter() {
+		Close();
+	}
+
+	bool CaptureRingWriter::Open( const CapturePath &path, uint32_t slotCount, uint64_t slotBytes ) {
+		Close();
+		if (slotCount == 0 || slotBytes == 0)
+			return false;
+
+		RingFileHeader layout;
+		InitHeader( layout, slotCount, AlignUp( slotBytes, 4096 ) );
+		std::unique_ptr<MappedFile> mapped( new MappedFile );
+		if (!mapped->Create( path, layout.dataOffset + uint64_t(slotCount) * layout.slotBytes ))
+			return false;
+
+		file = std::move( mapped );
+		header = reinterpret_cast<RingFileHeader*>(file->Data());
+		*header = layout;
+		index = reinterpret_cast<RingFrameEntry*>(file->Data() + layout.indexOffset);
+		data = file->Data() + layout.dataOffset;
+		return true;
+	}
+
+	void CaptureRingWriter::Close() {
+		file.reset();
+		header = nullptr;
+		index = nullptr;
+		data = nullptr;
+	}
+
+	bool CaptureRingWriter::IsOpen() const {
+		return file != nullptr;
+	}
+
+	uint64_t CaptureRingWriter::SlotBytes() const {
+		return header != nullptr ? header->slotBytes : 0;
+	}
+
+	bool CaptureRingWriter::Append( const RingFrame &frame ) {
+		if (header == nullptr || frame.pixels.size() > header->slotBytes)
+			return false;
+
+		uint64_t sequence = header->nextSequence;
+		size_t slotIndex = size_t((sequence - 1) % header->slotCount);
+		RingFrameEntry &slot = index[slotIndex];
+		// invalidate the slot first, so that a reader of the live file never pairs old metadata with new pixels
+		slot.sequence = 0;
+		std::atomic_thread_fence( std::memory_order_release );
+		memcpy( data + slotIndex * header->slotBytes, frame.pixels.data(), frame.pixels.size() );
+
+		RingFrameEntry entry = frame.entry;
+		entry.sequence = 0;
+		entry.dataSize = uint32_t(frame.pixels.size());
+		slot = entry;
+		std::atomic_thread_fence( std::memory_order_release );
+		slot.sequence = sequence;
+		header->nextSequence = sequence + 1;
+		return true;
+	}
+
+	bool CaptureRingWriter::ExportSince( uint64_t sinceMicros, const CapturePath &path, size_t &exported ) const {
+		exported = 0;
+		if (header == nullptr)
+			return false;
+
+		std::vector<size_t> slots;
+		uint64_t slotBytes = 0;
+		for (size_t i = 0; i < header->slotCount; ++i) {
+			if (index[i].sequence != 0 && index[i].timestampMicros >= sinceMicros) {
+				slots.push_back( i );
+				slotBytes = (std::max)( slotBytes, uint64_t(index[i].dataSize) );
+			}
+		}
+		std::sort( slots.begin(), slots.end(), [this]( size_t a, size_t b ) { return index[a].sequence < index[b].sequence; } );
+
+		// the export is a ring file of its own with exactly one slot per frame, so the same reader handles both
+		RingFileHeader exportHeader;
+		InitHeader( exportHeader, uint32_t(slots.size()), slotBytes );
+		exportHeader.nextSequence = slots.empty() ? 1 : index[slots.back()].sequence + 1;
+
+		std::ofstream out( path, std::ios::binary );
+		std::vector<char> padding( size_t(exportHeader.dataOffset), 0 );
+		memcpy( padding.data(), &exportHeader, sizeof(exportHeader) );
+		for (size_t i = 0; i < slots.size(); ++i)
+			memcpy( padding.data() + exportHeader.indexOffset + i * sizeof(RingFrameEntry), &index[slots[i]], sizeof(RingFrameEntry) );
+		out.write( padding.data(), padding.size() );
+
+		padding.assign( size_t(slotBytes), 0 );
+		for (size_t slot : slots) {
+			size_t size = index[slot].dataSize;
+			out.write( reinterpret_cast<const char*>(data + slot * header->slotBytes), size );
+			out.write( padding.data(), slotBytes - size );
+		}
+		if (!out)
+			return false;
+		exported = slots.size();
+		return true;
+	}
+
+	CaptureRingReader::CaptureRingReader() {}
+
+	CaptureRingReader::~CaptureRingReader() {}
+
+	bool CaptureRingReader::Open( const CapturePath &path, std::string &error ) {
+		file.reset();
+		header = nullptr;
+		std::unique_ptr<MappedFile> mapped( new MappedFile );
+		if (!mapped->OpenRead( path )) {
+			error = "could not open " + NarrowPath( path );
+			return false;
+		}
+
+		const uint8_t *base = mapped->Data();
+		uint64_t size = mapped->Size();
+		const RingFileHeader *fileHeader = reinterpret_cast<const RingFileHeader*>(base);
+		if (size < sizeof(RingFileHeader) || memcmp( fileHeader->magic, RingFileMagic, sizeof(RingFileMagic) ) != 0) {
+			error = "not a recording";
+			return false;
+		}
+		if (fileHeader->version != RingFileVersion) {
+			error = "unsupported recording version " + std::to_string( fileHeader->version );
+			return false;
+		}
+		// written by another process, so nothing is trusted before it is checked against the file size
+		uint64_t indexEnd = fileHeader->indexOffset + uint64_t(fileHeader->slotCount) * sizeof(RingFrameEntry);
+		bool valid = fileHeader->indexOffset >= sizeof(RingFileHeader) && fileHeader->indexOffset % 8 == 0 && indexEnd <= size
+				&& fileHeader->dataOffset >= indexEnd && fileHeader->dataOffset <= size
+				&& (fileHeader->slotCount == 0 || fileHeader->slotBytes <= (size - fileHeader->dataOffset) / fileHeader->slotCount);
+		if (!valid) {
+			error = "recording is truncated or corrupt";
+			return false;
+		}
+
+		file = std::move( mapped );
+		header = fileHeader;
+		index = reinterpret_cast<const RingFrameEntry*>(base + header->indexOffset);
+		data = base + header->dataOffset;
+		return true;
+	}
+
+	std::vector<CaptureRingReader::FrameView> CaptureRingReader::Frames() const {
+		std::vector<FrameView> frames;
+		if (header == nullptr)
+			return frames;
+		for (size_t i = 0; i < header->slotCount; ++i) {
+			const RingFrameEntry &entry = index[i];
+			uint64_t expected = uint64_t(entry.width) * entry.height * entry.bytesPerPixel;
+			if (entry.sequence == 0 || entry.dataSize > header->slotBytes || expected > entry.dataSize)
+				continue;
+			FrameView frame;
+			frame.entry = entry;
+			frame.pixels = data + i * header->slotBytes;
+			frames.push_back( frame );
+		}
+		std::sort( frames.begin(), frames.end(), []( const FrameView &a, const FrameView &b ) { return a.entry.sequence < b.entry.sequence; } );
+		return frames;
+	}
+
+	CaptureRecorder::CaptureRecorder() : shared( std::make_shared<Shared>() ) {}
+
+	CaptureRecorder::~CaptureRecorder() {
+		// like CaptureWriter, never join while the DLL may be unloading
+		if (thread.joinable()) {
+			{
+				std::lock_guard<std::mutex> lock( shared->mutex );
+				shared->stopping = true;
+			}
+			shared->wakeup.notify_one();
+			thread.detach();
+		}
+	}
+
+	void CaptureRecorder::Start( const CapturePath &ringPath, uint32_t slotCount ) {
+		Stop();
+		{
+			std::lock_guard<std::mutex> lock( shared->mutex );
+			shared->ringPath = ringPath;
+			shared->slotCount = slotCount;
+			shared->stopping = false;
+		}
+		thread = std::thread( Run, shared );
+	}
+
+	void CaptureRecorder::Stop() {
+		if (!thread.joinable())
+			return;
+		{
+			std::lock_guard<std::mutex> lock( shared->mutex );
+			shared->stopping = true;
+		}
+		shared->wakeup.notify_one();
+		thread.join();
+	}
+
+	RingFrame CaptureRecorder::AcquireFrame() {
+		RingFrame frame;
+		std::lock_guard<std::mutex> lock( shared->mutex );
+		if (!shared->freeBuffers.empty()) {
+			frame.pixels = std::move( shared->freeBuffers.back() );
+			shared->freeBuffers.pop_back();
+		}
+		return frame;
+	}
+
+	void CaptureRecorder::Submit( RingFrame &&frame ) {
+		{
+			std::lock_guard<std::mutex> lock( shared->mutex );
+			if (shared->queue.size() >= MaxQueuedFrames) {
+				++shared->dropped;
+				shared->freeBuffers.push_back( std::move( frame.pixels ) );
+				return;
+			}
+			shared->queue.push_back( std::move( frame ) );
+		}
+		shared->wakeup.notify_one();
+	}
+
+	void CaptureRecorder::RequestExport( uint64_t nowMicros, uint32_t seconds, const CapturePath &path ) {
+		{
+			std::lock_guard<std::mutex> lock( shared->mutex );
+			uint64_t span = uint64_t(seconds) * 1000000;
+			shared->exports.push_back( Export { nowMicros > span ? nowMicros - span : 0, path } );
+		}
+		shared->wakeup.notify_one();
+	}
+
+	std::vector<std::string> CaptureRecorder::TakeMessages() {
+		std::vector<std::string> messages;
+		std::lock_guard<std::mutex> lock( shared->mutex );
+		messages.swap( shared->messages );
+		return messages;
+	}
+
+	uint64_t CaptureRecorder::DroppedFrames() {
+		std::lock_guard<std::mutex> lock( shared->mutex );
+		return shared->dropped;
+	}
+
+	void CaptureRecorder::Run( std::shared_ptr<Shared> shared ) {
+		CaptureRingWriter writer;
+		std::unique_lock<std::mutex> lock( shared->mutex );
+		while (true) {
+			shared->wakeup.wait( lock, [&] { return shared->stopping || !shared->queue.empty() || !shared->exports.empty(); } );
+
+			// frames are appended before exports, so an export includes every frame submitted before it was requested
+			if (!shared->queue.empty()) {
+				RingFrame frame = std::move( shared->queue.front() );
+				shared->queue.pop_front();
+				CapturePath ringPath = shared->ringPath;
+				uint32_t slotCount = shared->slotCount;
+				lock.unlock();
+
+				std::string message;
+				if (!writer.IsOpen() || frame.pixels.size() > writer.SlotBytes()) {
+					if (writer.Open( ringPath, slotCount, frame.pixels.size() ))
+						message = "Recording the last " + std::to_string( slotCount ) + " frames into " + NarrowPath( ringPath );
+					else
+						message = "Could not create recording " + NarrowPath( ringPath );
+				}
+				if (writer.IsOpen())
+					writer.Append( frame );
+
+				lock.lock();
+				if (!message.empty())
+					shared->messages.push_back( message );
+				// a few spare buffers are enough to cover frames in flight
+				if (shared->freeBuffers.size() < MaxQueuedFrames)
+					shared->freeBuffers.push_back( std::move( frame.pixels ) );
+				continue;
+			}
+
+			if (!shared->exports.empty()) {
+				Export request = std::move( shared->exports.front() );
+				shared->exports.pop_front();
+				lock.unlock();
+
+				std::string message;
+				size_t exported = 0;
+				if (writer.IsOpen() && writer.ExportSince( request.sinceMicros, request.path, exported ))
+					message = "Saved " + std::to_string( exported ) + " recorded frames to " + NarrowPath( request.path );
+				else
+					message = "Could not save recording to " + NarrowPath( request.path );
+
+				lock.lock();
+				shared->messages.push_back( message );
+				continue;
+			}
+
+			if (shared->stopping)
+				break;
+		}
+		lock.unlock();
+		writer.Close();
+	}
+}
@@ -0,0 +1,159 @@
+#pragma once
+#include "CaptureWriter.h"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace vr {
+	// Recordings of the submitted eye images are kept in a ring file: a header, an index with one entry
+	// per slot, and a data area of equally sized slots. Frame n goes into slot n % slotCount, so the
+	// file always holds the most recent slotCount frames. All values are little endian.
+	enum RingConfigFlags : uint32_t {
+		RingFfrEnabled = 1,
+		RingVariableRateShading = 2,
+		RingSharpening = 4,
+	};
+
+	// the settings a frame was rendered with
+	struct RingConfigSnapshot {
+		float innerRadius = 0;
+		float midRadius = 0;
+		float outerRadius = 0;
+		float sharpness = 0;
+		float sharpenRadius = 0;
+		uint32_t flags = 0;
+	};
+
+	struct RingFrameEntry {
+		// 0 while the slot is being written or if it was never written
+		uint64_t sequence = 0;
+		uint64_t timestampMicros = 0;
+		uint32_t eye = 0;
+		uint32_t dxgiFormat = 0;
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint32_t bytesPerPixel = 0;
+		uint32_t dataSize = 0;
+		RingConfigSnapshot config;
+	};
+
+	struct RingFileHeader {
+		char magic[8];
+		uint32_t version;
+		uint32_t slotCount;
+		uint64_t slotBytes;
+		uint64_t indexOffset;
+		uint64_t dataOffset;
+		uint64_t nextSequence;
+	};
+
+	static const char RingFileMagic[8] = { 'F', 'F', 'R', 'R', 'I', 'N', 'G', '1' };
+	static const uint32_t RingFileVersion = 1;
+
+	struct RingFrame {
+		RingFrameEntry entry;
+		// tightly packed rows
+		std::vector<uint8_t> pixels;
+	};
+
+	class MappedFile;
+
+	// writes frames into a memory-mapped ring file; not thread-safe
+	class CaptureRingWriter {
+	public:
+		CaptureRingWriter();
+		~CaptureRingWriter();
+
+		bool Open( const CapturePath &path, uint32_t slotCount, uint64_t slotBytes );
+		void Close();
+		bool IsOpen() const;
+		uint64_t SlotBytes() const;
+
+		// assigns the frame's sequence number; fails if the frame does not fit into a slot
+		bool Append( const RingFrame &frame );
+		// writes the frames recorded since the given time into a separate, compact ring file
+		bool ExportSince( uint64_t sinceMicros, const CapturePath &path, size_t &exported ) const;
+
+	private:
+		std::unique_ptr<MappedFile> file;
+		RingFileHeader *header = nullptr;
+		RingFrameEntry *index = nullptr;
+		uint8_t *data = nullptr;
+	};
+
+	// reads a ring file, whether written by CaptureRingWriter or exported from it
+	class CaptureRingReader {
+	public:
+		CaptureRingReader();
+		~CaptureRingReader();
+
+		struct FrameView {
+			RingFrameEntry entry;
+			const uint8_t *pixels;
+		};
+
+		bool Open( const CapturePath &path, std::string &error );
+		// the valid frames in the order they were recorded; pixels stay valid while the reader is open
+		std::vector<FrameView> Frames() const;
+
+	private:
+		std::unique_ptr<MappedFile> file;
+		const RingFileHeader *header = nullptr;
+		const RingFrameEntry *index = nullptr;
+		const uint8_t *data = nullptr;
+	};
+
+	// Appends frames to a ring file on a background thread, so that the frame loop only has to hand over
+	// the pixels it read back. The ring is (re)created with slots of the size of the first frame that does
+	// not fit. Frame buffers are recycled to avoid allocating for every frame.
+	class CaptureRecorder {
+	public:
+		CaptureRecorder();
+		CaptureRecorder( const CaptureRecorder & ) = delete;
+		CaptureRecorder & operator=( const CaptureRecorder & ) = delete;
+		~CaptureRecorder();
+
+		void Start( const CapturePath &ringPath, uint32_t slotCount );
+		// writes the frames still queued and closes the ring file
+		void Stop();
+		bool IsRunning() const { return thread.joinable(); }
+
+		// returns an empty frame, possibly with a buffer of a previous frame to reuse
+		RingFrame AcquireFrame();
+		void Submit( RingFrame &&frame );
+		// exports the frames of the last given seconds into a separate file
+		void RequestExport( uint64_t nowMicros, uint32_t seconds, const CapturePath &path );
+		std::vector<std::string> TakeMessages();
+		uint64_t DroppedFrames();
+
+	private:
+		// frames beyond this are dropped rather than letting the queue grow while the disk can't keep up
+		static const size_t MaxQueuedFrames = 16;
+
+		struct Export {
+			uint64_t sinceMicros;
+			CapturePath path;
+		};
+		struct Shared {
+			std::mutex mutex;
+			std::condition_variable wakeup;
+			std::deque<RingFrame> queue;
+			std::deque<Export> exports;
+			std::vector<std::vector<uint8_t>> freeBuffers;
+			std::vector<std::string> messages;
+			CapturePath ringPath;
+			uint32_t slotCount = 0;
+			uint64_t dropped = 0;
+			bool stopping = false;
+		};
+		std::shared_ptr<Shared> shared;
+		std::thread thread;
+
+		static void Run( std::shared_ptr<Shared> shared );
+	};
+}
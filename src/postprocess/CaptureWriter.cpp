@@ -0,0 +1,312 @@
+#include "CaptureWriter.h"
+#include <algorithm>
+#include <fstream>
+
+namespace vr {
+	namespace {
+		void Put32( std::vector<uint8_t> &out, uint32_t value ) {
+			// DDS is little endian
+			for (int i = 0; i < 4; ++i)
+				out.push_back( uint8_t(value >> (8 * i)) );
+		}
+
+		void Put32BigEndian( std::vector<uint8_t> &out, uint32_t value ) {
+			for (int i = 3; i >= 0; --i)
+				out.push_back( uint8_t(value >> (8 * i)) );
+		}
+
+		struct Crc32Table {
+			uint32_t entries[256];
+			Crc32Table() {
+				for (uint32_t n = 0; n < 256; ++n) {
+					uint32_t c = n;
+					for (int k = 0; k < 8; ++k)
+						c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+					entries[n] = c;
+				}
+			}
+		};
+
+		uint32_t Crc32( const uint8_t *data, size_t size, uint32_t crc = 0 ) {
+			static const Crc32Table crcTable;
+			const uint32_t *table = crcTable.entries;
+			crc = ~crc;
+			for (size_t i = 0; i < size; ++i)
+				crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+			return ~crc;
+		}
+
+		void PutPngChunk( std::vector<uint8_t> &out, const char *type, const std::vector<uint8_t> &data ) {
+			Put32BigEndian( out, uint32_t(data.size()) );
+			size_t start = out.size();
+			out.insert( out.end(), type, type + 4 );
+			out.insert( out.end(), data.begin(), data.end() );
+			Put32BigEndian( out, Crc32( out.data() + start, out.size() - start ) );
+		}
+
+		// appends a zlib stream of stored deflate blocks, which costs little more than a copy
+		class StoredZlibStream {
+		public:
+			explicit StoredZlibStream( std::vector<uint8_t> &out ) : out(out) {
+				out.push_back( 0x78 );
+				out.push_back( 0x01 );
+			}
+
+			void Write( const uint8_t *data, size_t size ) {
+				// the sums can't overflow within this many bytes, so the modulo is only taken once per chunk
+				const size_t AdlerChunk = 5552;
+				for (size_t done = 0; done < size; ) {
+					size_t end = (std::min)( size, done + AdlerChunk );
+					for (; done < end; ++done) {
+						a += data[done];
+						b += a;
+					}
+					a %= 65521;
+					b %= 65521;
+				}
+				block.insert( block.end(), data, data + size );
+				while (block.size() >= MaxBlock)
+					FlushBlock( MaxBlock, false );
+			}
+
+			void Finish() {
+				FlushBlock( block.size(), true );
+				Put32BigEndian( out, (b << 16) | a );
+			}
+
+		private:
+			static const size_t MaxBlock = 65535;
+			std::vector<uint8_t> &out;
+			std::vector<uint8_t> block;
+			uint32_t a = 1;
+			uint32_t b = 0;
+
+			void FlushBlock( size_t size, bool last ) {
+				out.push_back( last ? 1 : 0 );
+				out.push_back( uint8_t(size) );
+				out.push_back( uint8_t(size >> 8) );
+				out.push_back( uint8_t(~size) );
+				out.push_back( uint8_t(~size >> 8) );
+				out.insert( out.end(), block.begin(), block.begin() + size );
+				block.erase( block.begin(), block.begin() + size );
+			}
+		};
+
+		const char * Extension( CaptureEncoding encoding ) {
+			switch (encoding) {
+			case CaptureEncoding::Png: return ".png";
+			case CaptureEncoding::Raw: return ".raw";
+			default: return ".dds";
+			}
+		}
+
+		CapturePath WithExtension( const CapturePath &base, const char *extension ) {
+			CapturePath path = base;
+			for (const char *c = extension; *c; ++c)
+				path += CapturePath::value_type(*c);
+			return path;
+		}
+	}
+
+	std::string NarrowPath( const CapturePath &path ) {
+		std::string narrow;
+		for (auto c : path)
+			narrow += (c > 0 && uint32_t(c) < 128) ? char(c) : '?';
+		return narrow;
+	}
+
+	bool EncodeDds( const CapturedImage &image, std::vector<uint8_t> &out ) {
+		if (image.bytesPerPixel == 0 || image.pixels.size() < image.SliceSize() * image.arraySize)
+			return false;
+
+		const uint32_t DDSD_CAPS = 0x1, DDSD_HEIGHT = 0x2, DDSD_WIDTH = 0x4, DDSD_PITCH = 0x8, DDSD_PIXELFORMAT = 0x1000, DDSD_MIPMAPCOUNT = 0x20000;
+		const uint32_t DDPF_FOURCC = 0x4;
+		const uint32_t DDSCAPS_TEXTURE = 0x1000;
+		const uint32_t D3D10_RESOURCE_DIMENSION_TEXTURE2D = 3;
+
+		out.clear();
+		out.reserve( 4 + 124 + 20 + image.pixels.size() );
+		out.insert( out.end(), { 'D', 'D', 'S', ' ' } );
+		Put32( out, 124 );
+		Put32( out, DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PITCH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT );
+		Put32( out, image.height );
+		Put32( out, image.width );
+		Put32( out, uint32_t(image.RowSize()) );
+		Put32( out, 0 );  // depth
+		Put32( out, 1 );  // mip levels
+		for (int i = 0; i < 11; ++i)
+			Put32( out, 0 );
+		// pixel format, deferring to the DX10 header
+		Put32( out, 32 );
+		Put32( out, DDPF_FOURCC );
+		out.insert( out.end(), { 'D', 'X', '1', '0' } );
+		for (int i = 0; i < 5; ++i)
+			Put32( out, 0 );
+		Put32( out, DDSCAPS_TEXTURE );
+		for (int i = 0; i < 4; ++i)
+			Put32( out, 0 );
+		// DX10 header
+		Put32( out, image.dxgiFormat );
+		Put32( out, D3D10_RESOURCE_DIMENSION_TEXTURE2D );
+		Put32( out, 0 );
+		Put32( out, image.arraySize );
+		Put32( out, 0 );
+
+		out.insert( out.end(), image.pixels.begin(), image.pixels.begin() + image.SliceSize() * image.arraySize );
+		return true;
+	}
+
+	bool EncodePng( const CapturedImage &image, std::vector<uint8_t> &out ) {
+		if (image.layout == CaptureLayout::Other || image.bytesPerPixel != 4 || image.pixels.size() < image.SliceSize())
+			return false;
+
+		out.clear();
+		out.reserve( image.SliceSize() * 3 / 4 + image.height * 6 + 1024 );
+		const uint8_t signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+		out.insert( out.end(), signature, signature + sizeof(signature) );
+
+		std::vector<uint8_t> header;
+		Put32BigEndian( header, image.width );
+		Put32BigEndian( header, image.height );
+		// 8 bits per channel, RGB; alpha is dropped as the submitted textures don't carry meaningful alpha
+		header.insert( header.end(), { 8, 2, 0, 0, 0 } );
+		PutPngChunk( out, "IHDR", header );
+
+		std::vector<uint8_t> data;
+		StoredZlibStream zlib( data );
+		std::vector<uint8_t> row( 1 + size_t(image.width) * 3 );
+		int red = image.layout == CaptureLayout::Rgba8 ? 0 : 2;
+		int blue = 2 - red;
+		for (uint32_t y = 0; y < image.height; ++y) {
+			const uint8_t *src = image.pixels.data() + y * image.RowSize();
+			uint8_t *dst = row.data();
+			*dst++ = 0;  // no filter
+			for (uint32_t x = 0; x < image.width; ++x, src += 4) {
+				*dst++ = src[red];
+				*dst++ = src[1];
+				*dst++ = src[blue];
+			}
+			zlib.Write( row.data(), row.size() );
+		}
+		zlib.Finish();
+		PutPngChunk( out, "IDAT", data );
+		PutPngChunk( out, "IEND", std::vector<uint8_t>() );
+		return true;
+	}
+
+	bool EncodeRaw( const CapturedImage &image, std::vector<uint8_t> &out ) {
+		size_t size = image.SliceSize() * image.arraySize;
+		if (image.bytesPerPixel == 0 || image.pixels.size() < size)
+			return false;
+		out.assign( image.pixels.begin(), image.pixels.begin() + size );
+		return true;
+	}
+
+	bool WriteCapture( const CapturedImage &image, std::string &message ) {
+		std::vector<uint8_t> encoded;
+		CaptureEncoding encoding = image.encoding;
+		bool encodedOk = false;
+		switch (encoding) {
+		case CaptureEncoding::Png: encodedOk = EncodePng( image, encoded ); break;
+		case CaptureEncoding::Raw: encodedOk = EncodeRaw( image, encoded ); break;
+		default: encodedOk = EncodeDds( image, encoded ); break;
+		}
+		if (!encodedOk && encoding != CaptureEncoding::Dds) {
+			encoding = CaptureEncoding::Dds;
+			encodedOk = EncodeDds( image, encoded );
+		}
+		if (!encodedOk) {
+			message = "Could not encode capture " + NarrowPath( image.path );
+			return false;
+		}
+
+		CapturePath path = image.path;
+		if (encoding == CaptureEncoding::Raw) {
+			// raw files carry no header, so the name has to tell how to read them
+			std::string layout = "_" + std::to_string( image.width ) + "x" + std::to_string( image.height ) + "x" + std::to_string( image.arraySize )
+					+ "_fmt" + std::to_string( image.dxgiFormat );
+			path = WithExtension( path, layout.c_str() );
+		}
+		path = WithExtension( path, Extension( encoding ) );
+
+		std::ofstream file( path, std::ios::binary );
+		file.write( reinterpret_cast<const char*>(encoded.data()), encoded.size() );
+		if (!file) {
+			message = "Error writing capture " + NarrowPath( path );
+			return false;
+		}
+		message = "Wrote capture " + NarrowPath( path );
+		if (encoding != image.encoding)
+			message += " (format not supported by the requested encoding)";
+		return true;
+	}
+
+	CaptureWriter::CaptureWriter() : shared( std::make_shared<Shared>() ) {}
+
+	CaptureWriter::~CaptureWriter() {
+		// may run while the DLL is unloaded, where joining a thread would deadlock on the loader lock
+		if (thread.joinable()) {
+			{
+				std::lock_guard<std::mutex> lock( shared->mutex );
+				shared->stopping = true;
+			}
+			shared->wakeup.notify_one();
+			thread.detach();
+		}
+	}
+
+	void CaptureWriter::Enqueue( CapturedImage &&image ) {
+		// held by a pointer, as the task has to be copyable
+		std::shared_ptr<CapturedImage> queued = std::make_shared<CapturedImage>( std::move( image ) );
+		EnqueueTask( [queued]() {
+			std::string message;
+			WriteCapture( *queued, message );
+			return message;
+		} );
+	}
+
+	void CaptureWriter::EnqueueTask( std::function<std::string()> task ) {
+		{
+			std::lock_guard<std::mutex> lock( shared->mutex );
+			shared->queue.push_back( std::move( task ) );
+			shared->stopping = false;
+		}
+		if (!thread.joinable()) {
+			thread = std::thread( Run, shared );
+		}
+		shared->wakeup.notify_one();
+	}
+
+	void CaptureWriter::Stop() {
+		if (!thread.joinable())
+			return;
+		{
+			std::lock_guard<std::mutex> lock( shared->mutex );
+			shared->stopping = true;
+		}
+		shared->wakeup.notify_one();
+		thread.join();
+	}
+
+	std::vector<std::string> CaptureWriter::TakeMessages() {
+		std::vector<std::string> messages;
+		std::lock_guard<std::mutex> lock( shared->mutex );
+		messages.swap( shared->messages );
+		return messages;
+	}
+
+	void CaptureWriter::Run( std::shared_ptr<Shared> shared ) {
+		std::unique_lock<std::mutex> lock( shared->mutex );
+		while (true) {
+			shared->wakeup.wait( lock, [&] { return shared->stopping || !shared->queue.empty(); } );
+			if (shared->queue.empty())
+				return;
+			std::function<std::string()> task = std::move( shared->queue.front() );
+			shared->queue.pop_front();
+			lock.unlock();
+			std::string message = task();
+			lock.lock();
+			shared->messages.push_back( message );
+		}
+	}
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace vr {
+#ifdef _WIN32
+	typedef std::wstring CapturePath;
+#else
+	typedef std::string CapturePath;
+#endif
+
+	enum class CaptureEncoding : uint8_t { Dds, Png, Raw };
+
+	// how the 8-bit channels of a pixel are ordered, for encoders that need to know
+	enum class CaptureLayout : uint8_t { Other, Rgba8, Bgra8 };
+
+	// a texture read back from the GPU, with its rows tightly packed and its array slices one after another
+	struct CapturedImage {
+		CapturePath path;    // without extension
+		CaptureEncoding encoding = CaptureEncoding::Dds;
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint32_t arraySize = 1;
+		uint32_t bytesPerPixel = 0;
+		uint32_t dxgiFormat = 0;
+		CaptureLayout layout = CaptureLayout::Other;
+		std::vector<uint8_t> pixels;
+
+		size_t RowSize() const { return size_t(width) * bytesPerPixel; }
+		size_t SliceSize() const { return RowSize() * height; }
+	};
+
+	// encoders produce the complete file contents; PNG only supports 8-bit layouts and only the first slice
+	bool EncodeDds( const CapturedImage &image, std::vector<uint8_t> &out );
+	bool EncodePng( const CapturedImage &image, std::vector<uint8_t> &out );
+	bool EncodeRaw( const CapturedImage &image, std::vector<uint8_t> &out );
+
+	// for messages; characters outside of ASCII are replaced
+	std::string NarrowPath( const CapturePath &path );
+
+	// encodes and writes the image, falling back to DDS if the requested encoding does not support it
+	bool WriteCapture( const CapturedImage &image, std::string &message );
+
+	// Encodes and writes captures on a background thread, so that the frame that requested them is
+	// not held up by the file system. Messages about written files are collected for the caller to log.
+	// Other files are written on the same thread as tasks returning their message.
+	class CaptureWriter {
+	public:
+		CaptureWriter();
+		CaptureWriter( const CaptureWriter & ) = delete;
+		CaptureWriter & operator=( const CaptureWriter & ) = delete;
+		~CaptureWriter();
+
+		void Enqueue( CapturedImage &&image );
+		void EnqueueTask( std::function<std::string()> task );
+		// writes the captures still queued and stops the thread; it is restarted by the next capture
+		void Stop();
+		std::vector<std::string> TakeMessages();
+
+	private:
+		// shared with the thread, so that a thread we could not join does not outlive its queue
+		struct Shared {
+			std::mutex mutex;
+			std::condition_variable wakeup;
+			std::deque<std::function<std::string()>> queue;
+			std::vector<std::string> messages;
+			bool stopping = false;
+		};
+		std::shared_ptr<Shared> shared;
+		std::thread thread;
+
+		static void Run( std::shared_ptr<Shared> shared );
+	};
+}
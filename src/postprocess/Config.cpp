@@ -22,11 +22,33 @@ std::wstring GetDllPath() {
 	return p.substr(0, p.find_last_of('\\'));
 }
 
-std::ostream& Log() {
-	try {
-		static std::ofstream logFile (GetDllPath() + L"\\openvr_mod.log");
-		return logFile;
-	} catch (...) {
-		return std::cout;
+namespace {
+	vr::Logger & LogInstance() {
+		static vr::Logger logger ([] () -> std::unique_ptr<std::ostream> {
+			try {
+				std::unique_ptr<std::ofstream> logFile (new std::ofstream(GetDllPath() + L"\\openvr_mod.log"));
+				if (logFile->is_open())
+					return std::move(logFile);
+			} catch (...) {
+			}
+			return std::unique_ptr<std::ostream>(new std::ostream(std::cout.rdbuf()));
+		}());
+		return logger;
 	}
 }
+
+vr::LogLine Log(vr::LogLevel level) {
+	return vr::LogLine(&LogInstance(), level);
+}
+
+void FlushLog() {
+	LogInstance().Flush();
+}
+
+void StopLog() {
+	LogInstance().Stop();
+}
+
+void StartLog() {
+	LogInstance().Start();
+}
@@ -1,9 +1,18 @@
 #pragma once
 #include <fstream>
+#include <string>
+#include "Logger.h"
 #include "PostProcessor.h"
+#include "Snapshot.h"
 #include "json/json.h"
 
-std::ostream& Log();
+// lines are written by a background thread; safe to use from any thread
+vr::LogLine Log(vr::LogLevel level = vr::LogLevel::Info);
+// writes all queued lines before returning
+void FlushLog();
+// StopLog writes all queued lines and ends the background thread; StartLog brings it back after a stop
+void StopLog();
+void StartLog();
 std::wstring GetDllPath();
 
 struct Config {
@@ -16,6 +25,12 @@ struct Config {
 	bool useSharpening = false;
 	float sharpness = 0.4f;
 	float sharpenRadius = 0.5f;
+	int outputRingSize = 2;
+	vr::CaptureEncoding captureEncoding = vr::CaptureEncoding::Dds;
+	bool recordingEnabled = false;
+	int recordingDownsample = 8;
+	int recordingMaxImages = 900;
+	int recordingDumpSeconds = 5;
 	bool hotkeysEnabled = true;
 	bool hotkeysRequireCtrl = false;
 	bool hotkeysRequireAlt = false;
@@ -28,58 +43,133 @@ struct Config {
 	int hotkeyIncreaseRadius = VK_F6;
 	int hotkeyCaptureOutput = VK_F7;
 	int hotkeyToggleUseVrs = VK_F8;
+	int hotkeyDumpRecording = VK_F9;
+	int hotkeyDumpTrace = VK_F10;
 	int hotkeySelectInnerRadius = '1';
 	int hotkeySelectMidRadius = '2';
 	int hotkeySelectOuterRadius = '3';
 	int hotkeySelectSharpenRadius = '4';
+	bool reloadOnChange = true;
+	int traceFrames = 120;
+	bool shareMetrics = true;
+	bool shadowVtableHooks = false;
+	bool warmUp = true;
 
-	static Config Load() {
-		Config config;
+	// reads the settings from a config file's contents; returns false and describes the problem in error if it can't
+	static bool Parse(std::istream &stream, Config &config, std::string &error) {
 		try {
-			std::ifstream configFile (GetDllPath() + L"\\openvr_mod.cfg");
-			if (configFile.is_open()) {
-				Json::Value root;
-				configFile >> root;
-				Json::Value foveated = root.get("foveated", Json::Value());
-				config.ffrEnabled = foveated.get("enabled", false).asBool();
-				config.useVrs = foveated.get("useVariableRateShading", false).asBool();
-				config.innerRadius = foveated.get("innerRadius", 0.6f).asFloat();
-				config.midRadius = foveated.get("midRadius", 0.8f).asFloat();
-				config.outerRadius = foveated.get("outerRadius", 1.0f).asFloat();
-				config.debugMode = foveated.get("debugMode", false).asBool();
-				Json::Value hotkeys = foveated.get("hotkeys", Json::Value());
-				config.hotkeysEnabled = hotkeys.get("enabled", true).asBool();
-				config.hotkeysRequireCtrl = hotkeys.get("requireCtrl", false).asBool();
-				config.hotkeysRequireAlt = hotkeys.get("requireAlt", false).asBool();
-				config.hotkeysRequireShift = hotkeys.get("requireShift", false).asBool();
-				config.hotkeyToggleFfr = hotkeys.get("toggleFFR", VK_F1).asInt();
-				config.hotkeyToggleDebugMode = hotkeys.get("toggleDebugMode", VK_F2).asInt();
-				config.hotkeyDecreaseSharpness = hotkeys.get("decreaseSharpness", VK_F3).asInt();
-				config.hotkeyIncreaseSharpness = hotkeys.get("increaseSharpness", VK_F4).asInt();
-				config.hotkeyDecreaseRadius = hotkeys.get("decreaseRadius", VK_F5).asInt();
-				config.hotkeyIncreaseRadius = hotkeys.get("increaseRadius", VK_F6).asInt();
-				config.hotkeyCaptureOutput = hotkeys.get("captureOutput", VK_F7).asInt();
-				config.hotkeyToggleUseVrs = hotkeys.get("toggleUseVRS", VK_F8).asInt();
-				config.hotkeySelectInnerRadius = hotkeys.get("selectInnerRadius", '1').asInt();
-				config.hotkeySelectMidRadius = hotkeys.get("selectMidRadius", '2').asInt();
-				config.hotkeySelectOuterRadius = hotkeys.get("selectOuterRadius", '3').asInt();
-				config.hotkeySelectSharpenRadius = hotkeys.get("selectSharpenRadius", '4').asInt();
+			Json::Value root;
+			stream >> root;
+			Json::Value foveated = root.get("foveated", Json::Value());
+			config.ffrEnabled = foveated.get("enabled", false).asBool();
+			config.useVrs = foveated.get("useVariableRateShading", false).asBool();
+			config.innerRadius = foveated.get("innerRadius", 0.6f).asFloat();
+			config.midRadius = foveated.get("midRadius", 0.8f).asFloat();
+			config.outerRadius = foveated.get("outerRadius", 1.0f).asFloat();
+			config.debugMode = foveated.get("debugMode", false).asBool();
+			config.reloadOnChange = foveated.get("reloadOnChange", true).asBool();
+			config.traceFrames = foveated.get("traceFrames", 120).asInt();
+			if (config.traceFrames < 1) config.traceFrames = 1;
+			config.shareMetrics = foveated.get("shareMetrics", true).asBool();
+			config.shadowVtableHooks = foveated.get("shadowVtableHooks", false).asBool();
+			config.warmUp = foveated.get("warmUp", true).asBool();
+			config.outputRingSize = foveated.get("outputTexturesPerEye", 2).asInt();
+			if (config.outputRingSize < 1) config.outputRingSize = 1;
+			if (config.outputRingSize > 4) config.outputRingSize = 4;
+			std::string captureFormat = foveated.get("captureFormat", "dds").asString();
+			if (captureFormat == "png") config.captureEncoding = vr::CaptureEncoding::Png;
+			if (captureFormat == "raw") config.captureEncoding = vr::CaptureEncoding::Raw;
+			Json::Value recording = foveated.get("recording", Json::Value());
+			config.recordingEnabled = recording.get("enabled", false).asBool();
+			config.recordingDownsample = recording.get("downsample", 8).asInt();
+			if (config.recordingDownsample < 1) config.recordingDownsample = 1;
+			config.recordingMaxImages = recording.get("maxImages", 900).asInt();
+			if (config.recordingMaxImages < 1) config.recordingMaxImages = 1;
+			config.recordingDumpSeconds = recording.get("dumpSeconds", 5).asInt();
+			if (config.recordingDumpSeconds < 1) config.recordingDumpSeconds = 1;
+			Json::Value hotkeys = foveated.get("hotkeys", Json::Value());
+			config.hotkeysEnabled = hotkeys.get("enabled", true).asBool();
+			config.hotkeysRequireCtrl = hotkeys.get("requireCtrl", false).asBool();
+			config.hotkeysRequireAlt = hotkeys.get("requireAlt", false).asBool();
+			config.hotkeysRequireShift = hotkeys.get("requireShift", false).asBool();
+			config.hotkeyToggleFfr = hotkeys.get("toggleFFR", VK_F1).asInt();
+			config.hotkeyToggleDebugMode = hotkeys.get("toggleDebugMode", VK_F2).asInt();
+			config.hotkeyDecreaseSharpness = hotkeys.get("decreaseSharpness", VK_F3).asInt();
+			config.hotkeyIncreaseSharpness = hotkeys.get("increaseSharpness", VK_F4).asInt();
+			config.hotkeyDecreaseRadius = hotkeys.get("decreaseRadius", VK_F5).asInt();
+			config.hotkeyIncreaseRadius = hotkeys.get("increaseRadius", VK_F6).asInt();
+			config.hotkeyCaptureOutput = hotkeys.get("captureOutput", VK_F7).asInt();
+			config.hotkeyToggleUseVrs = hotkeys.get("toggleUseVRS", VK_F8).asInt();
+			config.hotkeyDumpRecording = hotkeys.get("dumpRecording", VK_F9).asInt();
+			config.hotkeyDumpTrace = hotkeys.get("dumpTrace", VK_F10).asInt();
+			config.hotkeySelectInnerRadius = hotkeys.get("selectInnerRadius", '1').asInt();
+			config.hotkeySelectMidRadius = hotkeys.get("selectMidRadius", '2').asInt();
+			config.hotkeySelectOuterRadius = hotkeys.get("selectOuterRadius", '3').asInt();
+			config.hotkeySelectSharpenRadius = hotkeys.get("selectSharpenRadius", '4').asInt();
 
-				Json::Value sharpen = foveated.get("sharpen", Json::Value());
-				config.useSharpening = sharpen.get("enabled", false).asBool();
-				config.sharpness = sharpen.get("sharpness", 0.4).asFloat();
-				if (config.sharpness < 0) config.sharpness = 0;
-				if (config.sharpness > 1) config.sharpness = 1;
-				config.sharpenRadius = sharpen.get("radius", 0.5).asFloat();
-			}
+			Json::Value sharpen = foveated.get("sharpen", Json::Value());
+			config.useSharpening = sharpen.get("enabled", false).asBool();
+			config.sharpness = sharpen.get("sharpness", 0.4).asFloat();
+			if (config.sharpness < 0) config.sharpness = 0;
+			if (config.sharpness > 1) config.sharpness = 1;
+			config.sharpenRadius = sharpen.get("radius", 0.5).asFloat();
+		} catch (const std::exception &e) {
+			error = e.what();
+			return false;
 		} catch (...) {
-			Log() << "Could not read config file.\n";
+			error = "unknown error";
+			return false;
+		}
+		return true;
+	}
+
+	static std::wstring FilePath() {
+		return GetDllPath() + L"\\openvr_mod.cfg";
+	}
+
+	// returns what is wrong with the settings, or an empty string if they make sense
+	std::string Validate() const {
+		if (!(0 <= innerRadius && innerRadius <= midRadius && midRadius <= outerRadius))
+			return "radii must satisfy 0 <= innerRadius <= midRadius <= outerRadius";
+		if (sharpenRadius < 0)
+			return "sharpening radius must not be negative";
+		const int hotkeys[] = {
+			hotkeyToggleFfr, hotkeyToggleDebugMode, hotkeyDecreaseSharpness, hotkeyIncreaseSharpness,
+			hotkeyDecreaseRadius, hotkeyIncreaseRadius, hotkeyCaptureOutput, hotkeyToggleUseVrs, hotkeyDumpRecording, hotkeyDumpTrace,
+			hotkeySelectInnerRadius, hotkeySelectMidRadius, hotkeySelectOuterRadius, hotkeySelectSharpenRadius,
+		};
+		for (int key : hotkeys) {
+			if (key < 0 || key > 255)
+				return "hotkeys must be virtual key codes from 0 to 255";
+		}
+		return std::string();
+	}
+
+	static Config Load() {
+		Config config;
+		std::ifstream configFile (FilePath());
+		if (configFile.is_open()) {
+			std::string error;
+			if (!Parse(configFile, config, error)) {
+				Log(vr::LogLevel::Warning) << "Could not read config file: " << error << "\n";
+			} else {
+				std::string problem = config.Validate();
+				if (!problem.empty())
+					Log(vr::LogLevel::Warning) << "Config file: " << problem << "\n";
+			}
 		}
 		return config;
 	}
 
+	// The settings read from the config file. Settings changed at runtime, e.g. by hotkeys, are published as a new
+	// snapshot instead; passes take the published one once per frame, so that all of them see the same settings.
 	static Config& Instance() {
 		static Config instance = Load();
 		return instance;
 	}
+
+	static vr::SnapshotPublisher<Config>& Published() {
+		static vr::SnapshotPublisher<Config> publisher( Instance() );
+		return publisher;
+	}
 };
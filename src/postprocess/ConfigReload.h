@@ -0,0 +1,107 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace vr {
+	// what has to happen for a reloaded config to take effect; any change is at least published
+	enum ConfigReloadAction : uint32_t {
+		ReloadNothing = 0,
+		ReloadPublish = 1,
+		// the input thread was started with the old bindings
+		ReloadHotkeys = 2,
+		// the post-processing resources depend on the setting
+		ReloadResources = 4,
+		// switching between VRS and RDM also needs the VRS patterns dropped
+		ReloadVariableRateShading = 8,
+		// the ring file was sized for the old setting
+		ReloadRecorder = 16,
+	};
+
+	// compares two configs field by field; a template, so that it does not drag in the config's dependencies
+	template<typename ConfigT>
+	uint32_t PlanConfigReload( const ConfigT &before, const ConfigT &after ) {
+		uint32_t plan = ReloadNothing;
+		auto check = [&]( bool changed, uint32_t actions ) { if (changed) plan |= actions; };
+
+		check( before.innerRadius != after.innerRadius, ReloadPublish );
+		check( before.midRadius != after.midRadius, ReloadPublish );
+		check( before.outerRadius != after.outerRadius, ReloadPublish );
+		check( before.debugMode != after.debugMode, ReloadPublish );
+		check( before.sharpness != after.sharpness, ReloadPublish );
+		check( before.sharpenRadius != after.sharpenRadius, ReloadPublish );
+		check( before.captureEncoding != after.captureEncoding, ReloadPublish );
+		check( before.recordingDownsample != after.recordingDownsample, ReloadPublish );
+		check( before.recordingDumpSeconds != after.recordingDumpSeconds, ReloadPublish );
+		check( before.reloadOnChange != after.reloadOnChange, ReloadPublish );
+		check( before.traceFrames != after.traceFrames, ReloadPublish );
+		check( before.shareMetrics != after.shareMetrics, ReloadPublish );
+		// hooks stay installed the way they were
+		check( before.shadowVtableHooks != after.shadowVtableHooks, ReloadPublish );
+		// only decides whether resources are created ahead of their next recreation
+		check( before.warmUp != after.warmUp, ReloadPublish );
+
+		check( before.ffrEnabled != after.ffrEnabled, ReloadResources );
+		check( before.useSharpening != after.useSharpening, ReloadResources );
+		check( before.outputRingSize != after.outputRingSize, ReloadResources );
+		check( before.recordingEnabled != after.recordingEnabled, ReloadResources );
+		check( before.useVrs != after.useVrs, ReloadVariableRateShading );
+		check( before.recordingMaxImages != after.recordingMaxImages, ReloadRecorder );
+
+		check( before.hotkeysEnabled != after.hotkeysEnabled, ReloadHotkeys );
+		check( before.hotkeysRequireCtrl != after.hotkeysRequireCtrl, ReloadHotkeys );
+		check( before.hotkeysRequireAlt != after.hotkeysRequireAlt, ReloadHotkeys );
+		check( before.hotkeysRequireShift != after.hotkeysRequireShift, ReloadHotkeys );
+		check( before.hotkeyToggleFfr != after.hotkeyToggleFfr, ReloadHotkeys );
+		check( before.hotkeyToggleDebugMode != after.hotkeyToggleDebugMode, ReloadHotkeys );
+		check( before.hotkeyDecreaseSharpness != after.hotkeyDecreaseSharpness, ReloadHotkeys );
+		check( before.hotkeyIncreaseSharpness != after.hotkeyIncreaseSharpness, ReloadHotkeys );
+		check( before.hotkeyDecreaseRadius != after.hotkeyDecreaseRadius, ReloadHotkeys );
+		check( before.hotkeyIncreaseRadius != after.hotkeyIncreaseRadius, ReloadHotkeys );
+		check( before.hotkeyCaptureOutput != after.hotkeyCaptureOutput, ReloadHotkeys );
+		check( before.hotkeyToggleUseVrs != after.hotkeyToggleUseVrs, ReloadHotkeys );
+		check( before.hotkeyDumpRecording != after.hotkeyDumpRecording, ReloadHotkeys );
+		check( before.hotkeyDumpTrace != after.hotkeyDumpTrace, ReloadHotkeys );
+		check( before.hotkeySelectInnerRadius != after.hotkeySelectInnerRadius, ReloadHotkeys );
+		check( before.hotkeySelectMidRadius != after.hotkeySelectMidRadius, ReloadHotkeys );
+		check( before.hotkeySelectOuterRadius != after.hotkeySelectOuterRadius, ReloadHotkeys );
+		check( before.hotkeySelectSharpenRadius != after.hotkeySelectSharpenRadius, ReloadHotkeys );
+
+		if (plan != ReloadNothing)
+			plan |= ReloadPublish;
+		return plan;
+	}
+
+	// Hands the latest result of a reload from the watcher thread to the thread calling Submit. Only the latest
+	// result is kept, and checking for one is a single atomic load while there is none.
+	template<typename T>
+	class ReloadMailbox {
+	public:
+		// either value or error is set
+		void Post( std::unique_ptr<T> value, const std::string &error ) {
+			std::lock_guard<std::mutex> lock( mutex );
+			pendingValue = std::move( value );
+			pendingError = error;
+			pending.store( true, std::memory_order_release );
+		}
+
+		bool Take( std::unique_ptr<T> &value, std::string &error ) {
+			if (!pending.load( std::memory_order_acquire ))
+				return false;
+			std::lock_guard<std::mutex> lock( mutex );
+			value = std::move( pendingValue );
+			error.swap( pendingError );
+			pendingError.clear();
+			pending.store( false, std::memory_order_relaxed );
+			return true;
+		}
+
+	private:
+		std::atomic<bool> pending { false };
+		std::mutex mutex;
+		std::unique_ptr<T> pendingValue;
+		std::string pendingError;
+	};
+}
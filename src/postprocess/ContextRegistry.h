@@ -0,0 +1,136 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+
+namespace vr {
+	// Per-context state for device contexts used from other threads than the one calling Submit, i.e. the
+	// deferred contexts of multithreaded engines. A call on a context is bracketed by Enter and Leave, which are
+	// lock-free: a slot is claimed by swapping its key from empty to the context, and the call is announced in
+	// an in-flight count of that slot, so that threads recording on different contexts never write to the
+	// same cache line. Close stops new calls from entering and waits for the ones in flight by scanning the slots;
+	// while closed, the states may be changed or cleared from the thread that closed the registry.
+	// D3D11 does not tell us when a context is destroyed, so claimed slots are kept until Clear. A new
+	// context created at the address of a destroyed one inherits its state, which the caller must reset.
+	// A state is only ever used by the thread recording on its context, as D3D11 contexts are not free
+	// threaded.
+	template<typename State, size_t Capacity = 64>
+	class ContextRegistry {
+		static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+	public:
+		ContextRegistry() {}
+		ContextRegistry( const ContextRegistry & ) = delete;
+		ContextRegistry & operator=( const ContextRegistry & ) = delete;
+		~ContextRegistry() { Clear(); }
+
+		// returns the state for the context, creating it if necessary, with the call held in flight until Leave;
+		// or nullptr without the need for Leave if the registry is closed or full
+		State * Enter( const void *context, bool *created = nullptr ) {
+			if (created != nullptr)
+				*created = false;
+			if (!open.load( std::memory_order_relaxed ))
+				return nullptr;
+			size_t index = Home( context );
+			for (size_t probe = 0; probe < Capacity; ++probe, index = (index + 1) & (Capacity - 1)) {
+				Slot &slot = slots[index];
+				const void *key = slot.key.load( std::memory_order_acquire );
+				// another thread may claim the slot for a different context first, then we keep probing
+				if (key == nullptr && slot.key.compare_exchange_strong( key, context, std::memory_order_acq_rel ))
+					key = context;
+				if (key != context)
+					continue;
+
+				// announce the call before checking for Close, so that Close either waits for us or we see it
+				inFlight[index].count.fetch_add( 1 );
+				if (!open.load() || slot.key.load( std::memory_order_acquire ) != context) {
+					// closed, or cleared and handed to another context since we found the slot
+					inFlight[index].count.fetch_sub( 1, std::memory_order_release );
+					return nullptr;
+				}
+				State *state = slot.state.load( std::memory_order_acquire );
+				if (state == nullptr) {
+					state = new State();
+					slot.state.store( state, std::memory_order_release );
+					size.fetch_add( 1, std::memory_order_relaxed );
+					if (created != nullptr)
+						*created = true;
+				}
+				return state;
+			}
+			return nullptr;
+		}
+
+		// ends a call for which Enter returned a state
+		void Leave( const void *context ) {
+			// the slot cannot change hands while our call is in flight
+			size_t index = Home( context );
+			for (size_t probe = 0; probe < Capacity; ++probe, index = (index + 1) & (Capacity - 1)) {
+				if (slots[index].key.load( std::memory_order_relaxed ) == context) {
+					inFlight[index].count.fetch_sub( 1, std::memory_order_release );
+					return;
+				}
+			}
+		}
+
+		void Open() {
+			open.store( true );
+		}
+
+		// returns once no call is in flight and none can enter until Open
+		void Close() {
+			open.store( false );
+			for (size_t i = 0; i < Capacity; ++i) {
+				while (inFlight[i].count.load() != 0) {
+					std::this_thread::yield();
+				}
+			}
+		}
+
+		bool IsOpen() const { return open.load( std::memory_order_relaxed ); }
+
+		// whether every slot has been claimed, i.e. why Enter failed while open
+		bool IsFull() const {
+			for (size_t i = 0; i < Capacity; ++i) {
+				if (slots[i].key.load( std::memory_order_relaxed ) == nullptr)
+					return false;
+			}
+			return true;
+		}
+
+		size_t Size() const { return size.load( std::memory_order_relaxed ); }
+
+		// must only be called while closed
+		void Clear() {
+			for (size_t i = 0; i < Capacity; ++i) {
+				delete slots[i].state.exchange( nullptr, std::memory_order_acq_rel );
+				slots[i].key.store( nullptr, std::memory_order_release );
+			}
+			size.store( 0, std::memory_order_relaxed );
+		}
+
+	private:
+		struct Slot {
+			std::atomic<const void*> key { nullptr };
+			std::atomic<State*> state { nullptr };
+		};
+
+		// a cache line each and apart from the slots, which other threads read while probing, as the counts are
+		// written by the thread recording on the context
+		struct alignas(64) InFlight {
+			std::atomic<uint32_t> count { 0 };
+		};
+
+		Slot slots[Capacity];
+		InFlight inFlight[Capacity];
+		std::atomic<bool> open { false };
+		std::atomic<size_t> size { 0 };
+
+		static size_t Home( const void *context ) {
+			// contexts are large heap objects, so the low bits carry little information
+			uintptr_t value = reinterpret_cast<uintptr_t>(context);
+			return size_t((value >> 4) ^ (value >> 12)) & (Capacity - 1);
+		}
+	};
+}
@@ -0,0 +1,148 @@
+#include "D3D11PipelineBackend.h"
+#include <wrl/client.h>
+
+using Microsoft::WRL::ComPtr;
+
+namespace vr {
+	namespace {
+		// calls fn on every object the given groups of state refer to, including null ones
+		template<typename Fn>
+		void ForEachObject(uint32_t groups, const PipelineStateTracker::State &state, Fn fn) {
+			typedef PipelineStateTracker T;
+			if (groups & T::VertexShader) fn(state.vertexShader);
+			if (groups & T::PixelShader) fn(state.pixelShader);
+			if (groups & T::ComputeShader) fn(state.computeShader);
+			if (groups & T::InputLayout) fn(state.inputLayout);
+			if (groups & T::VSConstantBuffer) fn(state.constantBuffer[T::Stage_VS]);
+			if (groups & T::PSConstantBuffer) fn(state.constantBuffer[T::Stage_PS]);
+			if (groups & T::CSConstantBuffer) fn(state.constantBuffer[T::Stage_CS]);
+			if (groups & T::CSSampler) fn(state.csSampler);
+			if (groups & T::RasterizerState) fn(state.rasterizerState);
+			if (groups & T::DepthStencilState) fn(state.depthStencilState);
+		}
+	}
+
+	PipelineStateTracker & PipelineStateTracker::Instance() {
+		static D3D11PipelineBackend backend;
+		static PipelineStateTracker instance( &backend );
+		return instance;
+	}
+
+	void D3D11PipelineBackend::ReadBack( ID3D11DeviceContext *context, uint32_t groups, PipelineStateTracker::State &state ) {
+		if (groups & PipelineStateTracker::VertexShader) {
+			ComPtr<ID3D11VertexShader> shader;
+			context->VSGetShader( shader.GetAddressOf(), nullptr, nullptr );
+			state.vertexShader = shader.Get();
+		}
+		if (groups & PipelineStateTracker::PixelShader) {
+			ComPtr<ID3D11PixelShader> shader;
+			context->PSGetShader( shader.GetAddressOf(), nullptr, nullptr );
+			state.pixelShader = shader.Get();
+		}
+		if (groups & PipelineStateTracker::ComputeShader) {
+			ComPtr<ID3D11ComputeShader> shader;
+			context->CSGetShader( shader.GetAddressOf(), nullptr, nullptr );
+			state.computeShader = shader.Get();
+		}
+		if (groups & PipelineStateTracker::InputLayout) {
+			ComPtr<ID3D11InputLayout> inputLayout;
+			context->IAGetInputLayout( inputLayout.GetAddressOf() );
+			state.inputLayout = inputLayout.Get();
+		}
+		if (groups & PipelineStateTracker::PrimitiveTopology) {
+			D3D11_PRIMITIVE_TOPOLOGY topology;
+			context->IAGetPrimitiveTopology( &topology );
+			state.topology = topology;
+		}
+		if (groups & PipelineStateTracker::VSConstantBuffer) {
+			ComPtr<ID3D11Buffer> buffer;
+			context->VSGetConstantBuffers( 0, 1, buffer.GetAddressOf() );
+			state.constantBuffer[PipelineStateTracker::Stage_VS] = buffer.Get();
+		}
+		if (groups & PipelineStateTracker::PSConstantBuffer) {
+			ComPtr<ID3D11Buffer> buffer;
+			context->PSGetConstantBuffers( 0, 1, buffer.GetAddressOf() );
+			state.constantBuffer[PipelineStateTracker::Stage_PS] = buffer.Get();
+		}
+		if (groups & PipelineStateTracker::CSConstantBuffer) {
+			ComPtr<ID3D11Buffer> buffer;
+			context->CSGetConstantBuffers( 0, 1, buffer.GetAddressOf() );
+			state.constantBuffer[PipelineStateTracker::Stage_CS] = buffer.Get();
+		}
+		if (groups & PipelineStateTracker::CSSampler) {
+			ComPtr<ID3D11SamplerState> sampler;
+			context->CSGetSamplers( 0, 1, sampler.GetAddressOf() );
+			state.csSampler = sampler.Get();
+		}
+		if (groups & PipelineStateTracker::RasterizerState) {
+			ComPtr<ID3D11RasterizerState> rasterizerState;
+			context->RSGetState( rasterizerState.GetAddressOf() );
+			state.rasterizerState = rasterizerState.Get();
+		}
+		if (groups & PipelineStateTracker::DepthStencilState) {
+			ComPtr<ID3D11DepthStencilState> depthStencilState;
+			context->OMGetDepthStencilState( depthStencilState.GetAddressOf(), &state.stencilRef );
+			state.depthStencilState = depthStencilState.Get();
+		}
+		if (groups & PipelineStateTracker::Viewports) {
+			UINT numViewports = D3D11_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE;
+			context->RSGetViewports( &numViewports, reinterpret_cast<D3D11_VIEWPORT*>(state.viewports) );
+			state.numViewports = numViewports;
+		}
+	}
+
+	void D3D11PipelineBackend::Reissue( ID3D11DeviceContext *context, uint32_t group, const PipelineStateTracker::State &state ) {
+		switch (group) {
+		case PipelineStateTracker::VertexShader:
+			context->VSSetShader( state.vertexShader, nullptr, 0 );
+			break;
+		case PipelineStateTracker::PixelShader:
+			context->PSSetShader( state.pixelShader, nullptr, 0 );
+			break;
+		case PipelineStateTracker::ComputeShader:
+			context->CSSetShader( state.computeShader, nullptr, 0 );
+			break;
+		case PipelineStateTracker::InputLayout:
+			context->IASetInputLayout( state.inputLayout );
+			break;
+		case PipelineStateTracker::PrimitiveTopology:
+			context->IASetPrimitiveTopology( D3D11_PRIMITIVE_TOPOLOGY(state.topology) );
+			break;
+		case PipelineStateTracker::VSConstantBuffer:
+			context->VSSetConstantBuffers( 0, 1, &state.constantBuffer[PipelineStateTracker::Stage_VS] );
+			break;
+		case PipelineStateTracker::PSConstantBuffer:
+			context->PSSetConstantBuffers( 0, 1, &state.constantBuffer[PipelineStateTracker::Stage_PS] );
+			break;
+		case PipelineStateTracker::CSConstantBuffer:
+			context->CSSetConstantBuffers( 0, 1, &state.constantBuffer[PipelineStateTracker::Stage_CS] );
+			break;
+		case PipelineStateTracker::CSSampler:
+			context->CSSetSamplers( 0, 1, &state.csSampler );
+			break;
+		case PipelineStateTracker::RasterizerState:
+			context->RSSetState( state.rasterizerState );
+			break;
+		case PipelineStateTracker::DepthStencilState:
+			context->OMSetDepthStencilState( state.depthStencilState, state.stencilRef );
+			break;
+		case PipelineStateTracker::Viewports:
+			context->RSSetViewports( state.numViewports, reinterpret_cast<const D3D11_VIEWPORT*>(state.viewports) );
+			break;
+		}
+	}
+
+	void D3D11PipelineBackend::AddReferences( uint32_t groups, const PipelineStateTracker::State &state ) {
+		ForEachObject( groups, state, [](IUnknown *object) {
+			if (object != nullptr)
+				object->AddRef();
+		} );
+	}
+
+	void D3D11PipelineBackend::ReleaseReferences( uint32_t groups, const PipelineStateTracker::State &state ) {
+		ForEachObject( groups, state, [](IUnknown *object) {
+			if (object != nullptr)
+				object->Release();
+		} );
+	}
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include <d3d11.h>
+#include "PipelineStateTracker.h"
+
+namespace vr {
+	// reads back and re-issues the tracked pipeline state on a D3D11 device context
+	class D3D11PipelineBackend : public PipelineStateBackend {
+	public:
+		void ReadBack(ID3D11DeviceContext *context, uint32_t groups, PipelineStateTracker::State &state) override;
+		void Reissue(ID3D11DeviceContext *context, uint32_t group, const PipelineStateTracker::State &state) override;
+		void AddReferences(uint32_t groups, const PipelineStateTracker::State &state) override;
+		void ReleaseReferences(uint32_t groups, const PipelineStateTracker::State &state) override;
+	};
+
+	static_assert(sizeof(PipelineStateTracker::Viewport) == sizeof(D3D11_VIEWPORT), "tracked viewports must match D3D11_VIEWPORT");
+	static_assert(PipelineStateTracker::MaxViewports == D3D11_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE, "tracker must hold all viewports");
+
+	inline const PipelineStateTracker::Viewport * TrackedViewports(const D3D11_VIEWPORT *viewports) {
+		return reinterpret_cast<const PipelineStateTracker::Viewport*>(viewports);
+	}
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include "openvr.h"
+
+namespace vr {
+	struct EyeRegion {
+		uint32_t x = 0;
+		uint32_t y = 0;
+		uint32_t width = 0;
+		uint32_t height = 0;
+	};
+
+	inline EyeRegion RegionFromBounds( const VRTextureBounds_t &bounds, uint32_t textureWidth, uint32_t textureHeight ) {
+		EyeRegion region;
+		region.x = uint32_t(textureWidth * (std::min)(bounds.uMin, bounds.uMax));
+		region.y = uint32_t(textureHeight * (std::min)(bounds.vMin, bounds.vMax));
+		region.width = uint32_t(textureWidth * std::fabs(bounds.uMax - bounds.uMin));
+		region.height = uint32_t(textureHeight * std::fabs(bounds.vMax - bounds.vMin));
+		return region;
+	}
+
+	enum class EyeBatching {
+		None,
+		// both eyes side by side in one 2D texture, processed in a single dispatch over the region spanning them
+		SideBySide,
+		// one eye in each slice of an array texture; the shaders read plain 2D views, so each slice gets its own
+		// dispatch, but both are run on the first Submit with the pipeline state saved and restored once
+		ArraySlices,
+	};
+
+	// Both eyes can be post-processed on the first Submit of a frame if the game submits one texture holding both.
+	inline EyeBatching ChooseEyeBatching( bool textureContainsOnlyOneEye, uint32_t arraySize ) {
+		if (arraySize == 2)
+			return EyeBatching::ArraySlices;
+		if (arraySize == 1 && !textureContainsOnlyOneEye)
+			return EyeBatching::SideBySide;
+		return EyeBatching::None;
+	}
+
+	// For side-by-side textures, we expect the other eye's bounds to be those of the submitted eye
+	// moved over to the other half of the texture. The other slice of an array uses the same bounds.
+	inline VRTextureBounds_t PredictOtherEyeBounds( EyeBatching batching, EVREye eye, const VRTextureBounds_t &bounds ) {
+		if (batching == EyeBatching::ArraySlices)
+			return bounds;
+		float shift = eye == Eye_Left ? .5f : -.5f;
+		VRTextureBounds_t other;
+		other.uMin = bounds.uMin + shift;
+		other.uMax = bounds.uMax + shift;
+		other.vMin = bounds.vMin;
+		other.vMax = bounds.vMax;
+		return other;
+	}
+
+	inline bool BoundsMatch( const VRTextureBounds_t &a, const VRTextureBounds_t &b ) {
+		const float epsilon = 1e-4f;
+		return std::fabs(a.uMin - b.uMin) < epsilon && std::fabs(a.uMax - b.uMax) < epsilon
+			&& std::fabs(a.vMin - b.vMin) < epsilon && std::fabs(a.vMax - b.vMax) < epsilon;
+	}
+
+	// region spanning both eyes, used as the viewport when both eyes are processed in one dispatch
+	inline EyeRegion CombineEyeRegions( const EyeRegion &left, const EyeRegion &right ) {
+		EyeRegion combined;
+		combined.x = (std::min)(left.x, right.x);
+		combined.y = (std::min)(left.y, right.y);
+		combined.width = (std::max)(left.x + left.width, right.x + right.width) - combined.x;
+		combined.height = (std::max)(left.y + left.height, right.y + right.height) - combined.y;
+		return combined;
+	}
+}
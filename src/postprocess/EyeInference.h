@@ -0,0 +1,181 @@
+#pragma once
+#include <cstdint>
+#include "openvr.h"
+
+namespace vr {
+	struct ViewportRect {
+		float x = 0;
+		float y = 0;
+		float width = 0;
+		float height = 0;
+	};
+
+	// Infers which eye is currently being rendered for games that render each eye into its own single-eye
+	// target. The events of each frame are matched against a few known schedules:
+	// - SubmittedTexture: the game renders straight into the textures it submits, one per eye
+	// - Interleaved: each eye is rendered and then submitted before the next eye is rendered
+	// - Sequential: all passes are rendered before the first Submit, the first half of them for the first eye
+	// A pass starts with a depth clear on a single-eye target. Once a schedule has explained LearningFrames
+	// frames in a row it is trusted; a frame it does not explain drops it until it is relearned.
+	// This only consumes events, so it can be fed from the hooks as well as from a recorded trace.
+	class EyeInference {
+	public:
+		typedef uintptr_t TargetId;
+
+		enum class Schedule : uint8_t { Unknown, SubmittedTexture, Interleaved, Sequential };
+
+		static const int LearningFrames = 8;
+
+		void Reset() {
+			*this = EyeInference();
+		}
+
+		// a single-eye render target was bound
+		void OnTargetBound( TargetId target ) {
+			boundTarget = target;
+			for (int eye = 0; eye < 2; ++eye) {
+				if (target != 0 && target == submittedTexture[eye])
+					frame.boundSubmittedTexture = true;
+			}
+		}
+
+		// a single-eye depth target was cleared, which we take as the start of a render pass
+		void OnDepthClear() {
+			if (frame.submits == 0)
+				++frame.passesBeforeSubmit;
+			else
+				++frame.passesAfterSubmit;
+		}
+
+		void OnViewport( const ViewportRect &viewport ) {
+			EVREye eye;
+			if (!CurrentEye( eye ))
+				return;
+			ViewportRect &largest = frame.viewport[eye];
+			if (viewport.width * viewport.height > largest.width * largest.height)
+				largest = viewport;
+		}
+
+		void OnSubmit( EVREye eye, TargetId texture ) {
+			if (frame.submits == 0)
+				frame.firstEye = eye;
+			++frame.submits;
+			frame.submittedTexture[eye] = texture;
+		}
+
+		void OnFrameEnd() {
+			Schedule candidate = Explain();
+			int passes = frame.passesBeforeSubmit;
+			if (candidate != Schedule::Unknown && candidate == lastCandidate && (candidate != Schedule::Sequential || passes == passesPerFrame)) {
+				++stableFrames;
+			} else {
+				stableFrames = candidate != Schedule::Unknown ? 1 : 0;
+			}
+			lastCandidate = candidate;
+			passesPerFrame = passes;
+			schedule = stableFrames >= LearningFrames ? candidate : Schedule::Unknown;
+
+			firstEye = frame.firstEye;
+			for (int eye = 0; eye < 2; ++eye) {
+				submittedTexture[eye] = frame.submittedTexture[eye];
+				eyeViewport[eye] = frame.viewport[eye];
+			}
+			frame = FrameEvents();
+			boundTarget = 0;
+		}
+
+		Schedule ActiveSchedule() const { return schedule; }
+
+		static const char * ScheduleName( Schedule schedule ) {
+			switch (schedule) {
+			case Schedule::SubmittedTexture: return "rendering into submitted textures";
+			case Schedule::Interleaved: return "each eye rendered before its Submit";
+			case Schedule::Sequential: return "both eyes rendered before Submit";
+			default: return "unknown";
+			}
+		}
+
+		// returns false if we can't tell with confidence
+		bool CurrentEye( EVREye &eye ) const {
+			switch (schedule) {
+			case Schedule::SubmittedTexture:
+				for (int i = 0; i < 2; ++i) {
+					if (boundTarget != 0 && boundTarget == submittedTexture[i]) {
+						eye = EVREye(i);
+						return true;
+					}
+				}
+				return false;
+			case Schedule::Interleaved:
+				eye = frame.submits == 0 ? firstEye : OtherEye( firstEye );
+				return true;
+			case Schedule::Sequential:
+				if (frame.submits > 0 || frame.passesBeforeSubmit == 0)
+					return false;
+				eye = frame.passesBeforeSubmit <= passesPerFrame / 2 ? firstEye : OtherEye( firstEye );
+				return true;
+			default:
+				return false;
+			}
+		}
+
+		// largest viewport seen for the eye during the last frame, if any
+		bool EyeViewport( EVREye eye, ViewportRect &viewport ) const {
+			if (eyeViewport[eye].width <= 0 || eyeViewport[eye].height <= 0)
+				return false;
+			viewport = eyeViewport[eye];
+			return true;
+		}
+
+		// Maps the projection center of the eye's image, as a fraction of its size, into the target it is rendered
+		// to. The eye may only cover part of the target, e.g. with dynamic resolution, so the center is placed in
+		// the eye's viewport from the last frame. Leaves it as it is if there is none or it exceeds the target.
+		bool ProjectionCenter( EVREye eye, uint32_t targetWidth, uint32_t targetHeight, float &x, float &y ) const {
+			ViewportRect viewport;
+			if (!EyeViewport( eye, viewport ) || viewport.x < 0 || viewport.y < 0
+					|| viewport.x + viewport.width > targetWidth || viewport.y + viewport.height > targetHeight)
+				return false;
+			x = (viewport.x + x * viewport.width) / targetWidth;
+			y = (viewport.y + y * viewport.height) / targetHeight;
+			return true;
+		}
+
+	private:
+		struct FrameEvents {
+			int submits = 0;
+			EVREye firstEye = Eye_Left;
+			TargetId submittedTexture[2] = { 0, 0 };
+			bool boundSubmittedTexture = false;
+			int passesBeforeSubmit = 0;
+			int passesAfterSubmit = 0;
+			ViewportRect viewport[2];
+		};
+
+		FrameEvents frame;
+		TargetId boundTarget = 0;
+		// learned from previous frames
+		Schedule schedule = Schedule::Unknown;
+		Schedule lastCandidate = Schedule::Unknown;
+		int stableFrames = 0;
+		int passesPerFrame = 0;
+		EVREye firstEye = Eye_Left;
+		TargetId submittedTexture[2] = { 0, 0 };
+		ViewportRect eyeViewport[2];
+
+		static EVREye OtherEye( EVREye eye ) {
+			return eye == Eye_Left ? Eye_Right : Eye_Left;
+		}
+
+		Schedule Explain() const {
+			if (frame.submits != 2)
+				return Schedule::Unknown;
+			if (frame.boundSubmittedTexture && frame.submittedTexture[0] != frame.submittedTexture[1])
+				return Schedule::SubmittedTexture;
+			if (frame.passesBeforeSubmit > 0 && frame.passesAfterSubmit > 0)
+				return Schedule::Interleaved;
+			if (frame.passesAfterSubmit == 0 && frame.passesBeforeSubmit >= 2 && frame.passesBeforeSubmit % 2 == 0)
+				return Schedule::Sequential;
+			return Schedule::Unknown;
+		}
+	};
+}
@@ -0,0 +1,185 @@
+#include "FileWatcher.h"
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace vr {
+	struct FileWatcher::Shared {
+		CapturePath fileName;
+		Callback onChange;
+		std::chrono::milliseconds settleTime { 200 };
+		std::atomic<bool> stopping { false };
+#ifdef _WIN32
+		HANDLE directory = INVALID_HANDLE_VALUE;
+		HANDLE ioEvent = nullptr;
+		HANDLE stopEvent = nullptr;
+		OVERLAPPED overlapped;
+		bool ioPending = false;
+		alignas(DWORD) uint8_t buffer[16384];
+#else
+		int inotify = -1;
+		int stopPipe[2] = { -1, -1 };
+#endif
+
+		~Shared() {
+#ifdef _WIN32
+			if (directory != INVALID_HANDLE_VALUE)
+				CloseHandle( directory );
+			if (ioEvent != nullptr)
+				CloseHandle( ioEvent );
+			if (stopEvent != nullptr)
+				CloseHandle( stopEvent );
+#else
+			if (inotify >= 0)
+				close( inotify );
+			for (int fd : stopPipe) {
+				if (fd >= 0)
+					close( fd );
+			}
+#endif
+		}
+
+		bool Open( const CapturePath &directoryPath ) {
+#ifdef _WIN32
+			directory = CreateFileW( directoryPath.c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+					nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr );
+			ioEvent = CreateEventW( nullptr, TRUE, FALSE, nullptr );
+			stopEvent = CreateEventW( nullptr, TRUE, FALSE, nullptr );
+			return directory != INVALID_HANDLE_VALUE && ioEvent != nullptr && stopEvent != nullptr;
+#else
+			inotify = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+			if (inotify < 0 || pipe( stopPipe ) != 0)
+				return false;
+			return inotify_add_watch( inotify, directoryPath.c_str(), IN_CLOSE_WRITE | IN_MODIFY | IN_MOVED_TO | IN_CREATE ) >= 0;
+#endif
+		}
+
+		void SignalStop() {
+			stopping = true;
+#ifdef _WIN32
+			SetEvent( stopEvent );
+#else
+			char wake = 0;
+			ssize_t written = write( stopPipe[1], &wake, 1 );
+			(void)written;
+#endif
+		}
+
+		// returns whether the watched file changed within the timeout; false if stopped
+		bool WaitForChange( std::chrono::milliseconds timeout ) {
+#ifdef _WIN32
+			if (!ioPending) {
+				memset( &overlapped, 0, sizeof(overlapped) );
+				overlapped.hEvent = ioEvent;
+				ResetEvent( ioEvent );
+				DWORD filter = FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_SIZE;
+				if (!ReadDirectoryChangesW( directory, buffer, sizeof(buffer), FALSE, filter, nullptr, &overlapped, nullptr )) {
+					// nothing more to watch, so wait for the stop
+					WaitForSingleObject( stopEvent, INFINITE );
+					return false;
+				}
+				ioPending = true;
+			}
+			HANDLE handles[2] = { ioEvent, stopEvent };
+			if (WaitForMultipleObjects( 2, handles, FALSE, DWORD(timeout.count()) ) != WAIT_OBJECT_0)
+				return false;
+			ioPending = false;
+			DWORD size = 0;
+			if (!GetOverlappedResult( directory, &overlapped, &size, FALSE ))
+				return false;
+			if (size == 0) {
+				// too many changes for the buffer, so any file may have changed
+				return true;
+			}
+			bool changed = false;
+			for (uint8_t *entry = buffer; ; ) {
+				const FILE_NOTIFY_INFORMATION *info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(entry);
+				std::wstring name( info->FileName, info->FileNameLength / sizeof(WCHAR) );
+				if (_wcsicmp( name.c_str(), fileName.c_str() ) == 0)
+					changed = true;
+				if (info->NextEntryOffset == 0)
+					break;
+				entry += info->NextEntryOffset;
+			}
+			return changed;
+#else
+			pollfd fds[2] = { { inotify, POLLIN, 0 }, { stopPipe[0], POLLIN, 0 } };
+			if (poll( fds, 2, int(timeout.count()) ) <= 0 || (fds[1].revents & POLLIN))
+				return false;
+			alignas(inotify_event) char events[4096];
+			bool changed = false;
+			ssize_t length;
+			while ((length = read( inotify, events, sizeof(events) )) > 0) {
+				for (char *entry = events; entry < events + length; ) {
+					const inotify_event *event = reinterpret_cast<const inotify_event*>(entry);
+					if ((event->mask & IN_Q_OVERFLOW) || (event->len > 0 && fileName == event->name))
+						changed = true;
+					entry += sizeof(inotify_event) + event->len;
+				}
+			}
+			return changed;
+#endif
+		}
+
+		void CancelPending() {
+#ifdef _WIN32
+			// the buffer must stay alive until the kernel is done with it
+			if (ioPending) {
+				DWORD size;
+				CancelIoEx( directory, &overlapped );
+				GetOverlappedResult( directory, &overlapped, &size, TRUE );
+				ioPending = false;
+			}
+#endif
+		}
+	};
+
+	FileWatcher::FileWatcher() {}
+
+	FileWatcher::~FileWatcher() {
+		// like the other background threads, never join while the DLL may be unloading
+		if (thread.joinable()) {
+			shared->SignalStop();
+			thread.detach();
+		}
+	}
+
+	bool FileWatcher::Start( const CapturePath &directory, const CapturePath &fileName, Callback onChange, std::chrono::milliseconds settleTime ) {
+		Stop();
+		std::shared_ptr<Shared> watch = std::make_shared<Shared>();
+		if (!watch->Open( directory ))
+			return false;
+		watch->fileName = fileName;
+		watch->onChange = onChange;
+		watch->settleTime = settleTime;
+		shared = watch;
+		thread = std::thread( Run, shared );
+		return true;
+	}
+
+	void FileWatcher::Stop() {
+		if (!thread.joinable())
+			return;
+		shared->SignalStop();
+		thread.join();
+	}
+
+	void FileWatcher::Run( std::shared_ptr<Shared> shared ) {
+		while (!shared->stopping) {
+			if (!shared->WaitForChange( std::chrono::milliseconds( 1000 ) ))
+				continue;
+			while (!shared->stopping && shared->WaitForChange( shared->settleTime )) {}
+			if (!shared->stopping)
+				shared->onChange();
+		}
+		shared->CancelPending();
+	}
+}
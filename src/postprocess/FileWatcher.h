@@ -0,0 +1,33 @@
+#pragma once
+#include "CaptureWriter.h"
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <thread>
+
+namespace vr {
+	// Watches a single file for changes on a background thread, using ReadDirectoryChangesW on Windows and
+	// inotify elsewhere. Editors tend to save in several steps, so the callback only runs once the
+	// directory has been quiet for the settle time. The callback runs on the watcher thread.
+	class FileWatcher {
+	public:
+		typedef std::function<void()> Callback;
+
+		FileWatcher();
+		FileWatcher( const FileWatcher & ) = delete;
+		FileWatcher & operator=( const FileWatcher & ) = delete;
+		~FileWatcher();
+
+		bool Start( const CapturePath &directory, const CapturePath &fileName, Callback onChange, std::chrono::milliseconds settleTime = std::chrono::milliseconds( 200 ) );
+		void Stop();
+		bool IsRunning() const { return thread.joinable(); }
+
+	private:
+		struct Shared;
+		std::shared_ptr<Shared> shared;
+		std::thread thread;
+
+		static void Run( std::shared_ptr<Shared> shared );
+	};
+}
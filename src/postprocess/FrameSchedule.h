@@ -0,0 +1,137 @@
+#pragma once
+#include <cstdint>
+
+namespace vr {
+	// Learns which of the depth clears in a frame belong to the scene passes we want to mask, so that extra
+	// clears from UI or post-processing passes on similarly sized targets are left alone.
+	// Each clear of a qualifying depth target is scored by how often that depth target is bound together with
+	// a qualifying render target afterwards. The clears scoring at least half of the best one are taken as
+	// scene passes. Once the same clears have been chosen for LearningFrames frames in a row, only those are
+	// masked; before that, every qualifying clear is. A frame with a different number of clears, or a
+	// periodic verification frame choosing differently, sends us back to learning.
+	// This only consumes events, so it can be fed from the hooks as well as from a synthetic stream.
+	class FrameSchedule {
+	public:
+		typedef uintptr_t TargetId;
+
+		static const int LearningFrames = 16;
+		static const int VerifyInterval = 64;
+		static const int MaxClears = 32;
+
+		void Reset() {
+			*this = FrameSchedule();
+		}
+
+		bool IsLearned() const { return learned; }
+		int SceneClearsPerFrame() const { return learned ? CountBits( chosen ) : 0; }
+
+		// binds only need to be reported while we are scoring the current frame
+		bool IsScoring() const {
+			return !learned || frameCounter % VerifyInterval == 0;
+		}
+
+		// returns whether the given clear should be masked; maskOrdinal counts the masked clears in this frame
+		bool OnDepthClear( TargetId depth, int &maskOrdinal ) {
+			int index = clearCount++;
+			if (index < MaxClears) {
+				clears[index].depth = depth;
+				clears[index].score = 0;
+			}
+
+			bool mask = !learned || (index < MaxClears && (chosen & (1u << index)));
+			maskOrdinal = maskedThisFrame;
+			if (mask)
+				++maskedThisFrame;
+			return mask;
+		}
+
+		void OnTargetsBound( TargetId depth, bool qualifyingRenderTarget ) {
+			if (!IsScoring() || depth == 0 || !qualifyingRenderTarget)
+				return;
+			// attribute the bind to the most recent clear of this depth target
+			int last = (clearCount < MaxClears ? clearCount : MaxClears) - 1;
+			for (int i = last; i >= 0; --i) {
+				if (clears[i].depth == depth) {
+					++clears[i].score;
+					return;
+				}
+			}
+		}
+
+		void OnFrameEnd() {
+			if (IsScoring()) {
+				uint32_t candidate = ChooseSceneClears();
+				if (learned) {
+					if (candidate != chosen || clearCount != chosenClearCount)
+						Relearn();
+				} else {
+					if (candidate != 0 && candidate == lastCandidate && clearCount == lastClearCount)
+						++stableFrames;
+					else
+						stableFrames = candidate != 0 ? 1 : 0;
+					lastCandidate = candidate;
+					lastClearCount = clearCount;
+					if (stableFrames >= LearningFrames) {
+						learned = true;
+						chosen = candidate;
+						chosenClearCount = clearCount;
+					}
+				}
+			} else if (clearCount != chosenClearCount) {
+				Relearn();
+			}
+
+			++frameCounter;
+			clearCount = 0;
+			maskedThisFrame = 0;
+		}
+
+	private:
+		struct Clear {
+			TargetId depth = 0;
+			uint32_t score = 0;
+		};
+
+		Clear clears[MaxClears];
+		int clearCount = 0;
+		int maskedThisFrame = 0;
+		uint64_t frameCounter = 0;
+
+		bool learned = false;
+		uint32_t chosen = 0;
+		int chosenClearCount = 0;
+		uint32_t lastCandidate = 0;
+		int lastClearCount = 0;
+		int stableFrames = 0;
+
+		uint32_t ChooseSceneClears() const {
+			if (clearCount > MaxClears)
+				return 0;
+			uint32_t best = 0;
+			for (int i = 0; i < clearCount; ++i) {
+				if (clears[i].score > best)
+					best = clears[i].score;
+			}
+			uint32_t result = 0;
+			for (int i = 0; i < clearCount && best > 0; ++i) {
+				if (2 * clears[i].score >= best)
+					result |= 1u << i;
+			}
+			return result;
+		}
+
+		void Relearn() {
+			learned = false;
+			chosen = 0;
+			stableFrames = 0;
+			lastCandidate = 0;
+		}
+
+		static int CountBits( uint32_t bits ) {
+			int count = 0;
+			for (; bits; bits &= bits - 1)
+				++count;
+			return count;
+		}
+	};
+}
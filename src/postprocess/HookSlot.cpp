@@ -0,0 +1,36 @@
+#include "HookSlot.h"
+
+namespace vr {
+	HookRegistry & HookRegistry::Instance() {
+		static HookRegistry registry;
+		return registry;
+	}
+
+	void HookRegistry::Add( const char *name, void *hook, void *target, void (*clear)() ) {
+		std::lock_guard<std::mutex> lock( mutex );
+		Entry entry;
+		entry.name = name;
+		entry.hook = hook;
+		entry.target = target;
+		entry.clear = clear;
+		entries.push_back( entry );
+	}
+
+	std::vector<HookRegistry::Entry> HookRegistry::Entries() const {
+		std::lock_guard<std::mutex> lock( mutex );
+		return entries;
+	}
+
+	size_t HookRegistry::Count() const {
+		std::lock_guard<std::mutex> lock( mutex );
+		return entries.size();
+	}
+
+	void HookRegistry::Clear() {
+		std::lock_guard<std::mutex> lock( mutex );
+		for (const Entry &entry : entries) {
+			entry.clear();
+		}
+		entries.clear();
+	}
+}
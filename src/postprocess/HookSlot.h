@@ -0,0 +1,64 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+namespace vr {
+	// Lists the installed hooks. Only used while installing and removing hooks, never when calling an original.
+	class HookRegistry {
+	public:
+		struct Entry {
+			const char *name;
+			void *hook;
+			void *target;
+			void (*clear)();
+		};
+
+		static HookRegistry & Instance();
+
+		void Add( const char *name, void *hook, void *target, void (*clear)() );
+		std::vector<Entry> Entries() const;
+		size_t Count() const;
+		// forgets all originals, after the hooks have been removed
+		void Clear();
+
+	private:
+		mutable std::mutex mutex;
+		std::vector<Entry> entries;
+	};
+
+	// The original function of one hook. Each hook function gets its own slot from the template, so finding the
+	// original is a single load from a fixed address. The slot is zero-initialized before any code runs and
+	// only written while installing the hook, before the hook is enabled.
+	template<typename T, T Hook>
+	class HookSlot {
+	public:
+		static T Original() {
+			return storage.original.load( std::memory_order_acquire );
+		}
+
+		static void Install( T original, const char *name, void *target ) {
+			bool known = Original() != nullptr;
+			storage.original.store( original, std::memory_order_release );
+			if (!known)
+				HookRegistry::Instance().Add( name, (void*)Hook, target, &Clear );
+		}
+
+		static void Clear() {
+			storage.original.store( nullptr, std::memory_order_relaxed );
+		}
+
+	private:
+		// a line of its own, so that slots written at install never share a line with other data
+		struct alignas(64) Storage {
+			std::atomic<T> original;
+		};
+		static Storage storage;
+	};
+
+	template<typename T, T Hook>
+	typename HookSlot<T, Hook>::Storage HookSlot<T, Hook>::storage;
+}
+
+#define HOOK_SLOT(hook) vr::HookSlot<decltype(&hook), &hook>
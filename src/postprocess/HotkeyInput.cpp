@@ -0,0 +1,60 @@
+#include "HotkeyInput.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#endif
+
+namespace vr {
+	HotkeyInput::HotkeyInput() : shared( std::make_shared<Shared>() ) {}
+
+	HotkeyInput::~HotkeyInput() {
+		// like the capture threads, never join while the DLL may be unloading
+		if (thread.joinable()) {
+			{
+				std::lock_guard<std::mutex> lock( shared->mutex );
+				shared->stopping = true;
+			}
+			shared->wakeup.notify_one();
+			thread.detach();
+		}
+	}
+
+	void HotkeyInput::Start( std::unique_ptr<KeySource> keys, const HotkeyBindings &bindings, std::chrono::milliseconds interval ) {
+		Stop();
+		// a fresh queue, so that commands of a previous run are not replayed
+		shared = std::make_shared<Shared>();
+		shared->keys = std::move( keys );
+		shared->bindings = bindings;
+		shared->interval = interval;
+		thread = std::thread( Run, shared );
+	}
+
+	void HotkeyInput::Stop() {
+		if (!thread.joinable())
+			return;
+		{
+			std::lock_guard<std::mutex> lock( shared->mutex );
+			shared->stopping = true;
+		}
+		shared->wakeup.notify_one();
+		thread.join();
+	}
+
+	void HotkeyInput::Run( std::shared_ptr<Shared> shared ) {
+#ifdef _WIN32
+		SetThreadPriority( GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL );
+#endif
+		HotkeyDetector detector;
+		std::unique_lock<std::mutex> lock( shared->mutex );
+		while (!shared->stopping) {
+			lock.unlock();
+			detector.Poll( *shared->keys, shared->bindings, [&]( HotkeyCommand command ) {
+				if (!shared->commands.TryPush( command ))
+					shared->dropped.fetch_add( 1, std::memory_order_relaxed );
+			});
+			lock.lock();
+			shared->wakeup.wait_for( lock, shared->interval, [&] { return shared->stopping; } );
+		}
+	}
+}
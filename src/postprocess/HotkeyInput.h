@@ -0,0 +1,121 @@
+#pragma once
+#include "SpscQueue.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace vr {
+	enum class HotkeyCommand : uint8_t {
+		ToggleFfr,
+		ToggleDebugMode,
+		ToggleUseVrs,
+		DecreaseSharpness,
+		IncreaseSharpness,
+		DecreaseRadius,
+		IncreaseRadius,
+		SelectInnerRadius,
+		SelectMidRadius,
+		SelectOuterRadius,
+		SelectSharpenRadius,
+		CaptureOutput,
+		DumpRecording,
+		DumpTrace,
+		Count
+	};
+
+	// virtual key codes of the modifier keys, so that the detector does not need the Windows headers
+	const int KeyLeftShift = 0xA0;
+	const int KeyRightShift = 0xA1;
+	const int KeyLeftCtrl = 0xA2;
+	const int KeyRightCtrl = 0xA3;
+	const int KeyLeftAlt = 0xA4;
+	const int KeyRightAlt = 0xA5;
+	const int KeyCodeCount = 256;
+
+	struct HotkeyBindings {
+		bool requireCtrl = false;
+		bool requireAlt = false;
+		bool requireShift = false;
+		// virtual key code per command; codes outside of [1, 255] leave the command unbound
+		int keys[size_t(HotkeyCommand::Count)] = {};
+	};
+
+	class KeySource {
+	public:
+		virtual ~KeySource() {}
+		virtual bool IsPressed( int keyCode ) = 0;
+	};
+
+	// Turns key presses into commands. A command fires once when its key goes down while the required
+	// modifiers are held. Commands bound to the same key all fire, and each key is queried once per poll.
+	class HotkeyDetector {
+	public:
+		template<typename Emit>
+		void Poll( KeySource &keys, const HotkeyBindings &bindings, Emit emit ) {
+			// like before, key states are left alone while the modifiers are not held
+			if (bindings.requireShift && !keys.IsPressed( KeyLeftShift ) && !keys.IsPressed( KeyRightShift ))
+				return;
+			if (bindings.requireCtrl && !keys.IsPressed( KeyLeftCtrl ) && !keys.IsPressed( KeyRightCtrl ))
+				return;
+			if (bindings.requireAlt && !keys.IsPressed( KeyLeftAlt ) && !keys.IsPressed( KeyRightAlt ))
+				return;
+
+			bool polled[KeyCodeCount] = {};
+			bool newlyPressed[KeyCodeCount] = {};
+			for (int key : bindings.keys) {
+				if (key <= 0 || key >= KeyCodeCount || polled[key])
+					continue;
+				polled[key] = true;
+				bool pressed = keys.IsPressed( key );
+				newlyPressed[key] = pressed && !wasPressed[key];
+				wasPressed[key] = pressed;
+			}
+			for (size_t i = 0; i < size_t(HotkeyCommand::Count); ++i) {
+				int key = bindings.keys[i];
+				if (key > 0 && key < KeyCodeCount && newlyPressed[key])
+					emit( HotkeyCommand(i) );
+			}
+		}
+
+	private:
+		bool wasPressed[KeyCodeCount] = {};
+	};
+
+	// Polls the keys on a low priority thread at a fixed rate and queues the resulting commands, so that
+	// the thread calling Submit only has to drain the queue. Commands are dropped if it is not drained.
+	class HotkeyInput {
+	public:
+		HotkeyInput();
+		HotkeyInput( const HotkeyInput & ) = delete;
+		HotkeyInput & operator=( const HotkeyInput & ) = delete;
+		~HotkeyInput();
+
+		void Start( std::unique_ptr<KeySource> keys, const HotkeyBindings &bindings, std::chrono::milliseconds interval );
+		void Stop();
+		bool IsRunning() const { return thread.joinable(); }
+
+		// must only be called from one thread
+		bool TryPop( HotkeyCommand &command ) { return shared->commands.TryPop( command ); }
+		uint64_t DroppedCommands() const { return shared->dropped.load( std::memory_order_relaxed ); }
+
+	private:
+		struct Shared {
+			SpscQueue<HotkeyCommand, 64> commands;
+			std::atomic<uint64_t> dropped { 0 };
+			std::unique_ptr<KeySource> keys;
+			HotkeyBindings bindings;
+			std::chrono::milliseconds interval { 10 };
+			std::mutex mutex;
+			std::condition_variable wakeup;
+			bool stopping = false;
+		};
+		std::shared_ptr<Shared> shared;
+		std::thread thread;
+
+		static void Run( std::shared_ptr<Shared> shared );
+	};
+}
@@ -0,0 +1,56 @@
+#include "InterfaceCache.h"
+#include <cstring>
+
+namespace vr {
+	InterfaceCache & InterfaceCache::Instance() {
+		// never destroyed, as the game may still request interfaces while static objects are destroyed
+		static InterfaceCache *instance = new InterfaceCache;
+		return *instance;
+	}
+
+	size_t InterfaceCache::Hash( const char *version ) {
+		// FNV-1a
+		uint32_t hash = 2166136261u;
+		for (const char *c = version; *c != '\0'; ++c) {
+			hash = (hash ^ (uint8_t)*c) * 16777619u;
+		}
+		return hash & (SLOTS - 1);
+	}
+
+	void * InterfaceCache::Find( const char *version, uint32_t token ) const {
+		size_t index = Hash( version );
+		for (size_t probe = 0; probe < SLOTS; ++probe) {
+			const Record *record = slots[index].load( std::memory_order_acquire );
+			if (record == nullptr)
+				return nullptr;
+			if (strcmp( record->version.c_str(), version ) == 0)
+				return record->token == token ? record->instance : nullptr;
+			index = (index + 1) & (SLOTS - 1);
+		}
+		return nullptr;
+	}
+
+	void InterfaceCache::Store( const char *version, uint32_t token, void *instance ) {
+		std::lock_guard<std::mutex> lock( mutex );
+		size_t index = Hash( version );
+		for (size_t probe = 0; probe < SLOTS; ++probe) {
+			const Record *record = slots[index].load( std::memory_order_relaxed );
+			if (record == nullptr || record->version == version) {
+				records.push_back( std::unique_ptr<Record>( new Record { version, token, instance } ) );
+				// a version keeps its slot, so a reader probing for it never skips past it
+				slots[index].store( records.back().get(), std::memory_order_release );
+				return;
+			}
+			index = (index + 1) & (SLOTS - 1);
+		}
+	}
+
+	size_t InterfaceCache::Count() const {
+		size_t count = 0;
+		for (size_t i = 0; i < SLOTS; ++i) {
+			if (slots[i].load( std::memory_order_relaxed ) != nullptr)
+				++count;
+		}
+		return count;
+	}
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace vr {
+	// Remembers the interfaces the runtime handed out for each version string, so that repeated requests for an
+	// interface return without locking, allocating or parsing. Entries belong to the init token they were stored
+	// under and stop matching once the token changes. Lookups may run on any thread at any time.
+	class InterfaceCache {
+	public:
+		static InterfaceCache & Instance();
+
+		// the interface stored for version under token, or nullptr
+		void * Find( const char *version, uint32_t token ) const;
+		// Stores the interface for version under token, replacing what was stored for version before. Once the
+		// table is full, further versions are simply not cached.
+		void Store( const char *version, uint32_t token, void *instance );
+		size_t Count() const;
+
+	private:
+		// never changed once published, as readers may hold on to it
+		struct Record {
+			std::string version;
+			uint32_t token;
+			void *instance;
+		};
+
+		static const size_t SLOTS = 64;
+		static size_t Hash( const char *version );
+
+		std::atomic<const Record*> slots[SLOTS] = {};
+		mutable std::mutex mutex;
+		// Replaced records are kept, as a reader may still be comparing against one. There is one per version
+		// and init, so they hardly add up.
+		std::vector<std::unique_ptr<Record>> records;
+	};
+}
@@ -0,0 +1,223 @@
+#include "LiveMetrics.h"
+#include <algorithm>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace vr {
+	const char * MetricName( Metric metric ) {
+		switch (metric) {
+		case Metric::Frame: return "frame";
+		case Metric::UpdatedMicros: return "updatedMicros";
+		case Metric::FfrActive: return "ffrActive";
+		case Metric::Mode: return "mode";
+		case Metric::SharpeningActive: return "sharpeningActive";
+		case Metric::TextureWidth: return "textureWidth";
+		case Metric::TextureHeight: return "textureHeight";
+		case Metric::MasksLastFrame: return "masksLastFrame";
+		case Metric::MasksTotal: return "masksTotal";
+		case Metric::ViewsCreated: return "viewsCreated";
+		case Metric::Resets: return "resets";
+		case Metric::GpuPostProcessMicros: return "gpuPostProcessMicros";
+		case Metric::ShadedPixelsPermille: return "shadedPixelsPermille";
+		case Metric::VrsCallsIssued: return "vrsCallsIssued";
+		case Metric::VrsCallsAvoided: return "vrsCallsAvoided";
+		case Metric::ForcedOutputWaits: return "forcedOutputWaits";
+		default: return "unknown";
+		}
+	}
+
+	// Both sides map the block writable: on 32-bit targets, 64-bit atomic loads may be a compare-exchange,
+	// which faults on a read-only page.
+	class SharedMapping {
+	public:
+		void *address = nullptr;
+
+		~SharedMapping() {
+#ifdef _WIN32
+			if (address != nullptr)
+				UnmapViewOfFile( address );
+			if (handle != nullptr)
+				CloseHandle( handle );
+#else
+			if (address != nullptr)
+				munmap( address, sizeof(SharedMetricsBlock) );
+			if (fd >= 0)
+				close( fd );
+			if (unlinkOnClose)
+				shm_unlink( name.c_str() );
+#endif
+		}
+
+		bool Open( const std::string &baseName, bool create, std::string &error ) {
+#ifdef _WIN32
+			std::string fullName = "Local\\" + baseName;
+			std::wstring name( fullName.begin(), fullName.end() );
+			if (create) {
+				handle = CreateFileMappingW( INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, DWORD(sizeof(SharedMetricsBlock)), name.c_str() );
+			} else {
+				handle = OpenFileMappingW( FILE_MAP_READ | FILE_MAP_WRITE, FALSE, name.c_str() );
+			}
+			if (handle == nullptr) {
+				error = (create ? "could not create shared memory, error " : "no metrics published, error ") + std::to_string( GetLastError() );
+				return false;
+			}
+			address = MapViewOfFile( handle, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, sizeof(SharedMetricsBlock) );
+			if (address == nullptr) {
+				error = "could not map shared memory, error " + std::to_string( GetLastError() );
+				return false;
+			}
+			return true;
+#else
+			name = "/" + baseName;
+			fd = shm_open( name.c_str(), create ? O_RDWR | O_CREAT : O_RDWR, 0600 );
+			if (fd < 0) {
+				error = std::string( create ? "could not create shared memory: " : "no metrics published: " ) + strerror( errno );
+				return false;
+			}
+			unlinkOnClose = create;
+			if (create) {
+				if (ftruncate( fd, sizeof(SharedMetricsBlock) ) != 0) {
+					error = std::string( "could not size shared memory: " ) + strerror( errno );
+					return false;
+				}
+			} else {
+				struct stat info;
+				if (fstat( fd, &info ) != 0 || size_t(info.st_size) < sizeof(SharedMetricsBlock)) {
+					error = "shared memory is too small";
+					return false;
+				}
+			}
+			void *mapped = mmap( nullptr, sizeof(SharedMetricsBlock), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+			if (mapped == MAP_FAILED) {
+				error = std::string( "could not map shared memory: " ) + strerror( errno );
+				return false;
+			}
+			address = mapped;
+			return true;
+#endif
+		}
+
+	private:
+#ifdef _WIN32
+		HANDLE handle = nullptr;
+#else
+		int fd = -1;
+		std::string name;
+		bool unlinkOnClose = false;
+#endif
+	};
+
+	namespace {
+		uint32_t CurrentProcessId() {
+#ifdef _WIN32
+			return GetCurrentProcessId();
+#else
+			return uint32_t(getpid());
+#endif
+		}
+	}
+
+	LiveMetricsWriter::LiveMetricsWriter() : mapping( nullptr ), block( nullptr ) {}
+
+	LiveMetricsWriter::~LiveMetricsWriter() {
+		Close();
+	}
+
+	bool LiveMetricsWriter::Open( const std::string &name, std::string &error ) {
+		Close();
+		mapping = new SharedMapping;
+		if (!mapping->Open( name, true, error )) {
+			Close();
+			return false;
+		}
+		block = static_cast<SharedMetricsBlock*>(mapping->address);
+		// a block left behind by an earlier writer is only valid again once the magic is back
+		block->magic.store( 0, std::memory_order_relaxed );
+		block->sequence.store( 0, std::memory_order_relaxed );
+		for (uint32_t i = 0; i < SharedMetricsBlock::CAPACITY; ++i) {
+			block->values[i].store( 0, std::memory_order_relaxed );
+		}
+		block->version.store( SharedMetricsBlock::VERSION, std::memory_order_relaxed );
+		block->metricCount.store( uint32_t(Metric::Count), std::memory_order_relaxed );
+		block->writerProcess.store( CurrentProcessId(), std::memory_order_relaxed );
+		block->magic.store( SharedMetricsBlock::MAGIC, std::memory_order_release );
+		return true;
+	}
+
+	void LiveMetricsWriter::Close() {
+		if (block != nullptr)
+			block->magic.store( 0, std::memory_order_release );
+		block = nullptr;
+		delete mapping;
+		mapping = nullptr;
+	}
+
+	void LiveMetricsWriter::Publish( const MetricValues &metrics ) {
+		if (block == nullptr)
+			return;
+		uint64_t sequence = block->sequence.load( std::memory_order_relaxed );
+		block->sequence.store( sequence + 1, std::memory_order_relaxed );
+		std::atomic_thread_fence( std::memory_order_release );
+		for (size_t i = 0; i < size_t(Metric::Count); ++i) {
+			block->values[i].store( metrics.values[i], std::memory_order_relaxed );
+		}
+		block->sequence.store( sequence + 2, std::memory_order_release );
+	}
+
+	LiveMetricsReader::LiveMetricsReader() : mapping( nullptr ), block( nullptr ) {}
+
+	LiveMetricsReader::~LiveMetricsReader() {
+		Close();
+	}
+
+	bool LiveMetricsReader::Open( const std::string &name, std::string &error ) {
+		Close();
+		mapping = new SharedMapping;
+		if (!mapping->Open( name, false, error )) {
+			Close();
+			return false;
+		}
+		block = static_cast<const SharedMetricsBlock*>(mapping->address);
+		return true;
+	}
+
+	void LiveMetricsReader::Close() {
+		block = nullptr;
+		delete mapping;
+		mapping = nullptr;
+	}
+
+	bool LiveMetricsReader::Read( MetricValues &metrics, uint32_t &writerProcess ) const {
+		if (block == nullptr || block->magic.load( std::memory_order_acquire ) != SharedMetricsBlock::MAGIC)
+			return false;
+		if (block->version.load( std::memory_order_relaxed ) != SharedMetricsBlock::VERSION)
+			return false;
+		size_t count = (std::min)( size_t(block->metricCount.load( std::memory_order_relaxed )), size_t(Metric::Count) );
+		for (int attempt = 0; attempt < 1000; ++attempt) {
+			uint64_t before = block->sequence.load( std::memory_order_acquire );
+			if (before & 1)
+				continue;
+			MetricValues read;
+			for (size_t i = 0; i < count; ++i) {
+				read.values[i] = block->values[i].load( std::memory_order_relaxed );
+			}
+			std::atomic_thread_fence( std::memory_order_acquire );
+			if (block->sequence.load( std::memory_order_relaxed ) == before) {
+				metrics = read;
+				writerProcess = block->writerProcess.load( std::memory_order_relaxed );
+				return true;
+			}
+		}
+		return false;
+	}
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace vr {
+	// New metrics are only ever appended, so that readers built against an older list keep working; readers
+	// show the metrics both sides know.
+	enum class Metric : uint32_t {
+		Frame,
+		// system clock, in microseconds since the epoch
+		UpdatedMicros,
+		FfrActive,
+		// 0 if FFR is off, 1 for radial density masking, 2 for variable rate shading
+		Mode,
+		SharpeningActive,
+		TextureWidth,
+		TextureHeight,
+		MasksLastFrame,
+		MasksTotal,
+		ViewsCreated,
+		Resets,
+		// only measured in debug mode
+		GpuPostProcessMicros,
+		// share of the target resolution's pixels that are shaded, in 1/1000
+		ShadedPixelsPermille,
+		VrsCallsIssued,
+		VrsCallsAvoided,
+		ForcedOutputWaits,
+		Count
+	};
+
+	const char * MetricName( Metric metric );
+
+	struct MetricValues {
+		uint64_t values[size_t(Metric::Count)] = {};
+
+		uint64_t & operator[]( Metric metric ) { return values[size_t(metric)]; }
+		uint64_t operator[]( Metric metric ) const { return values[size_t(metric)]; }
+	};
+
+	// The block in shared memory. A writer bumps the sequence to an odd value, stores the values and bumps it
+	// again; readers retry while it is odd or changed during their read. Everything is an atomic, which is
+	// address-free for these sizes and so works across processes.
+	struct SharedMetricsBlock {
+		static const uint32_t MAGIC = 0x4d52564f; // "OVRM"
+		static const uint32_t VERSION = 1;
+		static const uint32_t CAPACITY = 64;
+
+		std::atomic<uint32_t> magic;
+		std::atomic<uint32_t> version;
+		std::atomic<uint32_t> metricCount;
+		std::atomic<uint32_t> writerProcess;
+		std::atomic<uint64_t> sequence;
+		std::atomic<uint64_t> values[CAPACITY];
+	};
+	static_assert(size_t(Metric::Count) <= SharedMetricsBlock::CAPACITY, "too many metrics for the shared block");
+
+	class SharedMapping;
+
+	// Publishes metrics through named shared memory; "Local\<name>" on Windows, "/<name>" in POSIX shm.
+	// Not thread-safe, as there is one writer per frame.
+	class LiveMetricsWriter {
+	public:
+		LiveMetricsWriter();
+		LiveMetricsWriter( const LiveMetricsWriter & ) = delete;
+		LiveMetricsWriter & operator=( const LiveMetricsWriter & ) = delete;
+		~LiveMetricsWriter();
+
+		bool Open( const std::string &name, std::string &error );
+		void Close();
+		bool IsOpen() const { return block != nullptr; }
+		void Publish( const MetricValues &metrics );
+
+	private:
+		SharedMapping *mapping;
+		SharedMetricsBlock *block;
+	};
+
+	class LiveMetricsReader {
+	public:
+		LiveMetricsReader();
+		LiveMetricsReader( const LiveMetricsReader & ) = delete;
+		LiveMetricsReader & operator=( const LiveMetricsReader & ) = delete;
+		~LiveMetricsReader();
+
+		bool Open( const std::string &name, std::string &error );
+		void Close();
+		// returns false if there is no consistent snapshot yet, e.g. because the writer keeps interrupting us.
+		// Metrics the writer does not know are left at 0.
+		bool Read( MetricValues &metrics, uint32_t &writerProcess ) const;
+
+	private:
+		SharedMapping *mapping;
+		const SharedMetricsBlock *block;
+	};
+}
@@ -0,0 +1,310 @@
+#include "Logger.h"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace vr {
+	namespace {
+		struct RecordHeader {
+			uint64_t sequence;
+			uint32_t length;
+			LogLevel level;
+		};
+
+		std::atomic<uint64_t> nextLoggerId { 1 };
+
+		struct Record {
+			uint64_t sequence;
+			LogLevel level;
+			std::string text;
+
+			bool operator<( const Record &other ) const { return sequence < other.sequence; }
+		};
+
+		const char * LevelPrefix( LogLevel level ) {
+			switch (level) {
+			case LogLevel::Warning:
+				return "[warning] ";
+			case LogLevel::Error:
+				return "[error] ";
+			default:
+				return "";
+			}
+		}
+	}
+
+	// single producer, the owning thread, and single consumer, whoever holds the drain mutex
+	struct Logger::ThreadBuffer {
+		alignas(64) std::atomic<uint64_t> head { 0 };
+		alignas(64) std::atomic<uint64_t> tail { 0 };
+		std::atomic<bool> retired { false };
+		char data[BUFFER_SIZE];
+
+		void CopyIn( uint64_t position, const void *source, size_t size ) {
+			size_t offset = size_t(position % BUFFER_SIZE);
+			size_t first = (std::min)( size, BUFFER_SIZE - offset );
+			memcpy( data + offset, source, first );
+			memcpy( data, static_cast<const char*>(source) + first, size - first );
+		}
+
+		void CopyOut( uint64_t position, void *target, size_t size ) const {
+			size_t offset = size_t(position % BUFFER_SIZE);
+			size_t first = (std::min)( size, BUFFER_SIZE - offset );
+			memcpy( target, data + offset, first );
+			memcpy( static_cast<char*>(target) + first, data, size - first );
+		}
+
+		// returns false if the buffer is full
+		bool Push( const RecordHeader &header, const char *text ) {
+			uint64_t position = head.load( std::memory_order_relaxed );
+			uint64_t used = position - tail.load( std::memory_order_acquire );
+			if (sizeof(header) + header.length > BUFFER_SIZE - used)
+				return false;
+			CopyIn( position, &header, sizeof(header) );
+			CopyIn( position + sizeof(header), text, header.length );
+			head.store( position + sizeof(header) + header.length, std::memory_order_release );
+			return true;
+		}
+
+		void PopAll( std::vector<Record> &records ) {
+			uint64_t position = tail.load( std::memory_order_relaxed );
+			uint64_t end = head.load( std::memory_order_acquire );
+			while (position < end) {
+				RecordHeader header;
+				CopyOut( position, &header, sizeof(header) );
+				Record record;
+				record.sequence = header.sequence;
+				record.level = header.level;
+				record.text.resize( header.length );
+				if (header.length > 0)
+					CopyOut( position + sizeof(header), &record.text[0], header.length );
+				records.push_back( std::move( record ) );
+				position += sizeof(header) + header.length;
+			}
+			tail.store( position, std::memory_order_release );
+		}
+
+		bool Empty() const {
+			return head.load( std::memory_order_acquire ) == tail.load( std::memory_order_relaxed );
+		}
+	};
+
+	struct Logger::Shared {
+		uint64_t id = nextLoggerId.fetch_add( 1 );
+		std::unique_ptr<std::ostream> output;
+		std::chrono::milliseconds flushInterval { 100 };
+		std::atomic<uint64_t> sequence { 0 };
+		std::atomic<uint64_t> dropped { 0 };
+
+		std::mutex registryMutex;
+		std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+
+		// held while draining, so that Flush and the flusher thread do not race for the buffers and output
+		std::mutex drainMutex;
+		std::vector<Record> records;
+		uint64_t reportedDrops = 0;
+		bool atLineStart = true;
+
+		std::mutex wakeMutex;
+		std::condition_variable wakeup;
+		bool stopping = false;
+
+		void Drain() {
+			std::lock_guard<std::mutex> drainLock( drainMutex );
+			std::vector<std::shared_ptr<ThreadBuffer>> current;
+			{
+				std::lock_guard<std::mutex> lock( registryMutex );
+				current = buffers;
+			}
+			records.clear();
+			for (const std::shared_ptr<ThreadBuffer> &buffer : current) {
+				buffer->PopAll( records );
+			}
+			// each buffer is in order already, but the lines of different threads need merging
+			std::sort( records.begin(), records.end() );
+			for (const Record &record : records) {
+				if (atLineStart)
+					*output << LevelPrefix( record.level );
+				*output << record.text;
+				if (!record.text.empty())
+					atLineStart = record.text.back() == '\n';
+			}
+			uint64_t drops = dropped.load( std::memory_order_relaxed );
+			if (drops != reportedDrops) {
+				*output << (atLineStart ? "" : "\n") << "[warning] " << (drops - reportedDrops) << " log lines dropped because the log buffer was full\n";
+				reportedDrops = drops;
+				atLineStart = true;
+			}
+			if (!records.empty())
+				output->flush();
+
+			std::lock_guard<std::mutex> lock( registryMutex );
+			buffers.erase( std::remove_if( buffers.begin(), buffers.end(), []( const std::shared_ptr<ThreadBuffer> &buffer ) {
+				return buffer->retired.load( std::memory_order_acquire ) && buffer->Empty();
+			} ), buffers.end() );
+		}
+	};
+
+	namespace {
+		// buffers of the calling thread, one per logger; retired when the thread exits
+		struct ThreadBuffers {
+			std::vector<std::pair<uint64_t, std::shared_ptr<void>>> entries;
+			std::vector<std::atomic<bool>*> retiredFlags;
+
+			~ThreadBuffers() {
+				for (std::atomic<bool> *retired : retiredFlags) {
+					retired->store( true, std::memory_order_release );
+				}
+			}
+		};
+		thread_local ThreadBuffers threadBuffers;
+
+		// the stream LogLine formats into, reused by all lines of a thread
+		thread_local std::ostringstream threadStream;
+		thread_local bool threadStreamBusy = false;
+	}
+
+	Logger::Logger( std::unique_ptr<std::ostream> output, std::chrono::milliseconds flushInterval ) : shared( std::make_shared<Shared>() ) {
+		shared->output = std::move( output );
+		shared->flushInterval = flushInterval;
+		thread = std::thread( Run, shared );
+	}
+
+	Logger::~Logger() {
+		if (!thread.joinable()) {
+			// stopped before, so what was logged since is written here
+			shared->Drain();
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock( shared->wakeMutex );
+			shared->stopping = true;
+		}
+		shared->wakeup.notify_one();
+		// not stopped in time; the flusher may be stuck on the disk, and must not be joined while the DLL is unloading
+		thread.detach();
+	}
+
+	void Logger::Stop() {
+		if (!thread.joinable())
+			return;
+		{
+			std::lock_guard<std::mutex> lock( shared->wakeMutex );
+			shared->stopping = true;
+		}
+		shared->wakeup.notify_one();
+		thread.join();
+	}
+
+	void Logger::Start() {
+		if (thread.joinable())
+			return;
+		{
+			std::lock_guard<std::mutex> lock( shared->wakeMutex );
+			shared->stopping = false;
+		}
+		thread = std::thread( Run, shared );
+	}
+
+	Logger::ThreadBuffer & Logger::CurrentThreadBuffer() {
+		for (auto &entry : threadBuffers.entries) {
+			if (entry.first == shared->id)
+				return *static_cast<ThreadBuffer*>(entry.second.get());
+		}
+		std::shared_ptr<ThreadBuffer> buffer = std::make_shared<ThreadBuffer>();
+		{
+			std::lock_guard<std::mutex> lock( shared->registryMutex );
+			shared->buffers.push_back( buffer );
+		}
+		threadBuffers.entries.push_back( std::make_pair( shared->id, std::shared_ptr<void>( buffer ) ) );
+		threadBuffers.retiredFlags.push_back( &buffer->retired );
+		return *buffer;
+	}
+
+	bool Logger::Write( LogLevel level, const char *text, size_t length ) {
+		if (length == 0)
+			return true;
+		RecordHeader header;
+		header.sequence = shared->sequence.fetch_add( 1, std::memory_order_relaxed );
+		header.level = level;
+		// a single line may take at most half of the buffer
+		header.length = uint32_t((std::min)( length, BUFFER_SIZE / 2 ));
+		ThreadBuffer &buffer = CurrentThreadBuffer();
+		if (!buffer.Push( header, text )) {
+			shared->dropped.fetch_add( 1, std::memory_order_relaxed );
+			shared->wakeup.notify_one();
+			return false;
+		}
+		if (buffer.head.load( std::memory_order_relaxed ) - buffer.tail.load( std::memory_order_relaxed ) > BUFFER_SIZE / 2)
+			shared->wakeup.notify_one();
+		return true;
+	}
+
+	void Logger::Flush() {
+		shared->Drain();
+	}
+
+	uint64_t Logger::DroppedLines() const {
+		return shared->dropped.load( std::memory_order_relaxed );
+	}
+
+	void Logger::Run( std::shared_ptr<Shared> shared ) {
+		while (true) {
+			{
+				std::unique_lock<std::mutex> lock( shared->wakeMutex );
+				if (!shared->stopping)
+					shared->wakeup.wait_for( lock, shared->flushInterval );
+			}
+			shared->Drain();
+			std::lock_guard<std::mutex> lock( shared->wakeMutex );
+			if (shared->stopping)
+				break;
+		}
+	}
+
+	LogLine::LogLine( Logger *logger, LogLevel level ) : logger( logger ), level( level ), stream( nullptr ) {
+		if (logger == nullptr || !logger->IsEnabled( level ))
+			return;
+		if (threadStreamBusy) {
+			ownStream.reset( new std::ostringstream );
+			stream = ownStream.get();
+		} else {
+			threadStreamBusy = true;
+			stream = &threadStream;
+		}
+	}
+
+	LogLine::LogLine( LogLine &&other ) : logger( other.logger ), level( other.level ), stream( other.stream ), ownStream( std::move( other.ownStream ) ) {
+		other.stream = nullptr;
+	}
+
+	LogLine::~LogLine() {
+		if (stream == nullptr)
+			return;
+		std::string text = stream->str();
+		if (stream == &threadStream) {
+			threadStream.str( std::string() );
+			threadStream.clear();
+			// manipulators only apply to the line they were used in
+			threadStream.flags( std::ios_base::dec | std::ios_base::skipws );
+			threadStream.precision( 6 );
+			threadStream.fill( ' ' );
+			threadStreamBusy = false;
+		}
+		logger->Write( level, text.data(), text.size() );
+	}
+
+	bool LogRateLimit::Allow( uint64_t &suppressedBefore ) {
+		int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+		int64_t start = windowStart.load( std::memory_order_relaxed );
+		if (now - start >= 1000 && windowStart.compare_exchange_strong( start, now, std::memory_order_relaxed )) {
+			linesInWindow.store( 0, std::memory_order_relaxed );
+		}
+		if (linesInWindow.fetch_add( 1, std::memory_order_relaxed ) >= linesPerSecond) {
+			suppressed.fetch_add( 1, std::memory_order_relaxed );
+			return false;
+		}
+		suppressedBefore = suppressed.exchange( 0, std::memory_order_relaxed );
+		return true;
+	}
+}
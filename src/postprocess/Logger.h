@@ -0,0 +1,131 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+namespace vr {
+	enum class LogLevel : uint8_t {
+		Debug,
+		Info,
+		Warning,
+		Error,
+	};
+
+	// Each thread formats its lines into its own lock-free ring buffer; a background thread merges the buffers
+	// in the order the lines were written and writes them to the output. Logging therefore never waits for the
+	// disk, and lines of concurrent threads never interleave. A line that does not fit into its thread's buffer
+	// is dropped and counted.
+	class Logger {
+	public:
+		static const size_t BUFFER_SIZE = 64 * 1024;
+
+		explicit Logger( std::unique_ptr<std::ostream> output, std::chrono::milliseconds flushInterval = std::chrono::milliseconds( 100 ) );
+		Logger( const Logger & ) = delete;
+		Logger & operator=( const Logger & ) = delete;
+		~Logger();
+
+		void SetLevel( LogLevel level ) { minimumLevel.store( uint8_t(level), std::memory_order_relaxed ); }
+		bool IsEnabled( LogLevel level ) const { return uint8_t(level) >= minimumLevel.load( std::memory_order_relaxed ); }
+
+		// queues text written by the calling thread; returns false if it was dropped
+		bool Write( LogLevel level, const char *text, size_t length );
+		// writes everything queued so far before returning
+		void Flush();
+		// writes what was queued and ends the background thread, waiting for it; lines logged afterwards stay
+		// queued until Start or Flush. Neither may be called concurrently with the other.
+		void Stop();
+		// restarts the background thread after a Stop
+		void Start();
+		uint64_t DroppedLines() const;
+
+	private:
+		struct ThreadBuffer;
+		struct Shared;
+		std::shared_ptr<Shared> shared;
+		std::thread thread;
+		std::atomic<uint8_t> minimumLevel { uint8_t(LogLevel::Info) };
+
+		ThreadBuffer & CurrentThreadBuffer();
+		static void Run( std::shared_ptr<Shared> shared );
+	};
+
+	// Collects one message streamed into it and hands it to the logger when it goes out of scope, at the end
+	// of the statement. Disabled lines skip the formatting.
+	class LogLine {
+	public:
+		LogLine( Logger *logger, LogLevel level );
+		LogLine( LogLine &&other );
+		LogLine( const LogLine & ) = delete;
+		LogLine & operator=( const LogLine & ) = delete;
+		~LogLine();
+
+		template<typename T>
+		LogLine & operator<<( const T &value ) {
+			if (stream != nullptr)
+				*stream << value;
+			return *this;
+		}
+
+		// manipulators such as std::endl and std::hex; their effect ends with the line
+		LogLine & operator<<( std::ostream & (*manipulator)( std::ostream & ) ) {
+			if (stream != nullptr)
+				manipulator( *stream );
+			return *this;
+		}
+
+		LogLine & operator<<( std::ios_base & (*manipulator)( std::ios_base & ) ) {
+			if (stream != nullptr)
+				manipulator( *stream );
+			return *this;
+		}
+
+	private:
+		Logger *logger;
+		LogLevel level;
+		std::ostringstream *stream;
+		// set if the thread's shared stream was busy, e.g. when logging from within a streamed expression
+		std::unique_ptr<std::ostringstream> ownStream;
+	};
+
+	// written at the start of a rate limited line
+	struct SuppressedLines {
+		uint64_t count;
+	};
+
+	inline std::ostream & operator<<( std::ostream &out, SuppressedLines lines ) {
+		if (lines.count > 0)
+			out << "[" << lines.count << " similar lines suppressed] ";
+		return out;
+	}
+
+	// Limits how many lines a call site writes per second; lines over the limit are counted and reported
+	// along with the next line that is let through. Safe to share between threads.
+	class LogRateLimit {
+	public:
+		explicit LogRateLimit( uint32_t linesPerSecond ) : linesPerSecond( linesPerSecond ) {}
+
+		// returns whether the line may be written, and how many were suppressed before it
+		bool Allow( uint64_t &suppressedBefore );
+
+	private:
+		const uint32_t linesPerSecond;
+		// in milliseconds; the first line starts a window
+		std::atomic<int64_t> windowStart { -1000 };
+		std::atomic<uint32_t> linesInWindow { 0 };
+		std::atomic<uint64_t> suppressed { 0 };
+	};
+}
+
+// for lines that may repeat every frame; writes at most the given number of lines per second from this call site.
+// Expands to a call of Log(level), which Config.h declares.
+#define LOG_LIMITED(level, linesPerSecond) \
+	if (uint64_t logSuppressed_ = 0) {} \
+	else if (![] () -> vr::LogRateLimit & { static vr::LogRateLimit limit( linesPerSecond ); return limit; }().Allow( logSuppressed_ )) {} \
+	else Log( level ) << vr::SuppressedLines { logSuppressed_ }
@@ -0,0 +1,102 @@
+#pragma once
+#include <functional>
+#include <vector>
+
+namespace vr {
+	// Ring of output resources indexed by eye and frame. The compositor may still be reading the output
+	// of a previous Submit while we process the next eye or frame, so each (eye, frame % depth) pair gets
+	// its own slot. Slots are created lazily on first use and reused afterwards. A slot handed to the
+	// compositor is signalled after Submit; if it is due for reuse before that signal has passed, we have
+	// to wait for it, which is counted so that a too shallow ring shows up in the logs. The wait is bounded:
+	// once it gives up, the slot is reused anyway, as a torn frame beats stalling the game.
+	template<typename Slot>
+	class OutputRing {
+	public:
+		typedef std::function<void(Slot&)> SlotFn;
+		typedef std::function<bool(Slot&)> IsIdleFn;
+		// returns whether the signal passed before the wait gave up
+		typedef std::function<bool(Slot&)> WaitFn;
+
+		void Init( int depth, SlotFn create, SlotFn signal, IsIdleFn isIdle, WaitFn wait ) {
+			this->depth = depth < 1 ? 1 : depth;
+			this->create = create;
+			this->signal = signal;
+			this->isIdle = isIdle;
+			this->wait = wait;
+			entries.clear();
+			entries.resize( 2 * this->depth );
+			forcedWaits = 0;
+			abandonedWaits = 0;
+		}
+
+		// releases all slots; they will be recreated on their next use
+		void Reset() {
+			entries.clear();
+			entries.resize( 2 * depth );
+		}
+
+		int Depth() const { return depth; }
+
+		int SlotIndex( int eye, int frame ) const {
+			return eye * depth + frame % depth;
+		}
+
+		// returns the index of the slot to write for the given eye and frame, creating it if necessary
+		int Acquire( int eye, int frame ) {
+			int index = SlotIndex( eye, frame );
+			Entry &entry = entries[index];
+			if (!entry.created) {
+				create( entry.slot );
+				entry.created = true;
+			}
+			else if (entry.inFlight && !isIdle( entry.slot )) {
+				++forcedWaits;
+				if (!wait( entry.slot ))
+					++abandonedWaits;
+			}
+			entry.inFlight = false;
+			return index;
+		}
+
+		Slot & Get( int index ) {
+			return entries[index].slot;
+		}
+
+		// marks the slot as being read by the compositor until its signal has passed
+		void Submitted( int index ) {
+			Entry &entry = entries[index];
+			if (!entry.created)
+				return;
+			signal( entry.slot );
+			entry.inFlight = true;
+		}
+
+		template<typename Fn>
+		void ForEachCreated( Fn fn ) {
+			for (Entry &entry : entries) {
+				if (entry.created)
+					fn( entry.slot );
+			}
+		}
+
+		int ForcedWaits() const { return forcedWaits; }
+		// forced waits that gave up before the slot was idle
+		int AbandonedWaits() const { return abandonedWaits; }
+
+	private:
+		struct Entry {
+			Slot slot;
+			bool created = false;
+			bool inFlight = false;
+		};
+
+		int depth = 1;
+		std::vector<Entry> entries;
+		SlotFn create;
+		SlotFn signal;
+		IsIdleFn isIdle;
+		WaitFn wait;
+		int forcedWaits = 0;
+		int abandonedWaits = 0;
+	};
+}
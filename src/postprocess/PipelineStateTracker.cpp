@@ -0,0 +1,135 @@
+#include "PipelineStateTracker.h"
+#include <cstring>
+
+namespace vr {
+	void PipelineStateTracker::Snapshot::AddReferences() {
+		backend->AddReferences(groups, state);
+	}
+
+	void PipelineStateTracker::Snapshot::ReleaseReferences() {
+		if (groups != 0)
+			backend->ReleaseReferences(groups, state);
+		groups = 0;
+	}
+
+	void PipelineStateTracker::Attach( ID3D11DeviceContext *context ) {
+		this->context = context;
+		current = State();
+		known = 0;
+	}
+
+	void PipelineStateTracker::Detach() {
+		context = nullptr;
+		current = State();
+		known = 0;
+	}
+
+	void PipelineStateTracker::Save( ID3D11DeviceContext *context, Snapshot &snapshot, uint32_t groups ) {
+		snapshot.ReleaseReferences();
+		snapshot.backend = backend;
+		snapshot.context = context;
+		snapshot.groups = groups;
+
+		if (IsTracked(context)) {
+			uint32_t unknown = groups & ~known;
+			if (unknown) {
+				backend->ReadBack(context, unknown, current);
+				known |= unknown;
+				++stats.readbacks;
+			}
+			snapshot.state = current;
+		} else {
+			// other contexts may be used from other threads, so they are left out of the stats
+			backend->ReadBack(context, groups, snapshot.state);
+		}
+		snapshot.AddReferences();
+	}
+
+	void PipelineStateTracker::Restore( Snapshot &snapshot ) {
+		if (snapshot.context == nullptr)
+			return;
+
+		bool tracked = IsTracked(snapshot.context);
+		for (uint32_t group = 1; group & AllGroups; group <<= 1) {
+			if (!(snapshot.groups & group))
+				continue;
+			if (tracked && (known & group) && Matches(group, current, snapshot.state)) {
+				++stats.skipped;
+				continue;
+			}
+			// for the tracked context, the hooks pick up the re-issued state
+			snapshot.backend->Reissue(snapshot.context, group, snapshot.state);
+			if (tracked)
+				++stats.reissued;
+		}
+		snapshot.ReleaseReferences();
+		snapshot.context = nullptr;
+	}
+
+	void PipelineStateTracker::OnSetConstantBuffers( Stage stage, uint32_t startSlot, uint32_t numBuffers, ID3D11Buffer * const *buffers, bool withOffsets ) {
+		if (startSlot > 0 || numBuffers == 0)
+			return;
+		uint32_t group = stage == Stage_VS ? VSConstantBuffer : stage == Stage_PS ? PSConstantBuffer : CSConstantBuffer;
+		if (withOffsets) {
+			// we can't restore a buffer bound with an offset through the plain setter, so we leave it alone
+			known &= ~group;
+			return;
+		}
+		current.constantBuffer[stage] = buffers != nullptr ? buffers[0] : nullptr;
+		known |= group;
+	}
+
+	void PipelineStateTracker::OnSetSamplers( uint32_t startSlot, uint32_t numSamplers, ID3D11SamplerState * const *samplers ) {
+		if (startSlot > 0 || numSamplers == 0)
+			return;
+		current.csSampler = samplers != nullptr ? samplers[0] : nullptr;
+		known |= CSSampler;
+	}
+
+	void PipelineStateTracker::OnSetDepthStencilState( ID3D11DepthStencilState *state, uint32_t stencilRef ) {
+		current.depthStencilState = state;
+		current.stencilRef = stencilRef;
+		known |= DepthStencilState;
+	}
+
+	void PipelineStateTracker::OnSetViewports( uint32_t numViewports, const Viewport *viewports ) {
+		if (numViewports > MaxViewports || (numViewports > 0 && viewports == nullptr)) {
+			// invalid call which the runtime ignores
+			return;
+		}
+		current.numViewports = numViewports;
+		memcpy(current.viewports, viewports, numViewports * sizeof(Viewport));
+		known |= Viewports;
+	}
+
+	void PipelineStateTracker::OnClearState() {
+		current = State();
+		known = AllGroups;
+	}
+
+	void PipelineStateTracker::OnExecuteCommandList( bool restoreContextState ) {
+		// without restoring, the immediate context is left in its default state after the command list
+		if (!restoreContextState) {
+			OnClearState();
+		}
+	}
+
+	bool PipelineStateTracker::Matches( uint32_t group, const State &a, const State &b ) {
+		switch (group) {
+		case VertexShader: return a.vertexShader == b.vertexShader;
+		case PixelShader: return a.pixelShader == b.pixelShader;
+		case ComputeShader: return a.computeShader == b.computeShader;
+		case InputLayout: return a.inputLayout == b.inputLayout;
+		case PrimitiveTopology: return a.topology == b.topology;
+		case VSConstantBuffer: return a.constantBuffer[Stage_VS] == b.constantBuffer[Stage_VS];
+		case PSConstantBuffer: return a.constantBuffer[Stage_PS] == b.constantBuffer[Stage_PS];
+		case CSConstantBuffer: return a.constantBuffer[Stage_CS] == b.constantBuffer[Stage_CS];
+		case CSSampler: return a.csSampler == b.csSampler;
+		case RasterizerState: return a.rasterizerState == b.rasterizerState;
+		case DepthStencilState: return a.depthStencilState == b.depthStencilState && a.stencilRef == b.stencilRef;
+		case Viewports: return a.numViewports == b.numViewports
+			&& memcmp(a.viewports, b.viewports, a.numViewports * sizeof(Viewport)) == 0;
+		}
+		return false;
+	}
+}
@@ -0,0 +1,158 @@
+#pragma once
+#include <cstdint>
+
+struct ID3D11DeviceContext;
+struct ID3D11VertexShader;
+struct ID3D11PixelShader;
+struct ID3D11ComputeShader;
+struct ID3D11InputLayout;
+struct ID3D11Buffer;
+struct ID3D11SamplerState;
+struct ID3D11RasterizerState;
+struct ID3D11DepthStencilState;
+
+namespace vr {
+	class PipelineStateBackend;
+
+	// Mirrors the parts of the immediate context's pipeline state that our post-processing disturbs, as
+	// the game sets them through the hooked context methods. Saving state then is a copy of the shadow
+	// instead of a round of Get* calls, and restoring only re-issues the groups that actually changed.
+	// Only state that is not subject to the runtime's hazard tracking is mirrored: resource views and
+	// vertex/index buffers may be unbound by the runtime behind our back and must still be read back.
+	// A group whose shadow is unknown (before the first readback, or after SwapDeviceContextState or
+	// constant buffers bound with offsets) is read back on save and re-issued on restore.
+	// The context calls go through a PipelineStateBackend, so that the shadow and diff logic does not
+	// depend on D3D11 directly.
+	class PipelineStateTracker {
+	public:
+		enum Group : uint32_t {
+			VertexShader = 1 << 0,
+			PixelShader = 1 << 1,
+			ComputeShader = 1 << 2,
+			InputLayout = 1 << 3,
+			PrimitiveTopology = 1 << 4,
+			VSConstantBuffer = 1 << 5,
+			PSConstantBuffer = 1 << 6,
+			CSConstantBuffer = 1 << 7,
+			CSSampler = 1 << 8,
+			RasterizerState = 1 << 9,
+			DepthStencilState = 1 << 10,
+			Viewports = 1 << 11,
+			AllGroups = (1 << 12) - 1,
+		};
+
+		enum Stage { Stage_VS, Stage_PS, Stage_CS };
+
+		// laid out like D3D11_VIEWPORT
+		struct Viewport {
+			float topLeftX;
+			float topLeftY;
+			float width;
+			float height;
+			float minDepth;
+			float maxDepth;
+		};
+		static const uint32_t MaxViewports = 16;
+
+		struct State {
+			ID3D11VertexShader *vertexShader = nullptr;
+			ID3D11PixelShader *pixelShader = nullptr;
+			ID3D11ComputeShader *computeShader = nullptr;
+			ID3D11InputLayout *inputLayout = nullptr;
+			// a D3D11_PRIMITIVE_TOPOLOGY, 0 being undefined
+			uint32_t topology = 0;
+			// we only ever bind slot 0 of the constant buffers and samplers
+			ID3D11Buffer *constantBuffer[3] = { nullptr, nullptr, nullptr };
+			ID3D11SamplerState *csSampler = nullptr;
+			ID3D11RasterizerState *rasterizerState = nullptr;
+			ID3D11DepthStencilState *depthStencilState = nullptr;
+			uint32_t stencilRef = 0;
+			uint32_t numViewports = 0;
+			Viewport viewports[MaxViewports];
+		};
+
+		// saved state holds a reference to all objects in its groups, so that they survive being unbound by us
+		class Snapshot {
+		public:
+			Snapshot() {}
+			~Snapshot() { ReleaseReferences(); }
+			Snapshot(const Snapshot&) = delete;
+			Snapshot& operator=(const Snapshot&) = delete;
+
+		private:
+			friend class PipelineStateTracker;
+			PipelineStateBackend *backend = nullptr;
+			ID3D11DeviceContext *context = nullptr;
+			State state;
+			uint32_t groups = 0;
+
+			void AddReferences();
+			void ReleaseReferences();
+		};
+
+		struct Stats {
+			uint64_t readbacks = 0;
+			uint64_t reissued = 0;
+			uint64_t skipped = 0;
+		};
+
+		explicit PipelineStateTracker(PipelineStateBackend *backend) : backend(backend) {}
+
+		// the instance that works on the game's device, through D3D11PipelineBackend
+		static PipelineStateTracker& Instance();
+
+		// forgets the shadow, as it may not match what the new backend finds in the context
+		void SetBackend(PipelineStateBackend *backend) {
+			this->backend = backend;
+			known = 0;
+		}
+
+		// starts mirroring the given context; call once all state hooks are in place
+		void Attach(ID3D11DeviceContext *context);
+		void Detach();
+		bool IsTracked(ID3D11DeviceContext *context) const { return context != nullptr && context == this->context; }
+
+		// contexts that are not tracked are read back in full and restored in full
+		void Save(ID3D11DeviceContext *context, Snapshot &snapshot, uint32_t groups);
+		void Restore(Snapshot &snapshot);
+		const Stats & GetStats() const { return stats; }
+
+		// to be called from the context hooks after the original call went through; a group set in full is known from then on
+		void OnSetVertexShader(ID3D11VertexShader *shader) { current.vertexShader = shader; known |= VertexShader; }
+		void OnSetPixelShader(ID3D11PixelShader *shader) { current.pixelShader = shader; known |= PixelShader; }
+		void OnSetComputeShader(ID3D11ComputeShader *shader) { current.computeShader = shader; known |= ComputeShader; }
+		void OnSetInputLayout(ID3D11InputLayout *inputLayout) { current.inputLayout = inputLayout; known |= InputLayout; }
+		void OnSetPrimitiveTopology(uint32_t topology) { current.topology = topology; known |= PrimitiveTopology; }
+		void OnSetConstantBuffers(Stage stage, uint32_t startSlot, uint32_t numBuffers, ID3D11Buffer * const *buffers, bool withOffsets = false);
+		void OnSetSamplers(uint32_t startSlot, uint32_t numSamplers, ID3D11SamplerState * const *samplers);
+		void OnSetRasterizerState(ID3D11RasterizerState *state) { current.rasterizerState = state; known |= RasterizerState; }
+		void OnSetDepthStencilState(ID3D11DepthStencilState *state, uint32_t stencilRef);
+		void OnSetViewports(uint32_t numViewports, const Viewport *viewports);
+		void OnClearState();
+		void OnExecuteCommandList(bool restoreContextState);
+		void OnSwapDeviceContextState() { known = 0; }
+
+	private:
+		PipelineStateBackend *backend;
+		ID3D11DeviceContext *context = nullptr;
+		State current;
+		// groups for which the shadow state is known to match the context
+		uint32_t known = 0;
+		Stats stats;
+
+		static bool Matches(uint32_t group, const State &a, const State &b);
+	};
+
+	// the context calls behind saving and restoring state
+	class PipelineStateBackend {
+	public:
+		virtual ~PipelineStateBackend() {}
+		// fills in the given groups from the context, without holding a reference on the objects
+		virtual void ReadBack(ID3D11DeviceContext *context, uint32_t groups, PipelineStateTracker::State &state) = 0;
+		// sets a single group on the context
+		virtual void Reissue(ID3D11DeviceContext *context, uint32_t group, const PipelineStateTracker::State &state) = 0;
+		// references held by a snapshot on the objects in its groups
+		virtual void AddReferences(uint32_t groups, const PipelineStateTracker::State &state) = 0;
+		virtual void ReleaseReferences(uint32_t groups, const PipelineStateTracker::State &state) = 0;
+	};
+}
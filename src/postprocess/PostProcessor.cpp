@@ -4,7 +4,9 @@
 #include <d3d11.h>
 #include <wrl/client.h>
 #define A_CPU
+#include <chrono>
 #include <iomanip>
+#include <sstream>
 
 #include "nis/NIS_Config.h"
 #include "Config.h"
@@ -12,25 +14,101 @@
 #include "shader_rdm_fullscreen_tri.h"
 #include "shader_rdm_mask.h"
 #include "shader_rdm_reconstruction.h"
+#include "shader_capture_downsample.h"
 #include "VrHooks.h"
+#include "PipelineStateTracker.h"
+#include "Trace.h"
 
 #define WIN32_LEAN_AND_MEAN
 #include <Windows.h>
 
-#include "ScreenGrab11.h"
 #include "vrs/VariableRateShading.h"
 
 using Microsoft::WRL::ComPtr;
 
-#define LOG_RATE if (frameCount % 200 == 0) Log()
-
 namespace vr {
+	const GUID InputViewCacheTag = { 0x5d81833f, 0x8bf0, 0x45e6, { 0x9b, 0x21, 0x61, 0xa0, 0xee, 0x4f, 0x1d, 0x87 } };
+	const GUID DepthStencilViewCacheTag = { 0xb4d295b4, 0x6e4f, 0x4508, { 0x90, 0x6b, 0x66, 0x3e, 0x54, 0xf9, 0x33, 0xa8 } };
+
+	const GUID RenderTargetClassTag = { 0x84bdb4ba, 0x43bf, 0x4baf, { 0x80, 0xfb, 0x30, 0x3b, 0x5e, 0x0b, 0xbe, 0x79 } };
+	const GUID DepthTargetClassTag = { 0x982ef588, 0xf290, 0x4077, { 0x84, 0x3e, 0x2e, 0xaa, 0x09, 0x30, 0xdf, 0xfd } };
+	const GUID WarmupConsideredTag = { 0x3c7a9e51, 0x2d64, 0x4f0b, { 0xa5, 0x8e, 0x17, 0xc2, 0x4b, 0x90, 0x6d, 0x3f } };
+	const GUID DepthTargetEyeTag = { 0x6f1d2c84, 0x95a3, 0x4e7b, { 0xb2, 0x0c, 0x5e, 0x71, 0xd8, 0x43, 0xa9, 0x16 } };
+
+	uint64_t PrivateDataTagger::GetTag(ID3D11DeviceChild *object) {
+		uint64_t tag = 0;
+		UINT size = sizeof(tag);
+		if (FAILED(object->GetPrivateData( guid, &size, &tag )) || size != sizeof(tag))
+			return 0;
+		return tag;
+	}
+
+	void PrivateDataTagger::SetTag(ID3D11DeviceChild *object, uint64_t tag) {
+		object->SetPrivateData( guid, sizeof(tag), &tag );
+	}
+
+	// each deferred context tags what it caches under its own GUIDs, so that the caches don't invalidate each other
+	GUID DeferredContextCacheTag(const GUID &base, uint32_t id) {
+		GUID tag = base;
+		tag.Data1 ^= id;
+		return tag;
+	}
+
+	uint32_t NextDeferredContextId() {
+		static std::atomic<uint32_t> counter { 0 };
+		return ++counter;
+	}
+
+	PostProcessor::DeferredContextState::DeferredContextState() : DeferredContextState( NextDeferredContextId() ) {}
+
+	PostProcessor::DeferredContextState::DeferredContextState(uint32_t id)
+		: depthTargetClasses( PrivateDataTagger( DeferredContextCacheTag( DepthTargetClassTag, id ) ) )
+		, depthStencilViews( PrivateDataTagger( DeferredContextCacheTag( DepthStencilViewCacheTag, id ) ) ) {}
+
+	void PostProcessor::DeferredContextState::Reset() {
+		depthTargetClasses.Clear();
+		depthStencilViews.Clear();
+		validated = false;
+		usable = false;
+		maskedClears = 0;
+	}
+
+	// Bindings read back with the Get* calls, which hand out a reference on each object. The runtime's hazard
+	// tracking unbinds views and buffers without going through the hooked setters, so these can't be mirrored
+	// by the state tracker; the references are dropped once the bindings were re-issued.
+	template<typename T, size_t N>
+	struct BoundObjects {
+		T *objects[N] = {};
+
+		BoundObjects() {}
+		BoundObjects(const BoundObjects&) = delete;
+		BoundObjects& operator=(const BoundObjects&) = delete;
+		~BoundObjects() {
+			for (T *object : objects) {
+				if (object)
+					object->Release();
+			}
+		}
+	};
+
 	void CheckResult(const std::string &operation, HRESULT result) {
 		if (FAILED(result)) {
-			Log() << "Failed (" << std::hex << result << std::dec << "): " << operation << std::endl;
+			Log(LogLevel::Error) << "Failed (" << std::hex << result << std::dec << "): " << operation << "\n";
 			throw std::exception();
 		}
 	}
+
+	// what the warm-up worker creates for an object
+	enum WarmupKind : uint32_t {
+		WarmupDeviceResources,
+		WarmupInputViews,
+		WarmupDepthStencilViews,
+	};
+
+	ResourceWarmup::Key WarmupKey(const void *object, WarmupKind kind) {
+		ResourceWarmup::Key key = { object, kind };
+		return key;
+	}
 	
 	DXGI_FORMAT TranslateTypelessFormats(DXGI_FORMAT format) {
 		switch (format) {
@@ -141,15 +219,25 @@ namespace vr {
 		Log() << "Projection center for eye " << eye << ": " << x << ", " << y << "\n";
 	}
 
-	void PostProcessor::Apply(EVREye eEye, const Texture_t *pTexture, const VRTextureBounds_t* pBounds, EVRSubmitFlags nSubmitFlags) {
-		if (Config::Instance().hotkeysEnabled) {
-			CheckHotkeys();
+	const VRTextureBounds_t * PostProcessor::Apply(EVREye eEye, const Texture_t *pTexture, const VRTextureBounds_t* pBounds, EVRSubmitFlags nSubmitFlags) {
+		TRACE_THREAD_NAME("Submit");
+		if (FrameConfig().hotkeysEnabled) {
+			ProcessHotkeys();
+		}
+		if (eyeCount == 0) {
+			CheckConfigReload();
+			RefreshFrameConfig();
+		}
+		if ((!enabled || !FrameConfig().ffrEnabled) && eEye == Eye_Left) {
+			// frames are only counted while processing, but monitors should still see that we are inactive
+			PublishMetrics();
 		}
 
 		if (!enabled || pTexture == nullptr || pTexture->eType != TextureType_DirectX || pTexture->handle == nullptr) {
-			return;
+			return pBounds;
 		}
 
+		const VRTextureBounds_t *submittedBounds = pBounds;
 		static VRTextureBounds_t defaultBounds { 0, 0, 1, 1 };
 		if (pBounds == nullptr) {
 			pBounds = &defaultBounds;
@@ -157,114 +245,498 @@ namespace vr {
 
 		ID3D11Texture2D *texture = (ID3D11Texture2D*)pTexture->handle;
 
-		if ( Config::Instance().ffrEnabled ) {
-			if (initialized) {
-				D3D11_TEXTURE2D_DESC td;
-				texture->GetDesc(&td);
-				if (td.Width != textureWidth || td.Height != textureHeight) {
-					Log() << "Texture size changed, recreating resources...\n";
-					Reset();
+		if ( FrameConfig().ffrEnabled ) {
+			try {
+				if (initialized) {
+					D3D11_TEXTURE2D_DESC td;
+					texture->GetDesc(&td);
+					if (td.Width != textureWidth || td.Height != textureHeight) {
+						Resize(td.Width, td.Height);
+					}
 				}
-			}
-			if (!initialized) {
-				try {
+				if (!initialized) {
 					textureContainsOnlyOneEye = std::abs(pBounds->uMax - pBounds->uMin) > .5f;
 					PrepareResources(texture, pTexture->eColorSpace);
-				} catch (...) {
-					Log() << "Resource creation failed, disabling\n";
-					enabled = false;
-					return;
 				}
+			} catch (...) {
+				Log(LogLevel::Error) << "Resource creation failed, disabling\n";
+				enabled = false;
+				PauseDeferredContexts();
+				return submittedBounds;
 			}
 
-			ApplyPostProcess(eEye, texture, pBounds);
+			bool alreadyProcessed = false;
+			if (batchedEyePending) {
+				batchedEyePending = false;
+				if (texture == lastSubmittedTexture && BoundsMatch(*pBounds, predictedBounds)) {
+					// this eye was already handled by the batched processing on the previous Submit
+					alreadyProcessed = true;
+					outputTexture = eyeOutputs[eEye].texture;
+					outputTextureSize = eyeOutputs[eEye].size;
+					currentOutput = eyeOutputs[eEye].slot;
+				} else {
+					Log() << "Submitted eye does not match the expected layout of both eyes, disabling batched processing\n";
+					eyeBatching = EyeBatching::None;
+				}
+			}
+
+			if (!alreadyProcessed) {
+				ApplyPostProcess(eEye, texture, pBounds, eyeBatching);
+				if (eyeBatching != EyeBatching::None) {
+					batchedEyePending = true;
+					predictedBounds = PredictOtherEyeBounds(eyeBatching, eEye, *pBounds);
+				}
+			}
 			lastSubmittedTexture = texture;
+			eyeInference.OnSubmit( eEye, EyeInference::TargetId(texture) );
 			eyeCount = (eyeCount + 1) % 2;
 			if (eyeCount == 0) {
-				depthClearCount = 0;
 				++frameCount;
+				TRACE_NEXT_FRAME();
+				PublishMetrics();
+				PollCaptures();
+				PollRecording();
+				eyeInference.OnFrameEnd();
+				if (eyeInference.ActiveSchedule() != loggedSchedule) {
+					loggedSchedule = eyeInference.ActiveSchedule();
+					Log() << "Eye render schedule: " << EyeInference::ScheduleName( loggedSchedule ) << "\n";
+				}
+				frameSchedule.OnFrameEnd();
+				if (frameSchedule.IsLearned() != loggedScheduleLearned) {
+					loggedScheduleLearned = frameSchedule.IsLearned();
+					if (loggedScheduleLearned)
+						Log() << "Learned depth clear schedule, masking " << frameSchedule.SceneClearsPerFrame() << " scene clears per frame\n";
+					else
+						Log() << "Depth clear schedule changed, masking all qualifying clears until relearned\n";
+				}
+				if (!loggedDeferredMasks && deferredMasks.load( std::memory_order_relaxed ) > 0) {
+					loggedDeferredMasks = true;
+					Log() << "Recording RDM mask into command lists of " << deferredContexts.Size() << " deferred contexts\n";
+				}
+				if (!loggedDeferredRegistryFull && deferredRegistryFull.load( std::memory_order_relaxed )) {
+					loggedDeferredRegistryFull = true;
+					Log() << "Too many deferred contexts, some of them are left unmasked\n";
+				}
+				if (useVariableRateShading) {
+					if (FrameConfig().debugMode) {
+						const VrsCallStats &vrsStats = VariableRateShading::Instance().StateTracker().LastFrameStats();
+						LOG_LIMITED(LogLevel::Info, 1) << "VRS driver calls in last frame: " << vrsStats.issued << " issued, " << vrsStats.avoided << " avoided\n";
+					}
+					VariableRateShading::Instance().EndFrame();
+				}
 			}
 			const_cast<Texture_t*>(pTexture)->handle = outputTexture;
 			const_cast<Texture_t*>(pTexture)->eColorSpace = inputIsSrgb ? ColorSpace_Gamma : ColorSpace_Auto;
+
+			if (outputTexture != texture && (outputTextureSize.width != textureWidth || outputTextureSize.height != textureHeight)) {
+				// the output texture is larger than the submitted one, so restrict the bounds to the area we wrote
+				float scaleU = float(textureWidth) / outputTextureSize.width;
+				float scaleV = float(textureHeight) / outputTextureSize.height;
+				VRTextureBounds_t &bounds = outputBounds[eEye];
+				bounds.uMin = pBounds->uMin * scaleU;
+				bounds.uMax = pBounds->uMax * scaleU;
+				bounds.vMin = pBounds->vMin * scaleV;
+				bounds.vMax = pBounds->vMax * scaleV;
+				return &bounds;
+			}
+		}
+
+		return submittedBounds;
+	}
+
+	void PostProcessor::Resize( uint32_t width, uint32_t height ) {
+		Log() << "Texture size changed from " << textureWidth << "x" << textureHeight << " to " << width << "x" << height << "\n";
+		PauseDeferredContexts();
+		textureWidth = width;
+		textureHeight = height;
+		// deferred contexts drop their caches on their next use
+		layoutGeneration.fetch_add( 1, std::memory_order_relaxed );
+		// the game most likely recreated its textures, so the views we have are of no further use
+		inputTextureViews.Clear();
+		depthStencilViews.Clear();
+		warmup.Clear();
+		++warmupGeneration;
+		// classification depends on the submitted texture size
+		renderTargetClasses.Clear();
+		depthTargetClasses.Clear();
+		eyeInference.Reset();
+		frameSchedule.Reset();
+		loggedScheduleLearned = false;
+		singleEyeTargetBound = false;
+		batchedEyePending = false;
+
+		if (requiresCopy) {
+			PrepareCopyResources(inputFormat);
+		}
+
+		// keep the output textures if the pool would still hand them out for the new size
+		bool keepOutput = true;
+		outputRing.ForEachCreated( [&](OutputTextures &output) {
+			if (output.rdmReconstructedTexture && !texturePool.Serves( output.rdmReconstructedSize, width, height ))
+				keepOutput = false;
+			if (output.sharpenedTexture && !texturePool.Serves( output.sharpenedSize, width, height ))
+				keepOutput = false;
+		});
+		if (!keepOutput) {
+			ReleaseOutputTextures();
+			// released textures are of the wrong size, so they would only hold on to memory
+			texturePool.Trim();
+		}
+
+		if (!useVariableRateShading) {
+			CalculateSavedPixelCount();
 		}
+
+		const PoolStats &stats = texturePool.Stats();
+		Log() << "Texture pool: " << stats.hits << " hits, " << stats.misses << " misses, " << (stats.bytesAllocated >> 20) << " MB allocated\n";
+		LogWarmupStats();
+		ResumeDeferredContexts();
 	}
 
 	void PostProcessor::ApplyFixedFoveatedRendering( ID3D11DepthStencilView *depthStencilView, float depth, uint8_t stencil ) {
-		if (!enabled || depthStencilView == nullptr || useVariableRateShading) {
+		if (!enabled || depthStencilView == nullptr) {
 			return;
 		}
 
-		ComPtr<ID3D11Resource> resource;
-		depthStencilView->GetResource(resource.GetAddressOf());
-		if (resource.Get() == nullptr) {
-			return;
+		const ClassifiedTarget &target = ClassifyDepthStencilView( depthTargetClasses, depthStencilView );
+		if (target.targetClass == TargetClass::SingleEye) {
+			eyeInference.OnDepthClear();
+			EVREye eye;
+			if (eyeInference.CurrentEye( eye ))
+				LearnDepthTargetEye( target.texture, eye );
 		}
-		D3D11_TEXTURE2D_DESC texDesc;
-		((ID3D11Texture2D*)resource.Get())->GetDesc(&texDesc);
 
-		if (texDesc.Width < textureWidth || texDesc.Height < textureHeight) {
-			// smaller than submitted texture size, so not the correct render target
+		if (useVariableRateShading) {
+			// a new pass may have started for the other eye
+			if (singleEyeTargetBound) {
+				ApplySingleEyeVRS( boundSingleEyeTarget );
+			}
 			return;
 		}
 
-		if (texDesc.Width == texDesc.Height) {
-			// this is probably the shadow map or something similar
+		int maskOrdinal;
+		switch (target.targetClass) {
+		case TargetClass::Combined:
+		case TargetClass::Array:
+		case TargetClass::SingleEye:
+			if (frameSchedule.OnDepthClear( FrameSchedule::TargetId(target.texture), maskOrdinal )) {
+				EVREye eye = Eye_Left;
+				if (target.targetClass == TargetClass::SingleEye && !eyeInference.CurrentEye( eye )) {
+					// a mask centred on the wrong eye would remove pixels the player looks at, so none until the eye is known
+					break;
+				}
+				ApplyRadialDensityMask( context.Get(), depthStencilViews, FrameConfig(), target, eye, depth, stencil );
+				++masksThisFrame;
+			}
+			break;
+		default:
+			// too small, probably a shadow map or otherwise known to be irrelevant
+			break;
+		}
+	}
+
+	void PostProcessor::ApplyFixedFoveatedRenderingDeferred( ID3D11DeviceContext *ctx, ID3D11DepthStencilView *depthStencilView, float depth, uint8_t stencil ) {
+		DeferredContextState *state = depthStencilView != nullptr ? BeginDeferredCall( ctx ) : nullptr;
+		if (state == nullptr)
 			return;
+		// the order of command lists is only known when they are executed, so there is no frame schedule to
+		// learn here and every qualifying clear is masked
+		const ClassifiedTarget &target = ClassifyDepthStencilView( state->depthTargetClasses, depthStencilView );
+		EVREye eye = Eye_Left;
+		switch (target.targetClass) {
+		case TargetClass::SingleEye:
+			// the eye the inference placed the target in on the immediate context; unknown or shared targets are left alone
+			if (!LearnedDepthTargetEye( target.texture, eye ))
+				break;
+			// fall through
+		case TargetClass::Combined:
+		case TargetClass::Array:
+			ApplyRadialDensityMask( ctx, state->depthStencilViews, state->config->value, target, eye, depth, stencil );
+			++state->maskedClears;
+			deferredMasks.fetch_add( 1, std::memory_order_relaxed );
+			break;
+		default:
+			break;
 		}
+		EndDeferredCall( ctx );
+	}
 
-		ApplyRadialDensityMask( (ID3D11Texture2D*)resource.Get(), depth, stencil);
+	void PostProcessor::LearnDepthTargetEye( ID3D11Texture2D *texture, EVREye eye ) {
+		uint64_t generation = layoutGeneration.load( std::memory_order_relaxed );
+		uint64_t tag = depthTargetEyes.GetTag( texture );
+		uint64_t eyes = (tag >> 2) == generation ? tag & 3 : 0;
+		uint64_t learned = (generation << 2) | eyes | (1ull << eye);
+		if (learned != tag)
+			depthTargetEyes.SetTag( texture, learned );
 	}
 
-	void PostProcessor::OnRenderTargetChange( UINT numViews, ID3D11RenderTargetView * const *renderTargetViews ) {
-		if (!enabled || numViews == 0 || renderTargetViews[0] == nullptr || !useVariableRateShading) {
+	bool PostProcessor::LearnedDepthTargetEye( ID3D11Texture2D *texture, EVREye &eye ) {
+		uint64_t tag = depthTargetEyes.GetTag( texture );
+		if ((tag >> 2) != layoutGeneration.load( std::memory_order_relaxed ))
+			return false;
+		switch (tag & 3) {
+		case 1: eye = Eye_Left; return true;
+		case 2: eye = Eye_Right; return true;
+		default: return false;
+		}
+	}
+
+	void PostProcessor::OnDeferredContextCreated( ID3D11DeviceContext *ctx ) {
+		// a new context may have been created at the address of a destroyed one
+		if (DeferredContextState *state = BeginDeferredCall( ctx )) {
+			state->Reset();
+			EndDeferredCall( ctx );
+		}
+	}
+
+	void PostProcessor::OnCommandListFinished( ID3D11DeviceContext *ctx ) {
+		if (DeferredContextState *state = BeginDeferredCall( ctx )) {
+			state->maskedClears = 0;
+			EndDeferredCall( ctx );
+		}
+	}
+
+	PostProcessor::DeferredContextState * PostProcessor::BeginDeferredCall( ID3D11DeviceContext *ctx ) {
+		DeferredContextState *state = deferredContexts.Enter( ctx );
+		if (state == nullptr) {
+			if (deferredContexts.IsOpen() && deferredContexts.IsFull())
+				deferredRegistryFull.store( true, std::memory_order_relaxed );
+			return nullptr;
+		}
+		uint32_t generation = layoutGeneration.load( std::memory_order_relaxed );
+		if (state->layoutGeneration != generation) {
+			state->Reset();
+			state->layoutGeneration = generation;
+		}
+		if (!state->validated) {
+			ComPtr<ID3D11Device> contextDevice;
+			ctx->GetDevice( contextDevice.GetAddressOf() );
+			state->usable = ctx->GetType() == D3D11_DEVICE_CONTEXT_DEFERRED && contextDevice.Get() == device.Get();
+			state->validated = true;
+		}
+		if (!state->usable) {
+			deferredContexts.Leave( ctx );
+			return nullptr;
+		}
+		Config::Published().Refresh( state->config );
+		return state;
+	}
+
+	void PostProcessor::EndDeferredCall( ID3D11DeviceContext *ctx ) {
+		deferredContexts.Leave( ctx );
+	}
+
+	void PostProcessor::PauseDeferredContexts() {
+		deferredContexts.Close();
+	}
+
+	void PostProcessor::ResumeDeferredContexts() {
+		if (enabled && initialized && !useVariableRateShading && rdmMaskingShader != nullptr)
+			deferredContexts.Open();
+		else
+			deferredContexts.Close();
+	}
+
+	void PostProcessor::OnRenderTargetChange( UINT numViews, ID3D11RenderTargetView * const *renderTargetViews, ID3D11DepthStencilView *depthStencilView ) {
+		singleEyeTargetBound = false;
+		if (enabled && initialized && FrameConfig().warmUp) {
+			// targets seen for the first time get their views created in the background, long before
+			// they are submitted or, if bound before they are cleared, a little before they are masked
+			if (numViews > 0 && renderTargetViews[0] != nullptr && renderTargetClasses.Find( renderTargetViews[0] ) == nullptr) {
+				const ClassifiedTarget &target = ClassifyRenderTargetView( renderTargetViews[0] );
+				if (target.targetClass == TargetClass::Combined || target.targetClass == TargetClass::Array || target.targetClass == TargetClass::SingleEye)
+					WarmUpInputViews( target.texture );
+			}
+			if (depthStencilView != nullptr && !useVariableRateShading && depthTargetClasses.Find( depthStencilView ) == nullptr) {
+				const ClassifiedTarget &target = ClassifyDepthStencilView( depthTargetClasses, depthStencilView );
+				if (target.targetClass == TargetClass::Combined || target.targetClass == TargetClass::Array || target.targetClass == TargetClass::SingleEye)
+					WarmUpDepthStencilViews( target.texture );
+			}
+		}
+		if (enabled && !useVariableRateShading && frameSchedule.IsScoring() && depthStencilView != nullptr && numViews > 0 && renderTargetViews[0] != nullptr) {
+			TargetClass colorClass = ClassifyRenderTargetView( renderTargetViews[0] ).targetClass;
+			bool qualifies = colorClass == TargetClass::Combined || colorClass == TargetClass::Array || colorClass == TargetClass::SingleEye;
+			if (qualifies) {
+				frameSchedule.OnTargetsBound( FrameSchedule::TargetId(ClassifyDepthStencilView( depthTargetClasses, depthStencilView ).texture), true );
+			}
+		}
+		if (!enabled || numViews == 0 || renderTargetViews[0] == nullptr) {
+			if (!issuingOwnCalls)
+				eyeInference.OnTargetBound( 0 );
 			VariableRateShading::Instance().DisableVRS();
 			return;
 		}
 
-		ComPtr<ID3D11Resource> resource;
-		renderTargetViews[0]->GetResource( resource.GetAddressOf() );
-		D3D11_RENDER_TARGET_VIEW_DESC rtd;
-		renderTargetViews[0]->GetDesc( &rtd );
-		if (rtd.ViewDimension != D3D11_RTV_DIMENSION_TEXTURE2D && rtd.ViewDimension != D3D11_RTV_DIMENSION_TEXTURE2DARRAY
-				&& rtd.ViewDimension != D3D11_RTV_DIMENSION_TEXTURE2DMS && rtd.ViewDimension != D3D11_RTV_DIMENSION_TEXTURE2DMSARRAY) {
+		const ClassifiedTarget &target = ClassifyRenderTargetView( renderTargetViews[0] );
+		// the radial density mask relies on the current eye as well, so binds are seen in either mode
+		if (!issuingOwnCalls)
+			eyeInference.OnTargetBound( target.targetClass == TargetClass::SingleEye ? EyeInference::TargetId(target.texture) : 0 );
+		if (!useVariableRateShading) {
 			VariableRateShading::Instance().DisableVRS();
 			return;
 		}
-		ID3D11Texture2D *tex = (ID3D11Texture2D*)resource.Get();
-		D3D11_TEXTURE2D_DESC td;
-		tex->GetDesc( &td );
+		switch (target.targetClass) {
+		case TargetClass::Combined:
+			TRACE_INSTANT("VRS combined target");
+			VariableRateShading::Instance().ApplyCombinedVRS( target.desc.width, target.desc.height, projX[0], projY[0], projX[1], projY[1] );
+			break;
+		case TargetClass::Array:
+			TRACE_INSTANT("VRS array target");
+			VariableRateShading::Instance().ApplyArrayVRS( target.desc.width, target.desc.height, projX[0], projY[0], projX[1], projY[1] );
+			break;
+		case TargetClass::SingleEye:
+			TRACE_INSTANT("VRS single eye target");
+			singleEyeTargetBound = true;
+			boundSingleEyeTarget = target;
+			ApplySingleEyeVRS( target );
+			break;
+		default:
+			VariableRateShading::Instance().DisableVRS();
+			break;
+		}
+	}
 
-		if (td.Width == td.Height) {
-			// probably the shadow map
+	void PostProcessor::ApplySingleEyeVRS( const ClassifiedTarget &target ) {
+		EVREye eye;
+		if (!eyeInference.CurrentEye( eye )) {
 			VariableRateShading::Instance().DisableVRS();
 			return;
 		}
+		float centerX = projX[eye];
+		float centerY = projY[eye];
+		eyeInference.ProjectionCenter( eye, target.desc.width, target.desc.height, centerX, centerY );
+		VariableRateShading::Instance().ApplySingleEyeVRS( eye, target.desc.width, target.desc.height, centerX, centerY );
+	}
 
-		if (textureContainsOnlyOneEye && td.Width >= 2 * textureWidth && td.Height >= textureHeight) {
-			VariableRateShading::Instance().ApplyCombinedVRS( td.Width, td.Height, projX[0], projY[0], projX[1], projY[1] );
-		}
-		else if (!textureContainsOnlyOneEye && td.Width >= textureWidth && td.Height >= textureHeight) {
-			VariableRateShading::Instance().ApplyCombinedVRS( td.Width, td.Height, projX[0], projY[0], projX[1], projY[1] );
+	void PostProcessor::OnViewportChange( UINT numViewports, const D3D11_VIEWPORT *viewports ) {
+		if (!enabled || issuingOwnCalls || numViewports == 0 || viewports == nullptr)
+			return;
+		ViewportRect viewport;
+		viewport.x = viewports[0].TopLeftX;
+		viewport.y = viewports[0].TopLeftY;
+		viewport.width = viewports[0].Width;
+		viewport.height = viewports[0].Height;
+		eyeInference.OnViewport( viewport );
+	}
+
+	SubmitLayout PostProcessor::CurrentSubmitLayout() const {
+		SubmitLayout layout;
+		layout.textureWidth = textureWidth;
+		layout.textureHeight = textureHeight;
+		layout.textureContainsOnlyOneEye = textureContainsOnlyOneEye;
+		return layout;
+	}
+
+	const PostProcessor::ClassifiedTarget & PostProcessor::ClassifyRenderTargetView( ID3D11RenderTargetView *view ) {
+		if (const ClassifiedTarget *cached = renderTargetClasses.Find( view ))
+			return *cached;
+
+		ClassifiedTarget &target = renderTargetClasses.Insert( view );
+		D3D11_RENDER_TARGET_VIEW_DESC rtd;
+		view->GetDesc( &rtd );
+		target.desc.isTexture2D = rtd.ViewDimension == D3D11_RTV_DIMENSION_TEXTURE2D || rtd.ViewDimension == D3D11_RTV_DIMENSION_TEXTURE2DARRAY
+				|| rtd.ViewDimension == D3D11_RTV_DIMENSION_TEXTURE2DMS || rtd.ViewDimension == D3D11_RTV_DIMENSION_TEXTURE2DMSARRAY;
+		if (target.desc.isTexture2D) {
+			ComPtr<ID3D11Resource> resource;
+			view->GetResource( resource.GetAddressOf() );
+			target.texture = (ID3D11Texture2D*)resource.Get();
+			D3D11_TEXTURE2D_DESC td;
+			target.texture->GetDesc( &td );
+			target.desc.width = td.Width;
+			target.desc.height = td.Height;
+			target.desc.arraySize = td.ArraySize;
 		}
-		else if (textureContainsOnlyOneEye && td.ArraySize == 2 && td.Width >= textureWidth && td.Height >= textureHeight) {
-			VariableRateShading::Instance().ApplyArrayVRS( td.Width, td.Height, projX[0], projY[0], projX[1], projY[1] );
+		target.targetClass = ClassifyRenderTarget( target.desc, CurrentSubmitLayout() );
+		return target;
+	}
+
+	bool HasBlacklistedTextureName(ID3D11Texture2D *tex) {
+		// used to ignore certain depth textures that we know are not relevant for us
+		// currently found in some older Unity games
+		char debugName[255] = { 0 };
+		UINT bufferSize = 255;
+		tex->GetPrivateData( WKPDID_D3DDebugObjectName, &bufferSize, debugName );
+		if (strncmp( debugName, "Camera DepthTexture", 255 ) == 0) {
+			return true;
 		}
-		else if (textureContainsOnlyOneEye && td.ArraySize == 1 && td.Width >= textureWidth && td.Height >= textureHeight) {
-			// fixme: how to guess the current eye?
-			VariableRateShading::Instance().DisableVRS();
+		return false;
+	}
+
+	const PostProcessor::ClassifiedTarget & PostProcessor::ClassifyDepthStencilView( DepthTargetClassCache &cache, ID3D11DepthStencilView *view ) {
+		if (const ClassifiedTarget *cached = cache.Find( view ))
+			return *cached;
+
+		ClassifiedTarget &target = cache.Insert( view );
+		D3D11_DEPTH_STENCIL_VIEW_DESC dvd;
+		view->GetDesc( &dvd );
+		target.desc.isTexture2D = dvd.ViewDimension != D3D11_DSV_DIMENSION_TEXTURE1D && dvd.ViewDimension != D3D11_DSV_DIMENSION_TEXTURE1DARRAY;
+		if (target.desc.isTexture2D) {
+			ComPtr<ID3D11Resource> resource;
+			view->GetResource( resource.GetAddressOf() );
+			target.texture = (ID3D11Texture2D*)resource.Get();
+			D3D11_TEXTURE2D_DESC td;
+			target.texture->GetDesc( &td );
+			target.desc.width = td.Width;
+			target.desc.height = td.Height;
+			target.desc.arraySize = td.ArraySize;
+			target.desc.blacklistedName = HasBlacklistedTextureName( target.texture );
 		}
-		else {
-			VariableRateShading::Instance().DisableVRS();
+		target.targetClass = ClassifyDepthTarget( target.desc, CurrentSubmitLayout() );
+		return target;
+	}
+
+	void PostProcessor::OnSubmitted() {
+		if (initialized && currentOutput >= 0) {
+			// the compositor is done reading the output once the GPU has passed this point
+			outputRing.Submitted( currentOutput );
 		}
 	}
 
 	void PostProcessor::Reset() {
+		++resets;
+		PauseDeferredContexts();
+		deferredContexts.Clear();
+		layoutGeneration.fetch_add( 1, std::memory_order_relaxed );
+		deferredMasks.store( 0, std::memory_order_relaxed );
+		publishedDeferredMasks = 0;
+		deferredRegistryFull.store( false, std::memory_order_relaxed );
+		loggedDeferredMasks = false;
+		loggedDeferredRegistryFull = false;
+		for (int i = 0; i < CAPTURE_RING_SIZE; ++i) {
+			captures[i].staging.Reset();
+			captures[i].pending = false;
+		}
+		// the writer goes on with what is queued; it is only stopped at shutdown
+		LogWarmupStats();
+		// jobs hold on to the objects they work on, so a running one is not waited for
+		warmup.Discard();
+		for (const std::string &message : captureWriter.TakeMessages()) {
+			Log() << message << "\n";
+			--capturesWriting;
+		}
+		// the recorder keeps running, so that toggling VRS does not discard the recording
+		for (int i = 0; i < RECORDING_RING_SIZE; ++i) {
+			recordedEyes[i].staging.Reset();
+			recordedEyes[i].pending = false;
+		}
+		downsampleShader.Reset();
+		downsampleConstantsBuffer.Reset();
+		downsampledTexture.Reset();
+		downsampledUav.Reset();
 		enabled = true;
 		initialized = false;
 		device.Reset();
 		context.Reset();
 		sampler.Reset();
-		inputTextureViews.clear();
+		inputTextureViews.Clear();
+		depthStencilViews.Clear();
+		++warmupGeneration;
+		renderTargetClasses.Clear();
+		depthTargetClasses.Clear();
+		eyeInference.Reset();
+		frameSchedule.Reset();
+		loggedScheduleLearned = false;
+		singleEyeTargetBound = false;
 		copiedTexture.Reset();
 		copiedTextureView.Reset();
 		rdmFullTriVertexShader.Reset();
@@ -274,20 +746,23 @@ namespace vr {
 		rdmDepthStencilState.Reset();
 		rdmRasterizerState.Reset();
 		rdmReconstructShader.Reset();
-		rdmReconstructedTexture.Reset();
-		rdmReconstructedView.Reset();
-		rdmReconstructedUav.Reset();
 		rdmReconstructConstantsBuffer[0].Reset();
 		rdmReconstructConstantsBuffer[1].Reset();
 		sharpenShader.Reset();
 		sharpenConstantsBuffer[0].Reset();
 		sharpenConstantsBuffer[1].Reset();
-		sharpenedTexture.Reset();
-		sharpenedTextureUav.Reset();
+		outputRing.Reset();
+		currentOutput = -1;
+		eyeOutputs[Eye_Left] = EyeOutput();
+		eyeOutputs[Eye_Right] = EyeOutput();
+		texturePool.Clear();
+		textureAllocator.device.Reset();
+		outputTextureSize = PoolKey();
 		lastSubmittedTexture = nullptr;
 		outputTexture = nullptr;
+		eyeBatching = EyeBatching::None;
+		batchedEyePending = false;
 		eyeCount = 0;
-		depthClearCount = 0;
 		for (int i = 0; i < QUERY_COUNT; ++i) {
 			profileQueries[i].queryStart.Reset();
 			profileQueries[i].queryEnd.Reset();
@@ -295,6 +770,16 @@ namespace vr {
 		}
 	}
 
+	void PostProcessor::StopWorkers() {
+		warmup.Stop();
+		// writes what is still queued
+		captureWriter.Stop();
+		for (const std::string &message : captureWriter.TakeMessages()) {
+			Log() << message << "\n";
+		}
+		capturesWriting = 0;
+	}
+
 	void PostProcessor::PrepareCopyResources( DXGI_FORMAT format ) {
 		Log() << "Creating copy texture of size " << textureWidth << "x" << textureHeight << "\n";
 		D3D11_TEXTURE2D_DESC td;
@@ -309,70 +794,94 @@ namespace vr {
 		td.SampleDesc.Count = 1;
 		td.SampleDesc.Quality = 0;
 		td.ArraySize = 1;
-		CheckResult("Creating copy texture", device->CreateTexture2D( &td, nullptr, copiedTexture.GetAddressOf()));
+		CheckResult("Creating copy texture", device->CreateTexture2D( &td, nullptr, copiedTexture.ReleaseAndGetAddressOf()));
 		D3D11_SHADER_RESOURCE_VIEW_DESC srv;
 		srv.Format = TranslateTypelessFormats(td.Format);
 		srv.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
 		srv.Texture2D.MipLevels = 1;
 		srv.Texture2D.MostDetailedMip = 0;
-		CheckResult("Creating copy SRV", device->CreateShaderResourceView(copiedTexture.Get(), &srv, copiedTextureView.GetAddressOf()));
+		CheckResult("Creating copy SRV", device->CreateShaderResourceView(copiedTexture.Get(), &srv, copiedTextureView.ReleaseAndGetAddressOf()));
 	}
 
 	ID3D11ShaderResourceView * PostProcessor::GetInputView( ID3D11Texture2D *inputTexture, int eye ) {
 		if (requiresCopy) {
 			D3D11_TEXTURE2D_DESC td;
 			inputTexture->GetDesc(&td);
+			// an array texture holds each eye in its own slice
+			UINT subresource = td.ArraySize > 1 ? D3D11CalcSubresource(0, eye, td.MipLevels) : 0;
 			if (td.SampleDesc.Count > 1) {
-				context->ResolveSubresource(copiedTexture.Get(), 0, inputTexture, 0, td.Format);
+				context->ResolveSubresource(copiedTexture.Get(), 0, inputTexture, subresource, td.Format);
 			} else {
 				D3D11_BOX region;
 				region.left = region.top = region.front = 0;
 				region.right = td.Width;
 				region.bottom = td.Height;
 				region.back = 1;
-				context->CopySubresourceRegion(copiedTexture.Get(), 0, 0, 0, 0, inputTexture, 0, &region);
+				context->CopySubresourceRegion(copiedTexture.Get(), 0, 0, 0, 0, inputTexture, subresource, &region);
 			}
+			inputViewWidth = textureWidth;
+			inputViewHeight = textureHeight;
 			return copiedTextureView.Get();
 		}
+
+		inputViewWidth = textureWidth;
+		inputViewHeight = textureHeight;
 		
-		if (inputTextureViews.find(inputTexture) == inputTextureViews.end()) {
-			Log() << "Creating shader resource view for input texture " << inputTexture << std::endl;
-			// create resource view for input texture
+		EyeViews *cached = inputTextureViews.Find( inputTexture );
+		if (cached == nullptr) {
+			// the views may have been created in the background since the texture was bound as a render target
+			std::shared_ptr<EyeViews> warmed = warmup.Take<EyeViews>( WarmupKey( inputTexture, WarmupInputViews ) );
+			if (warmed) {
+				Log() << "Using shader resource view created in the background for input texture " << inputTexture << "\n";
+				EyeViews &views = inputTextureViews.Insert( inputTexture );
+				views = *warmed;
+				viewsCreated.fetch_add( 1, std::memory_order_relaxed );
+				return views.view[eye].Get();
+			}
+
+			Log() << "Creating shader resource view for input texture " << inputTexture << "\n";
 			D3D11_TEXTURE2D_DESC std;
 			inputTexture->GetDesc( &std );
 			Log() << "Texture has size " << std.Width << "x" << std.Height << " and format " << std.Format << "\n";
-			D3D11_SHADER_RESOURCE_VIEW_DESC svd;
-			svd.Format = TranslateTypelessFormats(std.Format);
-			svd.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
-			svd.Texture2D.MostDetailedMip = 0;
-			svd.Texture2D.MipLevels = 1;
-			EyeViews &views = inputTextureViews[inputTexture];
-			HRESULT result = device->CreateShaderResourceView( inputTexture, &svd, views.view[0].GetAddressOf() );
-			if (FAILED(result)) {
-				Log() << "Failed to create resource view: " << std::hex << (unsigned long)result << std::dec << std::endl;
-				inputTextureViews.erase( inputTexture );
-				return nullptr;
-			}
 			if (std.ArraySize > 1) {
-				// if an array texture was submitted, the right eye will be placed in the second entry, so we need
-				// a separate view for that eye
 				Log() << "Texture is an array texture, using separate subview for right eye\n";
-				svd.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
-				svd.Texture2DArray.ArraySize = 1;
-				svd.Texture2DArray.FirstArraySlice = D3D11CalcSubresource( 0, 1, 1 );
-				svd.Texture2DArray.MostDetailedMip = 0;
-				svd.Texture2DArray.MipLevels = 1;
-				result = device->CreateShaderResourceView( inputTexture, &svd, views.view[1].GetAddressOf() );
-				if (FAILED(result)) {
-					Log() << "Failed to create secondary resource view: " << std::hex << (unsigned long)result << std::dec << std::endl;
-					inputTextureViews.erase( inputTexture );
-					return nullptr;
-				}
-			} else {
-				views.view[1] = views.view[0];
 			}
+			EyeViews &views = inputTextureViews.Insert( inputTexture );
+			HRESULT result = CreateInputViews( device.Get(), inputTexture, views );
+			if (FAILED(result)) {
+				Log() << "Failed to create resource view: " << std::hex << (unsigned long)result << std::dec << "\n";
+				inputTextureViews.Erase( inputTexture );
+				return nullptr;
+			}
+			viewsCreated.fetch_add( 1, std::memory_order_relaxed );
+			cached = &views;
 		}
-		return inputTextureViews[inputTexture].view[eye].Get();
+		return cached->view[eye].Get();
+	}
+
+	HRESULT PostProcessor::CreateInputViews( ID3D11Device *device, ID3D11Texture2D *inputTexture, EyeViews &views ) {
+		D3D11_TEXTURE2D_DESC std;
+		inputTexture->GetDesc( &std );
+		D3D11_SHADER_RESOURCE_VIEW_DESC svd;
+		svd.Format = TranslateTypelessFormats(std.Format);
+		svd.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+		svd.Texture2D.MostDetailedMip = 0;
+		svd.Texture2D.MipLevels = 1;
+		HRESULT result = device->CreateShaderResourceView( inputTexture, &svd, views.view[0].GetAddressOf() );
+		if (FAILED(result))
+			return result;
+		if (std.ArraySize > 1) {
+			// if an array texture was submitted, the right eye will be placed in the second entry, so we need
+			// a separate view for that eye
+			svd.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+			svd.Texture2DArray.ArraySize = 1;
+			svd.Texture2DArray.FirstArraySlice = D3D11CalcSubresource( 0, 1, 1 );
+			svd.Texture2DArray.MostDetailedMip = 0;
+			svd.Texture2DArray.MipLevels = 1;
+			return device->CreateShaderResourceView( inputTexture, &svd, views.view[1].GetAddressOf() );
+		}
+		views.view[1] = views.view[0];
+		return S_OK;
 	}
 
 	struct RdmMaskingConstants {
@@ -391,6 +900,10 @@ namespace vr {
 		float invResolution[2];
 		float radius[3];
 		int debugMode;
+		int offsetRight[2];
+		float projectionCenterRight[2];
+		uint32_t eyeSize[2];
+		uint32_t unused[2];
 	};
 
 	void PostProcessor::CalculateSavedPixelCount() {
@@ -401,6 +914,7 @@ namespace vr {
 		}
 		int numBlocksX = width / 8;
 		int numBlocksY = height / 8;
+		const Config &config = FrameConfig();
 
 		size_t renderedPixels = 0;
 		int fullBlocks = 0;
@@ -412,15 +926,15 @@ namespace vr {
 				float fx = (float)x / numBlocksX;
 				float fy = (float)y / numBlocksY;
 				float toCenter = 2 * sqrt((fx - projX[0]) * (fx - projX[0]) + (fy - projY[0]) * (fy - projY[0]));
-				if (toCenter < Config::Instance().innerRadius) {
+				if (toCenter < config.innerRadius) {
 					renderedPixels += 64;
 					++fullBlocks;
 				}
-				else if (toCenter < Config::Instance().midRadius) {
+				else if (toCenter < config.midRadius) {
 					renderedPixels += 32;
 					++halfBlocks;
 				}
-				else if (toCenter < Config::Instance().outerRadius) {
+				else if (toCenter < config.outerRadius) {
 					renderedPixels += 16;
 					++quarterBlocks;
 				}
@@ -432,209 +946,145 @@ namespace vr {
 		}
 
 		double renderedPct = (double)renderedPixels * 100.0 / width / height;
+		shadedPixelsPermille = uint32_t(renderedPct * 10);
 		Log() << "Current profile renders " << std::setprecision(2) << renderedPct << "% of pixels of target resolution " << width << "x" << height << "\n";
 		Log() << "There are " << numBlocksX * numBlocksY << " blocks, " << fullBlocks << " at full res, " << halfBlocks << " at half res, " << quarterBlocks << " at 1/4th res, " << sixteenthBlocks << " at 1/16th res.\n";
 	}
 
-	void PostProcessor::PrepareRdmResources( DXGI_FORMAT format ) {
-		CheckResult("Creating RDM fullscreen tri vertex shader", device->CreateVertexShader( g_RDMFullscreenTriShader, sizeof( g_RDMFullscreenTriShader ), nullptr, rdmFullTriVertexShader.GetAddressOf() ));
-		CheckResult("Creating RDM masking shader", device->CreatePixelShader( g_RDMMaskShader, sizeof( g_RDMMaskShader ), nullptr, rdmMaskingShader.GetAddressOf() ));
-		CheckResult("Creating RDM reconstruction shader", device->CreateComputeShader( g_RDMReconstructShader, sizeof( g_RDMReconstructShader ), nullptr, rdmReconstructShader.GetAddressOf() ));
-
-		// create output texture
-		D3D11_TEXTURE2D_DESC td;
-		td.Width = textureWidth;
-		td.Height = textureHeight;
-		td.MipLevels = 1;
-		td.CPUAccessFlags = 0;
-		td.Usage = D3D11_USAGE_DEFAULT;
-		td.BindFlags = D3D11_BIND_UNORDERED_ACCESS|D3D11_BIND_SHADER_RESOURCE;
-		td.Format = format;
-		td.MiscFlags = 0;
-		td.SampleDesc.Count = 1;
-		td.SampleDesc.Quality = 0;
-		td.ArraySize = 1;
-		CheckResult("Creating RDM reconstructed texture", device->CreateTexture2D( &td, nullptr, rdmReconstructedTexture.GetAddressOf() ));
-		D3D11_UNORDERED_ACCESS_VIEW_DESC uav;
-		uav.Format = td.Format;
-		uav.ViewDimension = D3D11_UAV_DIMENSION_TEXTURE2D;
-		uav.Texture2D.MipSlice = 0;
-		CheckResult("Creating RDM reconstructed UAV", device->CreateUnorderedAccessView( rdmReconstructedTexture.Get(), &uav, rdmReconstructedUav.GetAddressOf() ));
-		D3D11_SHADER_RESOURCE_VIEW_DESC svd;
-		svd.Format = TranslateTypelessFormats(format);
-		svd.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
-		svd.Texture2D.MostDetailedMip = 0;
-		svd.Texture2D.MipLevels = 1;
-		CheckResult("Creating RDM reconstructed view", device->CreateShaderResourceView( rdmReconstructedTexture.Get(), &svd, rdmReconstructedView.GetAddressOf() ));
-
-		D3D11_DEPTH_STENCIL_DESC dsd;
-		dsd.DepthEnable = TRUE;
-		dsd.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ALL;
-		dsd.DepthFunc = D3D11_COMPARISON_ALWAYS;
-		dsd.StencilEnable = TRUE;
-		dsd.StencilReadMask = 255;
-		dsd.StencilWriteMask = 255;
-		dsd.FrontFace.StencilPassOp = D3D11_STENCIL_OP_REPLACE;
-		dsd.FrontFace.StencilFailOp = D3D11_STENCIL_OP_KEEP;
-		dsd.FrontFace.StencilDepthFailOp = D3D11_STENCIL_OP_KEEP;
-		dsd.FrontFace.StencilFunc = D3D11_COMPARISON_ALWAYS;
-		dsd.BackFace.StencilPassOp = D3D11_STENCIL_OP_REPLACE;
-		dsd.BackFace.StencilFailOp = D3D11_STENCIL_OP_KEEP;
-		dsd.BackFace.StencilDepthFailOp = D3D11_STENCIL_OP_KEEP;
-		dsd.BackFace.StencilFunc = D3D11_COMPARISON_ALWAYS;
-		CheckResult("Creating RDM depth stencil state", device->CreateDepthStencilState(&dsd, rdmDepthStencilState.GetAddressOf()));
-
-		D3D11_RASTERIZER_DESC rsd;
-		rsd.FillMode = D3D11_FILL_SOLID;
-		rsd.CullMode = D3D11_CULL_NONE;
-		rsd.FrontCounterClockwise = FALSE;
-		rsd.DepthBias = 0;
-		rsd.SlopeScaledDepthBias = 0;
-		rsd.DepthBiasClamp = 0;
-		rsd.DepthClipEnable = TRUE;
-		rsd.ScissorEnable = FALSE;
-		rsd.MultisampleEnable = FALSE;
-		rsd.AntialiasedLineEnable = FALSE;
-		CheckResult("Creating RDM rasterizer state", device->CreateRasterizerState(&rsd, rdmRasterizerState.GetAddressOf()));
-
-		D3D11_BUFFER_DESC bd;
-		bd.Usage = D3D11_USAGE_DYNAMIC;
-		bd.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-		bd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-		bd.MiscFlags = 0;
-		bd.StructureByteStride = 0;
-		bd.ByteWidth = sizeof(RdmMaskingConstants);
-		CheckResult("Creating RDM masking constants buffer", device->CreateBuffer( &bd, nullptr, rdmMaskingConstantsBuffer[0].GetAddressOf() ));
-		CheckResult("Creating RDM masking constants buffer", device->CreateBuffer( &bd, nullptr, rdmMaskingConstantsBuffer[1].GetAddressOf() ));
-		bd.ByteWidth = sizeof(RdmReconstructConstants);
-		CheckResult("Creating RDM reconstruct constants buffer", device->CreateBuffer( &bd, nullptr, rdmReconstructConstantsBuffer[0].GetAddressOf() ));
-		CheckResult("Creating RDM reconstruct constants buffer", device->CreateBuffer( &bd, nullptr, rdmReconstructConstantsBuffer[1].GetAddressOf() ));
+	void PostProcessor::PrepareRdmResources( const DeviceResources &resources ) {
+		rdmFullTriVertexShader = resources.rdmFullTriVertexShader;
+		rdmMaskingShader = resources.rdmMaskingShader;
+		rdmReconstructShader = resources.rdmReconstructShader;
+		rdmDepthStencilState = resources.rdmDepthStencilState;
+		rdmRasterizerState = resources.rdmRasterizerState;
+		for (int eye = 0; eye < 2; ++eye) {
+			rdmMaskingConstantsBuffer[eye] = resources.rdmMaskingConstantsBuffer[eye];
+			rdmReconstructConstantsBuffer[eye] = resources.rdmReconstructConstantsBuffer[eye];
+		}
 
 		CalculateSavedPixelCount();
 	}
 
-	ID3D11DepthStencilView * PostProcessor::GetDepthStencilView( ID3D11Texture2D *depthStencilTex, EVREye eye ) {
-		if ( depthStencilViews.find( depthStencilTex ) == depthStencilViews.end() ) {
-			Log() << "Creating depth stencil views for " << std::hex << depthStencilTex << std::dec << "\n";
+	ID3D11DepthStencilView * PostProcessor::GetDepthStencilView( DepthStencilViewCache &cache, ID3D11Texture2D *depthStencilTex, EVREye eye, bool mayLog ) {
+		DepthStencilViews *cached = cache.Find( depthStencilTex );
+		if ( cached == nullptr ) {
+			// only the views for the immediate context are warmed up, when the game binds the depth target
+			if (&cache == &depthStencilViews) {
+				std::shared_ptr<DepthStencilViews> warmed = warmup.Take<DepthStencilViews>( WarmupKey( depthStencilTex, WarmupDepthStencilViews ) );
+				if (warmed) {
+					Log() << "Using depth stencil views created in the background for " << std::hex << depthStencilTex << std::dec << "\n";
+					DepthStencilViews &views = cache.Insert( depthStencilTex );
+					views = *warmed;
+					viewsCreated.fetch_add( 1, std::memory_order_relaxed );
+					return views.view[eye].Get();
+				}
+			}
+
 			D3D11_TEXTURE2D_DESC td;
 			depthStencilTex->GetDesc( &td );
-			bool isArray = td.ArraySize == 2;
-			bool isMS = td.SampleDesc.Count > 1;
-			Log() << "Texture format " << td.Format << ", array size " << td.ArraySize << ", sample count " << td.SampleDesc.Count << "\n";
-			D3D11_DEPTH_STENCIL_VIEW_DESC dvd;
-			dvd.Format = TranslateTypelessDepthFormats( td.Format );
-			dvd.ViewDimension = isMS ? D3D11_DSV_DIMENSION_TEXTURE2DMS : D3D11_DSV_DIMENSION_TEXTURE2D;
-			dvd.Flags = 0;
-			dvd.Texture2D.MipSlice = 0;
-			auto &views = depthStencilViews[depthStencilTex];
-			HRESULT result = device->CreateDepthStencilView( depthStencilTex, &dvd, views.view[0].GetAddressOf() );
+			if (mayLog) {
+				Log() << "Creating depth stencil views for " << std::hex << depthStencilTex << std::dec << "\n";
+				Log() << "Texture format " << td.Format << ", array size " << td.ArraySize << ", sample count " << td.SampleDesc.Count << "\n";
+				if (td.ArraySize == 2)
+					Log() << "Depth stencil texture is an array, using separate slice per eye\n";
+			}
+			auto &views = cache.Insert( depthStencilTex );
+			HRESULT result = CreateDepthStencilViews( device.Get(), depthStencilTex, views );
 			if (FAILED(result)) {
-				Log() << "Error creating depth stencil view: " << std::hex << result << std::dec << std::endl;
+				if (mayLog)
+					Log() << "Error creating depth stencil view: " << std::hex << result << std::dec << "\n";
 				return nullptr;
 			}
-			if (isArray) {
-				Log() << "Depth stencil texture is an array, using separate slice per eye\n";
-				if (isMS) {
-					dvd.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2DMSARRAY;
-					dvd.Texture2DMSArray.ArraySize = 1;
-					dvd.Texture2DMSArray.FirstArraySlice = D3D11CalcSubresource( 0, 1, 1 );
-				} else {
-					dvd.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2DARRAY;
-					dvd.Texture2DArray.MipSlice = 0;
-					dvd.Texture2DArray.ArraySize = 1;
-					dvd.Texture2DArray.FirstArraySlice = D3D11CalcSubresource( 0, 1, 1 );
-				}
-				result = device->CreateDepthStencilView( depthStencilTex, &dvd, views.view[1].GetAddressOf() );
-				if (FAILED(result)) {
-					Log() << "Error creating depth stencil view array slice: " << std::hex << result << std::dec << std::endl;
-					return nullptr;
-				}
-			} else {
-				views.view[1] = views.view[0];
-			}
+			viewsCreated.fetch_add( 1, std::memory_order_relaxed );
+			cached = &views;
 		}
 
-		return depthStencilViews[depthStencilTex].view[eye].Get();
+		return cached->view[eye].Get();
 	}
 
-	bool HasBlacklistedTextureName(ID3D11Texture2D *tex) {
-		// used to ignore certain depth textures that we know are not relevant for us
-		// currently found in some older Unity games
-		char debugName[255] = { 0 };
-		UINT bufferSize = 255;
-		tex->GetPrivateData( WKPDID_D3DDebugObjectName, &bufferSize, debugName );
-		if (strncmp( debugName, "Camera DepthTexture", 255 ) == 0) {
-			return true;
+	HRESULT PostProcessor::CreateDepthStencilViews( ID3D11Device *device, ID3D11Texture2D *depthStencilTex, DepthStencilViews &views ) {
+		D3D11_TEXTURE2D_DESC td;
+		depthStencilTex->GetDesc( &td );
+		bool isArray = td.ArraySize == 2;
+		bool isMS = td.SampleDesc.Count > 1;
+		D3D11_DEPTH_STENCIL_VIEW_DESC dvd;
+		dvd.Format = TranslateTypelessDepthFormats( td.Format );
+		dvd.ViewDimension = isMS ? D3D11_DSV_DIMENSION_TEXTURE2DMS : D3D11_DSV_DIMENSION_TEXTURE2D;
+		dvd.Flags = 0;
+		dvd.Texture2D.MipSlice = 0;
+		HRESULT result = device->CreateDepthStencilView( depthStencilTex, &dvd, views.view[0].GetAddressOf() );
+		if (FAILED(result))
+			return result;
+		if (isArray) {
+			if (isMS) {
+				dvd.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2DMSARRAY;
+				dvd.Texture2DMSArray.ArraySize = 1;
+				dvd.Texture2DMSArray.FirstArraySlice = D3D11CalcSubresource( 0, 1, 1 );
+			} else {
+				dvd.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2DARRAY;
+				dvd.Texture2DArray.MipSlice = 0;
+				dvd.Texture2DArray.ArraySize = 1;
+				dvd.Texture2DArray.FirstArraySlice = D3D11CalcSubresource( 0, 1, 1 );
+			}
+			return device->CreateDepthStencilView( depthStencilTex, &dvd, views.view[1].GetAddressOf() );
 		}
-		return false;
+		views.view[1] = views.view[0];
+		return S_OK;
 	}
 
-	void PostProcessor::ApplyRadialDensityMask( ID3D11Texture2D *depthStencilTex, float depth, uint8_t stencil ) {
-		if (HasBlacklistedTextureName(depthStencilTex)) {
-			return;
-		}
-
-		D3D11_TEXTURE2D_DESC td;
-		depthStencilTex->GetDesc( &td );
-		bool sideBySide = !textureContainsOnlyOneEye || td.Width >= 2 * textureWidth;
-		bool arrayTex = td.ArraySize == 2;
-		vr::EVREye currentEye = vr::Eye_Left;
-		if (!sideBySide && !arrayTex && depthClearCount > 0) {
-			currentEye = vr::Eye_Right;
-		}
-		uint32_t renderWidth = td.Width * (sideBySide ? 0.5 : 1);
-		uint32_t renderHeight = td.Height;
-		++depthClearCount;
-
-		// store current D3D11 state before drawing RDM mask
-		ComPtr<ID3D11VertexShader> prevVS;
-		context->VSGetShader(prevVS.GetAddressOf(), nullptr, nullptr);
-		ComPtr<ID3D11PixelShader> prevPS;
-		context->PSGetShader(prevPS.GetAddressOf(), nullptr, nullptr);
-		ComPtr<ID3D11InputLayout> inputLayout;
-		context->IAGetInputLayout( inputLayout.GetAddressOf() );
-		D3D11_PRIMITIVE_TOPOLOGY topology;
-		context->IAGetPrimitiveTopology( &topology );
-		ID3D11Buffer *vertexBuffers[D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT];
+	// pipeline state disturbed by drawing the RDM mask and by the post-processing dispatches, respectively
+	const uint32_t RdmMaskStateGroups = PipelineStateTracker::VertexShader | PipelineStateTracker::PixelShader
+		| PipelineStateTracker::InputLayout | PipelineStateTracker::PrimitiveTopology | PipelineStateTracker::VSConstantBuffer
+		| PipelineStateTracker::PSConstantBuffer | PipelineStateTracker::RasterizerState | PipelineStateTracker::DepthStencilState
+		| PipelineStateTracker::Viewports;
+	const uint32_t PostProcessStateGroups = PipelineStateTracker::ComputeShader | PipelineStateTracker::CSConstantBuffer
+		| PipelineStateTracker::CSSampler;
+
+	void PostProcessor::ApplyRadialDensityMask( ID3D11DeviceContext *ctx, DepthStencilViewCache &views, const Config &config, const ClassifiedTarget &target, EVREye currentEye, float depth, uint8_t stencil ) {
+		TRACE_SCOPE("RDM mask");
+		const TargetDesc &desc = target.desc;
+		ID3D11Texture2D *depthStencilTex = target.texture;
+		bool sideBySide = target.targetClass == TargetClass::Combined;
+		bool arrayTex = desc.arraySize == 2;
+		bool mayLog = ctx == context.Get();
+		uint32_t renderWidth = desc.width * (sideBySide ? 0.5 : 1);
+		uint32_t renderHeight = desc.height;
+
+		// our viewports and binds, and the game's state we re-issue, are not taken for the game's own calls
+		if (ctx == context.Get())
+			issuingOwnCalls = true;
+
+		// store current D3D11 state before drawing RDM mask. Most of it is mirrored by the state tracker,
+		// but buffer and view bindings are subject to the runtime's hazard tracking and must be read back.
+		PipelineStateTracker::Snapshot savedState;
+		PipelineStateTracker::Instance().Save( ctx, savedState, RdmMaskStateGroups );
+		BoundObjects<ID3D11Buffer, D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT> vertexBuffers;
 		UINT strides[D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT];
 		UINT offsets[D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT];
-		context->IAGetVertexBuffers( 0, D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT, vertexBuffers, strides, offsets );
+		ctx->IAGetVertexBuffers( 0, D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT, vertexBuffers.objects, strides, offsets );
 		ComPtr<ID3D11Buffer> indexBuffer;
 		DXGI_FORMAT format;
 		UINT offset;
-		context->IAGetIndexBuffer(indexBuffer.GetAddressOf(), &format, &offset);
-		ID3D11RenderTargetView *renderTargets[D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT];
+		ctx->IAGetIndexBuffer(indexBuffer.GetAddressOf(), &format, &offset);
+		BoundObjects<ID3D11RenderTargetView, D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT> renderTargets;
 		ComPtr<ID3D11DepthStencilView> depthStencil;
-		context->OMGetRenderTargets( D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT, renderTargets, depthStencil.GetAddressOf() );
-		ComPtr<ID3D11RasterizerState> rasterizerState;
-		context->RSGetState( rasterizerState.GetAddressOf() );
-		ComPtr<ID3D11DepthStencilState> depthStencilState;
-		UINT stencilRef;
-		context->OMGetDepthStencilState( depthStencilState.GetAddressOf(), &stencilRef );
-		D3D11_VIEWPORT viewports[D3D11_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE];
-		UINT numViewports = 0;
-		context->RSGetViewports( &numViewports, nullptr );
-		context->RSGetViewports( &numViewports, viewports );
-		ComPtr<ID3D11Buffer> vsConstantBuffer;
-		context->VSGetConstantBuffers( 0, 1, vsConstantBuffer.GetAddressOf() );
-		ComPtr<ID3D11Buffer> psConstantBuffer;
-		context->PSGetConstantBuffers( 0, 1, psConstantBuffer.GetAddressOf() );
-
-		context->VSSetShader( rdmFullTriVertexShader.Get(), nullptr, 0 );
-		context->PSSetShader( rdmMaskingShader.Get(), nullptr, 0 );
-		context->IASetInputLayout( nullptr );
-		context->IASetPrimitiveTopology( D3D10_PRIMITIVE_TOPOLOGY_TRIANGLELIST );
-		context->IASetVertexBuffers( 0, 0, nullptr, nullptr, nullptr );
-		context->IASetIndexBuffer( nullptr, DXGI_FORMAT_UNKNOWN, 0 );
-		context->OMSetRenderTargets( 0, nullptr, GetDepthStencilView(depthStencilTex, currentEye) );
-		context->RSSetState(rdmRasterizerState.Get());
-		context->OMSetDepthStencilState(rdmDepthStencilState.Get(), ~stencil);
+		ctx->OMGetRenderTargets( D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT, renderTargets.objects, depthStencil.GetAddressOf() );
+
+		ctx->VSSetShader( rdmFullTriVertexShader.Get(), nullptr, 0 );
+		ctx->PSSetShader( rdmMaskingShader.Get(), nullptr, 0 );
+		ctx->IASetInputLayout( nullptr );
+		ctx->IASetPrimitiveTopology( D3D10_PRIMITIVE_TOPOLOGY_TRIANGLELIST );
+		ctx->IASetVertexBuffers( 0, 0, nullptr, nullptr, nullptr );
+		ctx->IASetIndexBuffer( nullptr, DXGI_FORMAT_UNKNOWN, 0 );
+		ctx->OMSetRenderTargets( 0, nullptr, GetDepthStencilView(views, depthStencilTex, currentEye, mayLog) );
+		ctx->RSSetState(rdmRasterizerState.Get());
+		ctx->OMSetDepthStencilState(rdmDepthStencilState.Get(), ~stencil);
 
 		RdmMaskingConstants constants;
 		constants.depthOut = 1.f - depth;
-		constants.radius[0] = Config::Instance().innerRadius;
-		constants.radius[1] = Config::Instance().midRadius;
-		constants.radius[2] = Config::Instance().outerRadius;
+		constants.radius[0] = config.innerRadius;
+		constants.radius[1] = config.midRadius;
+		constants.radius[2] = config.outerRadius;
 		constants.invClusterResolution[0] = 8.f / renderWidth;
 		constants.invClusterResolution[1] = 8.f / renderHeight;
 		constants.projectionCenter[0] = projX[currentEye];
@@ -644,11 +1094,11 @@ namespace vr {
 		constants.yFix[0] = arrayTex ? -1 : 1;
 		constants.yFix[1] = arrayTex ? renderHeight : 0;
 		D3D11_MAPPED_SUBRESOURCE mapped { nullptr, 0, 0 };
-		context->Map( rdmMaskingConstantsBuffer[currentEye].Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped );
+		ctx->Map( rdmMaskingConstantsBuffer[currentEye].Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped );
 		memcpy(mapped.pData, &constants, sizeof(constants));
-		context->Unmap( rdmMaskingConstantsBuffer[currentEye].Get(), 0 );
-		context->VSSetConstantBuffers( 0, 1, rdmMaskingConstantsBuffer[currentEye].GetAddressOf() );
-		context->PSSetConstantBuffers( 0, 1, rdmMaskingConstantsBuffer[currentEye].GetAddressOf() );
+		ctx->Unmap( rdmMaskingConstantsBuffer[currentEye].Get(), 0 );
+		ctx->VSSetConstantBuffers( 0, 1, rdmMaskingConstantsBuffer[currentEye].GetAddressOf() );
+		ctx->PSSetConstantBuffers( 0, 1, rdmMaskingConstantsBuffer[currentEye].GetAddressOf() );
 
 		D3D11_VIEWPORT vp;
 		vp.TopLeftX = 0;
@@ -657,148 +1107,228 @@ namespace vr {
 		vp.MaxDepth = 1;
 		vp.Width = renderWidth;
 		vp.Height = renderHeight;
-		context->RSSetViewports( 1, &vp );
+		ctx->RSSetViewports( 1, &vp );
 
-		context->Draw( 3, 0 );
+		ctx->Draw( 3, 0 );
 
 		if (sideBySide || arrayTex) {
 			constants.projectionCenter[0] = projX[Eye_Right] + (sideBySide ? 1.f : 0.f);
 			constants.projectionCenter[1] = projY[Eye_Right];
-			context->Map( rdmMaskingConstantsBuffer[Eye_Right].Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped );
+			ctx->Map( rdmMaskingConstantsBuffer[Eye_Right].Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped );
 			memcpy(mapped.pData, &constants, sizeof(constants));
-			context->Unmap( rdmMaskingConstantsBuffer[Eye_Right].Get(), 0 );
-			context->VSSetConstantBuffers( 0, 1, rdmMaskingConstantsBuffer[1].GetAddressOf() );
-			context->PSSetConstantBuffers( 0, 1, rdmMaskingConstantsBuffer[1].GetAddressOf() );
-			context->OMSetRenderTargets( 0, nullptr, GetDepthStencilView(depthStencilTex, Eye_Right) );
+			ctx->Unmap( rdmMaskingConstantsBuffer[Eye_Right].Get(), 0 );
+			ctx->VSSetConstantBuffers( 0, 1, rdmMaskingConstantsBuffer[1].GetAddressOf() );
+			ctx->PSSetConstantBuffers( 0, 1, rdmMaskingConstantsBuffer[1].GetAddressOf() );
+			ctx->OMSetRenderTargets( 0, nullptr, GetDepthStencilView(views, depthStencilTex, Eye_Right, mayLog) );
 			if (sideBySide) {
 				vp.TopLeftX = renderWidth;
 			}
-			context->RSSetViewports( 1, &vp );
-			context->Draw( 3, 0 );
+			ctx->RSSetViewports( 1, &vp );
+			ctx->Draw( 3, 0 );
 		}
 
 		// restore previous state
-		context->VSSetShader(prevVS.Get(), nullptr, 0);
-		context->PSSetShader(prevPS.Get(), nullptr, 0);
-		context->IASetInputLayout( inputLayout.Get() );
-		context->IASetPrimitiveTopology( topology );
-		context->IASetVertexBuffers( 0, D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT, vertexBuffers, strides, offsets );
-		for (int i = 0; i < D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT; ++i) {
-			if (vertexBuffers[i])
-				vertexBuffers[i]->Release();
-		}
-		context->IASetIndexBuffer( indexBuffer.Get(), format, offset );
-		context->OMSetRenderTargets( D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT, renderTargets, depthStencil.Get() );
-		for (int i = 0; i < D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT; ++i) {
-			if (renderTargets[i]) {
-				renderTargets[i]->Release();
-			}
-		}
-		context->RSSetState( rasterizerState.Get() );
-		context->OMSetDepthStencilState( depthStencilState.Get(), stencilRef );
-		context->RSSetViewports( numViewports, viewports );
-		context->VSSetConstantBuffers( 0, 1, vsConstantBuffer.GetAddressOf() );
-		context->PSSetConstantBuffers( 0, 1, psConstantBuffer.GetAddressOf() );
+		PipelineStateTracker::Instance().Restore( savedState );
+		ctx->IASetVertexBuffers( 0, D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT, vertexBuffers.objects, strides, offsets );
+		ctx->IASetIndexBuffer( indexBuffer.Get(), format, offset );
+		ctx->OMSetRenderTargets( D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT, renderTargets.objects, depthStencil.Get() );
+		if (ctx == context.Get())
+			issuingOwnCalls = false;
 	}
 
-	void PostProcessor::ReconstructRdmRender( vr::EVREye eye, ID3D11ShaderResourceView *inputView, int x, int y, int width, int height ) {
+	void PostProcessor::ReconstructRdmRender( vr::EVREye eye, ID3D11ShaderResourceView *inputView, uint32_t inputWidth, uint32_t inputHeight, ID3D11UnorderedAccessView *outputUav, const EyeRegion (&regions)[2], bool sideBySide ) {
+		TRACE_SCOPE("RDM reconstruct");
 		context->CSSetShader( rdmReconstructShader.Get(), nullptr, 0 );
 		ID3D11Buffer *emptyBind[] = {nullptr};
 		context->CSSetConstantBuffers( 0, 1, emptyBind );
 
+		// for a side-by-side texture, the first eye slot holds the left eye and the dispatch's z index selects the eye
+		if (sideBySide)
+			eye = Eye_Left;
+		const EyeRegion &region = regions[eye];
+
 		RdmReconstructConstants constants;
-		constants.offset[0] = x;
-		constants.offset[1] = y;
+		constants.offset[0] = region.x;
+		constants.offset[1] = region.y;
 		constants.projectionCenter[0] = projX[eye];
 		constants.projectionCenter[1] = projY[eye];
-		constants.invResolution[0] = 1.f / textureWidth;
-		constants.invResolution[1] = 1.f / textureHeight;
-		constants.invClusterResolution[0] = 8.f / width;
-		constants.invClusterResolution[1] = 8.f / height;
-		constants.radius[0] = Config::Instance().innerRadius;
-		constants.radius[1] = Config::Instance().midRadius;
-		constants.radius[2] = Config::Instance().outerRadius;
-		constants.debugMode = Config::Instance().debugMode;
+		constants.invResolution[0] = 1.f / inputWidth;
+		constants.invResolution[1] = 1.f / inputHeight;
+		constants.invClusterResolution[0] = 8.f / region.width;
+		constants.invClusterResolution[1] = 8.f / region.height;
+		const Config &config = FrameConfig();
+		constants.radius[0] = config.innerRadius;
+		constants.radius[1] = config.midRadius;
+		constants.radius[2] = config.outerRadius;
+		constants.debugMode = config.debugMode;
 		if (!textureContainsOnlyOneEye && eye == Eye_Right)
 			constants.projectionCenter[0] += 1.f;
+		constants.offsetRight[0] = regions[Eye_Right].x;
+		constants.offsetRight[1] = regions[Eye_Right].y;
+		constants.projectionCenterRight[0] = projX[Eye_Right] + 1.f;
+		constants.projectionCenterRight[1] = projY[Eye_Right];
+		constants.eyeSize[0] = region.width;
+		constants.eyeSize[1] = region.height;
+		constants.unused[0] = constants.unused[1] = 0;
 		D3D11_MAPPED_SUBRESOURCE mapped { nullptr, 0, 0 };
 		context->Map( rdmReconstructConstantsBuffer[eye].Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped );
 		memcpy(mapped.pData, &constants, sizeof(constants));
 		context->Unmap( rdmReconstructConstantsBuffer[eye].Get(), 0 );
 		UINT uavCount = -1;
-		context->CSSetUnorderedAccessViews( 0, 1, rdmReconstructedUav.GetAddressOf(), &uavCount );
+		context->CSSetUnorderedAccessViews( 0, 1, &outputUav, &uavCount );
 		context->CSSetConstantBuffers( 0, 1, rdmReconstructConstantsBuffer[eye].GetAddressOf() );
 		ID3D11ShaderResourceView *srvs[1] = {inputView};
 		context->CSSetShaderResources( 0, 1, srvs );
 		context->CSSetSamplers(0, 1, sampler.GetAddressOf());
-		context->Dispatch( (width+7)/8, (height+7)/8, 1 );
+		context->Dispatch( (region.width+7)/8, (region.height+7)/8, sideBySide ? 2 : 1 );
 	}
 
-
-	void PostProcessor::PrepareSharpeningResources(DXGI_FORMAT format) {
-		CheckResult("Creating NIS sharpening shader", device->CreateComputeShader( g_NISSharpenShader, sizeof(g_NISSharpenShader), nullptr, sharpenShader.GetAddressOf()));
+	void PostProcessor::PrepareSharpeningResources( const DeviceResources &resources ) {
+		sharpenShader = resources.sharpenShader;
+		sharpenConstantsBuffer[0] = resources.sharpenConstantsBuffer[0];
+		sharpenConstantsBuffer[1] = resources.sharpenConstantsBuffer[1];
 
 		float proj[4];
 		CalculateProjectionCenter(Eye_Left, proj[0], proj[1]);
 		CalculateProjectionCenter(Eye_Right, proj[2], proj[3]);
+	}
 
-		D3D11_BUFFER_DESC bd;
-		bd.Usage = D3D11_USAGE_DYNAMIC;
-		bd.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-		bd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-		bd.MiscFlags = 0;
-		bd.StructureByteStride = 0;
-		bd.ByteWidth = sizeof(NISConfig);
-		CheckResult("Creating sharpen constants buffer", device->CreateBuffer( &bd, nullptr, sharpenConstantsBuffer[0].GetAddressOf()));
-		CheckResult("Creating sharpen constants buffer", device->CreateBuffer( &bd, nullptr, sharpenConstantsBuffer[1].GetAddressOf()));
-		
-		Log() << "Creating sharpened texture of size " << textureWidth << "x" << textureHeight << "\n";
+	void PostProcessor::PrepareOutputRing( DXGI_FORMAT format ) {
+		outputFormat = format;
+		int depth = FrameConfig().outputRingSize;
+		Log() << "Using " << depth << " output texture(s) per eye\n";
+		outputRing.Init( depth,
+			[this](OutputTextures &output) { CreateOutputTextures( output ); },
+			[this](OutputTextures &output) { context->End( output.submitFence.Get() ); },
+			[this](OutputTextures &output) { return context->GetData( output.submitFence.Get(), nullptr, 0, D3D11_ASYNC_GETDATA_DONOTFLUSH ) == S_OK; },
+			[this](OutputTextures &output) {
+				auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds( OUTPUT_WAIT_LIMIT_MS );
+				// flushes on the first poll only, then yields the core for a few polls before sleeping between them
+				for (int polls = 0; context->GetData( output.submitFence.Get(), nullptr, 0, polls == 0 ? 0 : D3D11_ASYNC_GETDATA_DONOTFLUSH ) == S_FALSE; ++polls) {
+					if (std::chrono::steady_clock::now() >= deadline)
+						return false;
+					Sleep( polls < 16 ? 0 : 1 );
+				}
+				return true;
+			});
+	}
+
+	ComPtr<ID3D11Texture2D> PostProcessor::TextureAllocator::Allocate( const PoolKey &key ) {
+		Log() << "Creating texture of size " << key.width << "x" << key.height << " in format " << key.format << "\n";
 		D3D11_TEXTURE2D_DESC td;
-		td.Width = textureWidth;
-		td.Height = textureHeight;
+		td.Width = key.width;
+		td.Height = key.height;
 		td.MipLevels = 1;
 		td.CPUAccessFlags = 0;
 		td.Usage = D3D11_USAGE_DEFAULT;
-		td.BindFlags = D3D11_BIND_UNORDERED_ACCESS|D3D11_BIND_SHADER_RESOURCE;
-		td.Format = format;
+		td.BindFlags = key.bindFlags;
+		td.Format = (DXGI_FORMAT)key.format;
 		td.MiscFlags = 0;
 		td.SampleDesc.Count = 1;
 		td.SampleDesc.Quality = 0;
 		td.ArraySize = 1;
-		CheckResult("Creating sharpened texture", device->CreateTexture2D( &td, nullptr, sharpenedTexture.GetAddressOf()));
+		ComPtr<ID3D11Texture2D> texture;
+		CheckResult("Creating pooled texture", device->CreateTexture2D( &td, nullptr, texture.GetAddressOf() ));
+		return texture;
+	}
+
+	uint64_t PostProcessor::TextureAllocator::SizeInBytes( const PoolKey &key ) {
+		// our output formats are all 32 bits per pixel, except for the 16 bit float one
+		uint64_t bytesPerPixel = key.format == DXGI_FORMAT_R16G16B16A16_FLOAT ? 8 : 4;
+		return bytesPerPixel * key.width * key.height;
+	}
+
+	void PostProcessor::CreateOutputTextures( OutputTextures &output ) {
+		UINT bindFlags = D3D11_BIND_UNORDERED_ACCESS|D3D11_BIND_SHADER_RESOURCE;
 		D3D11_UNORDERED_ACCESS_VIEW_DESC uav;
-		uav.Format = format;
+		uav.Format = outputFormat;
 		uav.ViewDimension = D3D11_UAV_DIMENSION_TEXTURE2D;
 		uav.Texture2D.MipSlice = 0;
-		CheckResult("Creating sharpened UAV", device->CreateUnorderedAccessView( sharpenedTexture.Get(), &uav, sharpenedTextureUav.GetAddressOf()));
+
+		if (!useVariableRateShading) {
+			output.rdmReconstructedTexture = texturePool.Acquire( outputFormat, bindFlags, textureWidth, textureHeight, &output.rdmReconstructedSize );
+			CheckResult("Creating RDM reconstructed UAV", device->CreateUnorderedAccessView( output.rdmReconstructedTexture.Get(), &uav, output.rdmReconstructedUav.GetAddressOf() ));
+			D3D11_SHADER_RESOURCE_VIEW_DESC svd;
+			svd.Format = TranslateTypelessFormats(outputFormat);
+			svd.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+			svd.Texture2D.MostDetailedMip = 0;
+			svd.Texture2D.MipLevels = 1;
+			CheckResult("Creating RDM reconstructed view", device->CreateShaderResourceView( output.rdmReconstructedTexture.Get(), &svd, output.rdmReconstructedView.GetAddressOf() ));
+		}
+
+		if (FrameConfig().useSharpening) {
+			output.sharpenedTexture = texturePool.Acquire( outputFormat, bindFlags, textureWidth, textureHeight, &output.sharpenedSize );
+			CheckResult("Creating sharpened UAV", device->CreateUnorderedAccessView( output.sharpenedTexture.Get(), &uav, output.sharpenedTextureUav.GetAddressOf()));
+			if (FrameConfig().recordingEnabled) {
+				D3D11_SHADER_RESOURCE_VIEW_DESC svd;
+				svd.Format = TranslateTypelessFormats(outputFormat);
+				svd.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+				svd.Texture2D.MostDetailedMip = 0;
+				svd.Texture2D.MipLevels = 1;
+				CheckResult("Creating sharpened view", device->CreateShaderResourceView( output.sharpenedTexture.Get(), &svd, output.sharpenedView.GetAddressOf() ));
+			}
+		}
+
+		D3D11_QUERY_DESC qd;
+		qd.Query = D3D11_QUERY_EVENT;
+		qd.MiscFlags = 0;
+		CheckResult("Creating output fence", device->CreateQuery( &qd, output.submitFence.GetAddressOf() ));
 	}
 
-	void PostProcessor::ApplySharpening( EVREye eEye, ID3D11ShaderResourceView *inputView, int x, int y, int width, int height ) {
+	void PostProcessor::ReleaseOutputTextures() {
+		outputRing.ForEachCreated( [this](OutputTextures &output) {
+			if (output.rdmReconstructedTexture)
+				texturePool.Release( output.rdmReconstructedTexture );
+			if (output.sharpenedTexture)
+				texturePool.Release( output.sharpenedTexture );
+		});
+		outputRing.Reset();
+		currentOutput = -1;
+	}
+
+	void PostProcessor::ApplySharpening( EVREye eEye, ID3D11ShaderResourceView *inputView, uint32_t inputWidth, uint32_t inputHeight, ID3D11UnorderedAccessView *outputUav, const EyeRegion (&regions)[2], bool sideBySide ) {
+		TRACE_SCOPE("Sharpen");
+		if (sideBySide)
+			eEye = Eye_Left;
+		// for a side-by-side texture, the viewport spans both eyes and the shader picks the eye's centre by the split position
+		EyeRegion viewport = sideBySide ? CombineEyeRegions( regions[Eye_Left], regions[Eye_Right] ) : regions[eEye];
+		uint32_t width = regions[eEye].width;
+		uint32_t height = regions[eEye].height;
+		const Config &config = FrameConfig();
 		NISConfig nisConfig;
-		NVSharpenUpdateConfig( nisConfig, Config::Instance().sharpness, x, y, width, height, textureWidth, textureHeight, x, y );
+		NVSharpenUpdateConfig( nisConfig, config.sharpness, viewport.x, viewport.y, viewport.width, viewport.height, inputWidth, inputHeight, viewport.x, viewport.y );
 		nisConfig.imageCentre[0] = width * projX[eEye];
 		nisConfig.imageCentre[1] = height * projY[eEye];
-		nisConfig.radius[0] = 0.5f * Config::Instance().sharpenRadius * height;
+		nisConfig.radius[0] = 0.5f * config.sharpenRadius * height;
 		nisConfig.radius[1] = nisConfig.radius[0] * nisConfig.radius[0];
-		nisConfig.reserved1 = Config::Instance().debugMode ? 1.f : 0.f;
+		nisConfig.reserved1 = config.debugMode ? 1.f : 0.f;
+		nisConfig.eyeSplitX = UINT32_MAX;
+		nisConfig.imageCentreRight[0] = nisConfig.imageCentreRight[1] = 0;
+		nisConfig.reserved2 = 0;
+		if (sideBySide) {
+			nisConfig.eyeSplitX = regions[Eye_Right].x - viewport.x;
+			nisConfig.imageCentreRight[0] = nisConfig.eyeSplitX + regions[Eye_Right].width * projX[Eye_Right];
+			nisConfig.imageCentreRight[1] = regions[Eye_Right].height * projY[Eye_Right];
+		}
 		D3D11_MAPPED_SUBRESOURCE mapped { nullptr, 0, 0 };
 		context->Map( sharpenConstantsBuffer[eEye].Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped );
 		memcpy( mapped.pData, &nisConfig, sizeof(nisConfig) );
 		context->Unmap( sharpenConstantsBuffer[eEye].Get(), 0 );
 		UINT uavCount = -1;
-		context->CSSetUnorderedAccessViews( 0, 1, sharpenedTextureUav.GetAddressOf(), &uavCount );
+		context->CSSetUnorderedAccessViews( 0, 1, &outputUav, &uavCount );
 		context->CSSetConstantBuffers( 0, 1, sharpenConstantsBuffer[eEye].GetAddressOf() );
 		ID3D11ShaderResourceView *srvs[1] = {inputView};
 		context->CSSetShaderResources( 0, 1, srvs );
 		context->CSSetSamplers( 0, 1, sampler.GetAddressOf() );
 		context->CSSetShader( sharpenShader.Get(), nullptr, 0 );
-		context->Dispatch( (UINT)std::ceil(width / 32.f), (UINT)std::ceil(height / 32.f), 1 );
+		context->Dispatch( (UINT)std::ceil(viewport.width / 32.f), (UINT)std::ceil(viewport.height / 32.f), 1 );
 	}
 
 	void PostProcessor::PrepareResources( ID3D11Texture2D *inputTexture, EColorSpace colorSpace ) {
 		Log() << "Creating post-processing resources\n";
 		inputTexture->GetDevice( device.GetAddressOf() );
 		device->GetImmediateContext( context.GetAddressOf() );
+		textureAllocator.device = device;
 
 		CalculateProjectionCenter( vr::Eye_Left, projX[0], projY[0] );
 		CalculateProjectionCenter( vr::Eye_Right, projX[1], projY[1] );
@@ -813,62 +1343,90 @@ namespace vr {
 		textureWidth = std.Width;
 		textureHeight = std.Height;
 
-		D3D11_SAMPLER_DESC sd;
-		sd.Filter = D3D11_FILTER_COMPARISON_MIN_MAG_MIP_LINEAR;
-		sd.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
-		sd.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
-		sd.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
-		sd.MipLODBias = 0;
-		sd.MaxAnisotropy = 1;
-		sd.ComparisonFunc = D3D11_COMPARISON_NEVER;
-		sd.MinLOD = 0;
-		sd.MaxLOD = 0;
-		device->CreateSamplerState(&sd, sampler.GetAddressOf());
+		// waits for the warm-up worker if it is still creating them
+		std::shared_ptr<DeviceResources> resources = warmup.Take<DeviceResources>( WarmupKey( device.Get(), WarmupDeviceResources ) );
+		if (resources) {
+			Log() << "Using resources created in the background\n";
+		} else {
+			resources = std::make_shared<DeviceResources>();
+		}
+		// anything left over was warmed up for devices the game does not submit from
+		warmup.Clear();
+		CreateDeviceResources( device.Get(), SamplerPart, *resources );
+		sampler = resources->sampler;
 
+		inputFormat = std.Format;
 		if (!(std.BindFlags & D3D11_BIND_SHADER_RESOURCE) || std.SampleDesc.Count > 1 || IsSrgbFormat(std.Format)) {
 			Log() << "Input texture can't be bound directly, need to copy\n";
 			requiresCopy = true;
 			PrepareCopyResources(std.Format);
 		}
 
-		if (Config::Instance().ffrEnabled) {
+		const Config &config = FrameConfig();
+		if (config.ffrEnabled) {
 			DXGI_FORMAT textureFormat = DetermineOutputFormat(std.Format);
 			Log() << "Creating output textures in format " << textureFormat << "\n";
 
 			VariableRateShading::Instance().Init( device, context );
-			useVariableRateShading = VariableRateShading::Instance().SupportsVariableRateShading() && Config::Instance().useVrs;
+			useVariableRateShading = VariableRateShading::Instance().SupportsVariableRateShading() && config.useVrs;
 
+			uint32_t parts = (useVariableRateShading ? 0 : RdmPart)
+				| (config.useSharpening ? SharpeningPart : 0)
+				| (config.recordingEnabled ? RecordingPart : 0);
+			CreateDeviceResources( device.Get(), parts, *resources );
 			if (!useVariableRateShading) {
-				PrepareRdmResources(textureFormat);
+				PrepareRdmResources(*resources);
+			}
+
+			eyeBatching = ChooseEyeBatching( textureContainsOnlyOneEye, std.ArraySize );
+			if (eyeBatching == EyeBatching::SideBySide) {
+				Log() << "Submitted texture contains both eyes side by side, processing both eyes in a single dispatch\n";
+			} else if (eyeBatching == EyeBatching::ArraySlices) {
+				Log() << "Submitted texture contains both eyes as array slices, processing both eyes on the first Submit\n";
+			}
+			if (config.useSharpening) {
+				PrepareSharpeningResources(*resources);
 			}
-			if (Config::Instance().useSharpening) {
-				PrepareSharpeningResources(textureFormat);
+			PrepareOutputRing(textureFormat);
+			if (config.recordingEnabled) {
+				PrepareRecordingResources(*resources);
 			}
 
 			HookD3D11Context( context.Get(), device.Get() );
 		}
 
 		initialized = true;
+		ResumeDeferredContexts();
 	}
 
-
-	void PostProcessor::ApplyPostProcess( EVREye eEye, ID3D11Texture2D *inputTexture, const VRTextureBounds_t *bounds ) {
-		ID3D11Buffer* currentConstBuffs[1];
-		ID3D11ShaderResourceView* currentSRVs[3];
-		ID3D11UnorderedAccessView* currentUAVs[1];
-
-		context->CSGetShaderResources(0, 3, currentSRVs);
-		context->CSGetUnorderedAccessViews(0, 1, currentUAVs);
-		context->CSGetConstantBuffers(0, 1, currentConstBuffs);
-
+	void PostProcessor::ApplyPostProcess( EVREye eEye, ID3D11Texture2D *inputTexture, const VRTextureBounds_t *bounds, EyeBatching batching ) {
+		TRACE_SCOPE("PostProcess");
+		// eyes that are not processed are submitted as they are; a copy of the submitted texture, if any, has the submitted size
+		for (EyeOutput &eyeOutput : eyeOutputs) {
+			eyeOutput.texture = inputTexture;
+			eyeOutput.size.width = textureWidth;
+			eyeOutput.size.height = textureHeight;
+			eyeOutput.slot = -1;
+		}
 		outputTexture = inputTexture;
+		outputTextureSize = eyeOutputs[eEye].size;
+		currentOutput = -1;
 
 		ID3D11ShaderResourceView *inputView = GetInputView(inputTexture, eEye);
 		if (inputView == nullptr) {
 			return;
 		}
 
-		if (Config::Instance().debugMode) {
+		// views are subject to the runtime's hazard tracking, so we read them back instead of relying on the state tracker
+		PipelineStateTracker::Snapshot savedState;
+		PipelineStateTracker::Instance().Save( context.Get(), savedState, PostProcessStateGroups );
+		BoundObjects<ID3D11ShaderResourceView, 3> currentSRVs;
+		BoundObjects<ID3D11UnorderedAccessView, 1> currentUAVs;
+		context->CSGetShaderResources(0, 3, currentSRVs.objects);
+		context->CSGetUnorderedAccessViews(0, 1, currentUAVs.objects);
+
+		const Config &config = FrameConfig();
+		if (config.debugMode) {
 			if (!profileQueries[0].queryStart) {
 				for (int i = 0; i < QUERY_COUNT; ++i) {
 					D3D11_QUERY_DESC qd;
@@ -885,28 +1443,32 @@ namespace vr {
 		}
 
 		context->OMSetRenderTargets(0, nullptr, nullptr);
-		uint32_t offsetX = textureWidth * min(bounds->uMin, bounds->uMax);
-		uint32_t offsetY = textureHeight * min(bounds->vMin, bounds->vMax);
-		uint32_t width = textureWidth * fabsf(bounds->uMax - bounds->uMin);
-		uint32_t height = textureHeight * fabsf(bounds->vMax - bounds->vMin);
-
-		if (Config::Instance().ffrEnabled && !useVariableRateShading) {
-			ReconstructRdmRender( eEye, inputView, offsetX, offsetY, width, height );
-			inputView = rdmReconstructedView.Get();
-			outputTexture = rdmReconstructedTexture.Get();
+		EVREye otherEye = eEye == Eye_Left ? Eye_Right : Eye_Left;
+		EyeRegion regions[2];
+		regions[eEye] = RegionFromBounds( *bounds, textureWidth, textureHeight );
+		if (batching != EyeBatching::None) {
+			regions[otherEye] = RegionFromBounds( PredictOtherEyeBounds( batching, eEye, *bounds ), textureWidth, textureHeight );
 		}
-
-		if (Config::Instance().ffrEnabled && Config::Instance().useSharpening) {
-			ApplySharpening(eEye, inputView, offsetX, offsetY, width, height);
-			outputTexture = sharpenedTexture.Get();
+		lastDispatchBatched = batching != EyeBatching::None;
+
+		ProcessEye( eEye, inputView, regions, batching == EyeBatching::SideBySide, config );
+		if (batching == EyeBatching::ArraySlices) {
+			// the other eye's slice, read through its own view
+			ID3D11ShaderResourceView *otherView = GetInputView(inputTexture, otherEye);
+			if (otherView != nullptr) {
+				ProcessEye( otherEye, otherView, regions, false, config );
+			}
 		}
+		outputTexture = eyeOutputs[eEye].texture;
+		outputTextureSize = eyeOutputs[eEye].size;
+		currentOutput = eyeOutputs[eEye].slot;
 
-		context->CSSetShaderResources(0, 3, currentSRVs);
+		PipelineStateTracker::Instance().Restore( savedState );
+		context->CSSetShaderResources(0, 3, currentSRVs.objects);
 		UINT uavCount = -1;
-		context->CSSetUnorderedAccessViews(0, 1, currentUAVs, &uavCount);
-		context->CSSetConstantBuffers(0, 1, currentConstBuffs);
+		context->CSSetUnorderedAccessViews(0, 1, currentUAVs.objects, &uavCount);
 
-		if (Config::Instance().debugMode) {
+		if (config.debugMode) {
 			context->End(profileQueries[currentQuery].queryEnd.Get());
 			context->End(profileQueries[currentQuery].queryDisjoint.Get());
 
@@ -921,160 +1483,907 @@ namespace vr {
 				context->GetData(profileQueries[currentQuery].queryStart.Get(), &begin, sizeof(UINT64), 0);
 				context->GetData(profileQueries[currentQuery].queryEnd.Get(), &end, sizeof(UINT64), 0);
 				float duration = (end - begin) / float(disjoint.Frequency);
+				gpuPostProcessMicros = uint64_t(duration * 1e6f * (lastDispatchBatched ? 1 : 2));
 				summedGpuTime += duration;
 				++countedQueries;
 
 				if (countedQueries >= 500) {
 					float avgTimeMs = 1000.f / countedQueries * summedGpuTime;
-					avgTimeMs *= 2; // because it's only for one eye, and we are interested in a time for both
+					if (!lastDispatchBatched)
+						avgTimeMs *= 2; // because it's only for one eye, and we are interested in a time for both
 					Log() << "Average GPU post-processing time per frame: " << avgTimeMs << " ms\n";
+					Log() << "Forced waits for output textures so far: " << outputRing.ForcedWaits() << ", " << outputRing.AbandonedWaits() << " given up\n";
+					const PoolStats &poolStats = texturePool.Stats();
+					Log() << "Texture pool: " << poolStats.hits << " hits, " << poolStats.misses << " misses, " << (poolStats.bytesAllocated >> 20) << " MB allocated, " << (poolStats.bytesInUse >> 20) << " MB in use\n";
+					Log() << "View caches: " << inputTextureViews.Size() << " input, " << depthStencilViews.Size() << " depth textures; " << inputTextureViews.Evictions() + depthStencilViews.Evictions() << " evictions, " << inputTextureViews.StaleHits() + depthStencilViews.StaleHits() << " stale entries\n";
+					const PipelineStateTracker::Stats &stateStats = PipelineStateTracker::Instance().GetStats();
+					Log() << "Pipeline state: " << stateStats.readbacks << " readbacks, " << stateStats.reissued << " groups restored, " << stateStats.skipped << " unchanged groups skipped\n";
 					countedQueries = 0;
 					summedGpuTime = 0.f;
 				}
 			}
 		}
 
-		if (takeCapture && eEye == Eye_Left) {
-			SaveTextureToFile( outputTexture );
+		if (takeCapture && (eEye == Eye_Left || batching != EyeBatching::None)) {
+			RequestCapture( eyeOutputs[Eye_Left].texture );
 			takeCapture = false;
 		}
 	}
 
-	void PostProcessor::SaveTextureToFile( ID3D11Texture2D *texture ) {
+	// runs the passes for one eye, or for both of a side-by-side texture, and sets what they are submitted with
+	void PostProcessor::ProcessEye( EVREye eye, ID3D11ShaderResourceView *inputView, const EyeRegion (&regions)[2], bool sideBySide, const Config &config ) {
+		EVREye otherEye = eye == Eye_Left ? Eye_Right : Eye_Left;
+		EyeOutput &eyeOutput = eyeOutputs[eye];
+		// both eyes of a batched side-by-side texture share one output texture
+		if (config.ffrEnabled && (!useVariableRateShading || config.useSharpening)) {
+			eyeOutput.slot = outputRing.Acquire( sideBySide ? Eye_Left : eye, frameCount );
+		}
+
+		uint32_t inputWidth = inputViewWidth;
+		uint32_t inputHeight = inputViewHeight;
+		if (config.ffrEnabled && !useVariableRateShading) {
+			OutputTextures &output = outputRing.Get( eyeOutput.slot );
+			ReconstructRdmRender( eye, inputView, inputWidth, inputHeight, output.rdmReconstructedUav.Get(), regions, sideBySide );
+			inputView = output.rdmReconstructedView.Get();
+			inputWidth = output.rdmReconstructedSize.width;
+			inputHeight = output.rdmReconstructedSize.height;
+			eyeOutput.texture = output.rdmReconstructedTexture.Get();
+			eyeOutput.size = output.rdmReconstructedSize;
+		}
+
+		if (config.ffrEnabled && config.useSharpening) {
+			OutputTextures &output = outputRing.Get( eyeOutput.slot );
+			ApplySharpening(eye, inputView, inputWidth, inputHeight, output.sharpenedTextureUav.Get(), regions, sideBySide);
+			inputView = output.sharpenedView.Get();
+			inputWidth = output.sharpenedSize.width;
+			inputHeight = output.sharpenedSize.height;
+			eyeOutput.texture = output.sharpenedTexture.Get();
+			eyeOutput.size = output.sharpenedSize;
+		}
+
+		if (downsampleShader && inputView != nullptr) {
+			RecordEye( eye, inputView, inputWidth, inputHeight, regions[eye] );
+			if (sideBySide) {
+				RecordEye( otherEye, inputView, inputWidth, inputHeight, regions[otherEye] );
+			}
+		}
+		if (sideBySide) {
+			eyeOutputs[otherEye] = eyeOutput;
+		}
+	}
+
+	CapturePath PostProcessor::CaptureFileName() {
 		static char timeBuf[16];
 		std::time_t now = std::time(nullptr);
 		std::strftime(timeBuf, sizeof(timeBuf), "%Y%m%d_%H%M%S", std::localtime(&now));
 
+		const Config &config = FrameConfig();
 		std::wostringstream filename;
 		filename << GetDllPath() << "\\"
 				 << "capture_" << timeBuf;
 		if (enabled) {
 			filename
 				 << "_" << (useVariableRateShading ? "vrs" : "rdm")
-				 << "_s" << int(roundf(Config::Instance().sharpness * 100))
-				 << "_" << int(roundf(Config::Instance().sharpenRadius * 100))
-				 << "_r" << int(roundf(Config::Instance().innerRadius * 100))
-				 << "_" << int(roundf(Config::Instance().midRadius * 100))
-				 << "_" << int(roundf(Config::Instance().outerRadius * 100))
-				 << ".dds";
+				 << "_s" << int(roundf(config.sharpness * 100))
+				 << "_" << int(roundf(config.sharpenRadius * 100))
+				 << "_r" << int(roundf(config.innerRadius * 100))
+				 << "_" << int(roundf(config.midRadius * 100))
+				 << "_" << int(roundf(config.outerRadius * 100));
 		} else {
-			filename << "_off.dds";
+			filename << "_off";
 		}
+		return filename.str();
+	}
 
-		HRESULT result = DirectX::SaveDDSTextureToFile( context.Get(), texture, filename.str().c_str() );
-		if (FAILED(result)) {
-			Log() << "Error taking screen capture: " << std::hex << result << std::dec << std::endl;
+	uint32_t CaptureBytesPerPixel(DXGI_FORMAT format) {
+		switch (format) {
+		case DXGI_FORMAT_R8G8B8A8_TYPELESS:
+		case DXGI_FORMAT_R8G8B8A8_UNORM:
+		case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+		case DXGI_FORMAT_B8G8R8A8_TYPELESS:
+		case DXGI_FORMAT_B8G8R8A8_UNORM:
+		case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+		case DXGI_FORMAT_B8G8R8X8_TYPELESS:
+		case DXGI_FORMAT_B8G8R8X8_UNORM:
+		case DXGI_FORMAT_B8G8R8X8_UNORM_SRGB:
+		case DXGI_FORMAT_R10G10B10A2_TYPELESS:
+		case DXGI_FORMAT_R10G10B10A2_UNORM:
+		case DXGI_FORMAT_R11G11B10_FLOAT:
+			return 4;
+		case DXGI_FORMAT_R16G16B16A16_TYPELESS:
+		case DXGI_FORMAT_R16G16B16A16_FLOAT:
+		case DXGI_FORMAT_R16G16B16A16_UNORM:
+			return 8;
+		case DXGI_FORMAT_R32G32B32A32_TYPELESS:
+		case DXGI_FORMAT_R32G32B32A32_FLOAT:
+			return 16;
+		default:
+			return 0;
+		}
+	}
+
+	CaptureLayout CaptureLayoutOf(DXGI_FORMAT format) {
+		switch (format) {
+		case DXGI_FORMAT_R8G8B8A8_TYPELESS:
+		case DXGI_FORMAT_R8G8B8A8_UNORM:
+		case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+			return CaptureLayout::Rgba8;
+		case DXGI_FORMAT_B8G8R8A8_TYPELESS:
+		case DXGI_FORMAT_B8G8R8A8_UNORM:
+		case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+		case DXGI_FORMAT_B8G8R8X8_TYPELESS:
+		case DXGI_FORMAT_B8G8R8X8_UNORM:
+		case DXGI_FORMAT_B8G8R8X8_UNORM_SRGB:
+			return CaptureLayout::Bgra8;
+		default:
+			return CaptureLayout::Other;
+		}
+	}
+
+	void PostProcessor::RequestCapture( ID3D11Texture2D *texture ) {
+		D3D11_TEXTURE2D_DESC td;
+		texture->GetDesc( &td );
+		uint32_t bytesPerPixel = CaptureBytesPerPixel( td.Format );
+		if (td.SampleDesc.Count > 1 || bytesPerPixel == 0) {
+			Log() << "Can't capture texture of format " << td.Format << " with " << td.SampleDesc.Count << " samples\n";
+			return;
+		}
+
+		PendingCapture *capture = nullptr;
+		for (int i = 0; i < CAPTURE_RING_SIZE; ++i) {
+			if (!captures[i].pending) {
+				capture = &captures[i];
+				break;
+			}
+		}
+		if (capture == nullptr) {
+			Log() << "Too many captures still being read back, skipping capture\n";
+			return;
+		}
+
+		D3D11_TEXTURE2D_DESC sd = td;
+		sd.Usage = D3D11_USAGE_STAGING;
+		sd.BindFlags = 0;
+		sd.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+		sd.MiscFlags = 0;
+		if (!capture->staging || memcmp( &capture->desc, &sd, sizeof(sd) ) != 0) {
+			capture->staging.Reset();
+			HRESULT result = device->CreateTexture2D( &sd, nullptr, capture->staging.GetAddressOf() );
+			if (FAILED(result)) {
+				Log() << "Error creating capture staging texture: " << std::hex << result << std::dec << "\n";
+				return;
+			}
+			capture->desc = sd;
+		}
+		context->CopyResource( capture->staging.Get(), texture );
+
+		CapturedImage &image = capture->image;
+		image = CapturedImage();
+		image.path = CaptureFileName();
+		image.encoding = FrameConfig().captureEncoding;
+		image.width = td.Width;
+		image.height = td.Height;
+		image.arraySize = td.ArraySize;
+		image.bytesPerPixel = bytesPerPixel;
+		image.dxgiFormat = TranslateTypelessFormats( td.Format );
+		image.layout = CaptureLayoutOf( td.Format );
+		capture->pending = true;
+	}
+
+	void PostProcessor::PollCaptures() {
+		TRACE_SCOPE("Poll captures");
+		for (int i = 0; i < CAPTURE_RING_SIZE; ++i) {
+			PendingCapture &capture = captures[i];
+			if (!capture.pending)
+				continue;
+
+			// no slice is waited for; if one is still being copied, the capture is read again on the next poll
+			CapturedImage &image = capture.image;
+			for (uint32_t slice = 0; slice < image.arraySize; ++slice) {
+				UINT subresource = D3D11CalcSubresource( 0, slice, capture.desc.MipLevels );
+				D3D11_MAPPED_SUBRESOURCE mapped;
+				HRESULT result = context->Map( capture.staging.Get(), subresource, D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &mapped );
+				if (result == DXGI_ERROR_WAS_STILL_DRAWING)
+					break;
+				if (FAILED(result)) {
+					Log() << "Error reading back capture: " << std::hex << result << std::dec << "\n";
+					capture.pending = false;
+					break;
+				}
+				if (slice == 0)
+					image.pixels.resize( image.SliceSize() * image.arraySize );
+				uint8_t *dst = image.pixels.data() + slice * image.SliceSize();
+				const uint8_t *src = (const uint8_t*)mapped.pData;
+				for (uint32_t y = 0; y < image.height; ++y) {
+					memcpy( dst + y * image.RowSize(), src + y * mapped.RowPitch, image.RowSize() );
+				}
+				context->Unmap( capture.staging.Get(), subresource );
+
+				if (slice + 1 == image.arraySize) {
+					captureWriter.Enqueue( std::move( image ) );
+					++capturesWriting;
+					capture.pending = false;
+				}
+			}
+		}
+
+		if (capturesWriting > 0) {
+			for (const std::string &message : captureWriter.TakeMessages()) {
+				Log() << message << "\n";
+				--capturesWriting;
+			}
 		}
 	}
 
-	void PostProcessor::CheckHotkeys() {
-		bool isShiftPressed = GetAsyncKeyState( VK_LSHIFT ) || GetAsyncKeyState( VK_RSHIFT );
-		if (!isShiftPressed && Config::Instance().hotkeysRequireShift)
+	struct DownsampleConstants {
+		float srcOrigin[2];
+		float srcStep[2];
+		uint32_t dstSize[2];
+		uint32_t unused[2];
+	};
+
+	void PostProcessor::PrepareRecordingResources( const DeviceResources &resources ) {
+		downsampleShader = resources.downsampleShader;
+		downsampleConstantsBuffer = resources.downsampleConstantsBuffer;
+
+		if (!recorder.IsRunning()) {
+			recorder.Start( GetDllPath() + L"\\openvr_mod_recording.ring", FrameConfig().recordingMaxImages );
+		}
+	}
+
+	void PostProcessor::CreateDeviceResources( ID3D11Device *device, uint32_t parts, DeviceResources &resources ) {
+		parts &= ~resources.parts;
+		D3D11_BUFFER_DESC bd;
+		bd.Usage = D3D11_USAGE_DYNAMIC;
+		bd.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+		bd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+		bd.MiscFlags = 0;
+		bd.StructureByteStride = 0;
+
+		if (parts & SamplerPart) {
+			D3D11_SAMPLER_DESC sd;
+			sd.Filter = D3D11_FILTER_COMPARISON_MIN_MAG_MIP_LINEAR;
+			sd.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
+			sd.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
+			sd.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+			sd.MipLODBias = 0;
+			sd.MaxAnisotropy = 1;
+			sd.ComparisonFunc = D3D11_COMPARISON_NEVER;
+			sd.MinLOD = 0;
+			sd.MaxLOD = 0;
+			device->CreateSamplerState(&sd, resources.sampler.GetAddressOf());
+		}
+
+		if (parts & RdmPart) {
+			CheckResult("Creating RDM fullscreen tri vertex shader", device->CreateVertexShader( g_RDMFullscreenTriShader, sizeof( g_RDMFullscreenTriShader ), nullptr, resources.rdmFullTriVertexShader.GetAddressOf() ));
+			CheckResult("Creating RDM masking shader", device->CreatePixelShader( g_RDMMaskShader, sizeof( g_RDMMaskShader ), nullptr, resources.rdmMaskingShader.GetAddressOf() ));
+			CheckResult("Creating RDM reconstruction shader", device->CreateComputeShader( g_RDMReconstructShader, sizeof( g_RDMReconstructShader ), nullptr, resources.rdmReconstructShader.GetAddressOf() ));
+
+			D3D11_DEPTH_STENCIL_DESC dsd;
+			dsd.DepthEnable = TRUE;
+			dsd.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ALL;
+			dsd.DepthFunc = D3D11_COMPARISON_ALWAYS;
+			dsd.StencilEnable = TRUE;
+			dsd.StencilReadMask = 255;
+			dsd.StencilWriteMask = 255;
+			dsd.FrontFace.StencilPassOp = D3D11_STENCIL_OP_REPLACE;
+			dsd.FrontFace.StencilFailOp = D3D11_STENCIL_OP_KEEP;
+			dsd.FrontFace.StencilDepthFailOp = D3D11_STENCIL_OP_KEEP;
+			dsd.FrontFace.StencilFunc = D3D11_COMPARISON_ALWAYS;
+			dsd.BackFace.StencilPassOp = D3D11_STENCIL_OP_REPLACE;
+			dsd.BackFace.StencilFailOp = D3D11_STENCIL_OP_KEEP;
+			dsd.BackFace.StencilDepthFailOp = D3D11_STENCIL_OP_KEEP;
+			dsd.BackFace.StencilFunc = D3D11_COMPARISON_ALWAYS;
+			CheckResult("Creating RDM depth stencil state", device->CreateDepthStencilState(&dsd, resources.rdmDepthStencilState.GetAddressOf()));
+
+			D3D11_RASTERIZER_DESC rsd;
+			rsd.FillMode = D3D11_FILL_SOLID;
+			rsd.CullMode = D3D11_CULL_NONE;
+			rsd.FrontCounterClockwise = FALSE;
+			rsd.DepthBias = 0;
+			rsd.SlopeScaledDepthBias = 0;
+			rsd.DepthBiasClamp = 0;
+			rsd.DepthClipEnable = TRUE;
+			rsd.ScissorEnable = FALSE;
+			rsd.MultisampleEnable = FALSE;
+			rsd.AntialiasedLineEnable = FALSE;
+			CheckResult("Creating RDM rasterizer state", device->CreateRasterizerState(&rsd, resources.rdmRasterizerState.GetAddressOf()));
+
+			bd.ByteWidth = sizeof(RdmMaskingConstants);
+			CheckResult("Creating RDM masking constants buffer", device->CreateBuffer( &bd, nullptr, resources.rdmMaskingConstantsBuffer[0].GetAddressOf() ));
+			CheckResult("Creating RDM masking constants buffer", device->CreateBuffer( &bd, nullptr, resources.rdmMaskingConstantsBuffer[1].GetAddressOf() ));
+			bd.ByteWidth = sizeof(RdmReconstructConstants);
+			CheckResult("Creating RDM reconstruct constants buffer", device->CreateBuffer( &bd, nullptr, resources.rdmReconstructConstantsBuffer[0].GetAddressOf() ));
+			CheckResult("Creating RDM reconstruct constants buffer", device->CreateBuffer( &bd, nullptr, resources.rdmReconstructConstantsBuffer[1].GetAddressOf() ));
+		}
+
+		if (parts & SharpeningPart) {
+			CheckResult("Creating NIS sharpening shader", device->CreateComputeShader( g_NISSharpenShader, sizeof(g_NISSharpenShader), nullptr, resources.sharpenShader.GetAddressOf()));
+			bd.ByteWidth = sizeof(NISConfig);
+			CheckResult("Creating sharpen constants buffer", device->CreateBuffer( &bd, nullptr, resources.sharpenConstantsBuffer[0].GetAddressOf()));
+			CheckResult("Creating sharpen constants buffer", device->CreateBuffer( &bd, nullptr, resources.sharpenConstantsBuffer[1].GetAddressOf()));
+		}
+
+		if (parts & RecordingPart) {
+			CheckResult("Creating recording downsample shader", device->CreateComputeShader( g_CaptureDownsampleShader, sizeof(g_CaptureDownsampleShader), nullptr, resources.downsampleShader.GetAddressOf()));
+			bd.ByteWidth = sizeof(DownsampleConstants);
+			CheckResult("Creating recording constants buffer", device->CreateBuffer( &bd, nullptr, resources.downsampleConstantsBuffer.GetAddressOf()));
+		}
+
+		if (parts & NvapiPart) {
+			resources.nvapi = std::make_shared<NvapiPreload>();
+		}
+		resources.parts |= parts;
+	}
+
+	uint32_t PostProcessor::WarmedDeviceResourceParts( const Config &config ) {
+		if (!config.ffrEnabled)
+			return 0;
+		// whether VRS is supported is only known once NVAPI is loaded, so the RDM resources are created either way
+		return SamplerPart | RdmPart
+			| (config.useSharpening ? SharpeningPart : 0)
+			| (config.recordingEnabled ? RecordingPart : 0)
+			| (config.useVrs ? NvapiPart : 0);
+	}
+
+	void PostProcessor::OnDeviceCreated( ID3D11Device *device ) {
+		const Config &config = Config::Published().Current()->value;
+		if (!config.warmUp)
 			return;
-		bool isCtrlPressed = GetAsyncKeyState( VK_LCONTROL ) || GetAsyncKeyState( VK_RCONTROL );
-		if (!isCtrlPressed && Config::Instance().hotkeysRequireCtrl)
+		if (device->GetCreationFlags() & D3D11_CREATE_DEVICE_SINGLETHREADED) {
+			Log() << "Device " << device << " is single-threaded, not creating resources in the background\n";
 			return;
-		bool isAltPressed = GetAsyncKeyState( VK_LMENU ) || GetAsyncKeyState( VK_RMENU );
-		if (!isAltPressed && Config::Instance().hotkeysRequireAlt)
+		}
+		if (device->GetFeatureLevel() < D3D_FEATURE_LEVEL_11_0)
 			return;
+		WarmUpDeviceResources( device, WarmedDeviceResourceParts( config ) );
+	}
 
-		if (IsHotkeyActive( Config::Instance().hotkeyToggleFfr )) {
-			enabled = !enabled;
-			VariableRateShading::Instance().DisableVRS();
-			if (enabled)
-				Log() << "Fixed foveated rendering is now enabled.\n";
-			else
-				Log() << "Fixed foveated rendering is now disabled.\n";
+	void PostProcessor::WarmUpDeviceResources( ID3D11Device *device, uint32_t parts ) {
+		if (parts == 0)
+			return;
+		ComPtr<ID3D11Device> target = device;
+		auto job = [target, parts]() -> std::shared_ptr<void> {
+			TRACE_THREAD_NAME("Warm-up");
+			TRACE_SCOPE("Warm up device resources");
+			std::shared_ptr<DeviceResources> resources = std::make_shared<DeviceResources>();
+			CreateDeviceResources( target.Get(), parts, *resources );
+			return resources;
+		};
+		if (warmup.Request( WarmupKey( device, WarmupDeviceResources ), job )) {
+			Log() << "Creating resources for device " << device << " in the background\n";
+		}
+	}
+
+	bool PostProcessor::MarkWarmupConsidered( ID3D11Texture2D *texture ) {
+		if (warmupConsidered.GetTag( texture ) == warmupGeneration)
+			return false;
+		warmupConsidered.SetTag( texture, warmupGeneration );
+		return true;
+	}
+
+	void PostProcessor::WarmUpInputViews( ID3D11Texture2D *texture ) {
+		// whether or not views are warmed up for it, as what decides that only changes on a resize or reset
+		if (!MarkWarmupConsidered( texture ))
+			return;
+		D3D11_TEXTURE2D_DESC td;
+		texture->GetDesc( &td );
+		// only textures that GetInputView would create views on for the current submit size
+		if (requiresCopy || !(td.BindFlags & D3D11_BIND_SHADER_RESOURCE) || td.SampleDesc.Count > 1 || IsSrgbFormat(td.Format)
+				|| td.Width != textureWidth || td.Height != textureHeight || inputTextureViews.Find( texture ) != nullptr)
+			return;
+		ComPtr<ID3D11Device> target = device;
+		// holding a reference keeps the texture's address from being reused until the job is done
+		ComPtr<ID3D11Texture2D> source = texture;
+		warmup.Request( WarmupKey( texture, WarmupInputViews ), [target, source]() -> std::shared_ptr<void> {
+			TRACE_THREAD_NAME("Warm-up");
+			TRACE_SCOPE("Warm up input views");
+			std::shared_ptr<EyeViews> views = std::make_shared<EyeViews>();
+			if (FAILED(CreateInputViews( target.Get(), source.Get(), *views )))
+				return nullptr;
+			return views;
+		} );
+	}
+
+	void PostProcessor::WarmUpDepthStencilViews( ID3D11Texture2D *texture ) {
+		if (!MarkWarmupConsidered( texture ) || depthStencilViews.Find( texture ) != nullptr)
+			return;
+		ComPtr<ID3D11Device> target = device;
+		ComPtr<ID3D11Texture2D> source = texture;
+		warmup.Request( WarmupKey( texture, WarmupDepthStencilViews ), [target, source]() -> std::shared_ptr<void> {
+			TRACE_THREAD_NAME("Warm-up");
+			TRACE_SCOPE("Warm up depth stencil views");
+			std::shared_ptr<DepthStencilViews> views = std::make_shared<DepthStencilViews>();
+			if (FAILED(CreateDepthStencilViews( target.Get(), source.Get(), *views )))
+				return nullptr;
+			return views;
+		} );
+	}
+
+	void PostProcessor::LogWarmupStats() {
+		WarmupStats stats = warmup.Stats();
+		if (stats.requested == 0)
+			return;
+		Log() << "Background creation: " << stats.requested << " requested, " << stats.taken << " used (" << stats.waited << " waited for), "
+			<< stats.cancelled << " cancelled, " << stats.discarded << " unused, " << stats.rejected << " rejected, " << stats.failed << " failed\n";
+	}
+
+	void PostProcessor::RecordEye( EVREye eye, ID3D11ShaderResourceView *view, uint32_t viewWidth, uint32_t viewHeight, const EyeRegion &region ) {
+		TRACE_SCOPE("Record eye");
+		RecordedEye &slot = recordedEyes[nextRecordedEye];
+		if (slot.pending) {
+			// the GPU is too far behind for us to read back another image
+			++recordingSkipped;
+			return;
 		}
 
-		if (IsHotkeyActive( Config::Instance().hotkeyToggleDebugMode )) {
-			Config::Instance().debugMode = !Config::Instance().debugMode;
+		const Config &config = FrameConfig();
+		uint32_t factor = config.recordingDownsample;
+		uint32_t width = (std::max)( region.width / factor, 1u );
+		uint32_t height = (std::max)( region.height / factor, 1u );
+
+		D3D11_TEXTURE2D_DESC td;
+		if (downsampledTexture) {
+			downsampledTexture->GetDesc( &td );
+		}
+		if (!downsampledTexture || td.Width != width || td.Height != height) {
+			td.Width = width;
+			td.Height = height;
+			td.MipLevels = 1;
+			td.ArraySize = 1;
+			td.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+			td.SampleDesc.Count = 1;
+			td.SampleDesc.Quality = 0;
+			td.Usage = D3D11_USAGE_DEFAULT;
+			td.BindFlags = D3D11_BIND_UNORDERED_ACCESS;
+			td.CPUAccessFlags = 0;
+			td.MiscFlags = 0;
+			downsampledTexture.Reset();
+			downsampledUav.Reset();
+			if (FAILED(device->CreateTexture2D( &td, nullptr, downsampledTexture.GetAddressOf() ))
+					|| FAILED(device->CreateUnorderedAccessView( downsampledTexture.Get(), nullptr, downsampledUav.GetAddressOf() ))) {
+				Log(LogLevel::Warning) << "Could not create recording texture, disabling recording\n";
+				downsampledTexture.Reset();
+				downsampleShader.Reset();
+				return;
+			}
 		}
 
-		if (IsHotkeyActive( Config::Instance().hotkeyToggleUseVrs )) {
-			Config::Instance().useVrs = !Config::Instance().useVrs;
-			VariableRateShading::Instance().DisableVRS();
-			Reset();
-			VariableRateShading::Instance().Reset();
+		D3D11_TEXTURE2D_DESC sd;
+		if (slot.staging) {
+			slot.staging->GetDesc( &sd );
+		}
+		if (!slot.staging || sd.Width != width || sd.Height != height) {
+			sd = td;
+			sd.Usage = D3D11_USAGE_STAGING;
+			sd.BindFlags = 0;
+			sd.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+			slot.staging.Reset();
+			if (FAILED(device->CreateTexture2D( &sd, nullptr, slot.staging.GetAddressOf() ))) {
+				Log(LogLevel::Warning) << "Could not create recording staging texture, disabling recording\n";
+				downsampleShader.Reset();
+				return;
+			}
+		}
+
+		DownsampleConstants constants;
+		constants.srcOrigin[0] = float(region.x) / viewWidth;
+		constants.srcOrigin[1] = float(region.y) / viewHeight;
+		constants.srcStep[0] = float(region.width) / width / viewWidth;
+		constants.srcStep[1] = float(region.height) / height / viewHeight;
+		constants.dstSize[0] = width;
+		constants.dstSize[1] = height;
+		constants.unused[0] = constants.unused[1] = 0;
+		D3D11_MAPPED_SUBRESOURCE mapped { nullptr, 0, 0 };
+		context->Map( downsampleConstantsBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped );
+		memcpy( mapped.pData, &constants, sizeof(constants) );
+		context->Unmap( downsampleConstantsBuffer.Get(), 0 );
+
+		UINT uavCount = -1;
+		context->CSSetUnorderedAccessViews( 0, 1, downsampledUav.GetAddressOf(), &uavCount );
+		context->CSSetConstantBuffers( 0, 1, downsampleConstantsBuffer.GetAddressOf() );
+		context->CSSetShaderResources( 0, 1, &view );
+		context->CSSetSamplers( 0, 1, sampler.GetAddressOf() );
+		context->CSSetShader( downsampleShader.Get(), nullptr, 0 );
+		context->Dispatch( (width + 7) / 8, (height + 7) / 8, 1 );
+		// unbind the UAV, or the copy would read a texture still bound for writing
+		ID3D11UnorderedAccessView *nullUav = nullptr;
+		context->CSSetUnorderedAccessViews( 0, 1, &nullUav, &uavCount );
+		context->CopyResource( slot.staging.Get(), downsampledTexture.Get() );
+
+		RingFrameEntry &entry = slot.entry;
+		entry = RingFrameEntry();
+		entry.timestampMicros = std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::system_clock::now().time_since_epoch() ).count();
+		entry.eye = eye;
+		// the shader stores values as they are, so they keep the encoding of the submitted image
+		entry.dxgiFormat = inputIsSrgb ? DXGI_FORMAT_R8G8B8A8_UNORM_SRGB : DXGI_FORMAT_R8G8B8A8_UNORM;
+		entry.width = width;
+		entry.height = height;
+		entry.bytesPerPixel = 4;
+		entry.config.innerRadius = config.innerRadius;
+		entry.config.midRadius = config.midRadius;
+		entry.config.outerRadius = config.outerRadius;
+		entry.config.sharpness = config.sharpness;
+		entry.config.sharpenRadius = config.sharpenRadius;
+		if (enabled)
+			entry.config.flags |= RingFfrEnabled;
+		if (useVariableRateShading)
+			entry.config.flags |= RingVariableRateShading;
+		if (config.useSharpening)
+			entry.config.flags |= RingSharpening;
+		slot.pending = true;
+		nextRecordedEye = (nextRecordedEye + 1) % RECORDING_RING_SIZE;
+	}
+
+	void PostProcessor::PollRecording() {
+		TRACE_SCOPE("Poll recording");
+		// oldest first, so that images reach the recorder in the order they were submitted
+		for (int i = 0; i < RECORDING_RING_SIZE; ++i) {
+			RecordedEye &slot = recordedEyes[(nextRecordedEye + i) % RECORDING_RING_SIZE];
+			if (!slot.pending)
+				continue;
+
+			D3D11_MAPPED_SUBRESOURCE mapped;
+			HRESULT result = context->Map( slot.staging.Get(), 0, D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &mapped );
+			if (result == DXGI_ERROR_WAS_STILL_DRAWING)
+				break;
+			slot.pending = false;
+			if (FAILED(result)) {
+				Log() << "Error reading back recorded image: " << std::hex << result << std::dec << "\n";
+				continue;
+			}
+			RingFrame frame = recorder.AcquireFrame();
+			frame.entry = slot.entry;
+			size_t rowSize = size_t(slot.entry.width) * slot.entry.bytesPerPixel;
+			frame.pixels.resize( rowSize * slot.entry.height );
+			const uint8_t *src = (const uint8_t*)mapped.pData;
+			for (uint32_t y = 0; y < slot.entry.height; ++y) {
+				memcpy( frame.pixels.data() + y * rowSize, src + y * mapped.RowPitch, rowSize );
+			}
+			context->Unmap( slot.staging.Get(), 0 );
+			recorder.Submit( std::move( frame ) );
+		}
+
+		if (recorder.IsRunning()) {
+			for (const std::string &message : recorder.TakeMessages()) {
+				Log() << message << "\n";
+			}
+			uint64_t drops = recorder.DroppedFrames() + recordingSkipped;
+			if (drops >= loggedRecordingDrops + 100) {
+				Log() << "Recording could not keep up, " << drops << " images dropped so far\n";
+				loggedRecordingDrops = drops;
+			}
+		}
+	}
+
+	void PostProcessor::DumpRecording() {
+		if (!recorder.IsRunning()) {
+			Log() << "Recording is not enabled\n";
+			return;
+		}
+		static char timeBuf[16];
+		std::time_t now = std::time(nullptr);
+		std::strftime(timeBuf, sizeof(timeBuf), "%Y%m%d_%H%M%S", std::localtime(&now));
+		std::wostringstream filename;
+		filename << GetDllPath() << "\\" << "recording_" << timeBuf << ".ring";
+		uint64_t nowMicros = std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::system_clock::now().time_since_epoch() ).count();
+		recorder.RequestExport( nowMicros, FrameConfig().recordingDumpSeconds, filename.str() );
+	}
+
+	void PostProcessor::PublishMetrics() {
+		const Config &config = FrameConfig();
+		if (!config.shareMetrics || metricsFailed) {
+			metricsWriter.Close();
+			return;
+		}
+		if (!metricsWriter.IsOpen()) {
+			std::string error;
+			if (!metricsWriter.Open( "openvr_mod_metrics", error )) {
+				Log(LogLevel::Warning) << "Could not share metrics: " << error << "\n";
+				metricsFailed = true;
+				return;
+			}
+		}
+
+		uint64_t deferred = deferredMasks.load( std::memory_order_relaxed );
+		uint64_t masks = masksThisFrame + (deferred - publishedDeferredMasks);
+		publishedDeferredMasks = deferred;
+		masksThisFrame = 0;
+		masksTotal += masks;
+
+		bool active = enabled && config.ffrEnabled;
+		MetricValues metrics;
+		metrics[Metric::Frame] = frameCount;
+		metrics[Metric::UpdatedMicros] = std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::system_clock::now().time_since_epoch() ).count();
+		metrics[Metric::FfrActive] = active;
+		metrics[Metric::Mode] = !active ? 0 : useVariableRateShading ? 2 : 1;
+		metrics[Metric::SharpeningActive] = active && config.useSharpening;
+		metrics[Metric::TextureWidth] = textureWidth;
+		metrics[Metric::TextureHeight] = textureHeight;
+		metrics[Metric::MasksLastFrame] = masks;
+		metrics[Metric::MasksTotal] = masksTotal;
+		metrics[Metric::ViewsCreated] = viewsCreated.load( std::memory_order_relaxed );
+		metrics[Metric::Resets] = resets;
+		metrics[Metric::GpuPostProcessMicros] = gpuPostProcessMicros;
+		metrics[Metric::ShadedPixelsPermille] = shadedPixelsPermille;
+		if (useVariableRateShading) {
+			const VrsCallStats &vrsStats = VariableRateShading::Instance().StateTracker().LastFrameStats();
+			metrics[Metric::VrsCallsIssued] = vrsStats.issued;
+			metrics[Metric::VrsCallsAvoided] = vrsStats.avoided;
+		}
+		metrics[Metric::ForcedOutputWaits] = outputRing.ForcedWaits();
+		metricsWriter.Publish( metrics );
+	}
+
+	void PostProcessor::SaveTrace( bool inBackground ) {
+#ifdef OPENVR_MOD_TRACING
+		static char timeBuf[16];
+		std::time_t now = std::time(nullptr);
+		std::strftime(timeBuf, sizeof(timeBuf), "%Y%m%d_%H%M%S", std::localtime(&now));
+		std::wostringstream filename;
+		filename << GetDllPath() << "\\" << "trace_" << timeBuf << ".json";
+		std::wstring path = filename.str();
+
+		// collecting is quick, but the JSON for a few hundred frames takes a while to write
+		std::vector<TraceEvent> events = Tracer::Instance().Collect( FrameConfig().traceFrames );
+		std::vector<std::pair<uint32_t, std::string>> threadNames = Tracer::Instance().ThreadNames();
+		auto write = [events, threadNames, path]() -> std::string {
+			std::ofstream out( path );
+			WriteChromeTrace( out, events, threadNames );
+			if (out.good())
+				return "Saved trace of " + std::to_string( events.size() ) + " events to " + NarrowPath( path );
+			return "Could not write trace to " + NarrowPath( path );
+		};
+		// on the capture writer's thread, which logs the message with the next frame
+		if (inBackground) {
+			captureWriter.EnqueueTask( write );
+			++capturesWriting;
+		} else {
+			Log() << write() << "\n";
+		}
+#else
+		(void)inBackground;
+		Log() << "Tracing is not compiled in, build with BUILD_TRACING to save traces\n";
+#endif
+	}
+
+	struct AsyncKeyStateSource : KeySource {
+		bool IsPressed( int keyCode ) override {
+			return GetAsyncKeyState( keyCode ) != 0;
+		}
+	};
+
+	HotkeyBindings HotkeyBindingsFromConfig() {
+		const Config &config = Config::Instance();
+		HotkeyBindings bindings;
+		bindings.requireCtrl = config.hotkeysRequireCtrl;
+		bindings.requireAlt = config.hotkeysRequireAlt;
+		bindings.requireShift = config.hotkeysRequireShift;
+		auto bind = [&]( HotkeyCommand command, int key ) { bindings.keys[size_t(command)] = key; };
+		bind( HotkeyCommand::ToggleFfr, config.hotkeyToggleFfr );
+		bind( HotkeyCommand::ToggleDebugMode, config.hotkeyToggleDebugMode );
+		bind( HotkeyCommand::ToggleUseVrs, config.hotkeyToggleUseVrs );
+		bind( HotkeyCommand::DecreaseSharpness, config.hotkeyDecreaseSharpness );
+		bind( HotkeyCommand::IncreaseSharpness, config.hotkeyIncreaseSharpness );
+		bind( HotkeyCommand::DecreaseRadius, config.hotkeyDecreaseRadius );
+		bind( HotkeyCommand::IncreaseRadius, config.hotkeyIncreaseRadius );
+		bind( HotkeyCommand::SelectInnerRadius, config.hotkeySelectInnerRadius );
+		bind( HotkeyCommand::SelectMidRadius, config.hotkeySelectMidRadius );
+		bind( HotkeyCommand::SelectOuterRadius, config.hotkeySelectOuterRadius );
+		bind( HotkeyCommand::SelectSharpenRadius, config.hotkeySelectSharpenRadius );
+		bind( HotkeyCommand::CaptureOutput, config.hotkeyCaptureOutput );
+		bind( HotkeyCommand::DumpRecording, config.hotkeyDumpRecording );
+		bind( HotkeyCommand::DumpTrace, config.hotkeyDumpTrace );
+		return bindings;
+	}
+
+	void PostProcessor::ProcessHotkeys() {
+		if (!hotkeyInput.IsRunning()) {
+			hotkeyInput.Start( std::unique_ptr<KeySource>( new AsyncKeyStateSource ), HotkeyBindingsFromConfig(), std::chrono::milliseconds( HOTKEY_POLL_INTERVAL_MS ) );
+		}
+		HotkeyCommand command;
+		while (hotkeyInput.TryPop( command )) {
+			ExecuteHotkey( command );
+		}
+	}
+
+	void PostProcessor::RefreshFrameConfig() {
+		if (Config::Published().Refresh( frameConfig )) {
+			const Config &config = frameConfig->value;
+			VariableRateShading::Instance().SetRadii( config.innerRadius, config.midRadius, config.outerRadius );
 		}
+	}
 
-		if (IsHotkeyActive( Config::Instance().hotkeyDecreaseSharpness )) {
-			Config::Instance().sharpness = max(Config::Instance().sharpness - 0.05f, 0.f);
-			Log() << "Sharpness is now at " << Config::Instance().sharpness << std::endl;
+	void PostProcessor::CheckConfigReload() {
+		if (!configWatcher.IsRunning()) {
+			if (!Config::Instance().reloadOnChange || configWatchFailed)
+				return;
+			std::shared_ptr<ReloadMailbox<Config>> mailbox = std::make_shared<ReloadMailbox<Config>>();
+			std::wstring path = Config::FilePath();
+			// runs on the watcher thread; Submit logs the outcome along with what it rebuilt
+			auto reload = [mailbox, path]() {
+				std::unique_ptr<Config> config( new Config );
+				std::string error;
+				std::ifstream file( path );
+				if (!file.is_open())
+					error = "could not open the file";
+				else if (Config::Parse( file, *config, error ))
+					error = config->Validate();
+				if (error.empty())
+					mailbox->Post( std::move( config ), error );
+				else
+					mailbox->Post( nullptr, error );
+			};
+			if (!configWatcher.Start( GetDllPath(), L"openvr_mod.cfg", reload )) {
+				Log(LogLevel::Warning) << "Could not watch the config file for changes\n";
+				configWatchFailed = true;
+				return;
+			}
+			configReloads = mailbox;
+			return;
 		}
 
-		if (IsHotkeyActive( Config::Instance().hotkeyIncreaseSharpness )) {
-			Config::Instance().sharpness = min(Config::Instance().sharpness + 0.05f, 1.f);
-			Log() << "Sharpness is now at " << Config::Instance().sharpness << std::endl;
+		std::unique_ptr<Config> reloaded;
+		std::string error;
+		if (!configReloads->Take( reloaded, error ))
+			return;
+		if (!reloaded) {
+			Log(LogLevel::Warning) << "Keeping the current settings, the changed config file is invalid: " << error << "\n";
+			return;
 		}
+		// compared with the settings in effect, which include changes made by hotkeys
+		uint32_t plan = PlanConfigReload( Config::Published().Current()->value, *reloaded );
+		if (plan == ReloadNothing)
+			return;
 
-		if (IsHotkeyActive( Config::Instance().hotkeyDecreaseRadius )) {
+		Config::Instance() = *reloaded;
+		Config::Published().Publish( *reloaded );
+		ComPtr<ID3D11Device> knownDevice;
+		Log() << "Reloaded config file";
+		if (plan & ReloadHotkeys) {
+			// restarted with the new bindings by ProcessHotkeys, if still enabled
+			hotkeyInput.Stop();
+			Log() << ", rebinding hotkeys";
+		}
+		if (plan & ReloadRecorder) {
+			// reopens the ring file with the new size when the recording resources are prepared again
+			recorder.Stop();
+			Log() << ", restarting the recording";
+		}
+		if (plan & (ReloadVariableRateShading | ReloadResources | ReloadRecorder)) {
+			if (!Config::Instance().recordingEnabled)
+				recorder.Stop();
+			VariableRateShading::Instance().DisableVRS();
+			knownDevice = device;
+			Reset();
+			if (plan & ReloadVariableRateShading)
+				VariableRateShading::Instance().Reset();
+			Log() << ", recreating resources";
+		}
+		Log() << "\n";
+		if (knownDevice && Config::Instance().warmUp) {
+			// the next Submit would otherwise stall on all of them
+			WarmUpDeviceResources( knownDevice.Get(), WarmedDeviceResourceParts( Config::Instance() ) );
+		}
+		if (!Config::Instance().reloadOnChange)
+			configWatcher.Stop();
+	}
+
+	const Config & PostProcessor::FrameConfig() const {
+		return frameConfig ? frameConfig->value : Config::Instance();
+	}
+
+	void PostProcessor::ExecuteHotkey( HotkeyCommand command ) {
+		// changes a copy of the settings in effect, which passes see from the next frame on
+		Config config = Config::Published().Current()->value;
+		bool changed = false;
+		bool resetVrs = false;
+		switch (command) {
+		case HotkeyCommand::ToggleFfr:
+			enabled = !enabled;
+			VariableRateShading::Instance().DisableVRS();
+			if (enabled) {
+				ResumeDeferredContexts();
+				Log() << "Fixed foveated rendering is now enabled.\n";
+			} else {
+				PauseDeferredContexts();
+				Log() << "Fixed foveated rendering is now disabled.\n";
+			}
+			break;
+		case HotkeyCommand::ToggleDebugMode:
+			changed = true;
+			config.debugMode = !config.debugMode;
+			break;
+		case HotkeyCommand::ToggleUseVrs:
+			changed = true;
+			resetVrs = true;
+			config.useVrs = !config.useVrs;
+			break;
+		case HotkeyCommand::DecreaseSharpness:
+			changed = true;
+			config.sharpness = max(config.sharpness - 0.05f, 0.f);
+			Log() << "Sharpness is now at " << config.sharpness << "\n";
+			break;
+		case HotkeyCommand::IncreaseSharpness:
+			changed = true;
+			config.sharpness = min(config.sharpness + 0.05f, 1.f);
+			Log() << "Sharpness is now at " << config.sharpness << "\n";
+			break;
+		case HotkeyCommand::DecreaseRadius:
+			changed = true;
 			switch (selectedRadius) {
 			case 0:
-				Config::Instance().innerRadius = max(Config::Instance().innerRadius - 0.05f, 0.f);
-				Log() << "Inner FFR radius is now at " << Config::Instance().innerRadius << std::endl;
+				config.innerRadius = max(config.innerRadius - 0.05f, 0.f);
+				Log() << "Inner FFR radius is now at " << config.innerRadius << "\n";
 				break;
 			case 1:
-				Config::Instance().midRadius = max(Config::Instance().midRadius - 0.05f, 0.f);
-				Log() << "Mid FFR radius is now at " << Config::Instance().midRadius << std::endl;
+				config.midRadius = max(config.midRadius - 0.05f, 0.f);
+				Log() << "Mid FFR radius is now at " << config.midRadius << "\n";
 				break;
 			case 2:
-				Config::Instance().outerRadius = max(Config::Instance().outerRadius - 0.05f, 0.f);
-				Log() << "Outer FFR radius is now at " << Config::Instance().outerRadius << std::endl;
+				config.outerRadius = max(config.outerRadius - 0.05f, 0.f);
+				Log() << "Outer FFR radius is now at " << config.outerRadius << "\n";
 				break;
 			case 3:
-				Config::Instance().sharpenRadius = max(Config::Instance().sharpenRadius - 0.05f, 0.f);
-				Log() << "Sharpening radius is now at " << Config::Instance().sharpenRadius << std::endl;
+				config.sharpenRadius = max(config.sharpenRadius - 0.05f, 0.f);
+				Log() << "Sharpening radius is now at " << config.sharpenRadius << "\n";
 				break;
 			}
-		}
-
-		if (IsHotkeyActive( Config::Instance().hotkeyIncreaseRadius )) {
+			break;
+		case HotkeyCommand::IncreaseRadius:
+			changed = true;
 			switch (selectedRadius) {
 			case 0:
-				Config::Instance().innerRadius += 0.05f;
-				Log() << "Inner FFR radius is now at " << Config::Instance().innerRadius << std::endl;
+				config.innerRadius += 0.05f;
+				Log() << "Inner FFR radius is now at " << config.innerRadius << "\n";
 				break;
 			case 1:
-				Config::Instance().midRadius += 0.05f;
-				Log() << "Mid FFR radius is now at " << Config::Instance().midRadius << std::endl;
+				config.midRadius += 0.05f;
+				Log() << "Mid FFR radius is now at " << config.midRadius << "\n";
 				break;
 			case 2:
-				Config::Instance().outerRadius += 0.05f;
-				Log() << "Outer FFR radius is now at " << Config::Instance().outerRadius << std::endl;
+				config.outerRadius += 0.05f;
+				Log() << "Outer FFR radius is now at " << config.outerRadius << "\n";
 				break;
 			case 3:
-				Config::Instance().sharpenRadius += 0.05f;
-				Log() << "Sharpening radius is now at " << Config::Instance().sharpenRadius << std::endl;
+				config.sharpenRadius += 0.05f;
+				Log() << "Sharpening radius is now at " << config.sharpenRadius << "\n";
 				break;
 			}
-		}
-
-		if (IsHotkeyActive( Config::Instance().hotkeySelectInnerRadius )) {
+			break;
+		case HotkeyCommand::SelectInnerRadius:
 			selectedRadius = 0;
-		}
-
-		if (IsHotkeyActive( Config::Instance().hotkeySelectMidRadius )) {
+			break;
+		case HotkeyCommand::SelectMidRadius:
 			selectedRadius = 1;
-		}
-
-		if (IsHotkeyActive( Config::Instance().hotkeySelectOuterRadius )) {
+			break;
+		case HotkeyCommand::SelectOuterRadius:
 			selectedRadius = 2;
-		}
-
-		if (IsHotkeyActive( Config::Instance().hotkeySelectSharpenRadius )) {
+			break;
+		case HotkeyCommand::SelectSharpenRadius:
 			selectedRadius = 3;
-		}
-
-		if (IsHotkeyActive( Config::Instance().hotkeyCaptureOutput )) {
+			break;
+		case HotkeyCommand::CaptureOutput:
 			takeCapture = true;
+			break;
+		case HotkeyCommand::DumpRecording:
+			DumpRecording();
+			break;
+		case HotkeyCommand::DumpTrace:
+			SaveTrace( true );
+			break;
+		default:
+			break;
+		}
+		if (!changed)
+			return;
+		Config::Published().Publish( config );
+		if (resetVrs) {
+			// the resources are recreated within this frame, so they must see the new setting already
+			RefreshFrameConfig();
+			VariableRateShading::Instance().DisableVRS();
+			Reset();
+			VariableRateShading::Instance().Reset();
 		}
-	}
-
-	bool PostProcessor::IsHotkeyActive( int keyCode ) {
-		bool isPressedNow = GetAsyncKeyState( keyCode );
-		bool isNewlyPressed = !wasKeyPressedBefore[keyCode] && isPressedNow;
-		wasKeyPressedBefore[keyCode] = isPressedNow;
-		return isNewlyPressed;
 	}
 }
@@ -1,18 +1,67 @@
 #pragma once
 #include <d3d11.h>
 #include <wrl/client.h>
-#include <unordered_map>
+#include <atomic>
 #include "openvr.h"
+#include "EyeBatching.h"
+#include "OutputRing.h"
+#include "ResourcePool.h"
+#include "ViewCache.h"
+#include "TargetClassification.h"
+#include "EyeInference.h"
+#include "FrameSchedule.h"
+#include "ContextRegistry.h"
+#include "CaptureWriter.h"
+#include "CaptureRing.h"
+#include "HotkeyInput.h"
+#include "FileWatcher.h"
+#include "ConfigReload.h"
+#include "Snapshot.h"
+#include "LiveMetrics.h"
+#include "ResourceWarmup.h"
+
+struct Config;
 
 namespace vr {
 	using Microsoft::WRL::ComPtr;
+	class NvapiPreload;
+	typedef std::shared_ptr<const Snapshot<Config>> ConfigSnapshot;
+
+	// tags textures and views we cache data for with the generation of their cache entry via private data,
+	// so that an object recreated at the address of a freed one is not mistaken for it
+	struct PrivateDataTagger {
+		GUID guid;
+		explicit PrivateDataTagger(const GUID &guid) : guid(guid) {}
+		uint64_t GetTag(ID3D11DeviceChild *object);
+		void SetTag(ID3D11DeviceChild *object, uint64_t tag);
+	};
+	extern const GUID InputViewCacheTag;
+	extern const GUID DepthStencilViewCacheTag;
+	extern const GUID RenderTargetClassTag;
+	extern const GUID DepthTargetClassTag;
+	extern const GUID WarmupConsideredTag;
+	extern const GUID DepthTargetEyeTag;
 
 	class PostProcessor {
 	public:
-		void Apply(EVREye eEye, const Texture_t *pTexture, const VRTextureBounds_t* pBounds, EVRSubmitFlags nSubmitFlags);
+		// returns the bounds to submit to the compositor along with the (possibly replaced) texture
+		const VRTextureBounds_t * Apply(EVREye eEye, const Texture_t *pTexture, const VRTextureBounds_t* pBounds, EVRSubmitFlags nSubmitFlags);
 		void ApplyFixedFoveatedRendering(ID3D11DepthStencilView *depthStencilView, float depth, uint8_t stencil);
-		void OnRenderTargetChange(UINT numViews, ID3D11RenderTargetView * const *renderTargetViews);
+		void OnRenderTargetChange(UINT numViews, ID3D11RenderTargetView * const *renderTargetViews, ID3D11DepthStencilView *depthStencilView);
+		void OnViewportChange(UINT numViewports, const D3D11_VIEWPORT *viewports);
+		// these may be called from any thread, for any context other than the immediate one
+		void ApplyFixedFoveatedRenderingDeferred(ID3D11DeviceContext *ctx, ID3D11DepthStencilView *depthStencilView, float depth, uint8_t stencil);
+		void OnDeferredContextCreated(ID3D11DeviceContext *ctx);
+		void OnCommandListFinished(ID3D11DeviceContext *ctx);
+		// called on whichever thread created the device, possibly long before the first Submit
+		void OnDeviceCreated(ID3D11Device *device);
+		void OnSubmitted();
 		void Reset();
+		// saves the trace of the last frames, if tracing is compiled in
+		void SaveTrace(bool inBackground);
+		// ends the background threads, after the captures still queued are written and without finishing queued
+		// warm-up jobs; for when the hooks are shut down
+		void StopWorkers();
 
 	private:
 		bool enabled = true;
@@ -21,8 +70,13 @@ namespace vr {
 		uint32_t textureWidth = 0;
 		uint32_t textureHeight = 0;
 		bool textureContainsOnlyOneEye = true;
+		// textures holding both eyes are processed for both on the first Submit of a frame
+		EyeBatching eyeBatching = EyeBatching::None;
+		bool batchedEyePending = false;
+		VRTextureBounds_t predictedBounds;
 		bool requiresCopy = false;
 		bool inputIsSrgb = false;
+		DXGI_FORMAT inputFormat = DXGI_FORMAT_UNKNOWN;
 		ComPtr<ID3D11Device> device;
 		ComPtr<ID3D11DeviceContext> context;
 		ComPtr<ID3D11SamplerState> sampler;
@@ -32,13 +86,17 @@ namespace vr {
 		struct EyeViews {
 			ComPtr<ID3D11ShaderResourceView> view[2];
 		};
-		std::unordered_map<ID3D11Texture2D*, EyeViews> inputTextureViews;
+		ViewCache<ID3D11Texture2D*, EyeViews, PrivateDataTagger> inputTextureViews { PrivateDataTagger(InputViewCacheTag) };
 		// in case the incoming texture can't be bound as an SRV, we'll need to prepare a copy
 		ComPtr<ID3D11Texture2D> copiedTexture;
 		ComPtr<ID3D11ShaderResourceView> copiedTextureView;
+		// size of the texture behind the view returned by GetInputView
+		uint32_t inputViewWidth = 0;
+		uint32_t inputViewHeight = 0;
 
 		void PrepareCopyResources(DXGI_FORMAT format);
 		ID3D11ShaderResourceView *GetInputView(ID3D11Texture2D *inputTexture, int eye);
+		static HRESULT CreateInputViews(ID3D11Device *device, ID3D11Texture2D *inputTexture, EyeViews &views);
 
 		// resources for radial density masking
 		ComPtr<ID3D11VertexShader> rdmFullTriVertexShader;
@@ -46,22 +104,87 @@ namespace vr {
 		ComPtr<ID3D11Buffer> rdmMaskingConstantsBuffer[2];
 		ComPtr<ID3D11ComputeShader> rdmReconstructShader;
 		ComPtr<ID3D11Buffer> rdmReconstructConstantsBuffer[2];
-		ComPtr<ID3D11Texture2D> rdmReconstructedTexture;
-		ComPtr<ID3D11ShaderResourceView> rdmReconstructedView;
-		ComPtr<ID3D11UnorderedAccessView> rdmReconstructedUav;
 		ComPtr<ID3D11DepthStencilState> rdmDepthStencilState;
 		ComPtr<ID3D11RasterizerState> rdmRasterizerState;
-		int depthClearCount = 0;
+		// learns which depth clears of a frame belong to the scene, so that we only mask those
+		FrameSchedule frameSchedule;
+		bool loggedScheduleLearned = false;
 		struct DepthStencilViews {
 			ComPtr<ID3D11DepthStencilView> view[2];
 		};
-		std::unordered_map<ID3D11Texture2D*, DepthStencilViews> depthStencilViews;
+		typedef ViewCache<ID3D11Texture2D*, DepthStencilViews, PrivateDataTagger> DepthStencilViewCache;
+		DepthStencilViewCache depthStencilViews { PrivateDataTagger(DepthStencilViewCacheTag) };
 
 		void CalculateSavedPixelCount();
-		void PrepareRdmResources(DXGI_FORMAT format);
-		ID3D11DepthStencilView *GetDepthStencilView( ID3D11Texture2D *depthStencilTex, EVREye eye );
-		void ApplyRadialDensityMask(ID3D11Texture2D *depthStencilTex, float depth, uint8_t stencil);
-		void ReconstructRdmRender(vr::EVREye eye, ID3D11ShaderResourceView *inputView, int x, int y, int width, int height);
+		// only the thread calling Submit logs; deferred contexts would repeat the same lines for every context
+		ID3D11DepthStencilView *GetDepthStencilView( DepthStencilViewCache &views, ID3D11Texture2D *depthStencilTex, EVREye eye, bool mayLog );
+		static HRESULT CreateDepthStencilViews(ID3D11Device *device, ID3D11Texture2D *depthStencilTex, DepthStencilViews &views);
+
+		// render and depth targets bound by the game are classified once per view, since the hooks
+		// that need the classification run many times per frame
+		struct ClassifiedTarget {
+			TargetClass targetClass = TargetClass::Ignore;
+			TargetDesc desc;
+			// kept alive by the view
+			ID3D11Texture2D *texture = nullptr;
+		};
+		ViewCache<ID3D11RenderTargetView*, ClassifiedTarget, PrivateDataTagger, 64> renderTargetClasses { PrivateDataTagger(RenderTargetClassTag) };
+		typedef ViewCache<ID3D11DepthStencilView*, ClassifiedTarget, PrivateDataTagger> DepthTargetClassCache;
+		DepthTargetClassCache depthTargetClasses { PrivateDataTagger(DepthTargetClassTag) };
+
+		void ApplyRadialDensityMask(ID3D11DeviceContext *ctx, DepthStencilViewCache &views, const Config &config, const ClassifiedTarget &target, EVREye currentEye, float depth, uint8_t stencil);
+
+		// for games rendering each eye into a single-eye target, we need to infer which eye is being rendered
+		EyeInference eyeInference;
+		// set while we issue calls on the immediate context, so that the hooks don't feed them to the eye inference
+		bool issuingOwnCalls = false;
+		EyeInference::Schedule loggedSchedule = EyeInference::Schedule::Unknown;
+		bool singleEyeTargetBound = false;
+		ClassifiedTarget boundSingleEyeTarget;
+		void ApplySingleEyeVRS(const ClassifiedTarget &target);
+		// The eyes the inference placed a single-eye depth target in, tagged onto the texture along with the layout
+		// generation. Command lists are recorded without submits in between, so the deferred path takes the eye from
+		// there; the tags are thread-safe to read.
+		PrivateDataTagger depthTargetEyes { PrivateDataTagger(DepthTargetEyeTag) };
+		void LearnDepthTargetEye(ID3D11Texture2D *texture, EVREye eye);
+		bool LearnedDepthTargetEye(ID3D11Texture2D *texture, EVREye &eye);
+
+		SubmitLayout CurrentSubmitLayout() const;
+		const ClassifiedTarget & ClassifyRenderTargetView(ID3D11RenderTargetView *view);
+		const ClassifiedTarget & ClassifyDepthStencilView(DepthTargetClassCache &cache, ID3D11DepthStencilView *view);
+
+		// Engines recording their scene on deferred contexts get the RDM mask recorded into their command
+		// lists. Each deferred context has its own caches, as it may be recording concurrently with others.
+		// The deferred path runs while the registry is open; anything that changes the resources or layout it
+		// reads first pauses it, which waits for the calls in flight on each context to finish.
+		struct DeferredContextState {
+			DeferredContextState();
+			explicit DeferredContextState(uint32_t id);
+			void Reset();
+			DepthTargetClassCache depthTargetClasses;
+			DepthStencilViewCache depthStencilViews;
+			// refreshed per call, as the thread recording on the context may be working on a different frame
+			ConfigSnapshot config;
+			uint32_t layoutGeneration = 0;
+			// whether this is a deferred context of our device
+			bool validated = false;
+			bool usable = false;
+			// masked clears in the command list being recorded
+			int maskedClears = 0;
+		};
+		ContextRegistry<DeferredContextState> deferredContexts;
+		std::atomic<uint32_t> layoutGeneration { 1 };
+		// written by the recording threads, logged from Submit
+		std::atomic<uint64_t> deferredMasks { 0 };
+		std::atomic<bool> deferredRegistryFull { false };
+		bool loggedDeferredMasks = false;
+		bool loggedDeferredRegistryFull = false;
+		void PauseDeferredContexts();
+		void ResumeDeferredContexts();
+		// returns the state of a usable deferred context, with the call held in flight until EndDeferredCall
+		DeferredContextState * BeginDeferredCall(ID3D11DeviceContext *ctx);
+		void EndDeferredCall(ID3D11DeviceContext *ctx);
+		void ReconstructRdmRender(vr::EVREye eye, ID3D11ShaderResourceView *inputView, uint32_t inputWidth, uint32_t inputHeight, ID3D11UnorderedAccessView *outputUav, const EyeRegion (&regions)[2], bool sideBySide);
 
 		// NIS specific lookup textures
 		ComPtr<ID3D11Texture2D> scalerCoeffTexture;
@@ -72,26 +195,179 @@ namespace vr {
 		// sharpening resources
 		ComPtr<ID3D11ComputeShader> sharpenShader;
 		ComPtr<ID3D11Buffer> sharpenConstantsBuffer[2];
-		ComPtr<ID3D11Texture2D> sharpenedTexture;
-		ComPtr<ID3D11UnorderedAccessView> sharpenedTextureUav;
 
-		void PrepareSharpeningResources(DXGI_FORMAT format);
-		void ApplySharpening(EVREye eEye, ID3D11ShaderResourceView *inputView, int x, int y, int width, int height);
+		void ApplySharpening(EVREye eEye, ID3D11ShaderResourceView *inputView, uint32_t inputWidth, uint32_t inputHeight, ID3D11UnorderedAccessView *outputUav, const EyeRegion (&regions)[2], bool sideBySide);
+
+		// output textures, rotated per eye and frame so that we never write to a texture
+		// the compositor may still be reading from a previous Submit
+		// the pool may hand out textures of different sizes, each at least as large as the submitted texture
+		struct OutputTextures {
+			ComPtr<ID3D11Texture2D> rdmReconstructedTexture;
+			PoolKey rdmReconstructedSize;
+			ComPtr<ID3D11ShaderResourceView> rdmReconstructedView;
+			ComPtr<ID3D11UnorderedAccessView> rdmReconstructedUav;
+			ComPtr<ID3D11Texture2D> sharpenedTexture;
+			PoolKey sharpenedSize;
+			ComPtr<ID3D11UnorderedAccessView> sharpenedTextureUav;
+			ComPtr<ID3D11ShaderResourceView> sharpenedView;
+			ComPtr<ID3D11Query> submitFence;
+		};
+		OutputRing<OutputTextures> outputRing;
+		// how long an output texture due for reuse is waited for while the compositor may still read it
+		static const int OUTPUT_WAIT_LIMIT_MS = 20;
+		int currentOutput = -1;
+		DXGI_FORMAT outputFormat = DXGI_FORMAT_UNKNOWN;
+		// output textures may be larger than the submitted textures, in which case we use bounds to select the used area
+		PoolKey outputTextureSize;
+		VRTextureBounds_t outputBounds[2];
+
+		// size-dependent textures are served from a pool, so that a resolution change does not have to recreate them
+		struct TextureAllocator : ResourcePool<ComPtr<ID3D11Texture2D>>::Allocator {
+			ComPtr<ID3D11Device> device;
+			ComPtr<ID3D11Texture2D> Allocate(const PoolKey &key) override;
+			uint64_t SizeInBytes(const PoolKey &key) override;
+		};
+		TextureAllocator textureAllocator;
+		ResourcePool<ComPtr<ID3D11Texture2D>> texturePool { &textureAllocator };
+
+		void PrepareOutputRing(DXGI_FORMAT format);
+		void CreateOutputTextures(OutputTextures &output);
+		void ReleaseOutputTextures();
+		void Resize(uint32_t width, uint32_t height);
 
 		ID3D11Texture2D *lastSubmittedTexture = nullptr;
 		ID3D11Texture2D *outputTexture = nullptr;
+		// what each eye is submitted with; a batched Submit sets it for both eyes
+		struct EyeOutput {
+			ID3D11Texture2D *texture = nullptr;
+			PoolKey size;
+			int slot = -1;
+		};
+		EyeOutput eyeOutputs[2];
 		int eyeCount = 0;
 		int frameCount = 0;
 
 		void PrepareResources(ID3D11Texture2D *inputTexture, EColorSpace colorSpace);
-		void ApplyPostProcess(EVREye eEye, ID3D11Texture2D *inputTexture, const VRTextureBounds_t *bounds);
-		void SaveTextureToFile(ID3D11Texture2D *texture);
 
-		void CheckHotkeys();
-		bool IsHotkeyActive(int keyCode);
+		// Objects that do not depend on the submitted textures. The warm-up worker creates them as soon as the
+		// game has created its device; whatever it did not get to is created on the first Submit.
+		enum DeviceResourceParts : uint32_t {
+			SamplerPart = 1,
+			RdmPart = 2,
+			SharpeningPart = 4,
+			RecordingPart = 8,
+			NvapiPart = 16,
+		};
+		struct DeviceResources {
+			uint32_t parts = 0;
+			ComPtr<ID3D11SamplerState> sampler;
+			ComPtr<ID3D11VertexShader> rdmFullTriVertexShader;
+			ComPtr<ID3D11PixelShader> rdmMaskingShader;
+			ComPtr<ID3D11Buffer> rdmMaskingConstantsBuffer[2];
+			ComPtr<ID3D11ComputeShader> rdmReconstructShader;
+			ComPtr<ID3D11Buffer> rdmReconstructConstantsBuffer[2];
+			ComPtr<ID3D11DepthStencilState> rdmDepthStencilState;
+			ComPtr<ID3D11RasterizerState> rdmRasterizerState;
+			ComPtr<ID3D11ComputeShader> sharpenShader;
+			ComPtr<ID3D11Buffer> sharpenConstantsBuffer[2];
+			ComPtr<ID3D11ComputeShader> downsampleShader;
+			ComPtr<ID3D11Buffer> downsampleConstantsBuffer;
+			std::shared_ptr<NvapiPreload> nvapi;
+		};
+		// creates the given parts the resources do not have yet; may run on the warm-up worker
+		static void CreateDeviceResources(ID3D11Device *device, uint32_t parts, DeviceResources &resources);
+		static uint32_t WarmedDeviceResourceParts(const Config &config);
+		void PrepareRdmResources(const DeviceResources &resources);
+		void PrepareSharpeningResources(const DeviceResources &resources);
+
+		// Views on textures the game binds as eye render or depth targets are created in the background as
+		// well, so that they are ready by the time the texture is submitted or its depth is masked.
+		ResourceWarmup warmup;
+		void WarmUpDeviceResources(ID3D11Device *device, uint32_t parts);
+		void WarmUpInputViews(ID3D11Texture2D *texture);
+		void WarmUpDepthStencilViews(ID3D11Texture2D *texture);
+		// textures are tagged once they were considered for warm-up, as the classification caches evict
+		// targets of games binding many of them; a new generation makes all of them eligible again
+		PrivateDataTagger warmupConsidered { PrivateDataTagger(WarmupConsideredTag) };
+		uint64_t warmupGeneration = 1;
+		bool MarkWarmupConsidered(ID3D11Texture2D *texture);
+		void LogWarmupStats();
+		void ApplyPostProcess(EVREye eEye, ID3D11Texture2D *inputTexture, const VRTextureBounds_t *bounds, EyeBatching batching);
+		void ProcessEye(EVREye eye, ID3D11ShaderResourceView *inputView, const EyeRegion (&regions)[2], bool sideBySide, const Config &config);
+
+		// captures are copied into a ring of staging textures and read back once the GPU is done with them,
+		// so that taking one does not stall the game; the files are written on the capture writer's thread
+		struct PendingCapture {
+			ComPtr<ID3D11Texture2D> staging;
+			D3D11_TEXTURE2D_DESC desc;
+			// pixels are only filled in once read back
+			CapturedImage image;
+			bool pending = false;
+		};
+		static const int CAPTURE_RING_SIZE = 3;
+		PendingCapture captures[CAPTURE_RING_SIZE];
+		// writes captures and saved traces
+		CaptureWriter captureWriter;
+		// files queued on the writer whose message has not been logged yet
+		int capturesWriting = 0;
+		CapturePath CaptureFileName();
+		void RequestCapture(ID3D11Texture2D *texture);
+		void PollCaptures();
+
+		// Continuous recording downsamples each submitted eye on the GPU and reads it back through a ring
+		// of staging textures like captures do; the recorder appends the images to a ring file on disk.
+		struct RecordedEye {
+			ComPtr<ID3D11Texture2D> staging;
+			RingFrameEntry entry;
+			bool pending = false;
+		};
+		static const int RECORDING_RING_SIZE = 8;
+		RecordedEye recordedEyes[RECORDING_RING_SIZE];
+		int nextRecordedEye = 0;
+		ComPtr<ID3D11ComputeShader> downsampleShader;
+		ComPtr<ID3D11Buffer> downsampleConstantsBuffer;
+		ComPtr<ID3D11Texture2D> downsampledTexture;
+		ComPtr<ID3D11UnorderedAccessView> downsampledUav;
+		CaptureRecorder recorder;
+		uint64_t recordingSkipped = 0;
+		uint64_t loggedRecordingDrops = 0;
+		void PrepareRecordingResources(const DeviceResources &resources);
+		void RecordEye(EVREye eye, ID3D11ShaderResourceView *view, uint32_t viewWidth, uint32_t viewHeight, const EyeRegion &region);
+		void PollRecording();
+		void DumpRecording();
+
+		// keys are polled on the input thread; Submit only drains the commands it queued
+		static const int HOTKEY_POLL_INTERVAL_MS = 10;
+		HotkeyInput hotkeyInput;
+		void ProcessHotkeys();
+		void ExecuteHotkey(HotkeyCommand command);
+
+		// the settings of the current frame; hotkeys and config reloads publish new ones, taken at the start of a frame
+		ConfigSnapshot frameConfig;
+		void RefreshFrameConfig();
+		const Config & FrameConfig() const;
+
+		// the config file is parsed and validated on the watcher thread, which leaves the result for Submit;
+		// a reload only rebuilds what the changed settings require
+		FileWatcher configWatcher;
+		std::shared_ptr<ReloadMailbox<Config>> configReloads;
+		bool configWatchFailed = false;
+		void CheckConfigReload();
+
+		// metrics for external monitors, published through shared memory once per frame
+		LiveMetricsWriter metricsWriter;
+		bool metricsFailed = false;
+		uint32_t masksThisFrame = 0;
+		uint64_t masksTotal = 0;
+		uint64_t publishedDeferredMasks = 0;
+		// also counted by the threads recording on deferred contexts
+		std::atomic<uint64_t> viewsCreated { 0 };
+		uint64_t resets = 0;
+		uint64_t gpuPostProcessMicros = 0;
+		uint32_t shadedPixelsPermille = 0;
+		void PublishMetrics();
 
 		int selectedRadius = 0;
-		std::unordered_map<int, bool> wasKeyPressedBefore;
 		bool takeCapture = false;
 
 		struct ProfileQuery {
@@ -105,5 +381,6 @@ namespace vr {
 		int currentQuery = 0;
 		float summedGpuTime = 0.0f;
 		int countedQueries = 0;
+		bool lastDispatchBatched = false;
 	};
 }
@@ -0,0 +1,159 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace vr {
+	struct PoolKey {
+		uint32_t format = 0;
+		uint32_t bindFlags = 0;
+		uint32_t width = 0;
+		uint32_t height = 0;
+	};
+
+	struct PoolStats {
+		uint64_t hits = 0;
+		uint64_t misses = 0;
+		uint64_t bytesAllocated = 0;
+		uint64_t bytesInUse = 0;
+	};
+
+	// Pool for size-dependent resources, keyed by format, bind flags and a size bucket. Sizes are rounded
+	// up to the bucket granularity, and a request is also served by a free resource with a larger bucket,
+	// so that a resolution change usually only changes the viewport and bounds we use on a resource we
+	// already have, unless that resource would take more than maxOversize times the memory needed.
+	// Released resources are kept for reuse; only the oldest free resources beyond maxFree are destroyed.
+	template<typename Resource>
+	class ResourcePool {
+	public:
+		class Allocator {
+		public:
+			virtual ~Allocator() {}
+			// creates a resource of exactly the given key; expected to throw on failure
+			virtual Resource Allocate( const PoolKey &key ) = 0;
+			virtual uint64_t SizeInBytes( const PoolKey &key ) = 0;
+		};
+
+		ResourcePool( Allocator *allocator, uint32_t granularity = 256, size_t maxFree = 8, uint32_t maxOversize = 2 )
+			: allocator(allocator), granularity(granularity), maxFree(maxFree), maxOversize(maxOversize) {}
+
+		uint32_t Bucket( uint32_t size ) const {
+			return (size + granularity - 1) / granularity * granularity;
+		}
+
+		// whether a resource allocated for key would be handed out for a request of the given size
+		bool Serves( const PoolKey &key, uint32_t width, uint32_t height ) const {
+			PoolKey wanted = key;
+			wanted.width = Bucket( width );
+			wanted.height = Bucket( height );
+			return Fits( key, wanted );
+		}
+
+		// returns a resource at least as large as requested; the actually allocated size is written to key
+		Resource Acquire( uint32_t format, uint32_t bindFlags, uint32_t width, uint32_t height, PoolKey *key = nullptr ) {
+			PoolKey wanted;
+			wanted.format = format;
+			wanted.bindFlags = bindFlags;
+			wanted.width = Bucket( width );
+			wanted.height = Bucket( height );
+
+			Entry *best = nullptr;
+			for (Entry &entry : entries) {
+				if (entry.inUse || !Fits( entry.key, wanted ))
+					continue;
+				if (best == nullptr || Area( entry.key ) < Area( best->key ))
+					best = &entry;
+			}
+
+			if (best != nullptr) {
+				++stats.hits;
+			} else {
+				++stats.misses;
+				Entry entry;
+				entry.resource = allocator->Allocate( wanted );
+				entry.key = wanted;
+				entry.bytes = allocator->SizeInBytes( wanted );
+				stats.bytesAllocated += entry.bytes;
+				entries.push_back( entry );
+				best = &entries.back();
+			}
+
+			best->inUse = true;
+			best->lastUse = ++useCounter;
+			stats.bytesInUse += best->bytes;
+			if (key != nullptr)
+				*key = best->key;
+			return best->resource;
+		}
+
+		void Release( const Resource &resource ) {
+			for (Entry &entry : entries) {
+				if (entry.inUse && entry.resource == resource) {
+					entry.inUse = false;
+					entry.lastUse = ++useCounter;
+					stats.bytesInUse -= entry.bytes;
+					break;
+				}
+			}
+			TrimFree( maxFree );
+		}
+
+		// destroys all resources that are currently not in use
+		void Trim() {
+			TrimFree( 0 );
+		}
+
+		void Clear() {
+			entries.clear();
+			stats.bytesAllocated = 0;
+			stats.bytesInUse = 0;
+		}
+
+		const PoolStats & Stats() const { return stats; }
+
+	private:
+		struct Entry {
+			Resource resource;
+			PoolKey key;
+			uint64_t bytes = 0;
+			uint64_t lastUse = 0;
+			bool inUse = false;
+		};
+
+		Allocator *allocator;
+		uint32_t granularity;
+		size_t maxFree;
+		uint32_t maxOversize;
+		std::vector<Entry> entries;
+		uint64_t useCounter = 0;
+		PoolStats stats;
+
+		bool Fits( const PoolKey &have, const PoolKey &wanted ) const {
+			return have.format == wanted.format && have.bindFlags == wanted.bindFlags
+				&& have.width >= wanted.width && have.height >= wanted.height
+				&& Area( have ) <= maxOversize * Area( wanted );
+		}
+
+		static uint64_t Area( const PoolKey &key ) {
+			return uint64_t(key.width) * key.height;
+		}
+
+		void TrimFree( size_t keep ) {
+			for (;;) {
+				size_t freeCount = 0;
+				size_t oldest = entries.size();
+				for (size_t i = 0; i < entries.size(); ++i) {
+					if (entries[i].inUse)
+						continue;
+					++freeCount;
+					if (oldest == entries.size() || entries[i].lastUse < entries[oldest].lastUse)
+						oldest = i;
+				}
+				if (freeCount <= keep)
+					return;
+				stats.bytesAllocated -= entries[oldest].bytes;
+				entries.erase( entries.begin() + oldest );
+			}
+		}
+	};
+}
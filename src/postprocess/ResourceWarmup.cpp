@@ -0,0 +1,208 @@
+#include "ResourceWarmup.h"
+
+namespace vr {
+	ResourceWarmup::Entry * ResourceWarmup::Shared::Find( const Key &key ) {
+		for (Entry &entry : entries) {
+			if (entry.key == key)
+				return &entry;
+		}
+		return nullptr;
+	}
+
+	void ResourceWarmup::Shared::Erase( Entry *entry ) {
+		entries.erase( entries.begin() + (entry - entries.data()) );
+	}
+
+	void ResourceWarmup::Shared::DropAll( std::unique_lock<std::mutex> &lock, bool waitForRunning ) {
+		bool running = false;
+		for (size_t i = 0; i < entries.size(); ) {
+			Entry &entry = entries[i];
+			if (entry.state == State::Running) {
+				entry.discard = true;
+				running = true;
+				++i;
+				continue;
+			}
+			if (entry.state == State::Done)
+				++stats.discarded;
+			entries.erase( entries.begin() + i );
+		}
+		if (running && waitForRunning) {
+			// the objects may be created on a device that is about to be released
+			finished.wait( lock, [this] {
+				for (const Entry &entry : entries) {
+					if (entry.discard)
+						return false;
+				}
+				return true;
+			} );
+		}
+	}
+
+	ResourceWarmup::ResourceWarmup( size_t capacity ) : shared( std::make_shared<Shared>() ), capacity( capacity ) {}
+
+	ResourceWarmup::~ResourceWarmup() {
+		std::lock_guard<std::mutex> threadLock( threadMutex );
+		// may run while the DLL is unloaded, where joining a thread would deadlock on the loader lock
+		if (thread.joinable()) {
+			{
+				std::lock_guard<std::mutex> lock( shared->mutex );
+				for (size_t i = 0; i < shared->entries.size(); ) {
+					if (shared->entries[i].state == State::Queued)
+						shared->entries.erase( shared->entries.begin() + i );
+					else
+						++i;
+				}
+				shared->stopping = true;
+			}
+			shared->wakeup.notify_one();
+			thread.detach();
+		}
+	}
+
+	bool ResourceWarmup::Request( const Key &key, Job job ) {
+		{
+			std::lock_guard<std::mutex> lock( shared->mutex );
+			if (shared->Find( key ) != nullptr)
+				return false;
+			if (shared->entries.size() >= capacity) {
+				Entry *oldest = nullptr;
+				for (Entry &entry : shared->entries) {
+					if (entry.state == State::Done) {
+						oldest = &entry;
+						break;
+					}
+				}
+				if (oldest == nullptr) {
+					++shared->stats.rejected;
+					return false;
+				}
+				++shared->stats.discarded;
+				shared->Erase( oldest );
+			}
+			Entry entry;
+			entry.key = key;
+			entry.job = std::move( job );
+			shared->entries.push_back( std::move( entry ) );
+			++shared->stats.requested;
+		}
+		std::lock_guard<std::mutex> threadLock( threadMutex );
+		if (!thread.joinable()) {
+			{
+				std::lock_guard<std::mutex> lock( shared->mutex );
+				shared->stopping = false;
+			}
+			thread = std::thread( Run, shared );
+		}
+		shared->wakeup.notify_one();
+		return true;
+	}
+
+	std::shared_ptr<void> ResourceWarmup::TakeResult( const Key &key ) {
+		std::unique_lock<std::mutex> lock( shared->mutex );
+		Entry *entry = shared->Find( key );
+		// a discarded job's result is dropped, so there is nothing to wait for
+		if (entry == nullptr || entry->discard)
+			return nullptr;
+		if (entry->state == State::Queued) {
+			++shared->stats.cancelled;
+			shared->Erase( entry );
+			return nullptr;
+		}
+		if (entry->state == State::Running) {
+			++shared->stats.waited;
+			// the entry stays in place while it runs, but later ones may move
+			shared->finished.wait( lock, [&] {
+				entry = shared->Find( key );
+				return entry == nullptr || entry->state != State::Running;
+			} );
+			if (entry == nullptr)
+				return nullptr;
+		}
+		std::shared_ptr<void> result = std::move( entry->result );
+		shared->Erase( entry );
+		++shared->stats.taken;
+		return result;
+	}
+
+	bool ResourceWarmup::IsPending( const Key &key ) {
+		std::lock_guard<std::mutex> lock( shared->mutex );
+		Entry *entry = shared->Find( key );
+		return entry != nullptr && !entry->discard;
+	}
+
+	void ResourceWarmup::Clear() {
+		std::unique_lock<std::mutex> lock( shared->mutex );
+		shared->DropAll( lock, true );
+	}
+
+	void ResourceWarmup::Discard() {
+		std::unique_lock<std::mutex> lock( shared->mutex );
+		shared->DropAll( lock, false );
+	}
+
+	void ResourceWarmup::Stop() {
+		std::lock_guard<std::mutex> threadLock( threadMutex );
+		if (!thread.joinable())
+			return;
+		{
+			std::unique_lock<std::mutex> lock( shared->mutex );
+			shared->DropAll( lock, true );
+			shared->stopping = true;
+		}
+		shared->wakeup.notify_one();
+		thread.join();
+	}
+
+	WarmupStats ResourceWarmup::Stats() {
+		std::lock_guard<std::mutex> lock( shared->mutex );
+		return shared->stats;
+	}
+
+	void ResourceWarmup::Run( std::shared_ptr<Shared> shared ) {
+		std::unique_lock<std::mutex> lock( shared->mutex );
+		while (true) {
+			Entry *next = nullptr;
+			shared->wakeup.wait( lock, [&] {
+				for (Entry &entry : shared->entries) {
+					if (entry.state == State::Queued) {
+						next = &entry;
+						return true;
+					}
+				}
+				return shared->stopping;
+			} );
+			// jobs requested while stopping are left to the next thread
+			if (shared->stopping)
+				return;
+
+			next->state = State::Running;
+			Key key = next->key;
+			Job job = std::move( next->job );
+			lock.unlock();
+			std::shared_ptr<void> result;
+			try {
+				result = job();
+			} catch (...) {
+				result = nullptr;
+			}
+			// releases what the job holds on to, e.g. the object it worked on, outside of the lock
+			job = nullptr;
+			lock.lock();
+
+			// running entries are only removed here
+			Entry *entry = shared->Find( key );
+			if (!result)
+				++shared->stats.failed;
+			else if (entry->discard)
+				++shared->stats.discarded;
+			if (entry->discard || !result) {
+				shared->Erase( entry );
+			} else {
+				entry->state = State::Done;
+				entry->result = std::move( result );
+			}
+			shared->finished.notify_all();
+		}
+	}
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace vr {
+	struct WarmupStats {
+		uint64_t requested = 0;
+		// results handed out, and how many of those had to be waited for as they were still being created
+		uint64_t taken = 0;
+		uint64_t waited = 0;
+		// jobs taken back before they started, so that the caller created the objects itself
+		uint64_t cancelled = 0;
+		// results dropped unused, by Clear or to make room for newer requests
+		uint64_t discarded = 0;
+		// requests turned away because too many jobs and results were pending
+		uint64_t rejected = 0;
+		uint64_t failed = 0;
+	};
+
+	// Creates objects ahead of their first use on a worker thread, so that the thread needing them only takes
+	// finished ones instead of stalling on their creation. A job is identified by the object it works on and
+	// a kind, and is not requested again while its result is pending. Taking the result of a job that has not
+	// started yet cancels it, so that the caller creates the objects right away instead of queueing behind
+	// other jobs; a job being run is waited for, which is never slower than creating the objects again.
+	// Finished results that nobody took are dropped, oldest first, once capacity jobs and results are pending.
+	class ResourceWarmup {
+	public:
+		struct Key {
+			const void *object;
+			uint32_t kind;
+			bool operator==( const Key &other ) const { return object == other.object && kind == other.kind; }
+		};
+		// returns null if the objects could not be created; exceptions count as failures, too
+		typedef std::function<std::shared_ptr<void>()> Job;
+
+		explicit ResourceWarmup( size_t capacity = 16 );
+		ResourceWarmup( const ResourceWarmup & ) = delete;
+		ResourceWarmup & operator=( const ResourceWarmup & ) = delete;
+		~ResourceWarmup();
+
+		// returns whether the job was queued; not while a discarded job for the key is still running
+		bool Request( const Key &key, Job job );
+		// returns the result for the key if its job finished or was running, null otherwise
+		template<typename T>
+		std::shared_ptr<T> Take( const Key &key ) { return std::static_pointer_cast<T>( TakeResult( key ) ); }
+		bool IsPending( const Key &key );
+		// drops all queued jobs and finished results, waiting for a job being run to finish
+		void Clear();
+		// like Clear, but a job being run is not waited for; it drops its result once done
+		void Discard();
+		// like Clear, and stops the thread; it is restarted by the next request
+		void Stop();
+		WarmupStats Stats();
+
+	private:
+		enum class State { Queued, Running, Done };
+		struct Entry {
+			Key key;
+			Job job;
+			State state = State::Queued;
+			// set for a running job whose result nobody wants anymore
+			bool discard = false;
+			std::shared_ptr<void> result;
+		};
+		// shared with the thread, so that a thread we could not join does not outlive its jobs
+		struct Shared {
+			std::mutex mutex;
+			std::condition_variable wakeup;
+			std::condition_variable finished;
+			// in the order requested
+			std::vector<Entry> entries;
+			bool stopping = false;
+			WarmupStats stats;
+
+			Entry * Find( const Key &key );
+			void Erase( Entry *entry );
+			// a job being run drops its own result, and may be waited for
+			void DropAll( std::unique_lock<std::mutex> &lock, bool waitForRunning );
+		};
+		std::shared_ptr<Shared> shared;
+		size_t capacity;
+		// jobs may be requested from any thread, while the thread calling Submit stops the worker
+		std::mutex threadMutex;
+		std::thread thread;
+
+		std::shared_ptr<void> TakeResult( const Key &key );
+		static void Run( std::shared_ptr<Shared> shared );
+	};
+}
@@ -0,0 +1,111 @@
+#include "RuntimeDiscovery.h"
+#include <vrcommon/envvartools_public.h>
+#include <vrcommon/strtools_public.h>
+#include <vrcommon/vrpathregistry_public.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#undef GetEnvironmentVariable
+#else
+#include <sys/stat.h>
+#endif
+
+namespace vr {
+	namespace {
+		bool FileStamp( const std::string &path, int64_t &modified, int64_t &size ) {
+#ifdef _WIN32
+			// with the full resolution, as _stat only has seconds
+			WIN32_FILE_ATTRIBUTE_DATA data;
+			if (!GetFileAttributesExW( UTF8to16( path ).c_str(), GetFileExInfoStandard, &data ))
+				return false;
+			modified = (int64_t(data.ftLastWriteTime.dwHighDateTime) << 32) | data.ftLastWriteTime.dwLowDateTime;
+			size = (int64_t(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+#else
+			struct stat buf;
+			if (stat( path.c_str(), &buf ) != 0)
+				return false;
+#ifdef __APPLE__
+			modified = int64_t(buf.st_mtimespec.tv_sec) * 1000000000 + buf.st_mtimespec.tv_nsec;
+#else
+			modified = int64_t(buf.st_mtim.tv_sec) * 1000000000 + buf.st_mtim.tv_nsec;
+#endif
+			size = int64_t(buf.st_size);
+#endif
+			return true;
+		}
+	}
+
+	RuntimeDiscovery & RuntimeDiscovery::Instance() {
+		static RuntimeDiscovery instance;
+		return instance;
+	}
+
+	RuntimeDiscovery::Fingerprint RuntimeDiscovery::Current() {
+		Fingerprint current;
+		// everything that changes which registry file is read or which paths come from the environment instead
+		const char *variables[] = {
+			k_pchRuntimeOverrideVar, k_pchConfigOverrideVar, k_pchLogOverrideVar, "VR_PATHREG_OVERRIDE", "XDG_CONFIG_HOME", "HOME",
+		};
+		for (const char *name : variables) {
+			current.environment += GetEnvironmentVariable( name );
+			current.environment += '\0';
+		}
+		if (current.environment != registryEnvironment) {
+			registryFile = CVRPathRegistry_Public::GetVRPathRegistryFilename();
+			registryEnvironment = current.environment;
+		}
+		current.exists = FileStamp( registryFile, current.modified, current.size );
+		return current;
+	}
+
+	bool RuntimeDiscovery::GetPaths( std::string *runtimePath, std::string *configPath, std::string *logPath ) {
+		std::lock_guard<std::mutex> lock( mutex );
+		auto now = std::chrono::steady_clock::now();
+		if (!checked || now - lastCheck >= checkInterval) {
+			Fingerprint current = Current();
+			if (!(current == fingerprint)) {
+				for (Entry &entry : entries) {
+					entry.valid = false;
+				}
+				fingerprint = current;
+			}
+			lastCheck = now;
+			checked = true;
+		}
+
+		Entry &entry = entries[(runtimePath ? 1 : 0) | (configPath ? 2 : 0) | (logPath ? 4 : 0)];
+		if (!entry.valid) {
+			entry.result = CVRPathRegistry_Public::GetPaths( runtimePath ? &entry.runtimePath : nullptr,
+				configPath ? &entry.configPath : nullptr, logPath ? &entry.logPath : nullptr, nullptr, nullptr );
+			entry.valid = true;
+			++reads;
+		}
+		if (runtimePath)
+			*runtimePath = entry.runtimePath;
+		if (configPath)
+			*configPath = entry.configPath;
+		if (logPath)
+			*logPath = entry.logPath;
+		return entry.result;
+	}
+
+	void RuntimeDiscovery::Invalidate() {
+		std::lock_guard<std::mutex> lock( mutex );
+		for (Entry &entry : entries) {
+			entry.valid = false;
+		}
+		// the registry file may have moved with the environment as well
+		checked = false;
+	}
+
+	void RuntimeDiscovery::SetCheckInterval( std::chrono::milliseconds interval ) {
+		std::lock_guard<std::mutex> lock( mutex );
+		checkInterval = interval;
+		checked = false;
+	}
+
+	uint64_t RuntimeDiscovery::ReadCount() const {
+		std::lock_guard<std::mutex> lock( mutex );
+		return reads;
+	}
+}
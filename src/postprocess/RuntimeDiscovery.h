@@ -0,0 +1,58 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+namespace vr {
+	// Remembers what the path registry resolved to, so that launchers polling VR_IsRuntimeInstalled,
+	// VR_GetRuntimePath or VR_IsHmdPresent do not read and parse openvrpaths.vrpath on every call. The registry is
+	// read again once one of the environment variables it depends on changes, the registry file's modification
+	// time or size changes, or Invalidate is called. Those are only looked at once per check interval, as building
+	// the environment and the stat of the registry file cost more than the rest of a poll.
+	class RuntimeDiscovery {
+	public:
+		static RuntimeDiscovery & Instance();
+
+		// CVRPathRegistry_Public::GetPaths without path overrides; pass nullptr for paths you don't care about
+		bool GetPaths( std::string *runtimePath, std::string *configPath, std::string *logPath );
+		void Invalidate();
+		// 0 looks for changes on every call
+		void SetCheckInterval( std::chrono::milliseconds interval );
+		// how often the registry has actually been read
+		uint64_t ReadCount() const;
+
+	private:
+		struct Fingerprint {
+			std::string environment;
+			bool exists = false;
+			int64_t modified = 0;
+			int64_t size = 0;
+
+			bool operator==( const Fingerprint &other ) const {
+				return environment == other.environment && exists == other.exists && modified == other.modified && size == other.size;
+			}
+		};
+
+		struct Entry {
+			bool valid = false;
+			bool result = false;
+			std::string runtimePath, configPath, logPath;
+		};
+
+		Fingerprint Current();
+
+		mutable std::mutex mutex;
+		// the registry file for the environment it was computed for
+		std::string registryEnvironment;
+		std::string registryFile;
+		Fingerprint fingerprint;
+		std::chrono::milliseconds checkInterval { 250 };
+		std::chrono::steady_clock::time_point lastCheck;
+		bool checked = false;
+		// one per combination of requested paths, as GetPaths only succeeds without the registry file if every
+		// requested path is overridden
+		Entry entries[8];
+		uint64_t reads = 0;
+	};
+}
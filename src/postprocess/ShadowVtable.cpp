@@ -0,0 +1,121 @@
+#include "ShadowVtable.h"
+#include <atomic>
+#include <utility>
+
+namespace vr {
+	static_assert(sizeof(std::atomic<void*>) == sizeof(void*), "shadow vtable entries must be laid out like a vtable");
+	static_assert(sizeof(std::atomic<void**>) == sizeof(void**), "the vtable pointer must be replaceable atomically");
+
+	namespace {
+		// The vtable pointer is replaced while other threads may be calling through the object. Both vtables
+		// stay valid, so a call goes through either one.
+		std::atomic<void**> & VtablePointer( void *instance ) {
+			return *reinterpret_cast<std::atomic<void**>*>(instance);
+		}
+	}
+
+	struct ShadowVtables::Table {
+		void *instance = nullptr;
+		void **original = nullptr;
+		size_t methodCount = 0;
+		size_t capacity = 0;
+		std::unique_ptr<std::atomic<void*>[]> entries;
+		// Entries outgrown by a new object at this address. A thread may still be calling through one when it
+		// is replaced, so they are kept for as long as the table.
+		std::vector<std::unique_ptr<std::atomic<void*>[]>> retired;
+
+		void ** Vtable() const {
+			return reinterpret_cast<void**>(entries.get() + PREFIX_ENTRIES);
+		}
+	};
+
+	ShadowVtables & ShadowVtables::Instance() {
+		// never destroyed, as objects may still point at our tables while the DLL unloads
+		static ShadowVtables *instance = new ShadowVtables;
+		return *instance;
+	}
+
+	ShadowVtables::Table * ShadowVtables::Find( void *instance ) const {
+		for (const std::unique_ptr<Table> &table : tables) {
+			if (table->instance == instance)
+				return table.get();
+		}
+		return nullptr;
+	}
+
+	bool ShadowVtables::UsesTable( void *instance, const Table &table ) {
+		return VtablePointer( instance ).load( std::memory_order_relaxed ) == table.Vtable();
+	}
+
+	void * ShadowVtables::Hook( void *instance, size_t methodCount, uint32_t methodPos, void *hook ) {
+		std::lock_guard<std::mutex> lock( mutex );
+		Table *table = Find( instance );
+		if (table != nullptr && UsesTable( instance, *table )) {
+			if (methodPos >= table->methodCount)
+				return nullptr;
+			table->entries[PREFIX_ENTRIES + methodPos].store( hook, std::memory_order_release );
+			return table->original[methodPos];
+		}
+		if (methodPos >= methodCount)
+			return nullptr;
+
+		// A table left by a destroyed or restored object at this address is reused. Its entries are only
+		// overwritten with methods of the object's own vtable, so a call still running through them stays valid.
+		if (table == nullptr) {
+			tables.push_back( std::unique_ptr<Table>( new Table ) );
+			table = tables.back().get();
+			table->instance = instance;
+		}
+		if (table->capacity < methodCount) {
+			if (table->entries)
+				table->retired.push_back( std::move( table->entries ) );
+			table->entries.reset( new std::atomic<void*>[PREFIX_ENTRIES + methodCount] );
+			table->capacity = methodCount;
+		}
+		void **vtable = VtablePointer( instance ).load( std::memory_order_acquire );
+		table->original = vtable;
+		table->methodCount = methodCount;
+		for (size_t i = 0; i < PREFIX_ENTRIES + methodCount; ++i) {
+			table->entries[i].store( (vtable - PREFIX_ENTRIES)[i], std::memory_order_relaxed );
+		}
+		table->entries[PREFIX_ENTRIES + methodPos].store( hook, std::memory_order_relaxed );
+		// the copy must be complete before any thread can call through it
+		VtablePointer( instance ).store( table->Vtable(), std::memory_order_release );
+		return vtable[methodPos];
+	}
+
+	void * ShadowVtables::Original( void *instance, uint32_t methodPos ) const {
+		std::lock_guard<std::mutex> lock( mutex );
+		Table *table = Find( instance );
+		if (table != nullptr && UsesTable( instance, *table ))
+			return table->original[methodPos];
+		return VtablePointer( instance ).load( std::memory_order_relaxed )[methodPos];
+	}
+
+	bool ShadowVtables::IsShadowed( void *instance ) const {
+		std::lock_guard<std::mutex> lock( mutex );
+		Table *table = Find( instance );
+		return table != nullptr && UsesTable( instance, *table );
+	}
+
+	void ShadowVtables::Restore( void *instance ) {
+		std::lock_guard<std::mutex> lock( mutex );
+		Table *table = Find( instance );
+		if (table != nullptr && UsesTable( instance, *table ))
+			VtablePointer( instance ).store( table->original, std::memory_order_release );
+	}
+
+	void ShadowVtables::UnhookAll() {
+		std::lock_guard<std::mutex> lock( mutex );
+		for (const std::unique_ptr<Table> &table : tables) {
+			for (size_t i = 0; i < table->methodCount; ++i) {
+				table->entries[PREFIX_ENTRIES + i].store( table->original[i], std::memory_order_release );
+			}
+		}
+	}
+
+	size_t ShadowVtables::Count() const {
+		std::lock_guard<std::mutex> lock( mutex );
+		return tables.size();
+	}
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace vr {
+	// Hooks methods of single objects by pointing each object at a copy of its vtable in which some entries are
+	// replaced. Unlike patching the methods' code, this neither suspends threads nor writes executable memory,
+	// and other objects of the same class are left alone. Hooks must be installed and removed from one thread
+	// at a time; calls through hooked objects may happen on any thread meanwhile.
+	class ShadowVtables {
+	public:
+		// entries copied from before the vtable, where the ABI keeps the type information
+		static const size_t PREFIX_ENTRIES = 2;
+
+		static ShadowVtables & Instance();
+
+		// Replaces method methodPos of instance with hook and returns the method it replaced in the object's own
+		// vtable, which must have at least methodCount entries. Returns nullptr if methodPos is out of range.
+		void * Hook( void *instance, size_t methodCount, uint32_t methodPos, void *hook );
+		// the method the instance would call without our hooks
+		void * Original( void *instance, uint32_t methodPos ) const;
+		bool IsShadowed( void *instance ) const;
+		// points the instance back at its own vtable; only for instances known to still exist
+		void Restore( void *instance );
+		// Puts the original methods back into all shadow vtables, so that objects still using one behave as if
+		// never hooked. The objects themselves are not touched, as they may no longer exist.
+		void UnhookAll();
+		size_t Count() const;
+
+	private:
+		struct Table;
+		Table * Find( void *instance ) const;
+		static bool UsesTable( void *instance, const Table &table );
+
+		mutable std::mutex mutex;
+		// Tables are never freed, as other threads may be calling through them at any time. A table is reused
+		// for a new object created at the address of the object it was made for.
+		std::vector<std::unique_ptr<Table>> tables;
+	};
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+namespace vr {
+	template<typename T>
+	struct Snapshot {
+		T value;
+		// increases with every published value, so that caches derived from a value can tell cheaply whether it is stale
+		uint64_t generation;
+	};
+
+	// Publishes immutable copies of a settings struct. A reader takes the current copy and keeps using it for
+	// as long as it holds it, so it never sees a change half applied; the copy is freed with its last reader.
+	template<typename T>
+	class SnapshotPublisher {
+	public:
+		typedef std::shared_ptr<const Snapshot<T>> Ptr;
+
+		explicit SnapshotPublisher( const T &initial ) {
+			Publish( initial );
+		}
+		SnapshotPublisher( const SnapshotPublisher & ) = delete;
+		SnapshotPublisher & operator=( const SnapshotPublisher & ) = delete;
+
+		uint64_t Publish( const T &value ) {
+			std::lock_guard<std::mutex> lock( writeMutex );
+			uint64_t next = generation.load( std::memory_order_relaxed ) + 1;
+			Ptr snapshot( new Snapshot<T> { value, next } );
+			std::atomic_store_explicit( &current, snapshot, std::memory_order_release );
+			generation.store( next, std::memory_order_release );
+			return next;
+		}
+
+		Ptr Current() const {
+			return std::atomic_load_explicit( &current, std::memory_order_acquire );
+		}
+
+		uint64_t Generation() const {
+			return generation.load( std::memory_order_acquire );
+		}
+
+		// replaces the given snapshot by the current one if a newer one was published; returns whether it did.
+		// Only reads the generation when nothing changed.
+		bool Refresh( Ptr &snapshot ) const {
+			if (snapshot && snapshot->generation == Generation())
+				return false;
+			snapshot = Current();
+			return true;
+		}
+
+	private:
+		Ptr current;
+		std::atomic<uint64_t> generation { 0 };
+		std::mutex writeMutex;
+	};
+}
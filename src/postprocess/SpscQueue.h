@@ -0,0 +1,43 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+
+namespace vr {
+	// A bounded queue for exactly one producer thread and one consumer thread. Neither side ever blocks
+	// or allocates: pushing into a full queue fails, popping from an empty one fails.
+	template<typename T, size_t Capacity>
+	class SpscQueue {
+		static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+	public:
+		SpscQueue() {}
+		SpscQueue( const SpscQueue & ) = delete;
+		SpscQueue & operator=( const SpscQueue & ) = delete;
+
+		// producer only
+		bool TryPush( const T &value ) {
+			size_t tailIndex = tail.load( std::memory_order_relaxed );
+			if (tailIndex - head.load( std::memory_order_acquire ) == Capacity)
+				return false;
+			items[tailIndex & (Capacity - 1)] = value;
+			tail.store( tailIndex + 1, std::memory_order_release );
+			return true;
+		}
+
+		// consumer only
+		bool TryPop( T &value ) {
+			size_t headIndex = head.load( std::memory_order_relaxed );
+			if (headIndex == tail.load( std::memory_order_acquire ))
+				return false;
+			value = items[headIndex & (Capacity - 1)];
+			head.store( headIndex + 1, std::memory_order_release );
+			return true;
+		}
+
+	private:
+		// on separate cache lines, so that the two threads don't contend for the line the other one writes
+		alignas(64) std::atomic<size_t> head { 0 };
+		alignas(64) std::atomic<size_t> tail { 0 };
+		T items[Capacity];
+	};
+}
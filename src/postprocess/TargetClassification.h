@@ -0,0 +1,64 @@
+#pragma once
+#include <cstdint>
+
+namespace vr {
+	// How a render or depth target bound by the game relates to the textures it submits, which decides
+	// whether and how we apply foveated rendering to it.
+	enum class TargetClass : uint8_t {
+		Ignore,       // not a plain 2D texture, or too small to be the eye render target
+		ShadowMap,    // square texture, most likely a shadow map or similar
+		Blacklisted,  // known to be irrelevant by its debug name
+		Combined,     // contains both eyes side by side
+		Array,        // contains both eyes as slices of an array texture
+		SingleEye,    // contains a single eye, but we can't tell which
+	};
+
+	struct TargetDesc {
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint32_t arraySize = 1;
+		bool isTexture2D = true;
+		bool blacklistedName = false;
+	};
+
+	// what we know about the textures submitted to the compositor
+	struct SubmitLayout {
+		uint32_t textureWidth = 0;
+		uint32_t textureHeight = 0;
+		bool textureContainsOnlyOneEye = true;
+	};
+
+	inline bool QualifiesForEye( const TargetDesc &desc, const SubmitLayout &layout ) {
+		return desc.width >= layout.textureWidth && desc.height >= layout.textureHeight;
+	}
+
+	inline TargetClass ClassifyRenderTarget( const TargetDesc &desc, const SubmitLayout &layout ) {
+		if (!desc.isTexture2D)
+			return TargetClass::Ignore;
+		if (desc.width == desc.height)
+			return TargetClass::ShadowMap;
+		if (!QualifiesForEye( desc, layout ))
+			return TargetClass::Ignore;
+		if (!layout.textureContainsOnlyOneEye || desc.width >= 2 * layout.textureWidth)
+			return TargetClass::Combined;
+		if (desc.arraySize == 2)
+			return TargetClass::Array;
+		if (desc.arraySize == 1)
+			return TargetClass::SingleEye;
+		return TargetClass::Ignore;
+	}
+
+	inline TargetClass ClassifyDepthTarget( const TargetDesc &desc, const SubmitLayout &layout ) {
+		if (!desc.isTexture2D || !QualifiesForEye( desc, layout ))
+			return TargetClass::Ignore;
+		if (desc.width == desc.height)
+			return TargetClass::ShadowMap;
+		if (desc.blacklistedName)
+			return TargetClass::Blacklisted;
+		if (!layout.textureContainsOnlyOneEye || desc.width >= 2 * layout.textureWidth)
+			return TargetClass::Combined;
+		if (desc.arraySize == 2)
+			return TargetClass::Array;
+		return TargetClass::SingleEye;
+	}
+}
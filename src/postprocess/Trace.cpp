@@ -0,0 +1,180 @@
+#include "Trace.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+namespace vr {
+	namespace {
+		std::atomic<uint64_t> nextTracerId { 1 };
+
+		void WriteJsonString( std::ostream &out, const char *text ) {
+			out << '"';
+			for (const char *c = text; *c != 0; ++c) {
+				if (*c == '"' || *c == '\\') {
+					out << '\\' << *c;
+				} else if (uint8_t(*c) < 0x20) {
+					char escaped[8];
+					snprintf( escaped, sizeof(escaped), "\\u%04x", unsigned(uint8_t(*c)) );
+					out << escaped;
+				} else {
+					out << *c;
+				}
+			}
+			out << '"';
+		}
+
+		// Chrome traces take microseconds
+		void WriteMicroseconds( std::ostream &out, uint64_t nanoseconds ) {
+			char text[32];
+			snprintf( text, sizeof(text), "%llu.%03u", (unsigned long long)(nanoseconds / 1000), unsigned(nanoseconds % 1000) );
+			out << text;
+		}
+	}
+
+	// Every slot is a small seqlock: the owning thread clears its sequence, writes the event and then sets the
+	// sequence to the event's index + 1, so a collecting thread can tell whether it read the slot while it was
+	// being overwritten.
+	struct Tracer::ThreadBuffer {
+		struct Slot {
+			std::atomic<uint64_t> sequence;
+			std::atomic<uint64_t> start;
+			std::atomic<uint64_t> duration;
+			std::atomic<const char*> name;
+			std::atomic<uint64_t> frameAndPhase;
+		};
+
+		uint32_t thread = 0;
+		std::atomic<const char*> threadName { nullptr };
+		std::atomic<uint64_t> written { 0 };
+		Slot slots[EVENTS_PER_THREAD];
+	};
+
+	namespace {
+		// buffers of the calling thread, one per tracer; the tracer keeps them alive
+		thread_local std::vector<std::pair<uint64_t, void*>> threadBuffers;
+	}
+
+	Tracer::Tracer() : id( nextTracerId.fetch_add( 1 ) ) {}
+
+	Tracer & Tracer::Instance() {
+		// never destroyed, as threads may still be recording while the DLL unloads
+		static Tracer *tracer = new Tracer;
+		return *tracer;
+	}
+
+	uint64_t Tracer::Now() {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+	}
+
+	Tracer::ThreadBuffer & Tracer::CurrentThreadBuffer() {
+		for (const auto &entry : threadBuffers) {
+			if (entry.first == id)
+				return *static_cast<ThreadBuffer*>(entry.second);
+		}
+		std::shared_ptr<ThreadBuffer> buffer = std::make_shared<ThreadBuffer>();
+		{
+			std::lock_guard<std::mutex> lock( registryMutex );
+			buffer->thread = uint32_t(buffers.size() + 1);
+			buffers.push_back( buffer );
+		}
+		threadBuffers.push_back( std::make_pair( id, static_cast<void*>(buffer.get()) ) );
+		return *buffer;
+	}
+
+	void Tracer::Record( const char *name, char phase, uint64_t start, uint64_t duration ) {
+		ThreadBuffer &buffer = CurrentThreadBuffer();
+		uint64_t index = buffer.written.load( std::memory_order_relaxed );
+		ThreadBuffer::Slot &slot = buffer.slots[index % EVENTS_PER_THREAD];
+		slot.sequence.store( 0, std::memory_order_relaxed );
+		std::atomic_thread_fence( std::memory_order_release );
+		slot.start.store( start, std::memory_order_relaxed );
+		slot.duration.store( duration, std::memory_order_relaxed );
+		slot.name.store( name, std::memory_order_relaxed );
+		slot.frameAndPhase.store( (uint64_t(Frame()) << 8) | uint8_t(phase), std::memory_order_relaxed );
+		slot.sequence.store( index + 1, std::memory_order_release );
+		buffer.written.store( index + 1, std::memory_order_release );
+	}
+
+	void Tracer::SetThreadName( const char *name ) {
+		CurrentThreadBuffer().threadName.store( name, std::memory_order_relaxed );
+	}
+
+	std::vector<TraceEvent> Tracer::Collect( uint32_t frameCount ) const {
+		std::vector<std::shared_ptr<ThreadBuffer>> current;
+		{
+			std::lock_guard<std::mutex> lock( registryMutex );
+			current = buffers;
+		}
+		uint32_t lastFrame = Frame();
+		uint32_t firstFrame = lastFrame >= frameCount ? lastFrame - frameCount : 0;
+
+		std::vector<TraceEvent> events;
+		for (const std::shared_ptr<ThreadBuffer> &buffer : current) {
+			uint64_t end = buffer->written.load( std::memory_order_acquire );
+			uint64_t begin = end > EVENTS_PER_THREAD ? end - EVENTS_PER_THREAD : 0;
+			for (uint64_t index = begin; index < end; ++index) {
+				const ThreadBuffer::Slot &slot = buffer->slots[index % EVENTS_PER_THREAD];
+				if (slot.sequence.load( std::memory_order_acquire ) != index + 1)
+					continue;
+				TraceEvent event;
+				event.start = slot.start.load( std::memory_order_relaxed );
+				event.duration = slot.duration.load( std::memory_order_relaxed );
+				event.name = slot.name.load( std::memory_order_relaxed );
+				uint64_t frameAndPhase = slot.frameAndPhase.load( std::memory_order_relaxed );
+				std::atomic_thread_fence( std::memory_order_acquire );
+				if (slot.sequence.load( std::memory_order_relaxed ) != index + 1) {
+					// overwritten while we were reading it
+					continue;
+				}
+				event.frame = uint32_t(frameAndPhase >> 8);
+				event.phase = char(frameAndPhase & 0xff);
+				event.thread = buffer->thread;
+				if (event.frame >= firstFrame && event.frame <= lastFrame)
+					events.push_back( event );
+			}
+		}
+		std::sort( events.begin(), events.end(), []( const TraceEvent &a, const TraceEvent &b ) { return a.start < b.start; } );
+		return events;
+	}
+
+	std::vector<std::pair<uint32_t, std::string>> Tracer::ThreadNames() const {
+		std::vector<std::pair<uint32_t, std::string>> names;
+		std::lock_guard<std::mutex> lock( registryMutex );
+		for (const std::shared_ptr<ThreadBuffer> &buffer : buffers) {
+			const char *name = buffer->threadName.load( std::memory_order_relaxed );
+			if (name != nullptr)
+				names.push_back( std::make_pair( buffer->thread, std::string( name ) ) );
+		}
+		return names;
+	}
+
+	void WriteChromeTrace( std::ostream &out, const std::vector<TraceEvent> &events, const std::vector<std::pair<uint32_t, std::string>> &threadNames ) {
+		out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+		bool first = true;
+		for (const auto &thread : threadNames) {
+			out << (first ? "\n" : ",\n");
+			first = false;
+			out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread.first << ",\"args\":{\"name\":";
+			WriteJsonString( out, thread.second.c_str() );
+			out << "}}";
+		}
+		// timestamps relative to the first event, so that they stay readable
+		uint64_t origin = events.empty() ? 0 : events.front().start;
+		for (const TraceEvent &event : events) {
+			out << (first ? "\n" : ",\n");
+			first = false;
+			out << "{\"name\":";
+			WriteJsonString( out, event.name != nullptr ? event.name : "" );
+			out << ",\"ph\":\"" << event.phase << "\",\"ts\":";
+			WriteMicroseconds( out, event.start - origin );
+			if (event.phase == 'X') {
+				out << ",\"dur\":";
+				WriteMicroseconds( out, event.duration );
+			} else {
+				out << ",\"s\":\"t\"";
+			}
+			out << ",\"pid\":1,\"tid\":" << event.thread << ",\"args\":{\"frame\":" << event.frame << "}}";
+		}
+		out << "\n]}\n";
+	}
+}
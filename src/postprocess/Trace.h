@@ -0,0 +1,90 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace vr {
+	struct TraceEvent {
+		// nanoseconds on the steady clock
+		uint64_t start;
+		uint64_t duration;
+		// a string literal; only the pointer is recorded
+		const char *name;
+		uint32_t frame;
+		uint32_t thread;
+		// 'X' for scopes, 'i' for instants
+		char phase;
+	};
+
+	// Records a timeline of named scopes and instants. Each thread writes into its own fixed ring of events,
+	// overwriting its oldest ones, so recording takes no locks and never allocates after a thread's first
+	// event. The events of the last frames can be collected at any time and saved as a Chrome trace, which
+	// chrome://tracing and Perfetto open.
+	class Tracer {
+	public:
+		static const size_t EVENTS_PER_THREAD = 16384;
+
+		Tracer();
+		Tracer( const Tracer & ) = delete;
+		Tracer & operator=( const Tracer & ) = delete;
+
+		static Tracer & Instance();
+		static uint64_t Now();
+
+		void Record( const char *name, char phase, uint64_t start, uint64_t duration );
+		// events recorded afterwards belong to the next frame
+		void NextFrame() { frame.fetch_add( 1, std::memory_order_relaxed ); }
+		uint32_t Frame() const { return frame.load( std::memory_order_relaxed ); }
+		// names the calling thread in the trace; the name must outlive the tracer
+		void SetThreadName( const char *name );
+
+		// events of the given number of frames before the current one, ordered by start time; safe to call
+		// while other threads are recording
+		std::vector<TraceEvent> Collect( uint32_t frameCount ) const;
+		std::vector<std::pair<uint32_t, std::string>> ThreadNames() const;
+
+	private:
+		struct ThreadBuffer;
+		uint64_t id;
+		std::atomic<uint32_t> frame { 0 };
+		mutable std::mutex registryMutex;
+		std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+
+		ThreadBuffer & CurrentThreadBuffer();
+	};
+
+	void WriteChromeTrace( std::ostream &out, const std::vector<TraceEvent> &events, const std::vector<std::pair<uint32_t, std::string>> &threadNames );
+
+	class TraceScope {
+	public:
+		explicit TraceScope( const char *name ) : name( name ), start( Tracer::Now() ) {}
+		TraceScope( const TraceScope & ) = delete;
+		TraceScope & operator=( const TraceScope & ) = delete;
+		~TraceScope() {
+			Tracer::Instance().Record( name, 'X', start, Tracer::Now() - start );
+		}
+
+	private:
+		const char *name;
+		uint64_t start;
+	};
+}
+
+// instrumentation is only compiled in when building with BUILD_TRACING
+#ifdef OPENVR_MOD_TRACING
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(name) vr::TraceScope TRACE_CONCAT(traceScope_, __LINE__)( name )
+#define TRACE_INSTANT(name) vr::Tracer::Instance().Record( name, 'i', vr::Tracer::Now(), 0 )
+#define TRACE_NEXT_FRAME() vr::Tracer::Instance().NextFrame()
+#define TRACE_THREAD_NAME(name) vr::Tracer::Instance().SetThreadName( name )
+#else
+#define TRACE_SCOPE(name) do {} while (false)
+#define TRACE_INSTANT(name) do {} while (false)
+#define TRACE_NEXT_FRAME() do {} while (false)
+#define TRACE_THREAD_NAME(name) do {} while (false)
+#endif
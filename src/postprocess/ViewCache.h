@@ -0,0 +1,143 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+namespace vr {
+	// Small fixed-capacity cache for views we create on textures handed to us by the game, keyed by the
+	// texture pointer. Entries live in an open-addressed table with linear probing; once full, the least
+	// recently used entry is evicted and its views released right away.
+	// Since a pointer may be reused for a new texture once the game frees the old one, each entry is
+	// assigned a generation that is also stored as a tag on the resource itself. A lookup only counts
+	// as a hit if the resource still carries the entry's tag.
+	// Tagger must provide uint64_t GetTag(Key) (0 if untagged) and void SetTag(Key, uint64_t).
+	template<typename Key, typename Value, typename Tagger, size_t Capacity = 16>
+	class ViewCache {
+		static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+	public:
+		explicit ViewCache( Tagger tagger = Tagger() ) : tagger(tagger) {}
+
+		Value * Find( Key key ) {
+			size_t index;
+			if (!Locate( key, index ))
+				return nullptr;
+			Slot &slot = slots[index];
+			if (tagger.GetTag( key ) != slot.generation) {
+				++staleHits;
+				Remove( index );
+				return nullptr;
+			}
+			slot.lastUse = ++useCounter;
+			return &slot.value;
+		}
+
+		// returns a default-constructed value for the key, evicting the least recently used entry if needed
+		Value & Insert( Key key ) {
+			size_t index;
+			if (Locate( key, index )) {
+				Remove( index );
+			}
+			if (count >= MaxEntries) {
+				EvictLeastRecentlyUsed();
+			}
+
+			index = Home( key );
+			while (slots[index].used) {
+				index = (index + 1) & (Capacity - 1);
+			}
+			Slot &slot = slots[index];
+			slot.used = true;
+			slot.key = key;
+			slot.generation = ++generationCounter;
+			slot.lastUse = ++useCounter;
+			slot.value = Value();
+			tagger.SetTag( key, slot.generation );
+			++count;
+			return slot.value;
+		}
+
+		void Erase( Key key ) {
+			size_t index;
+			if (Locate( key, index )) {
+				Remove( index );
+			}
+		}
+
+		void Clear() {
+			for (size_t i = 0; i < Capacity; ++i) {
+				slots[i] = Slot();
+			}
+			count = 0;
+		}
+
+		size_t Size() const { return count; }
+		uint64_t Evictions() const { return evictions; }
+		uint64_t StaleHits() const { return staleHits; }
+
+	private:
+		// keep some slots free so that probe sequences stay short
+		static const size_t MaxEntries = Capacity - Capacity / 4;
+
+		struct Slot {
+			Key key = Key();
+			Value value = Value();
+			uint64_t generation = 0;
+			uint64_t lastUse = 0;
+			bool used = false;
+		};
+
+		Tagger tagger;
+		Slot slots[Capacity];
+		size_t count = 0;
+		uint64_t generationCounter = 0;
+		uint64_t useCounter = 0;
+		uint64_t evictions = 0;
+		uint64_t staleHits = 0;
+
+		size_t Home( Key key ) const {
+			return std::hash<Key>()( key ) & (Capacity - 1);
+		}
+
+		bool Locate( Key key, size_t &index ) const {
+			index = Home( key );
+			for (size_t probes = 0; probes < Capacity && slots[index].used; ++probes) {
+				if (slots[index].key == key)
+					return true;
+				index = (index + 1) & (Capacity - 1);
+			}
+			return false;
+		}
+
+		void EvictLeastRecentlyUsed() {
+			size_t oldest = Capacity;
+			for (size_t i = 0; i < Capacity; ++i) {
+				if (slots[i].used && (oldest == Capacity || slots[i].lastUse < slots[oldest].lastUse))
+					oldest = i;
+			}
+			if (oldest != Capacity) {
+				++evictions;
+				Remove( oldest );
+			}
+		}
+
+		// releases the slot's value and shifts following entries back so no tombstones are needed
+		void Remove( size_t index ) {
+			slots[index] = Slot();
+			--count;
+			size_t hole = index;
+			size_t next = (index + 1) & (Capacity - 1);
+			while (slots[next].used) {
+				size_t home = Home( slots[next].key );
+				// move the entry into the hole unless its home lies cyclically between the hole and its position
+				bool between = hole <= next ? (hole < home && home <= next) : (hole < home || home <= next);
+				if (!between) {
+					slots[hole] = slots[next];
+					slots[next] = Slot();
+					hole = next;
+				}
+				next = (next + 1) & (Capacity - 1);
+			}
+		}
+	};
+}
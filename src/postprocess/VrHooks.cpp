@@ -1,40 +1,116 @@
 #include "VrHooks.h"
 #include "Config.h"
 #include "PostProcessor.h"
+#include "D3D11PipelineBackend.h"
+#include "HookSlot.h"
+#include "ShadowVtable.h"
+#include "Trace.h"
+#include "vrs/VariableRateShading.h"
 
 #include <openvr.h>
 #include <MinHook.h>
-#include <unordered_map>
+#include <d3d11_4.h>
+#include <atomic>
 #include <unordered_set>
 
 
 namespace {
-	std::unordered_map<void*, void*> hooksToOriginal;
 	bool ivrSystemHooked = false;
 	bool ivrCompositorHooked = false;
-	ID3D11DeviceContext *hookedContext = nullptr;
+	std::atomic<ID3D11DeviceContext*> hookedContext { nullptr };
 	ID3D11Device *device = nullptr;
+	// D3D11 methods are either patched in place through MinHook or hooked per object through shadow vtables.
+	// Chosen once, as the two must not be mixed: a patched method would lead a shadow vtable hook back to itself.
+	bool shadowVtableHooks = false;
+	bool hookBackendChosen = false;
+	// our reference to d3d11.dll, held while its device creation functions are hooked
+	HMODULE d3d11Module = nullptr;
 
 	vr::PostProcessor postProcessor;
 
-	void InstallVirtualFunctionHook(void *instance, uint32_t methodPos, void *hookFunction) {
+	// The context hooks are called from whichever thread the game records on, so the original is looked up in
+	// the hook's own slot rather than a shared table. Hooks are only installed on one thread at a time.
+	template<typename T, T Hook>
+	bool InstallVirtualFunctionHook(void *instance, uint32_t methodPos, const char *name) {
 		LPVOID* vtable = *((LPVOID**)instance);
 		LPVOID  pTarget = vtable[methodPos];
 
 		LPVOID pOriginal = nullptr;
-		MH_CreateHook(pTarget, hookFunction, &pOriginal);
+		if (MH_CreateHook(pTarget, (LPVOID)Hook, &pOriginal) != MH_OK) {
+			// the target may already be hooked through another instance sharing the same implementation
+			return vr::HookSlot<T, Hook>::Original() != nullptr;
+		}
+		// the original must be known before the hook can be called
+		vr::HookSlot<T, Hook>::Install((T)pOriginal, name, pTarget);
 		MH_EnableHook(pTarget);
+		return true;
+	}
+
+	template<typename T, T Hook>
+	bool InstallShadowVtableHook(void *instance, size_t methodCount, uint32_t methodPos, const char *name) {
+		vr::ShadowVtables &shadows = vr::ShadowVtables::Instance();
+		void *original = shadows.Original(instance, methodPos);
+		T known = vr::HookSlot<T, Hook>::Original();
+		if (known != nullptr && (void*)known != original) {
+			// a hook function has a single original
+			Log(vr::LogLevel::Warning) << name << " is implemented differently for this object than for the ones hooked before, not hooking it\n";
+			return false;
+		}
+		if (shadows.Hook(instance, methodCount, methodPos, (LPVOID)Hook) == nullptr)
+			return false;
+		vr::HookSlot<T, Hook>::Install((T)original, name, original);
+		return true;
+	}
+
+	// for D3D11 objects; the runtime's interfaces are always hooked through MinHook
+	template<typename T, T Hook>
+	bool InstallObjectHook(void *instance, size_t methodCount, uint32_t methodPos, const char *name) {
+		if (shadowVtableHooks)
+			return InstallShadowVtableHook<T, Hook>(instance, methodCount, methodPos, name);
+		return InstallVirtualFunctionHook<T, Hook>(instance, methodPos, name);
+	}
+
+	// for functions exported by a loaded module
+	template<typename T, T Hook>
+	bool InstallApiHook(LPCWSTR module, LPCSTR function, const char *name) {
+		LPVOID pOriginal = nullptr;
+		LPVOID pTarget = nullptr;
+		if (MH_CreateHookApiEx(module, function, (LPVOID)Hook, &pOriginal, &pTarget) != MH_OK)
+			return vr::HookSlot<T, Hook>::Original() != nullptr;
+		vr::HookSlot<T, Hook>::Install((T)pOriginal, name, pTarget);
+		MH_EnableHook(pTarget);
+		return true;
+	}
+
+#define INSTALL_HOOK(instance, methodPos, hook) InstallVirtualFunctionHook<decltype(&hook), &hook>(instance, methodPos, #hook)
+#define INSTALL_OBJECT_HOOK(instance, methodCount, methodPos, hook) InstallObjectHook<decltype(&hook), &hook>(instance, methodCount, methodPos, #hook)
+#define INSTALL_API_HOOK(module, function, hook) InstallApiHook<decltype(&hook), &hook>(module, function, #hook)
+#define CALL_ORIGINAL(hook) HOOK_SLOT(hook)::Original()
+
+	// Games usually create their device after VR_Init, so the resources the first Submit needs can be created
+	// while the game loads. Software devices are left alone, as nothing is ever submitted from them.
+	void OnDeviceCreated(HRESULT result, D3D_DRIVER_TYPE driverType, ID3D11Device **ppDevice) {
+		if (FAILED(result) || ppDevice == nullptr || *ppDevice == nullptr)
+			return;
+		if (driverType == D3D_DRIVER_TYPE_NULL || driverType == D3D_DRIVER_TYPE_REFERENCE || driverType == D3D_DRIVER_TYPE_WARP || driverType == D3D_DRIVER_TYPE_SOFTWARE)
+			return;
+		postProcessor.OnDeviceCreated(*ppDevice);
+	}
 
-		hooksToOriginal[hookFunction] = pOriginal;
+	HRESULT WINAPI D3D11_CreateDevice(IDXGIAdapter *pAdapter, D3D_DRIVER_TYPE DriverType, HMODULE Software, UINT Flags, const D3D_FEATURE_LEVEL *pFeatureLevels, UINT FeatureLevels, UINT SDKVersion, ID3D11Device **ppDevice, D3D_FEATURE_LEVEL *pFeatureLevel, ID3D11DeviceContext **ppImmediateContext) {
+		HRESULT ret = CALL_ORIGINAL(D3D11_CreateDevice)(pAdapter, DriverType, Software, Flags, pFeatureLevels, FeatureLevels, SDKVersion, ppDevice, pFeatureLevel, ppImmediateContext);
+		OnDeviceCreated(ret, DriverType, ppDevice);
+		return ret;
 	}
 
-	template<typename T>
-	T CallOriginal(T hookFunction) {
-		return (T)hooksToOriginal[hookFunction];
+	HRESULT WINAPI D3D11_CreateDeviceAndSwapChain(IDXGIAdapter *pAdapter, D3D_DRIVER_TYPE DriverType, HMODULE Software, UINT Flags, const D3D_FEATURE_LEVEL *pFeatureLevels, UINT FeatureLevels, UINT SDKVersion, const DXGI_SWAP_CHAIN_DESC *pSwapChainDesc, IDXGISwapChain **ppSwapChain, ID3D11Device **ppDevice, D3D_FEATURE_LEVEL *pFeatureLevel, ID3D11DeviceContext **ppImmediateContext) {
+		HRESULT ret = CALL_ORIGINAL(D3D11_CreateDeviceAndSwapChain)(pAdapter, DriverType, Software, Flags, pFeatureLevels, FeatureLevels, SDKVersion, pSwapChainDesc, ppSwapChain, ppDevice, pFeatureLevel, ppImmediateContext);
+		OnDeviceCreated(ret, DriverType, ppDevice);
+		return ret;
 	}
 
 	void IVRSystem_GetRecommendedRenderTargetSize(vr::IVRSystem *self, uint32_t *pnWidth, uint32_t *pnHeight) {
-		CallOriginal(IVRSystem_GetRecommendedRenderTargetSize)(self, pnWidth, pnHeight);
+		CALL_ORIGINAL(IVRSystem_GetRecommendedRenderTargetSize)(self, pnWidth, pnHeight);
 
 		if (pnWidth == nullptr || pnHeight == nullptr) {
 			return;
@@ -42,13 +118,16 @@ namespace {
 	}
 
 	vr::EVRCompositorError IVRCompositor_Submit(vr::IVRCompositor *self, vr::EVREye eEye, const vr::Texture_t *pTexture, const vr::VRTextureBounds_t *pBounds, vr::EVRSubmitFlags nSubmitFlags) {
+		TRACE_SCOPE("Submit");
 		void *origHandle = pTexture->handle;
 
-		postProcessor.Apply(eEye, pTexture, pBounds, nSubmitFlags);
-		vr::EVRCompositorError error = CallOriginal(IVRCompositor_Submit)(self, eEye, pTexture, pBounds, nSubmitFlags);
+		pBounds = postProcessor.Apply(eEye, pTexture, pBounds, nSubmitFlags);
+		vr::EVRCompositorError error = CALL_ORIGINAL(IVRCompositor_Submit)(self, eEye, pTexture, pBounds, nSubmitFlags);
+		postProcessor.OnSubmitted();
 		if (error != vr::VRCompositorError_None) {
-			if (Config::Instance().debugMode)
-				Log() << "Error when submitting for eye " << eEye << ": " << error << std::endl;
+			// the settings in effect, which hotkeys may have changed
+			if (Config::Published().Current()->value.debugMode)
+				LOG_LIMITED(vr::LogLevel::Error, 2) << "Error when submitting for eye " << eEye << ": " << error << "\n";
 		}
 
 		const_cast<vr::Texture_t*>(pTexture)->handle = origHandle;
@@ -62,10 +141,12 @@ namespace {
 			texture.eType = vr::TextureType_DirectX;
 			texture.eColorSpace = vr::ColorSpace_Auto;
 			texture.handle = pTexture;
-			postProcessor.Apply(eEye, &texture, pBounds, nSubmitFlags);
+			pBounds = postProcessor.Apply(eEye, &texture, pBounds, nSubmitFlags);
 			pTexture = texture.handle;
 		}
-		return CallOriginal(IVRCompositor_Submit_008)(self, eEye, eTextureType, pTexture, pBounds, nSubmitFlags);
+		vr::EVRCompositorError error = CALL_ORIGINAL(IVRCompositor_Submit_008)(self, eEye, eTextureType, pTexture, pBounds, nSubmitFlags);
+		postProcessor.OnSubmitted();
+		return error;
 	}
 
 	vr::EVRCompositorError IVRCompositor_Submit_007(vr::IVRCompositor *self, vr::EVREye eEye, unsigned int eTextureType, void *pTexture, const vr::VRTextureBounds_t *pBounds) {
@@ -75,27 +156,134 @@ namespace {
 			texture.eType = vr::TextureType_DirectX;
 			texture.eColorSpace = vr::ColorSpace_Auto;
 			texture.handle = pTexture;
-			postProcessor.Apply(eEye, &texture, pBounds, vr::Submit_Default);
+			pBounds = postProcessor.Apply(eEye, &texture, pBounds, vr::Submit_Default);
 			pTexture = texture.handle;
 		}
-		return CallOriginal(IVRCompositor_Submit_007)(self, eEye, eTextureType, pTexture, pBounds);
+		vr::EVRCompositorError error = CALL_ORIGINAL(IVRCompositor_Submit_007)(self, eEye, eTextureType, pTexture, pBounds);
+		postProcessor.OnSubmitted();
+		return error;
 	}
 
 	using Microsoft::WRL::ComPtr;
 
+	bool IsImmediateContext(ID3D11DeviceContext *context) {
+		return context == hookedContext.load(std::memory_order_relaxed);
+	}
+
+	// A shadow vtable is a copy of the whole vtable, which all versions of an interface share, so its size
+	// is given by the newest version the object implements.
+	size_t ContextMethodCount(ID3D11DeviceContext *context) {
+		ComPtr<ID3D11DeviceContext4> context4;
+		if (SUCCEEDED(context->QueryInterface(context4.GetAddressOf())))
+			return 149;
+		ComPtr<ID3D11DeviceContext3> context3;
+		if (SUCCEEDED(context->QueryInterface(context3.GetAddressOf())))
+			return 147;
+		ComPtr<ID3D11DeviceContext2> context2;
+		if (SUCCEEDED(context->QueryInterface(context2.GetAddressOf())))
+			return 144;
+		ComPtr<ID3D11DeviceContext1> context1;
+		if (SUCCEEDED(context->QueryInterface(context1.GetAddressOf())))
+			return 134;
+		return 115;
+	}
+
+	size_t DeviceMethodCount(ID3D11Device *device) {
+		ComPtr<ID3D11Device5> device5;
+		if (SUCCEEDED(device->QueryInterface(device5.GetAddressOf())))
+			return 69;
+		ComPtr<ID3D11Device4> device4;
+		if (SUCCEEDED(device->QueryInterface(device4.GetAddressOf())))
+			return 67;
+		ComPtr<ID3D11Device3> device3;
+		if (SUCCEEDED(device->QueryInterface(device3.GetAddressOf())))
+			return 65;
+		ComPtr<ID3D11Device2> device2;
+		if (SUCCEEDED(device->QueryInterface(device2.GetAddressOf())))
+			return 54;
+		ComPtr<ID3D11Device1> device1;
+		if (SUCCEEDED(device->QueryInterface(device1.GetAddressOf())))
+			return 50;
+		return 43;
+	}
+
+	// Deferred contexts may have their own implementation of the context methods, so the hooks we need for
+	// them are installed through a deferred context as well. If the implementation is shared with the
+	// immediate context, the hook installed for it already sees both kinds of context, unless the hooks
+	// are installed through shadow vtables.
+	enum class ContextKind { Immediate, Deferred };
+
+	template<ContextKind Kind>
 	HRESULT D3D11Context_ClearDepthStencilView(ID3D11DeviceContext *self, ID3D11DepthStencilView *pDepthStencilView, UINT ClearFlags, FLOAT Depth, UINT8 Stencil) {
-		HRESULT ret = CallOriginal(D3D11Context_ClearDepthStencilView)(self, pDepthStencilView, ClearFlags, Depth, Stencil);
-		if (ClearFlags & D3D11_CLEAR_DEPTH)
-			postProcessor.ApplyFixedFoveatedRendering(pDepthStencilView, Depth, Stencil);
+		TRACE_SCOPE("ClearDepthStencilView");
+		HRESULT ret = CALL_ORIGINAL(D3D11Context_ClearDepthStencilView<Kind>)(self, pDepthStencilView, ClearFlags, Depth, Stencil);
+		if (ClearFlags & D3D11_CLEAR_DEPTH) {
+			if (IsImmediateContext(self))
+				postProcessor.ApplyFixedFoveatedRendering(pDepthStencilView, Depth, Stencil);
+			else
+				postProcessor.ApplyFixedFoveatedRenderingDeferred(self, pDepthStencilView, Depth, Stencil);
+		}
+		return ret;
+	}
+
+	HRESULT D3D11Context_FinishCommandList(ID3D11DeviceContext *self, BOOL RestoreDeferredContextState, ID3D11CommandList **ppCommandList) {
+		TRACE_SCOPE("FinishCommandList");
+		HRESULT ret = CALL_ORIGINAL(D3D11Context_FinishCommandList)(self, RestoreDeferredContextState, ppCommandList);
+		if (!IsImmediateContext(self))
+			postProcessor.OnCommandListFinished(self);
+		return ret;
+	}
+
+	void HookDeferredContext(ID3D11DeviceContext *context) {
+		size_t methodCount = ContextMethodCount(context);
+		INSTALL_OBJECT_HOOK(context, methodCount, 53, D3D11Context_ClearDepthStencilView<ContextKind::Deferred>);
+		INSTALL_OBJECT_HOOK(context, methodCount, 114, D3D11Context_FinishCommandList);
+	}
+
+	void OnDeferredContextCreated(ID3D11DeviceContext *context) {
+		// shadow vtables only hook the objects they are installed for
+		if (shadowVtableHooks)
+			HookDeferredContext(context);
+		postProcessor.OnDeferredContextCreated(context);
+	}
+
+	HRESULT D3D11Device_CreateDeferredContext(ID3D11Device *self, UINT ContextFlags, ID3D11DeviceContext **ppDeferredContext) {
+		HRESULT ret = CALL_ORIGINAL(D3D11Device_CreateDeferredContext)(self, ContextFlags, ppDeferredContext);
+		if (SUCCEEDED(ret) && ppDeferredContext != nullptr && *ppDeferredContext != nullptr)
+			OnDeferredContextCreated(*ppDeferredContext);
+		return ret;
+	}
+
+	HRESULT D3D11Device1_CreateDeferredContext1(ID3D11Device1 *self, UINT ContextFlags, ID3D11DeviceContext1 **ppDeferredContext) {
+		HRESULT ret = CALL_ORIGINAL(D3D11Device1_CreateDeferredContext1)(self, ContextFlags, ppDeferredContext);
+		if (SUCCEEDED(ret) && ppDeferredContext != nullptr && *ppDeferredContext != nullptr)
+			OnDeferredContextCreated(*ppDeferredContext);
 		return ret;
 	}
 
+	HRESULT D3D11Device2_CreateDeferredContext2(ID3D11Device2 *self, UINT ContextFlags, ID3D11DeviceContext2 **ppDeferredContext) {
+		HRESULT ret = CALL_ORIGINAL(D3D11Device2_CreateDeferredContext2)(self, ContextFlags, ppDeferredContext);
+		if (SUCCEEDED(ret) && ppDeferredContext != nullptr && *ppDeferredContext != nullptr)
+			OnDeferredContextCreated(*ppDeferredContext);
+		return ret;
+	}
+
+	HRESULT D3D11Device3_CreateDeferredContext3(ID3D11Device3 *self, UINT ContextFlags, ID3D11DeviceContext3 **ppDeferredContext) {
+		HRESULT ret = CALL_ORIGINAL(D3D11Device3_CreateDeferredContext3)(self, ContextFlags, ppDeferredContext);
+		if (SUCCEEDED(ret) && ppDeferredContext != nullptr && *ppDeferredContext != nullptr)
+			OnDeferredContextCreated(*ppDeferredContext);
+		return ret;
+	}
+
+	// render target binds only drive VRS and the frame schedule, which both follow the immediate context
 	void D3D11Context_OMSetRenderTargets(
 			ID3D11DeviceContext *self,
 			UINT NumViews, ID3D11RenderTargetView * const *ppRenderTargetViews,
 			ID3D11DepthStencilView *pDepthStencilView) {
-		CallOriginal(D3D11Context_OMSetRenderTargets)(self, NumViews, ppRenderTargetViews, pDepthStencilView);
-		postProcessor.OnRenderTargetChange( NumViews, ppRenderTargetViews );
+		TRACE_SCOPE("OMSetRenderTargets");
+		CALL_ORIGINAL(D3D11Context_OMSetRenderTargets)(self, NumViews, ppRenderTargetViews, pDepthStencilView);
+		if (IsImmediateContext(self))
+			postProcessor.OnRenderTargetChange( NumViews, ppRenderTargetViews, pDepthStencilView );
 	}
 
 	void D3D11Context_OMSetRenderTargetsAndUnorderedAccessViews(
@@ -107,25 +295,238 @@ namespace {
 			UINT NumUAVs,
 			ID3D11UnorderedAccessView * const *ppUnorderedAccessViews,
 			const UINT *pUAVInitialCounts) {
-		CallOriginal(D3D11Context_OMSetRenderTargetsAndUnorderedAccessViews)(self, NumRTVs, ppRenderTargetViews, pDepthStencilView, UAVStartSlot, NumUAVs, ppUnorderedAccessViews, pUAVInitialCounts);
-		postProcessor.OnRenderTargetChange( NumRTVs, ppRenderTargetViews );
+		TRACE_SCOPE("OMSetRenderTargets");
+		CALL_ORIGINAL(D3D11Context_OMSetRenderTargetsAndUnorderedAccessViews)(self, NumRTVs, ppRenderTargetViews, pDepthStencilView, UAVStartSlot, NumUAVs, ppUnorderedAccessViews, pUAVInitialCounts);
+		// render targets may be left as they are if only UAVs are updated
+		if (NumRTVs != D3D11_KEEP_RENDER_TARGETS_AND_DEPTH_STENCIL && IsImmediateContext(self))
+			postProcessor.OnRenderTargetChange( NumRTVs, ppRenderTargetViews, pDepthStencilView );
+	}
+
+	// the remaining context hooks only keep the pipeline state tracker up to date. The hooked functions are
+	// shared with deferred contexts, so we have to check which context a call is meant for.
+	using vr::PipelineStateTracker;
+
+	void D3D11Context_VSSetShader(ID3D11DeviceContext *self, ID3D11VertexShader *pVertexShader, ID3D11ClassInstance * const *ppClassInstances, UINT NumClassInstances) {
+		CALL_ORIGINAL(D3D11Context_VSSetShader)(self, pVertexShader, ppClassInstances, NumClassInstances);
+		if (PipelineStateTracker::Instance().IsTracked(self))
+			PipelineStateTracker::Instance().OnSetVertexShader(pVertexShader);
+	}
+
+	void D3D11Context_PSSetShader(ID3D11DeviceContext *self, ID3D11PixelShader *pPixelShader, ID3D11ClassInstance * const *ppClassInstances, UINT NumClassInstances) {
+		CALL_ORIGINAL(D3D11Context_PSSetShader)(self, pPixelShader, ppClassInstances, NumClassInstances);
+		if (PipelineStateTracker::Instance().IsTracked(self))
+			PipelineStateTracker::Instance().OnSetPixelShader(pPixelShader);
+	}
+
+	void D3D11Context_CSSetShader(ID3D11DeviceContext *self, ID3D11ComputeShader *pComputeShader, ID3D11ClassInstance * const *ppClassInstances, UINT NumClassInstances) {
+		CALL_ORIGINAL(D3D11Context_CSSetShader)(self, pComputeShader, ppClassInstances, NumClassInstances);
+		if (PipelineStateTracker::Instance().IsTracked(self))
+			PipelineStateTracker::Instance().OnSetComputeShader(pComputeShader);
+	}
+
+	void D3D11Context_IASetInputLayout(ID3D11DeviceContext *self, ID3D11InputLayout *pInputLayout) {
+		CALL_ORIGINAL(D3D11Context_IASetInputLayout)(self, pInputLayout);
+		if (PipelineStateTracker::Instance().IsTracked(self))
+			PipelineStateTracker::Instance().OnSetInputLayout(pInputLayout);
+	}
+
+	void D3D11Context_IASetPrimitiveTopology(ID3D11DeviceContext *self, D3D11_PRIMITIVE_TOPOLOGY Topology) {
+		CALL_ORIGINAL(D3D11Context_IASetPrimitiveTopology)(self, Topology);
+		if (PipelineStateTracker::Instance().IsTracked(self))
+			PipelineStateTracker::Instance().OnSetPrimitiveTopology(Topology);
+	}
+
+	void D3D11Context_VSSetConstantBuffers(ID3D11DeviceContext *self, UINT StartSlot, UINT NumBuffers, ID3D11Buffer * const *ppConstantBuffers) {
+		CALL_ORIGINAL(D3D11Context_VSSetConstantBuffers)(self, StartSlot, NumBuffers, ppConstantBuffers);
+		if (PipelineStateTracker::Instance().IsTracked(self))
+			PipelineStateTracker::Instance().OnSetConstantBuffers(PipelineStateTracker::Stage_VS, StartSlot, NumBuffers, ppConstantBuffers);
+	}
+
+	void D3D11Context_PSSetConstantBuffers(ID3D11DeviceContext *self, UINT StartSlot, UINT NumBuffers, ID3D11Buffer * const *ppConstantBuffers) {
+		CALL_ORIGINAL(D3D11Context_PSSetConstantBuffers)(self, StartSlot, NumBuffers, ppConstantBuffers);
+		if (PipelineStateTracker::Instance().IsTracked(self))
+			PipelineStateTracker::Instance().OnSetConstantBuffers(PipelineStateTracker::Stage_PS, StartSlot, NumBuffers, ppConstantBuffers);
+	}
+
+	void D3D11Context_CSSetConstantBuffers(ID3D11DeviceContext *self, UINT StartSlot, UINT NumBuffers, ID3D11Buffer * const *ppConstantBuffers) {
+		CALL_ORIGINAL(D3D11Context_CSSetConstantBuffers)(self, StartSlot, NumBuffers, ppConstantBuffers);
+		if (PipelineStateTracker::Instance().IsTracked(self))
+			PipelineStateTracker::Instance().OnSetConstantBuffers(PipelineStateTracker::Stage_CS, StartSlot, NumBuffers, ppConstantBuffers);
+	}
+
+	void D3D11Context_CSSetSamplers(ID3D11DeviceContext *self, UINT StartSlot, UINT NumSamplers, ID3D11SamplerState * const *ppSamplers) {
+		CALL_ORIGINAL(D3D11Context_CSSetSamplers)(self, StartSlot, NumSamplers, ppSamplers);
+		if (PipelineStateTracker::Instance().IsTracked(self))
+			PipelineStateTracker::Instance().OnSetSamplers(StartSlot, NumSamplers, ppSamplers);
+	}
+
+	void D3D11Context_RSSetState(ID3D11DeviceContext *self, ID3D11RasterizerState *pRasterizerState) {
+		CALL_ORIGINAL(D3D11Context_RSSetState)(self, pRasterizerState);
+		if (PipelineStateTracker::Instance().IsTracked(self))
+			PipelineStateTracker::Instance().OnSetRasterizerState(pRasterizerState);
+	}
+
+	void D3D11Context_OMSetDepthStencilState(ID3D11DeviceContext *self, ID3D11DepthStencilState *pDepthStencilState, UINT StencilRef) {
+		CALL_ORIGINAL(D3D11Context_OMSetDepthStencilState)(self, pDepthStencilState, StencilRef);
+		if (PipelineStateTracker::Instance().IsTracked(self))
+			PipelineStateTracker::Instance().OnSetDepthStencilState(pDepthStencilState, StencilRef);
+	}
+
+	void D3D11Context_RSSetViewports(ID3D11DeviceContext *self, UINT NumViewports, const D3D11_VIEWPORT *pViewports) {
+		CALL_ORIGINAL(D3D11Context_RSSetViewports)(self, NumViewports, pViewports);
+		if (PipelineStateTracker::Instance().IsTracked(self)) {
+			PipelineStateTracker::Instance().OnSetViewports(NumViewports, vr::TrackedViewports(pViewports));
+			postProcessor.OnViewportChange(NumViewports, pViewports);
+		}
+	}
+
+	void D3D11Context_ClearState(ID3D11DeviceContext *self) {
+		CALL_ORIGINAL(D3D11Context_ClearState)(self);
+		if (PipelineStateTracker::Instance().IsTracked(self)) {
+			PipelineStateTracker::Instance().OnClearState();
+			vr::VariableRateShading::Instance().InvalidateState();
+		}
+	}
+
+	void D3D11Context_ExecuteCommandList(ID3D11DeviceContext *self, ID3D11CommandList *pCommandList, BOOL RestoreContextState) {
+		CALL_ORIGINAL(D3D11Context_ExecuteCommandList)(self, pCommandList, RestoreContextState);
+		if (PipelineStateTracker::Instance().IsTracked(self)) {
+			PipelineStateTracker::Instance().OnExecuteCommandList(RestoreContextState != FALSE);
+			vr::VariableRateShading::Instance().InvalidateState();
+		}
+	}
+
+	void D3D11Context1_VSSetConstantBuffers1(ID3D11DeviceContext1 *self, UINT StartSlot, UINT NumBuffers, ID3D11Buffer * const *ppConstantBuffers, const UINT *pFirstConstant, const UINT *pNumConstants) {
+		CALL_ORIGINAL(D3D11Context1_VSSetConstantBuffers1)(self, StartSlot, NumBuffers, ppConstantBuffers, pFirstConstant, pNumConstants);
+		if (PipelineStateTracker::Instance().IsTracked(self))
+			PipelineStateTracker::Instance().OnSetConstantBuffers(PipelineStateTracker::Stage_VS, StartSlot, NumBuffers, ppConstantBuffers, pFirstConstant != nullptr);
+	}
+
+	void D3D11Context1_PSSetConstantBuffers1(ID3D11DeviceContext1 *self, UINT StartSlot, UINT NumBuffers, ID3D11Buffer * const *ppConstantBuffers, const UINT *pFirstConstant, const UINT *pNumConstants) {
+		CALL_ORIGINAL(D3D11Context1_PSSetConstantBuffers1)(self, StartSlot, NumBuffers, ppConstantBuffers, pFirstConstant, pNumConstants);
+		if (PipelineStateTracker::Instance().IsTracked(self))
+			PipelineStateTracker::Instance().OnSetConstantBuffers(PipelineStateTracker::Stage_PS, StartSlot, NumBuffers, ppConstantBuffers, pFirstConstant != nullptr);
+	}
+
+	void D3D11Context1_CSSetConstantBuffers1(ID3D11DeviceContext1 *self, UINT StartSlot, UINT NumBuffers, ID3D11Buffer * const *ppConstantBuffers, const UINT *pFirstConstant, const UINT *pNumConstants) {
+		CALL_ORIGINAL(D3D11Context1_CSSetConstantBuffers1)(self, StartSlot, NumBuffers, ppConstantBuffers, pFirstConstant, pNumConstants);
+		if (PipelineStateTracker::Instance().IsTracked(self))
+			PipelineStateTracker::Instance().OnSetConstantBuffers(PipelineStateTracker::Stage_CS, StartSlot, NumBuffers, ppConstantBuffers, pFirstConstant != nullptr);
+	}
+
+	void D3D11Context1_SwapDeviceContextState(ID3D11DeviceContext1 *self, ID3DDeviceContextState *pState, ID3DDeviceContextState **ppPreviousState) {
+		CALL_ORIGINAL(D3D11Context1_SwapDeviceContextState)(self, pState, ppPreviousState);
+		if (PipelineStateTracker::Instance().IsTracked(self)) {
+			PipelineStateTracker::Instance().OnSwapDeviceContextState();
+			vr::VariableRateShading::Instance().InvalidateState();
+		}
+	}
+
+	bool HookStateTracking(ID3D11DeviceContext *context) {
+		size_t methodCount = ContextMethodCount(context);
+		bool success = true;
+		success &= INSTALL_OBJECT_HOOK(context, methodCount, 7, D3D11Context_VSSetConstantBuffers);
+		success &= INSTALL_OBJECT_HOOK(context, methodCount, 9, D3D11Context_PSSetShader);
+		success &= INSTALL_OBJECT_HOOK(context, methodCount, 11, D3D11Context_VSSetShader);
+		success &= INSTALL_OBJECT_HOOK(context, methodCount, 16, D3D11Context_PSSetConstantBuffers);
+		success &= INSTALL_OBJECT_HOOK(context, methodCount, 17, D3D11Context_IASetInputLayout);
+		success &= INSTALL_OBJECT_HOOK(context, methodCount, 24, D3D11Context_IASetPrimitiveTopology);
+		success &= INSTALL_OBJECT_HOOK(context, methodCount, 36, D3D11Context_OMSetDepthStencilState);
+		success &= INSTALL_OBJECT_HOOK(context, methodCount, 43, D3D11Context_RSSetState);
+		success &= INSTALL_OBJECT_HOOK(context, methodCount, 44, D3D11Context_RSSetViewports);
+		success &= INSTALL_OBJECT_HOOK(context, methodCount, 58, D3D11Context_ExecuteCommandList);
+		success &= INSTALL_OBJECT_HOOK(context, methodCount, 69, D3D11Context_CSSetShader);
+		success &= INSTALL_OBJECT_HOOK(context, methodCount, 70, D3D11Context_CSSetSamplers);
+		success &= INSTALL_OBJECT_HOOK(context, methodCount, 71, D3D11Context_CSSetConstantBuffers);
+		success &= INSTALL_OBJECT_HOOK(context, methodCount, 110, D3D11Context_ClearState);
+
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext1> context1;
+		if (SUCCEEDED(context->QueryInterface(context1.GetAddressOf()))) {
+			success &= INSTALL_OBJECT_HOOK(context1.Get(), methodCount, 119, D3D11Context1_VSSetConstantBuffers1);
+			success &= INSTALL_OBJECT_HOOK(context1.Get(), methodCount, 123, D3D11Context1_PSSetConstantBuffers1);
+			success &= INSTALL_OBJECT_HOOK(context1.Get(), methodCount, 124, D3D11Context1_CSSetConstantBuffers1);
+			success &= INSTALL_OBJECT_HOOK(context1.Get(), methodCount, 131, D3D11Context1_SwapDeviceContextState);
+		}
+		return success;
+	}
+
+	void HookDeferredContexts(ID3D11Device *device) {
+		if (!shadowVtableHooks) {
+			Microsoft::WRL::ComPtr<ID3D11DeviceContext> deferredContext;
+			if (FAILED(device->CreateDeferredContext(0, deferredContext.GetAddressOf()))) {
+				Log() << "Device does not support deferred contexts\n";
+				return;
+			}
+			Log() << "Injecting ClearDepthStencilView and FinishCommandList into deferred D3D11DeviceContext\n";
+			if (!INSTALL_HOOK(deferredContext.Get(), 53, D3D11Context_ClearDepthStencilView<ContextKind::Deferred>)) {
+				Log() << "Deferred contexts share the immediate context's ClearDepthStencilView\n";
+			}
+			INSTALL_HOOK(deferredContext.Get(), 114, D3D11Context_FinishCommandList);
+		}
+
+		// contexts created from now on are reported to us, so that state left behind by a destroyed context
+		// at the same address is not carried over. With shadow vtables, this is also where they are hooked;
+		// deferred contexts created before are not.
+		Log() << "Injecting CreateDeferredContext into D3D11Device\n";
+		size_t methodCount = DeviceMethodCount(device);
+		INSTALL_OBJECT_HOOK(device, methodCount, 27, D3D11Device_CreateDeferredContext);
+		Microsoft::WRL::ComPtr<ID3D11Device1> device1;
+		if (SUCCEEDED(device->QueryInterface(device1.GetAddressOf()))) {
+			INSTALL_OBJECT_HOOK(device1.Get(), methodCount, 44, D3D11Device1_CreateDeferredContext1);
+		}
+		Microsoft::WRL::ComPtr<ID3D11Device2> device2;
+		if (SUCCEEDED(device->QueryInterface(device2.GetAddressOf()))) {
+			INSTALL_OBJECT_HOOK(device2.Get(), methodCount, 51, D3D11Device2_CreateDeferredContext2);
+		}
+		Microsoft::WRL::ComPtr<ID3D11Device3> device3;
+		if (SUCCEEDED(device->QueryInterface(device3.GetAddressOf()))) {
+			INSTALL_OBJECT_HOOK(device3.Get(), methodCount, 62, D3D11Device3_CreateDeferredContext3);
+		}
 	}
 }
 
 void InitHooks() {
+	// the log thread is stopped by a previous shutdown
+	StartLog();
 	Log() << "Initializing hooks...\n";
 	MH_Initialize();
+	if (Config::Instance().warmUp && d3d11Module == nullptr) {
+		// loaded here if the game has not done so yet, so that a device it creates later is seen as well
+		d3d11Module = LoadLibraryW(L"d3d11.dll");
+		if (d3d11Module == nullptr) {
+			Log(vr::LogLevel::Warning) << "Could not load d3d11.dll (" << GetLastError() << "), resources are created when first needed\n";
+		} else {
+			Log() << "Injecting D3D11CreateDevice and D3D11CreateDeviceAndSwapChain\n";
+			INSTALL_API_HOOK(L"d3d11", "D3D11CreateDevice", D3D11_CreateDevice);
+			INSTALL_API_HOOK(L"d3d11", "D3D11CreateDeviceAndSwapChain", D3D11_CreateDeviceAndSwapChain);
+		}
+	}
 }
 
 void ShutdownHooks() {
 	Log() << "Shutting down hooks...\n";
+#ifdef OPENVR_MOD_TRACING
+	postProcessor.SaveTrace(false);
+#endif
+	FlushLog();
+	Log() << "Removing " << vr::HookRegistry::Instance().Count() << " hooks\n";
 	MH_Uninitialize();
-	hooksToOriginal.clear();
+	if (d3d11Module != nullptr) {
+		FreeLibrary(d3d11Module);
+		d3d11Module = nullptr;
+	}
+	// objects may outlive us, so they keep their shadow vtables, which only lead to the original methods now
+	vr::ShadowVtables::Instance().UnhookAll();
+	vr::HookRegistry::Instance().Clear();
 	ivrSystemHooked = false;
 	ivrCompositorHooked = false;
 	hookedContext = nullptr;
 	device = nullptr;
+	vr::PipelineStateTracker::Instance().Detach();
 	postProcessor.Reset();
+	postProcessor.StopWorkers();
+	// joined here rather than when the DLL unloads, where the thread can no longer exit
+	StopLog();
 }
 
 void HookVRInterface(const char *version, void *instance) {
@@ -144,8 +545,8 @@ void HookVRInterface(const char *version, void *instance) {
 		// The 'IVRSystem::GetRecommendedRenderTargetSize' function definition has been the same since the initial
 		// release of OpenVR; however, in early versions there was an additional method in front of it.
 		uint32_t methodPos = (system_version >= 9 ? 0 : 1);
-		Log() << "Injecting GetRecommendedRenderTargetSize into " << version << std::endl;
-		InstallVirtualFunctionHook(instance, methodPos, IVRSystem_GetRecommendedRenderTargetSize);
+		Log() << "Injecting GetRecommendedRenderTargetSize into " << version << "\n";
+		INSTALL_HOOK(instance, methodPos, IVRSystem_GetRecommendedRenderTargetSize);
 
 		ivrSystemHooked = true;
 	}
@@ -157,19 +558,19 @@ void HookVRInterface(const char *version, void *instance) {
 	if (!ivrCompositorHooked && std::sscanf(version, "IVRCompositor_%u", &compositor_version))
 	{
 		if (compositor_version >= 9) {
-		Log() << "Injecting Submit into " << version << std::endl;
+		Log() << "Injecting Submit into " << version << "\n";
 			uint32_t methodPos = compositor_version >= 12 ? 5 : 4;
-			InstallVirtualFunctionHook(instance, methodPos, IVRCompositor_Submit);
+			INSTALL_HOOK(instance, methodPos, IVRCompositor_Submit);
 			ivrCompositorHooked = true;
 		}
 		else if (compositor_version == 8) {
-			Log() << "Injecting Submit into " << version << std::endl;
-			InstallVirtualFunctionHook(instance, 6, IVRCompositor_Submit_008);
+			Log() << "Injecting Submit into " << version << "\n";
+			INSTALL_HOOK(instance, 6, IVRCompositor_Submit_008);
 			ivrCompositorHooked = true;
 		}
 		else if (compositor_version == 7) {
-			Log() << "Injecting Submit into " << version << std::endl;
-			InstallVirtualFunctionHook(instance, 6, IVRCompositor_Submit_007);
+			Log() << "Injecting Submit into " << version << "\n";
+			INSTALL_HOOK(instance, 6, IVRCompositor_Submit_007);
 			ivrCompositorHooked = true;
 		}
 	}
@@ -177,13 +578,29 @@ void HookVRInterface(const char *version, void *instance) {
 
 void HookD3D11Context( ID3D11DeviceContext *context, ID3D11Device *pDevice ) {
 	device = pDevice;
-	if (context != hookedContext) {
-		Log() << "Injecting ClearDepthStencilView into D3D11DeviceContext" << std::endl;
-		InstallVirtualFunctionHook(context, 53, D3D11Context_ClearDepthStencilView);
-		Log() << "Injecting OMSetRenderTargets into D3D11DeviceContext" << std::endl;
-		InstallVirtualFunctionHook(context, 33, D3D11Context_OMSetRenderTargets);
-		Log() << "Injecting OMSetRenderTargetsAndUnorderedAccessViews into D3D11DeviceContext" << std::endl;
-		InstallVirtualFunctionHook(context, 34, D3D11Context_OMSetRenderTargetsAndUnorderedAccessViews);
+	if (context != hookedContext.load()) {
+		// mark the context as immediate before any hook can see it
 		hookedContext = context;
+		if (!hookBackendChosen) {
+			shadowVtableHooks = Config::Instance().shadowVtableHooks;
+			hookBackendChosen = true;
+			if (shadowVtableHooks)
+				Log() << "Hooking D3D11 objects through shadow vtables\n";
+		}
+		size_t methodCount = ContextMethodCount(context);
+		Log() << "Injecting ClearDepthStencilView into D3D11DeviceContext\n";
+		INSTALL_OBJECT_HOOK(context, methodCount, 53, D3D11Context_ClearDepthStencilView<ContextKind::Immediate>);
+		Log() << "Injecting OMSetRenderTargets into D3D11DeviceContext\n";
+		INSTALL_OBJECT_HOOK(context, methodCount, 33, D3D11Context_OMSetRenderTargets);
+		Log() << "Injecting OMSetRenderTargetsAndUnorderedAccessViews into D3D11DeviceContext\n";
+		INSTALL_OBJECT_HOOK(context, methodCount, 34, D3D11Context_OMSetRenderTargetsAndUnorderedAccessViews);
+		Log() << "Injecting pipeline state tracking into D3D11DeviceContext\n";
+		if (HookStateTracking(context)) {
+			vr::PipelineStateTracker::Instance().Attach(context);
+		} else {
+			Log(vr::LogLevel::Warning) << "Failed to hook pipeline state, falling back to reading state back from the context\n";
+			vr::PipelineStateTracker::Instance().Detach();
+		}
+		HookDeferredContexts(pDevice);
 	}
 }
@@ -14,6 +14,10 @@ cbuffer cb : register(b0) {
 	float2 u_invResolution;
 	float3 u_radius;
 	int u_debugMode;
+	uint2 u_offsetRight;
+	float2 u_projectionCenterRight;
+	uint2 u_eyeSize;
+	uint2 u_unused;
 };
 
 // FIXME: AMD/NVIDIA extensions?
@@ -166,11 +170,17 @@ void reconstructSixteenthRes( int2 dstUV, uint2 uFragCoordHalf )
 
 [numthreads(8, 8, 1)]
 void main(uint3 globalInvocationID : SV_DispatchThreadID) {
-	uint2 currentUV = uint2(globalInvocationID.xy) + u_offset;
+	// both eyes may be reconstructed in a single dispatch, in which case z selects the eye.
+	// Threads outside the eye's region must not write, or they might overwrite the other eye.
+	if( globalInvocationID.x >= u_eyeSize.x || globalInvocationID.y >= u_eyeSize.y )
+		return;
+	bool rightEye = globalInvocationID.z > 0;
+	uint2 currentUV = uint2(globalInvocationID.xy) + (rightEye ? u_offsetRight : u_offset);
+	float2 projectionCenter = rightEye ? u_projectionCenterRight : u_projectionCenter;
 	uint2 uFragCoordHalf = uint2(currentUV >> 1u);
 
 	//We must work in blocks so the reconstruction filter can work properly
-	float2 toCenter     = (currentUV >> 3u) * u_invClusterResolution - u_projectionCenter;
+	float2 toCenter     = (currentUV >> 3u) * u_invClusterResolution - projectionCenter;
 	float  distToCenter = 2 * length(toCenter);
 
 	//We know for a fact distToCenter is in blocks of 8x8
@@ -0,0 +1,105 @@
+// Lists and extracts the frames of a recording written by the continuous capture mode.
+#include "../postprocess/CaptureRing.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+using namespace vr;
+
+namespace {
+	const uint32_t DXGI_FORMAT_R8G8B8A8_UNORM = 28;
+	const uint32_t DXGI_FORMAT_R8G8B8A8_UNORM_SRGB = 29;
+
+	CapturePath ToPath( const std::string &s ) {
+		return CapturePath( s.begin(), s.end() );
+	}
+
+	int Usage() {
+		fprintf( stderr,
+			"usage: capture_ring_extract <recording> [output directory] [--last seconds] [--format dds|png|raw]\n"
+			"Lists the frames of the recording; with an output directory, also writes them as images.\n" );
+		return 2;
+	}
+}
+
+int main( int argc, char **argv ) {
+	std::string ringPath;
+	std::string outputDir;
+	double lastSeconds = 0;
+	CaptureEncoding encoding = CaptureEncoding::Png;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp( argv[i], "--last" ) == 0 && i + 1 < argc) {
+			lastSeconds = atof( argv[++i] );
+		} else if (strcmp( argv[i], "--format" ) == 0 && i + 1 < argc) {
+			std::string format = argv[++i];
+			if (format == "dds") encoding = CaptureEncoding::Dds;
+			else if (format == "png") encoding = CaptureEncoding::Png;
+			else if (format == "raw") encoding = CaptureEncoding::Raw;
+			else return Usage();
+		} else if (argv[i][0] == '-') {
+			return Usage();
+		} else if (ringPath.empty()) {
+			ringPath = argv[i];
+		} else if (outputDir.empty()) {
+			outputDir = argv[i];
+		} else {
+			return Usage();
+		}
+	}
+	if (ringPath.empty())
+		return Usage();
+
+	CaptureRingReader reader;
+	std::string error;
+	if (!reader.Open( ToPath( ringPath ), error )) {
+		fprintf( stderr, "%s: %s\n", ringPath.c_str(), error.c_str() );
+		return 1;
+	}
+
+	std::vector<CaptureRingReader::FrameView> frames = reader.Frames();
+	if (!frames.empty() && lastSeconds > 0) {
+		uint64_t since = frames.back().entry.timestampMicros - (std::min)( frames.back().entry.timestampMicros, uint64_t(lastSeconds * 1e6) );
+		size_t first = 0;
+		while (first < frames.size() && frames[first].entry.timestampMicros < since)
+			++first;
+		frames.erase( frames.begin(), frames.begin() + first );
+	}
+
+	printf( "%zu frames\n", frames.size() );
+	printf( "%10s %16s %4s %9s %6s %7s %7s %7s %6s %6s %s\n", "sequence", "time (us)", "eye", "size", "format", "inner", "mid", "outer", "sharp", "radius", "flags" );
+	for (const CaptureRingReader::FrameView &frame : frames) {
+		const RingFrameEntry &e = frame.entry;
+		std::string flags;
+		if (e.config.flags & RingFfrEnabled) flags += e.config.flags & RingVariableRateShading ? "vrs " : "rdm ";
+		if (e.config.flags & RingSharpening) flags += "sharpen";
+		printf( "%10llu %16llu %4s %4ux%-4u %6u %7.2f %7.2f %7.2f %6.2f %6.2f %s\n", (unsigned long long)e.sequence, (unsigned long long)e.timestampMicros,
+			e.eye == 0 ? "L" : "R", e.width, e.height, e.dxgiFormat, e.config.innerRadius, e.config.midRadius, e.config.outerRadius,
+			e.config.sharpness, e.config.sharpenRadius, flags.c_str() );
+	}
+
+	if (outputDir.empty())
+		return 0;
+
+	int failed = 0;
+	for (const CaptureRingReader::FrameView &frame : frames) {
+		const RingFrameEntry &e = frame.entry;
+		char name[64];
+		snprintf( name, sizeof(name), "/frame_%06llu_%s", (unsigned long long)e.sequence, e.eye == 0 ? "left" : "right" );
+		CapturedImage image;
+		image.path = ToPath( outputDir + name );
+		image.encoding = encoding;
+		image.width = e.width;
+		image.height = e.height;
+		image.bytesPerPixel = e.bytesPerPixel;
+		image.dxgiFormat = e.dxgiFormat;
+		image.layout = (e.dxgiFormat == DXGI_FORMAT_R8G8B8A8_UNORM || e.dxgiFormat == DXGI_FORMAT_R8G8B8A8_UNORM_SRGB) ? CaptureLayout::Rgba8 : CaptureLayout::Other;
+		image.pixels.assign( frame.pixels, frame.pixels + image.SliceSize() );
+		std::string message;
+		if (!WriteCapture( image, message ))
+			++failed;
+		printf( "%s\n", message.c_str() );
+	}
+	return failed == 0 ? 0 : 1;
+}
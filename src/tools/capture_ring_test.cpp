@@ -0,0 +1,251 @@
+// Checks the recording ring file: frames kept in the slots of the most recent ones and read back in order with
+// their metadata, frames too large for a slot refused, exports of the last frames into a compact file, files the
+// reader must refuse, and the background recorder creating, growing and exporting its ring. Then measures
+// appending frames to the mapped file, and how long Submit holds up the calling thread.
+#include "../postprocess/CaptureRing.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+using namespace vr;
+
+namespace {
+	int failures = 0;
+
+	void Check( bool condition, const char *what ) {
+		if (!condition) {
+			fprintf( stderr, "FAIL  %s\n", what );
+			++failures;
+		}
+	}
+
+	CapturePath TestPath( const std::string &name ) {
+		return CapturePath( name.begin(), name.end() );
+	}
+
+	// a frame whose pixels and metadata are told by its number
+	RingFrame Frame( uint32_t number, uint32_t width = 16, uint32_t height = 8 ) {
+		RingFrame frame;
+		frame.entry.timestampMicros = 1000000 + uint64_t(number) * 11111;
+		frame.entry.eye = number % 2;
+		frame.entry.dxgiFormat = 28;
+		frame.entry.width = width;
+		frame.entry.height = height;
+		frame.entry.bytesPerPixel = 4;
+		frame.entry.config.innerRadius = .5f;
+		frame.entry.config.sharpness = float(number);
+		frame.entry.config.flags = RingFfrEnabled | RingSharpening;
+		frame.pixels.resize( size_t(width) * height * 4 );
+		for (size_t i = 0; i < frame.pixels.size(); ++i)
+			frame.pixels[i] = uint8_t(number + i);
+		return frame;
+	}
+
+	bool IsFrame( const CaptureRingReader::FrameView &view, uint32_t number ) {
+		RingFrame expected = Frame( number, view.entry.width, view.entry.height );
+		const RingFrameEntry &e = view.entry;
+		return e.timestampMicros == expected.entry.timestampMicros && e.eye == expected.entry.eye && e.dxgiFormat == 28
+			&& e.dataSize == expected.pixels.size() && e.config.sharpness == float(number) && e.config.flags == (RingFfrEnabled | RingSharpening)
+			&& memcmp( view.pixels, expected.pixels.data(), expected.pixels.size() ) == 0;
+	}
+
+	// the frame numbers read back, in order
+	std::string Numbers( const std::vector<CaptureRingReader::FrameView> &frames ) {
+		std::string numbers;
+		for (const CaptureRingReader::FrameView &frame : frames) {
+			uint32_t number = uint32_t(frame.entry.config.sharpness);
+			numbers += (numbers.empty() ? "" : " ") + std::to_string( number );
+			if (!IsFrame( frame, number ))
+				numbers += "?";
+		}
+		return numbers;
+	}
+
+	void CheckRing() {
+		CaptureRingWriter writer;
+		Check( !writer.Open( TestPath( "capture_ring_test.ring" ), 0, 512 ), "ring without slots refused" );
+		Check( writer.Open( TestPath( "capture_ring_test.ring" ), 4, 512 ) && writer.SlotBytes() == 4096, "slots rounded up to pages" );
+
+		CaptureRingReader reader;
+		std::string error;
+		Check( reader.Open( TestPath( "capture_ring_test.ring" ), error ) && reader.Frames().empty(), "new ring empty" );
+
+		for (uint32_t number = 1; number <= 3; ++number) {
+			Check( writer.Append( Frame( number ) ), "frame appended" );
+		}
+		// the live file, as the extraction tool reads it while the game records
+		Check( Numbers( reader.Frames() ) == "1 2 3", "frames read back from the live file" );
+		for (uint32_t number = 4; number <= 6; ++number) {
+			writer.Append( Frame( number ) );
+		}
+		Check( Numbers( reader.Frames() ) == "3 4 5 6", "oldest frames overwritten" );
+		Check( !writer.Append( Frame( 7, 64, 32 ) ) && Numbers( reader.Frames() ) == "3 4 5 6", "frame larger than a slot refused" );
+		Check( reader.Frames()[0].entry.sequence == 3 && reader.Frames()[3].entry.sequence == 6, "sequence numbers assigned in order" );
+
+		size_t exported = 0;
+		Check( writer.ExportSince( Frame( 5 ).entry.timestampMicros, TestPath( "capture_ring_test.export" ), exported ) && exported == 2, "last frames exported" );
+		CaptureRingReader exportReader;
+		Check( exportReader.Open( TestPath( "capture_ring_test.export" ), error ) && Numbers( exportReader.Frames() ) == "5 6", "export read back" );
+		Check( writer.ExportSince( Frame( 7 ).entry.timestampMicros, TestPath( "capture_ring_test.export" ), exported ) && exported == 0, "empty export" );
+		Check( exportReader.Open( TestPath( "capture_ring_test.export" ), error ) && exportReader.Frames().empty(), "empty export read back" );
+
+		writer.Close();
+		Check( !writer.Append( Frame( 8 ) ) && !writer.ExportSince( 0, TestPath( "capture_ring_test.export" ), exported ), "closed ring refuses frames" );
+		Check( Numbers( reader.Frames() ) == "3 4 5 6", "frames kept after closing" );
+	}
+
+	// writes a copy of the ring file with some bytes replaced
+	void WriteCorrupted( const char *path, size_t offset, const void *bytes, size_t size, size_t truncate = 0 ) {
+		std::ifstream in( "capture_ring_test.ring", std::ios::binary );
+		std::vector<char> contents( (std::istreambuf_iterator<char>( in )), std::istreambuf_iterator<char>() );
+		memcpy( contents.data() + offset, bytes, size );
+		if (truncate != 0)
+			contents.resize( truncate );
+		std::ofstream out( path, std::ios::binary );
+		out.write( contents.data(), contents.size() );
+	}
+
+	void CheckCorruptFiles() {
+		CaptureRingReader reader;
+		std::string error;
+		Check( !reader.Open( TestPath( "capture_ring_test.missing" ), error ) && error.find( "could not open" ) == 0, "missing file refused" );
+
+		WriteCorrupted( "capture_ring_test.bad", 0, "FFRRING0", 8 );
+		Check( !reader.Open( TestPath( "capture_ring_test.bad" ), error ) && error == "not a recording", "other file refused" );
+		uint32_t version = RingFileVersion + 1;
+		WriteCorrupted( "capture_ring_test.bad", offsetof( RingFileHeader, version ), &version, 4 );
+		Check( !reader.Open( TestPath( "capture_ring_test.bad" ), error ) && error == "unsupported recording version 2", "newer version refused" );
+		uint32_t slotCount = 1000;
+		WriteCorrupted( "capture_ring_test.bad", offsetof( RingFileHeader, slotCount ), &slotCount, 4 );
+		Check( !reader.Open( TestPath( "capture_ring_test.bad" ), error ) && error == "recording is truncated or corrupt", "index beyond the file refused" );
+		WriteCorrupted( "capture_ring_test.bad", 0, "F", 1, 4096 + 2 * 4096 );
+		Check( !reader.Open( TestPath( "capture_ring_test.bad" ), error ), "truncated slots refused" );
+
+		// a slot claiming more pixels than it holds is skipped rather than read past
+		RingFileHeader header;
+		std::ifstream( "capture_ring_test.ring", std::ios::binary ).read( reinterpret_cast<char*>(&header), sizeof(header) );
+		uint32_t height = 1000;
+		WriteCorrupted( "capture_ring_test.bad", size_t(header.indexOffset) + offsetof( RingFrameEntry, height ), &height, 4 );
+		Check( reader.Open( TestPath( "capture_ring_test.bad" ), error ) && reader.Frames().size() == 3, "frame larger than its data skipped" );
+	}
+
+	void CheckRecorder() {
+		CaptureRecorder recorder;
+		recorder.Start( TestPath( "capture_ring_test.recording" ), 8 );
+		Check( recorder.IsRunning(), "recorder started" );
+		for (uint32_t number = 1; number <= 10; ++number) {
+			RingFrame frame = recorder.AcquireFrame();
+			RingFrame content = Frame( number );
+			frame.entry = content.entry;
+			frame.pixels.assign( content.pixels.begin(), content.pixels.end() );
+			recorder.Submit( std::move( frame ) );
+		}
+		recorder.RequestExport( Frame( 10 ).entry.timestampMicros, 0, TestPath( "capture_ring_test.export" ) );
+		recorder.Stop();
+		Check( !recorder.IsRunning() && recorder.DroppedFrames() == 0, "frames written before Stop returns" );
+		std::vector<std::string> messages = recorder.TakeMessages();
+		Check( messages.size() == 2 && messages[0] == "Recording the last 8 frames into capture_ring_test.recording", "recording reported" );
+		Check( messages.size() == 2 && messages[1] == "Saved 1 recorded frames to capture_ring_test.export", "export reported" );
+
+		CaptureRingReader reader;
+		std::string error;
+		Check( reader.Open( TestPath( "capture_ring_test.recording" ), error ) && Numbers( reader.Frames() ) == "3 4 5 6 7 8 9 10", "recorded frames" );
+		Check( reader.Open( TestPath( "capture_ring_test.export" ), error ) && Numbers( reader.Frames() ) == "10", "exported frames" );
+
+		// a larger frame recreates the ring with larger slots
+		recorder.Start( TestPath( "capture_ring_test.recording" ), 8 );
+		recorder.Submit( Frame( 11 ) );
+		recorder.Submit( Frame( 12, 256, 256 ) );
+		recorder.Stop();
+		Check( recorder.TakeMessages().size() == 2, "ring created again for the larger frame" );
+		Check( reader.Open( TestPath( "capture_ring_test.recording" ), error ) && Numbers( reader.Frames() ) == "12", "ring restarted with the larger frame" );
+	}
+
+	// keeps the appends from being optimized away
+	volatile uint64_t sink;
+
+	double Milliseconds( std::chrono::steady_clock::time_point start ) {
+		return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+	}
+
+	void Benchmark( uint32_t width, uint32_t height, int frames ) {
+		RingFrame frame = Frame( 1, width, height );
+		double megabytes = double(frame.pixels.size()) / (1 << 20);
+		CaptureRingWriter writer;
+		if (!writer.Open( TestPath( "capture_ring_test.bench" ), 32, frame.pixels.size() )) {
+			Check( false, "benchmark ring created" );
+			return;
+		}
+		// first pass faults the pages of the mapping in
+		for (int i = 0; i < 32; ++i) {
+			writer.Append( frame );
+		}
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < frames; ++i) {
+			sink = writer.Append( frame );
+		}
+		double appended = Milliseconds( start ) / frames;
+		writer.Close();
+		printf( "append       %8.3f ms per %ux%u frame, %7.1f MB/s\n", appended, width, height, megabytes / appended * 1000 );
+
+		CaptureRecorder recorder;
+		recorder.Start( TestPath( "capture_ring_test.bench" ), 32 );
+		double held = 0;
+		for (int i = 0; i < frames; ++i) {
+			RingFrame recorded = recorder.AcquireFrame();
+			recorded.entry = frame.entry;
+			recorded.pixels.assign( frame.pixels.begin(), frame.pixels.end() );
+			start = std::chrono::steady_clock::now();
+			recorder.Submit( std::move( recorded ) );
+			held += Milliseconds( start );
+		}
+		recorder.Stop();
+		printf( "submit       %8.3f ms per frame, %llu of %d dropped\n", held / frames, (unsigned long long)recorder.DroppedFrames(), frames );
+		remove( "capture_ring_test.bench" );
+	}
+
+	int Usage() {
+		fprintf( stderr,
+			"usage: capture_ring_test [--size WxH] [--frames count]\n"
+			"Checks the recording ring file, then measures recording frames of the given size\n"
+			"(default 1008x1120, 200 frames).\n" );
+		return 2;
+	}
+}
+
+int main( int argc, char **argv ) {
+	unsigned width = 1008, height = 1120;
+	int frames = 200;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp( argv[i], "--size" ) == 0 && i + 1 < argc) {
+			if (sscanf( argv[++i], "%ux%u", &width, &height ) != 2 || width == 0 || height == 0)
+				return Usage();
+		} else if (strcmp( argv[i], "--frames" ) == 0 && i + 1 < argc) {
+			frames = atoi( argv[++i] );
+			if (frames <= 0)
+				return Usage();
+		} else {
+			return Usage();
+		}
+	}
+
+	CheckRing();
+	CheckCorruptFiles();
+	CheckRecorder();
+	remove( "capture_ring_test.ring" );
+	remove( "capture_ring_test.bad" );
+	remove( "capture_ring_test.export" );
+	remove( "capture_ring_test.recording" );
+	Benchmark( width, height, frames );
+
+	if (failures != 0) {
+		fprintf( stderr, "%d checks failed\n", failures );
+		return 1;
+	}
+	printf( "all checks passed\n" );
+	return 0;
+}
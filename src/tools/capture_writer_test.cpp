@@ -0,0 +1,321 @@
+// Checks the capture encoders by reading their output back: the DDS headers, the PNG chunks, checksums and
+// stored deflate blocks decoded into the original pixels, and the raw dumps. Then writes captures through the
+// background writer and checks the files and messages it leaves, also for a task queued with the captures.
+// Finally measures each encoder, and how long Enqueue holds up the calling thread against writing the capture on it.
+#include "../postprocess/CaptureWriter.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+using namespace vr;
+
+namespace {
+	int failures = 0;
+
+	void Check( bool condition, const char *what ) {
+		if (!condition) {
+			fprintf( stderr, "FAIL  %s\n", what );
+			++failures;
+		}
+	}
+
+	uint32_t Get32( const std::vector<uint8_t> &data, size_t offset ) {
+		return uint32_t(data[offset]) | uint32_t(data[offset + 1]) << 8 | uint32_t(data[offset + 2]) << 16 | uint32_t(data[offset + 3]) << 24;
+	}
+
+	uint32_t Get32BigEndian( const std::vector<uint8_t> &data, size_t offset ) {
+		return uint32_t(data[offset]) << 24 | uint32_t(data[offset + 1]) << 16 | uint32_t(data[offset + 2]) << 8 | uint32_t(data[offset + 3]);
+	}
+
+	// bit by bit, so that it does not share a mistake with the table driven one being checked
+	uint32_t Crc32( const uint8_t *data, size_t size ) {
+		uint32_t crc = 0xffffffffu;
+		for (size_t i = 0; i < size; ++i) {
+			crc ^= data[i];
+			for (int k = 0; k < 8; ++k)
+				crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+		}
+		return ~crc;
+	}
+
+	uint32_t Adler32( const std::vector<uint8_t> &data ) {
+		uint32_t a = 1, b = 0;
+		for (uint8_t byte : data) {
+			a = (a + byte) % 65521;
+			b = (b + a) % 65521;
+		}
+		return b << 16 | a;
+	}
+
+	CapturedImage Image( uint32_t width, uint32_t height, uint32_t arraySize = 1, CaptureLayout layout = CaptureLayout::Bgra8 ) {
+		CapturedImage image;
+		image.width = width;
+		image.height = height;
+		image.arraySize = arraySize;
+		image.bytesPerPixel = 4;
+		image.dxgiFormat = layout == CaptureLayout::Rgba8 ? 28 : 87;
+		image.layout = layout;
+		image.pixels.resize( image.SliceSize() * arraySize );
+		for (size_t i = 0; i < image.pixels.size(); ++i)
+			image.pixels[i] = uint8_t(i * 7 + i / 4093);
+		return image;
+	}
+
+	// decodes what EncodePng writes: chunks with their checksums, and a zlib stream of stored blocks
+	bool DecodePng( const std::vector<uint8_t> &png, uint32_t &width, uint32_t &height, std::vector<uint8_t> &rgb ) {
+		const uint8_t signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+		if (png.size() < 8 || memcmp( png.data(), signature, 8 ) != 0)
+			return false;
+		std::vector<uint8_t> zlib;
+		bool ended = false;
+		for (size_t offset = 8; offset + 12 <= png.size() && !ended; ) {
+			uint32_t length = Get32BigEndian( png, offset );
+			if (offset + 12 + length > png.size() || Crc32( &png[offset + 4], 4 + length ) != Get32BigEndian( png, offset + 8 + length ))
+				return false;
+			std::string type( png.begin() + offset + 4, png.begin() + offset + 8 );
+			const uint8_t *data = &png[offset + 8];
+			if (type == "IHDR") {
+				std::vector<uint8_t> header( data, data + length );
+				width = Get32BigEndian( header, 0 );
+				height = Get32BigEndian( header, 4 );
+				if (header[8] != 8 || header[9] != 2)
+					return false;
+			} else if (type == "IDAT") {
+				zlib.insert( zlib.end(), data, data + length );
+			} else if (type == "IEND") {
+				ended = true;
+			}
+			offset += 12 + length;
+		}
+		if (!ended || zlib.size() < 6 || zlib[0] != 0x78 || (zlib[0] * 256 + zlib[1]) % 31 != 0)
+			return false;
+
+		std::vector<uint8_t> filtered;
+		size_t offset = 2;
+		for (bool last = false; !last; ) {
+			if (offset + 5 > zlib.size() || (zlib[offset] & 6) != 0)
+				return false;
+			last = (zlib[offset] & 1) != 0;
+			size_t size = zlib[offset + 1] | zlib[offset + 2] << 8;
+			if ((size ^ (zlib[offset + 3] | zlib[offset + 4] << 8)) != 0xffff || offset + 5 + size > zlib.size())
+				return false;
+			filtered.insert( filtered.end(), zlib.begin() + offset + 5, zlib.begin() + offset + 5 + size );
+			offset += 5 + size;
+		}
+		if (offset + 4 != zlib.size() || Get32BigEndian( zlib, offset ) != Adler32( filtered ))
+			return false;
+
+		size_t rowSize = 1 + size_t(width) * 3;
+		if (filtered.size() != rowSize * height)
+			return false;
+		rgb.clear();
+		for (uint32_t y = 0; y < height; ++y) {
+			if (filtered[y * rowSize] != 0)
+				return false;
+			rgb.insert( rgb.end(), filtered.begin() + y * rowSize + 1, filtered.begin() + (y + 1) * rowSize );
+		}
+		return true;
+	}
+
+	bool SameColors( const CapturedImage &image, const std::vector<uint8_t> &rgb ) {
+		int red = image.layout == CaptureLayout::Rgba8 ? 0 : 2;
+		for (size_t pixel = 0; pixel < size_t(image.width) * image.height; ++pixel) {
+			const uint8_t *src = &image.pixels[pixel * 4];
+			if (rgb[pixel * 3] != src[red] || rgb[pixel * 3 + 1] != src[1] || rgb[pixel * 3 + 2] != src[2 - red])
+				return false;
+		}
+		return true;
+	}
+
+	void CheckDds() {
+		CapturedImage image = Image( 5, 3, 2 );
+		std::vector<uint8_t> dds;
+		Check( EncodeDds( image, dds ), "DDS encoded" );
+		Check( dds.size() == 148 + image.pixels.size() && memcmp( dds.data(), "DDS ", 4 ) == 0 && Get32( dds, 4 ) == 124, "DDS header size" );
+		Check( Get32( dds, 12 ) == 3 && Get32( dds, 16 ) == 5 && Get32( dds, 20 ) == 20, "DDS height, width and pitch" );
+		Check( memcmp( &dds[84], "DX10", 4 ) == 0 && Get32( dds, 128 ) == 87 && Get32( dds, 132 ) == 3 && Get32( dds, 140 ) == 2, "DX10 header with format and array size" );
+		Check( memcmp( &dds[148], image.pixels.data(), image.pixels.size() ) == 0, "DDS pixels unchanged" );
+
+		image.pixels.pop_back();
+		Check( !EncodeDds( image, dds ), "DDS refused with missing pixels" );
+	}
+
+	void CheckPng() {
+		std::vector<uint8_t> png, rgb;
+		uint32_t width = 0, height = 0;
+		// rows spanning several stored blocks, which hold 65535 bytes at most
+		CapturedImage bgra = Image( 301, 257, 2 );
+		Check( EncodePng( bgra, png ) && DecodePng( png, width, height, rgb ), "PNG decoded" );
+		Check( width == 301 && height == 257 && SameColors( bgra, rgb ), "BGRA pixels as RGB, first slice only" );
+
+		CapturedImage rgba = Image( 3, 2, 1, CaptureLayout::Rgba8 );
+		Check( EncodePng( rgba, png ) && DecodePng( png, width, height, rgb ) && SameColors( rgba, rgb ), "RGBA pixels as RGB" );
+		CapturedImage empty = Image( 0, 0 );
+		Check( EncodePng( empty, png ) && DecodePng( png, width, height, rgb ) && rgb.empty(), "empty image" );
+
+		Check( !EncodePng( Image( 3, 2, 1, CaptureLayout::Other ), png ), "PNG refused for other layouts" );
+		CapturedImage wide = Image( 3, 2 );
+		wide.bytesPerPixel = 8;
+		Check( !EncodePng( wide, png ), "PNG refused for wider pixels" );
+	}
+
+	void CheckRaw() {
+		CapturedImage image = Image( 4, 4, 2 );
+		std::vector<uint8_t> raw;
+		Check( EncodeRaw( image, raw ) && raw == image.pixels, "raw is the pixels" );
+		image.pixels.resize( image.pixels.size() + 16 );
+		Check( EncodeRaw( image, raw ) && raw.size() == image.SliceSize() * 2, "raw stops after the last slice" );
+	}
+
+	CapturePath TestPath( const std::string &name ) {
+		return CapturePath( name.begin(), name.end() );
+	}
+
+	// reads and removes a file written by a test
+	bool TakeFile( const std::string &path, std::vector<uint8_t> &contents ) {
+		std::ifstream file( path, std::ios::binary );
+		if (!file)
+			return false;
+		contents.assign( std::istreambuf_iterator<char>( file ), std::istreambuf_iterator<char>() );
+		file.close();
+		remove( path.c_str() );
+		return true;
+	}
+
+	void CheckWrites() {
+		std::vector<uint8_t> contents;
+		std::string message;
+		CapturedImage image = Image( 8, 4 );
+		image.path = TestPath( "capture_writer_test_raw" );
+		image.encoding = CaptureEncoding::Raw;
+		Check( WriteCapture( image, message ) && message == "Wrote capture capture_writer_test_raw_8x4x1_fmt87.raw", "raw name tells the layout" );
+		Check( TakeFile( "capture_writer_test_raw_8x4x1_fmt87.raw", contents ) && contents == image.pixels, "raw file written" );
+
+		image.path = TestPath( "capture_writer_test_fallback" );
+		image.encoding = CaptureEncoding::Png;
+		image.layout = CaptureLayout::Other;
+		Check( WriteCapture( image, message ) && message.find( "not supported" ) != std::string::npos, "fallback reported" );
+		Check( TakeFile( "capture_writer_test_fallback.dds", contents ) && contents.size() == 148 + image.pixels.size(), "unsupported encoding written as DDS" );
+
+		image.path = TestPath( "capture_writer_test_missing/capture" );
+		Check( !WriteCapture( image, message ) && message.find( "Error writing" ) == 0, "failed write reported" );
+
+		CaptureWriter writer;
+		for (int i = 0; i < 3; ++i) {
+			CapturedImage queued = Image( 16, 16 );
+			queued.path = TestPath( "capture_writer_test_" + std::to_string( i ) );
+			queued.encoding = i == 1 ? CaptureEncoding::Png : CaptureEncoding::Dds;
+			writer.Enqueue( std::move( queued ) );
+		}
+		writer.Stop();
+		std::vector<std::string> messages = writer.TakeMessages();
+		Check( messages.size() == 3 && messages[1] == "Wrote capture capture_writer_test_1.png", "queued captures written in order before Stop returns" );
+		Check( TakeFile( "capture_writer_test_0.dds", contents ) && TakeFile( "capture_writer_test_1.png", contents ) && TakeFile( "capture_writer_test_2.dds", contents ), "queued files written" );
+		Check( writer.TakeMessages().empty(), "messages taken once" );
+
+		image = Image( 2, 2 );
+		image.path = TestPath( "capture_writer_test_restarted" );
+		writer.Enqueue( std::move( image ) );
+		writer.Stop();
+		Check( writer.TakeMessages().size() == 1 && TakeFile( "capture_writer_test_restarted.dds", contents ), "writer restarted by the next capture" );
+
+		// other files written on the same thread, in order with the captures
+		image = Image( 2, 2 );
+		image.path = TestPath( "capture_writer_test_before_task" );
+		writer.Enqueue( std::move( image ) );
+		writer.EnqueueTask( []() { return std::string( "task ran" ); } );
+		writer.Stop();
+		messages = writer.TakeMessages();
+		Check( messages.size() == 2 && messages[1] == "task ran" && TakeFile( "capture_writer_test_before_task.dds", contents ), "task run after the capture queued before it" );
+	}
+
+	// keeps the encoded sizes from being optimized away
+	volatile uint64_t sink;
+
+	double Milliseconds( std::chrono::steady_clock::time_point start ) {
+		return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+	}
+
+	void Benchmark( uint32_t width, uint32_t height, int frames ) {
+		CapturedImage image = Image( width, height );
+		double megabytes = double(image.pixels.size()) / (1 << 20);
+		std::vector<uint8_t> out;
+		const char *names[] = { "DDS", "PNG", "raw" };
+		bool (*encoders[])( const CapturedImage &, std::vector<uint8_t> & ) = { EncodeDds, EncodePng, EncodeRaw };
+		for (int e = 0; e < 3; ++e) {
+			auto start = std::chrono::steady_clock::now();
+			for (int i = 0; i < frames; ++i) {
+				encoders[e]( image, out );
+				sink = out.size();
+			}
+			double ms = Milliseconds( start ) / frames;
+			printf( "encode %s  %8.2f ms per %ux%u frame, %7.1f MB/s\n", names[e], ms, width, height, megabytes / ms * 1000 );
+		}
+
+		std::string message;
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < frames; ++i) {
+			CapturedImage copy = image;
+			copy.path = TestPath( "capture_writer_test_bench" );
+			copy.encoding = CaptureEncoding::Png;
+			WriteCapture( copy, message );
+		}
+		double written = Milliseconds( start ) / frames;
+
+		CaptureWriter writer;
+		double held = 0;
+		for (int i = 0; i < frames; ++i) {
+			CapturedImage copy = image;
+			copy.path = TestPath( "capture_writer_test_bench" );
+			copy.encoding = CaptureEncoding::Png;
+			start = std::chrono::steady_clock::now();
+			writer.Enqueue( std::move( copy ) );
+			held += Milliseconds( start );
+		}
+		writer.Stop();
+		remove( "capture_writer_test_bench.png" );
+		printf( "PNG written on the caller     %8.3f ms per frame\n", written );
+		printf( "PNG queued for the writer     %8.3f ms per frame\n", held / frames );
+	}
+
+	int Usage() {
+		fprintf( stderr,
+			"usage: capture_writer_test [--size WxH] [--frames count]\n"
+			"Checks the capture encoders and writer, then measures encoding and writing frames of the given size\n"
+			"(default 2016x2240, 10 frames).\n" );
+		return 2;
+	}
+}
+
+int main( int argc, char **argv ) {
+	unsigned width = 2016, height = 2240;
+	int frames = 10;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp( argv[i], "--size" ) == 0 && i + 1 < argc) {
+			if (sscanf( argv[++i], "%ux%u", &width, &height ) != 2 || width == 0 || height == 0)
+				return Usage();
+		} else if (strcmp( argv[i], "--frames" ) == 0 && i + 1 < argc) {
+			frames = atoi( argv[++i] );
+			if (frames <= 0)
+				return Usage();
+		} else {
+			return Usage();
+		}
+	}
+
+	CheckDds();
+	CheckPng();
+	CheckRaw();
+	CheckWrites();
+	Benchmark( width, height, frames );
+
+	if (failures != 0) {
+		fprintf( stderr, "%d checks failed\n", failures );
+		return 1;
+	}
+	printf( "all checks passed\n" );
+	return 0;
+}
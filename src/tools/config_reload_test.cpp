@@ -0,0 +1,229 @@
+// Checks what a reloaded config rebuilds for each setting that changed, the mailbox handing reloads to the Submit
+// thread, and the file watcher: a save reported once after its writes settle, an editor's save through a renamed
+// temporary file reported too, other files in the directory ignored, and Stop returning promptly.
+#include "../postprocess/ConfigReload.h"
+#include "../postprocess/FileWatcher.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace vr;
+
+namespace {
+	int failures = 0;
+
+	void Check( bool condition, const char *what ) {
+		if (!condition) {
+			fprintf( stderr, "FAIL  %s\n", what );
+			++failures;
+		}
+	}
+
+	// the fields of Config that the plan compares, without its dependencies on D3D11 and the log
+	struct FakeConfig {
+		bool ffrEnabled = false;
+		bool useVrs = false;
+		float innerRadius = 0.5f;
+		float midRadius = 0.8f;
+		float outerRadius = 1.0f;
+		bool debugMode = false;
+		bool useSharpening = false;
+		float sharpness = 0.4f;
+		float sharpenRadius = 0.5f;
+		int outputRingSize = 2;
+		int captureEncoding = 0;
+		bool recordingEnabled = false;
+		int recordingDownsample = 8;
+		int recordingMaxImages = 900;
+		int recordingDumpSeconds = 5;
+		bool hotkeysEnabled = true;
+		bool hotkeysRequireCtrl = false;
+		bool hotkeysRequireAlt = false;
+		bool hotkeysRequireShift = false;
+		int hotkeyToggleFfr = 0x70;
+		int hotkeyToggleDebugMode = 0x71;
+		int hotkeyDecreaseSharpness = 0x72;
+		int hotkeyIncreaseSharpness = 0x73;
+		int hotkeyDecreaseRadius = 0x74;
+		int hotkeyIncreaseRadius = 0x75;
+		int hotkeyCaptureOutput = 0x76;
+		int hotkeyToggleUseVrs = 0x77;
+		int hotkeyDumpRecording = 0x78;
+		int hotkeyDumpTrace = 0x79;
+		int hotkeySelectInnerRadius = '1';
+		int hotkeySelectMidRadius = '2';
+		int hotkeySelectOuterRadius = '3';
+		int hotkeySelectSharpenRadius = '4';
+		bool reloadOnChange = true;
+		int traceFrames = 120;
+		bool shareMetrics = true;
+		bool shadowVtableHooks = false;
+		bool warmUp = true;
+	};
+
+	struct Change {
+		const char *what;
+		std::function<void( FakeConfig & )> apply;
+		uint32_t plan;
+	};
+
+	void CheckPlans() {
+		const uint32_t Hotkeys = ReloadPublish | ReloadHotkeys;
+		const uint32_t Resources = ReloadPublish | ReloadResources;
+		const std::vector<Change> changes = {
+			{ "radius only published", []( FakeConfig &c ) { c.innerRadius = .3f; }, ReloadPublish },
+			{ "outer radius only published", []( FakeConfig &c ) { c.outerRadius = 1.2f; }, ReloadPublish },
+			{ "sharpness only published", []( FakeConfig &c ) { c.sharpness = .9f; }, ReloadPublish },
+			{ "debug mode only published", []( FakeConfig &c ) { c.debugMode = true; }, ReloadPublish },
+			{ "capture encoding only published", []( FakeConfig &c ) { c.captureEncoding = 1; }, ReloadPublish },
+			{ "hook kind kept until restart", []( FakeConfig &c ) { c.shadowVtableHooks = true; }, ReloadPublish },
+			{ "warm-up only published", []( FakeConfig &c ) { c.warmUp = false; }, ReloadPublish },
+			{ "trace length only published", []( FakeConfig &c ) { c.traceFrames = 10; }, ReloadPublish },
+			{ "metrics sharing only published", []( FakeConfig &c ) { c.shareMetrics = false; }, ReloadPublish },
+			{ "FFR recreates resources", []( FakeConfig &c ) { c.ffrEnabled = true; }, Resources },
+			{ "sharpening recreates resources", []( FakeConfig &c ) { c.useSharpening = true; }, Resources },
+			{ "output ring recreates resources", []( FakeConfig &c ) { c.outputRingSize = 3; }, Resources },
+			{ "recording recreates resources", []( FakeConfig &c ) { c.recordingEnabled = true; }, Resources },
+			{ "VRS switch drops the patterns", []( FakeConfig &c ) { c.useVrs = true; }, ReloadPublish | ReloadVariableRateShading },
+			{ "ring size restarts the recorder", []( FakeConfig &c ) { c.recordingMaxImages = 90; }, ReloadPublish | ReloadRecorder },
+			{ "hotkey switch rebinds", []( FakeConfig &c ) { c.hotkeysEnabled = false; }, Hotkeys },
+			{ "modifier rebinds", []( FakeConfig &c ) { c.hotkeysRequireShift = true; }, Hotkeys },
+			{ "key rebinds", []( FakeConfig &c ) { c.hotkeyDumpRecording = 'R'; }, Hotkeys },
+			{ "trace key rebinds", []( FakeConfig &c ) { c.hotkeyDumpTrace = 'T'; }, Hotkeys },
+			{ "radius key rebinds", []( FakeConfig &c ) { c.hotkeySelectSharpenRadius = '5'; }, Hotkeys },
+		};
+
+		FakeConfig before;
+		Check( PlanConfigReload( before, before ) == ReloadNothing, "unchanged config needs nothing" );
+		FakeConfig all = before;
+		uint32_t combined = ReloadNothing;
+		for (const Change &change : changes) {
+			FakeConfig after = before;
+			change.apply( after );
+			Check( PlanConfigReload( before, after ) == change.plan, change.what );
+			change.apply( all );
+			combined |= change.plan;
+		}
+		Check( PlanConfigReload( before, all ) == combined, "changes combined" );
+		Check( PlanConfigReload( all, before ) == combined, "changes back combined" );
+	}
+
+	void CheckMailbox() {
+		ReloadMailbox<FakeConfig> mailbox;
+		std::unique_ptr<FakeConfig> config;
+		std::string error;
+		Check( !mailbox.Take( config, error ), "nothing posted" );
+
+		std::unique_ptr<FakeConfig> first( new FakeConfig ), second( new FakeConfig );
+		second->recordingMaxImages = 7;
+		mailbox.Post( std::move( first ), "" );
+		mailbox.Post( std::move( second ), "" );
+		Check( mailbox.Take( config, error ) && config && config->recordingMaxImages == 7 && error.empty(), "latest reload taken" );
+		Check( !mailbox.Take( config, error ), "taken once" );
+		mailbox.Post( nullptr, "radii must satisfy 0 <= innerRadius" );
+		Check( mailbox.Take( config, error ) && !config && error == "radii must satisfy 0 <= innerRadius", "error taken" );
+		mailbox.Post( std::unique_ptr<FakeConfig>( new FakeConfig ), "" );
+		Check( mailbox.Take( config, error ) && config && error.empty(), "error cleared by the next reload" );
+	}
+
+	CapturePath ToPath( const std::string &s ) {
+		return CapturePath( s.begin(), s.end() );
+	}
+
+	void WriteFile( const std::string &path, const char *contents ) {
+		std::ofstream file( path );
+		file << contents;
+	}
+
+	// counts the callbacks of the watcher thread
+	struct Changes {
+		std::mutex mutex;
+		std::condition_variable changed;
+		int count = 0;
+
+		void Notify() {
+			std::lock_guard<std::mutex> lock( mutex );
+			++count;
+			changed.notify_all();
+		}
+
+		// the count once it reached the given one or the timeout passed
+		int WaitFor( int expected, std::chrono::milliseconds timeout ) {
+			std::unique_lock<std::mutex> lock( mutex );
+			changed.wait_for( lock, timeout, [&] { return count >= expected; } );
+			return count;
+		}
+	};
+
+	void CheckWatcher() {
+		const std::string directory = "config_reload_test_dir";
+#ifdef _WIN32
+		_mkdir( directory.c_str() );
+#else
+		mkdir( directory.c_str(), 0755 );
+#endif
+		const std::string config = directory + "/openvr_mod.cfg";
+		const std::string other = directory + "/other.txt";
+		const std::string temporary = directory + "/openvr_mod.cfg.tmp";
+		WriteFile( config, "{}" );
+
+		FileWatcher watcher;
+		Changes changes;
+		const std::chrono::milliseconds settle( 100 );
+		Check( !watcher.Start( ToPath( "config_reload_test_missing" ), ToPath( "openvr_mod.cfg" ), [&] { changes.Notify(); }, settle ), "missing directory refused" );
+		Check( watcher.Start( ToPath( directory ), ToPath( "openvr_mod.cfg" ), [&] { changes.Notify(); }, settle ) && watcher.IsRunning(), "watching" );
+
+		// an editor writing the file in several steps
+		for (int i = 0; i < 3; ++i) {
+			WriteFile( config, "{ \"foveated\": {} }" );
+			std::this_thread::sleep_for( std::chrono::milliseconds( 20 ) );
+		}
+		Check( changes.WaitFor( 1, std::chrono::seconds( 3 ) ) == 1, "save reported" );
+		Check( changes.WaitFor( 2, 3 * settle ) == 1, "writes of one save reported once" );
+
+		WriteFile( other, "x" );
+		Check( changes.WaitFor( 2, 3 * settle ) == 1, "other files ignored" );
+
+		WriteFile( temporary, "{}" );
+		rename( temporary.c_str(), config.c_str() );
+		Check( changes.WaitFor( 2, std::chrono::seconds( 3 ) ) == 2, "file replaced by a rename reported" );
+
+		auto start = std::chrono::steady_clock::now();
+		watcher.Stop();
+		Check( !watcher.IsRunning() && std::chrono::steady_clock::now() - start < std::chrono::milliseconds( 500 ), "stopped promptly" );
+		WriteFile( config, "{}" );
+		Check( changes.WaitFor( 3, 3 * settle ) == 2, "nothing reported once stopped" );
+
+		remove( config.c_str() );
+		remove( other.c_str() );
+#ifdef _WIN32
+		_rmdir( directory.c_str() );
+#else
+		rmdir( directory.c_str() );
+#endif
+	}
+}
+
+int main() {
+	CheckPlans();
+	CheckMailbox();
+	CheckWatcher();
+	if (failures != 0) {
+		fprintf( stderr, "%d checks failed\n", failures );
+		return 1;
+	}
+	printf( "all checks passed\n" );
+	return 0;
+}
@@ -0,0 +1,237 @@
+// Checks the per-context registry of the deferred context path: states created once per context, calls refused
+// while closed or full, and, with threads recording on their own fake contexts while another one keeps closing,
+// clearing and reopening the registry, that Close returns only once no call is in flight and that no state is
+// used after it was cleared or by two threads at once. Then measures a call entering and leaving the registry
+// against announcing it in a counter shared by all threads; the shared counter only costs more once the threads
+// run on separate cores and take its cache line from each other.
+#include "../postprocess/ContextRegistry.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+using namespace vr;
+
+namespace {
+	const uint32_t Alive = 0xa11fe;
+	const uint32_t Destroyed = 0xdead;
+
+	std::atomic<int> created { 0 };
+	std::atomic<int> destroyed { 0 };
+	// calls between Enter and Leave, across all threads
+	std::atomic<int> inFlight { 0 };
+
+	struct TestState {
+		TestState() { created.fetch_add( 1 ); }
+		~TestState() {
+			magic = Destroyed;
+			destroyed.fetch_add( 1 );
+		}
+
+		volatile uint32_t magic = Alive;
+		std::atomic<int> users { 0 };
+		uint64_t calls = 0;
+	};
+
+	typedef ContextRegistry<TestState, 16> Registry;
+
+	// stand-ins for device contexts, spaced like heap objects so that some share a home slot
+	char contexts[64][256];
+
+	int failures = 0;
+
+	void Check( bool condition, const char *what ) {
+		if (!condition) {
+			fprintf( stderr, "FAIL  %s\n", what );
+			++failures;
+		}
+	}
+
+	void CheckSingleThread() {
+		Registry registry;
+		Check( registry.Enter( contexts[0] ) == nullptr && registry.Size() == 0, "closed until opened" );
+		registry.Open();
+
+		bool isNew = false;
+		TestState *state = registry.Enter( contexts[0], &isNew );
+		Check( state != nullptr && isNew, "state created on the first call" );
+		registry.Leave( contexts[0] );
+		Check( registry.Enter( contexts[0], &isNew ) == state && !isNew, "same state on the next call" );
+		registry.Leave( contexts[0] );
+		TestState *other = registry.Enter( contexts[1] );
+		Check( other != nullptr && other != state && registry.Size() == 2, "state per context" );
+		registry.Leave( contexts[1] );
+
+		registry.Close();
+		Check( registry.Enter( contexts[0] ) == nullptr, "no call while closed" );
+		registry.Open();
+
+		for (int i = 2; i < 16; ++i) {
+			Check( registry.Enter( contexts[i] ) != nullptr, "registered until full" );
+			registry.Leave( contexts[i] );
+		}
+		Check( registry.Enter( contexts[16] ) == nullptr && registry.IsFull(), "no state when full" );
+		Check( registry.Enter( contexts[3] ) != nullptr, "known contexts still served when full" );
+		registry.Leave( contexts[3] );
+
+		int before = destroyed.load();
+		registry.Close();
+		registry.Clear();
+		Check( destroyed.load() - before == 16 && registry.Size() == 0 && !registry.IsFull(), "states deleted on clear" );
+		registry.Open();
+		Check( registry.Enter( contexts[16], &isNew ) != nullptr && isNew, "registered again after clear" );
+		registry.Leave( contexts[16] );
+	}
+
+	struct Stress {
+		Registry registry;
+		std::atomic<bool> stop { false };
+		std::atomic<uint64_t> calls { 0 };
+		std::atomic<int> misuses { 0 };
+		std::atomic<int> busyCloses { 0 };
+		int closes = 0;
+	};
+
+	// records on its own contexts, as each context is only used by one thread at a time
+	void Record( Stress &stress, int first, int count ) {
+		uint64_t calls = 0;
+		for (uint64_t i = 0; !stress.stop.load( std::memory_order_relaxed ); ++i) {
+			const void *context = contexts[first + i % count];
+			TestState *state = stress.registry.Enter( context );
+			if (state == nullptr)
+				continue;
+			inFlight.fetch_add( 1 );
+			if (state->magic != Alive || state->users.fetch_add( 1 ) != 0)
+				stress.misuses.fetch_add( 1 );
+			++state->calls;
+			state->users.fetch_sub( 1 );
+			inFlight.fetch_sub( 1 );
+			stress.registry.Leave( context );
+			++calls;
+		}
+		stress.calls.fetch_add( calls );
+	}
+
+	// what Resize and Reset do from the Submit thread
+	void CloseAndClear( Stress &stress, int rounds ) {
+		for (int round = 0; round < rounds; ++round) {
+			std::this_thread::sleep_for( std::chrono::microseconds( 50 ) );
+			stress.registry.Close();
+			if (inFlight.load() != 0)
+				stress.busyCloses.fetch_add( 1 );
+			if (round % 4 == 0)
+				stress.registry.Clear();
+			++stress.closes;
+			stress.registry.Open();
+		}
+		stress.stop.store( true );
+	}
+
+	void CheckConcurrentCalls( int threads ) {
+		created.store( 0 );
+		destroyed.store( 0 );
+		{
+			Stress stress;
+			stress.registry.Open();
+			std::vector<std::thread> recorders;
+			// more contexts than slots, so that threads also race for slots and find the registry full
+			for (int i = 0; i < threads; ++i) {
+				recorders.emplace_back( Record, std::ref( stress ), i * 5, 5 );
+			}
+			CloseAndClear( stress, 400 );
+			for (std::thread &recorder : recorders) {
+				recorder.join();
+			}
+			Check( stress.misuses.load() == 0, "states only used while alive and by one thread at a time" );
+			Check( stress.busyCloses.load() == 0, "close waits for the calls in flight" );
+			Check( stress.calls.load() > 0 && stress.closes == 400, "calls made between closes" );
+		}
+		Check( created.load() == destroyed.load(), "every state deleted once" );
+	}
+
+	// keeps the calls from being optimized away
+	volatile uint64_t sink;
+
+	// nanoseconds per call on each of the threads, each recording on its own context
+	double NanosecondsPerCall( int threads, uint64_t calls, bool shared ) {
+		Registry registry;
+		registry.Open();
+		std::atomic<int> sharedCalls { 0 };
+		std::atomic<int> ready { 0 };
+		std::vector<double> elapsed( threads );
+		std::vector<std::thread> workers;
+		for (int t = 0; t < threads; ++t) {
+			workers.emplace_back( [&, t]() {
+				const void *context = contexts[t];
+				uint64_t sum = 0;
+				ready.fetch_add( 1 );
+				while (ready.load() < threads) {}
+				auto start = std::chrono::steady_clock::now();
+				for (uint64_t i = 0; i < calls; ++i) {
+					if (shared) {
+						// the single counter all calls announced themselves in before
+						sharedCalls.fetch_add( 1 );
+						sum += i;
+						sharedCalls.fetch_sub( 1 );
+					} else if (TestState *state = registry.Enter( context )) {
+						sum += ++state->calls;
+						registry.Leave( context );
+					}
+				}
+				elapsed[t] = std::chrono::duration<double, std::nano>( std::chrono::steady_clock::now() - start ).count();
+				sink = sum;
+			} );
+		}
+		double total = 0;
+		for (int t = 0; t < threads; ++t) {
+			workers[t].join();
+			total += elapsed[t];
+		}
+		registry.Close();
+		return total / double(threads) / double(calls);
+	}
+
+	int Usage() {
+		fprintf( stderr,
+			"usage: context_registry_test [--threads count] [--calls count]\n"
+			"Checks the context registry, then compares calls entering and leaving it on each thread with\n"
+			"announcing them in a shared counter (default 4 threads, 2000000 calls each).\n" );
+		return 2;
+	}
+}
+
+int main( int argc, char **argv ) {
+	int threads = 4;
+	uint64_t calls = 2000000;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp( argv[i], "--threads" ) == 0 && i + 1 < argc) {
+			threads = atoi( argv[++i] );
+			if (threads <= 0 || threads > 12)
+				return Usage();
+		} else if (strcmp( argv[i], "--calls" ) == 0 && i + 1 < argc) {
+			calls = strtoull( argv[++i], nullptr, 10 );
+			if (calls == 0)
+				return Usage();
+		} else {
+			return Usage();
+		}
+	}
+
+	CheckSingleThread();
+	CheckConcurrentCalls( threads );
+
+	double shared = NanosecondsPerCall( threads, calls, true );
+	double perContext = NanosecondsPerCall( threads, calls, false );
+	printf( "shared counter       %8.2f ns per call on %d threads\n", shared, threads );
+	printf( "per context          %8.2f ns per call on %d threads\n", perContext, threads );
+
+	if (failures != 0) {
+		fprintf( stderr, "%d checks failed\n", failures );
+		return 1;
+	}
+	printf( "all checks passed\n" );
+	return 0;
+}
@@ -0,0 +1,91 @@
+// Checks when both eyes are processed on the first Submit and the bounds math behind it: the region an eye covers
+// in the submitted texture, the bounds predicted for the other eye of a side-by-side or array texture, and the
+// region spanning both eyes that the side-by-side dispatch is run on.
+#include "../postprocess/EyeBatching.h"
+#include <cstdio>
+
+using namespace vr;
+
+namespace {
+	int failures = 0;
+
+	void Check( bool condition, const char *what ) {
+		if (!condition) {
+			fprintf( stderr, "FAIL  %s\n", what );
+			++failures;
+		}
+	}
+
+	VRTextureBounds_t Bounds( float uMin, float uMax, float vMin, float vMax ) {
+		VRTextureBounds_t bounds;
+		bounds.uMin = uMin;
+		bounds.uMax = uMax;
+		bounds.vMin = vMin;
+		bounds.vMax = vMax;
+		return bounds;
+	}
+
+	bool RegionIs( const EyeRegion &region, uint32_t x, uint32_t y, uint32_t width, uint32_t height ) {
+		return region.x == x && region.y == y && region.width == width && region.height == height;
+	}
+
+	void CheckRegions() {
+		Check( RegionIs( RegionFromBounds( Bounds( 0, 1, 0, 1 ), 2016, 2240 ), 0, 0, 2016, 2240 ), "full bounds cover the texture" );
+		Check( RegionIs( RegionFromBounds( Bounds( .5f, 1, 0, 1 ), 4032, 2240 ), 2016, 0, 2016, 2240 ), "right half of a side-by-side texture" );
+		// games rendering upside down submit flipped v bounds
+		Check( RegionIs( RegionFromBounds( Bounds( 0, .5f, 1, 0 ), 4032, 2240 ), 0, 0, 2016, 2240 ), "flipped bounds give the same region" );
+		Check( RegionIs( RegionFromBounds( Bounds( .25f, .75f, .125f, .625f ), 1024, 1024 ), 256, 128, 512, 512 ), "partial bounds" );
+	}
+
+	void CheckBatchingDecision() {
+		Check( ChooseEyeBatching( false, 1 ) == EyeBatching::SideBySide, "side-by-side texture is batched" );
+		Check( ChooseEyeBatching( true, 1 ) == EyeBatching::None, "texture with a single eye is not batched" );
+		Check( ChooseEyeBatching( true, 2 ) == EyeBatching::ArraySlices, "array texture with one eye per slice is batched by slice" );
+		Check( ChooseEyeBatching( false, 2 ) == EyeBatching::ArraySlices, "array slices batched whatever the bounds" );
+		Check( ChooseEyeBatching( true, 6 ) == EyeBatching::None, "array with more slices than eyes is not batched" );
+	}
+
+	void CheckPrediction() {
+		VRTextureBounds_t left = Bounds( 0, .5f, 0, 1 );
+		VRTextureBounds_t right = Bounds( .5f, 1, 0, 1 );
+		Check( BoundsMatch( PredictOtherEyeBounds( EyeBatching::SideBySide, Eye_Left, left ), right ), "right eye predicted from the left" );
+		Check( BoundsMatch( PredictOtherEyeBounds( EyeBatching::SideBySide, Eye_Right, right ), left ), "left eye predicted from the right" );
+		VRTextureBounds_t flipped = Bounds( 0, .5f, 1, 0 );
+		Check( BoundsMatch( PredictOtherEyeBounds( EyeBatching::SideBySide, Eye_Left, flipped ), Bounds( .5f, 1, 1, 0 ) ), "flipped v bounds kept for the other eye" );
+
+		Check( BoundsMatch( right, Bounds( .50001f, 1, 0, 1 ) ), "rounding differences still match" );
+		Check( !BoundsMatch( right, Bounds( .501f, 1, 0, 1 ) ), "shifted bounds do not match" );
+		Check( !BoundsMatch( right, Bounds( .5f, 1, 1, 0 ) ), "flipped bounds do not match" );
+
+		VRTextureBounds_t slice = Bounds( 0, 1, 1, 0 );
+		Check( BoundsMatch( PredictOtherEyeBounds( EyeBatching::ArraySlices, Eye_Left, slice ), slice ), "other slice predicted with the same bounds" );
+	}
+
+	void CheckCombinedRegion() {
+		uint32_t width = 4032, height = 2240;
+		VRTextureBounds_t left = Bounds( 0, .5f, 0, 1 );
+		EyeRegion leftRegion = RegionFromBounds( left, width, height );
+		EyeRegion rightRegion = RegionFromBounds( PredictOtherEyeBounds( EyeBatching::SideBySide, Eye_Left, left ), width, height );
+		Check( RegionIs( CombineEyeRegions( leftRegion, rightRegion ), 0, 0, width, height ), "both halves combine to the whole texture" );
+		Check( RegionIs( CombineEyeRegions( rightRegion, leftRegion ), 0, 0, width, height ), "combining does not depend on the order" );
+
+		// eyes rendered into a smaller area of a larger texture, e.g. with dynamic resolution
+		VRTextureBounds_t used = Bounds( .125f, .375f, .25f, .75f );
+		EyeRegion a = RegionFromBounds( used, 1024, 1024 );
+		EyeRegion b = RegionFromBounds( PredictOtherEyeBounds( EyeBatching::SideBySide, Eye_Left, used ), 1024, 1024 );
+		Check( RegionIs( CombineEyeRegions( a, b ), 128, 256, 768, 512 ), "combined region spans only the used area" );
+	}
+}
+
+int main() {
+	CheckRegions();
+	CheckBatchingDecision();
+	CheckPrediction();
+	CheckCombinedRegion();
+	if (failures != 0) {
+		fprintf( stderr, "%d checks failed\n", failures );
+		return 1;
+	}
+	printf( "all checks passed\n" );
+	return 0;
+}
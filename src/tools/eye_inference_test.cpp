@@ -0,0 +1,162 @@
+// Replays recorded traces of the events the hooks feed to the eye inference, written as a line of tokens per frame,
+// and checks which schedule it learns, when it starts and stops trusting it, the eye it reports at points marked in
+// the trace, and the per-eye viewports it estimates and places the projection center in.
+#include "../postprocess/EyeInference.h"
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+
+using namespace vr;
+
+namespace {
+	int failures = 0;
+
+	void Check( bool condition, const char *what ) {
+		if (!condition) {
+			fprintf( stderr, "FAIL  %s\n", what );
+			++failures;
+		}
+	}
+
+	// Replays a frame's trace the given number of times and returns how many eyes marked in it were reported
+	// differently. Tokens: B<n> binds single-eye target n (0 for any other target), C clears its depth,
+	// V<x>,<y>,<w>,<h> sets a viewport, L<n> and R<n> submit texture n for the left or right eye, and E<eye>
+	// marks the eye expected at that point, L, R or - for none. The frame ends after the last token.
+	int Replay( EyeInference &inference, const char *trace, int frames = 1 ) {
+		int wrong = 0;
+		for (int frame = 0; frame < frames; ++frame) {
+			std::istringstream tokens( trace );
+			std::string token;
+			while (tokens >> token) {
+				const char *args = token.c_str() + 1;
+				switch (token[0]) {
+				case 'B':
+					inference.OnTargetBound( EyeInference::TargetId( atoi( args ) ) );
+					break;
+				case 'C':
+					inference.OnDepthClear();
+					break;
+				case 'V': {
+					ViewportRect viewport;
+					sscanf( args, "%f,%f,%f,%f", &viewport.x, &viewport.y, &viewport.width, &viewport.height );
+					inference.OnViewport( viewport );
+					break;
+				}
+				case 'L':
+				case 'R':
+					inference.OnSubmit( token[0] == 'L' ? Eye_Left : Eye_Right, EyeInference::TargetId( atoi( args ) ) );
+					break;
+				case 'E': {
+					EVREye eye;
+					bool known = inference.CurrentEye( eye );
+					char reported = known ? (eye == Eye_Left ? 'L' : 'R') : '-';
+					if (reported != args[0])
+						++wrong;
+					break;
+				}
+				default:
+					fprintf( stderr, "bad token %s\n", token.c_str() );
+					++wrong;
+				}
+			}
+			inference.OnFrameEnd();
+		}
+		return wrong;
+	}
+
+	// the game renders each eye straight into the texture it then submits for that eye
+	const char *SubmittedTextures = "B7 B1 C E- B2 C E- B0 L1 R2";
+	const char *SubmittedTexturesLearned = "B7 E- B1 C EL B2 C ER B0 E- L1 R2";
+	// each eye rendered into the same target and submitted before the next one is rendered
+	const char *Interleaved = "B1 C EL B0 C EL L1 B1 C ER R1";
+	const char *InterleavedRightFirst = "B1 C ER R1 B1 C EL L1";
+	// all passes rendered before the first Submit, the first half for the first eye
+	const char *Sequential = "B1 C EL C EL C ER C ER L1 E- R1";
+
+	void CheckSchedules() {
+		EyeInference inference;
+		// the first frame has no submitted textures to compare the binds with yet
+		Check( Replay( inference, SubmittedTextures, EyeInference::LearningFrames + 1 ) == 0, "no eye reported while learning" );
+		Check( inference.ActiveSchedule() == EyeInference::Schedule::SubmittedTexture, "submitted textures learned" );
+		Check( Replay( inference, SubmittedTexturesLearned, 4 ) == 0, "eye told by the bound texture" );
+
+		inference.Reset();
+		Replay( inference, Interleaved, EyeInference::LearningFrames );
+		Check( inference.ActiveSchedule() == EyeInference::Schedule::Interleaved, "interleaved eyes learned" );
+		Check( Replay( inference, Interleaved, 4 ) == 0, "eye told by the submits so far" );
+
+		inference.Reset();
+		Replay( inference, InterleavedRightFirst, EyeInference::LearningFrames );
+		Check( inference.ActiveSchedule() == EyeInference::Schedule::Interleaved && Replay( inference, InterleavedRightFirst ) == 0, "right eye rendered first" );
+
+		inference.Reset();
+		Replay( inference, Sequential, EyeInference::LearningFrames );
+		Check( inference.ActiveSchedule() == EyeInference::Schedule::Sequential, "sequential eyes learned" );
+		Check( Replay( inference, Sequential, 4 ) == 0, "eye told by the number of passes" );
+	}
+
+	void CheckLearning() {
+		EyeInference inference;
+		Replay( inference, Interleaved, EyeInference::LearningFrames - 1 );
+		Check( inference.ActiveSchedule() == EyeInference::Schedule::Unknown, "not trusted before enough frames" );
+		Check( Replay( inference, "B1 C E- L1 B1 C E- R1" ) == 0, "no eye reported before it is trusted" );
+		Check( inference.ActiveSchedule() == EyeInference::Schedule::Interleaved, "trusted after enough frames" );
+
+		// a frame with a single Submit, e.g. while loading
+		Replay( inference, "B1 C L1" );
+		Check( inference.ActiveSchedule() == EyeInference::Schedule::Unknown, "unexplained frame drops the schedule" );
+		Replay( inference, Interleaved, EyeInference::LearningFrames - 1 );
+		Check( inference.ActiveSchedule() == EyeInference::Schedule::Unknown, "schedule relearned from scratch" );
+		Replay( inference, Interleaved );
+		Check( inference.ActiveSchedule() == EyeInference::Schedule::Interleaved, "schedule relearned" );
+
+		// a sequential frame is only explained with the same number of passes as before
+		inference.Reset();
+		Replay( inference, Sequential, EyeInference::LearningFrames );
+		Replay( inference, "B1 C C C C C C L1 R1" );
+		Check( inference.ActiveSchedule() == EyeInference::Schedule::Unknown, "changed number of passes drops the schedule" );
+		Replay( inference, "B1 C C C L1 R1" );
+		Check( inference.ActiveSchedule() == EyeInference::Schedule::Unknown, "odd number of passes not explained" );
+
+		Replay( inference, Interleaved, EyeInference::LearningFrames );
+		inference.Reset();
+		Check( inference.ActiveSchedule() == EyeInference::Schedule::Unknown && Replay( inference, "B1 C E-" ) == 0, "reset forgets the schedule" );
+	}
+
+	void CheckViewports() {
+		EyeInference inference;
+		ViewportRect viewport;
+		Replay( inference, "B1 C V0,0,1008,1120 C V0,0,1008,1120 C V1008,0,1008,1120 C L1 R1", EyeInference::LearningFrames );
+		Check( !inference.EyeViewport( Eye_Left, viewport ), "viewports ignored while the eye is unknown" );
+
+		// dynamic resolution renders each eye into part of the target, next to a small shadow pass
+		Replay( inference, "B1 C V0,0,1008,1120 V0,0,512,512 C V0,0,1008,1120 C V1008,0,1008,1120 C V1008,0,1008,1120 L1 R1" );
+		Check( inference.EyeViewport( Eye_Left, viewport ) && viewport.x == 0 && viewport.width == 1008 && viewport.height == 1120, "largest viewport of the left eye" );
+		Check( inference.EyeViewport( Eye_Right, viewport ) && viewport.x == 1008 && viewport.width == 1008, "largest viewport of the right eye" );
+
+		float x = .5f, y = .5f;
+		Check( inference.ProjectionCenter( Eye_Left, 4032, 2240, x, y ) && x == .125f && y == .25f, "center placed in the left viewport" );
+		x = .5f, y = .5f;
+		Check( inference.ProjectionCenter( Eye_Right, 4032, 2240, x, y ) && x == .375f && y == .25f, "center placed in the right viewport" );
+		x = .5f, y = .5f;
+		Check( !inference.ProjectionCenter( Eye_Right, 1024, 1024, x, y ) && x == .5f && y == .5f, "viewport beyond the target leaves the center alone" );
+
+		// a frame without any viewports set leaves nothing to estimate from
+		Replay( inference, "B1 C C C C L1 R1" );
+		x = .5f;
+		Check( !inference.EyeViewport( Eye_Left, viewport ) && !inference.ProjectionCenter( Eye_Left, 4032, 2240, x, y ) && x == .5f, "no viewport without any set" );
+	}
+}
+
+int main() {
+	CheckSchedules();
+	CheckLearning();
+	CheckViewports();
+	if (failures != 0) {
+		fprintf( stderr, "%d checks failed\n", failures );
+		return 1;
+	}
+	printf( "all checks passed\n" );
+	return 0;
+}
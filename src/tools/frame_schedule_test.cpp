@@ -0,0 +1,141 @@
+// Feeds synthetic streams of depth clears and target binds to the frame schedule, written as a line of tokens per
+// frame, and checks which clears it masks while learning, once learned, and after a frame or a verification frame
+// that does not match what it learned.
+#include "../postprocess/FrameSchedule.h"
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+
+using namespace vr;
+
+namespace {
+	int failures = 0;
+
+	void Check( bool condition, const char *what ) {
+		if (!condition) {
+			fprintf( stderr, "FAIL  %s\n", what );
+			++failures;
+		}
+	}
+
+	// Replays a frame's events the given number of times and returns the decisions of the last frame, M for a
+	// masked clear and . for one left alone. Tokens: C<n> clears depth target n, B<n> binds it with a qualifying
+	// render target and b<n> with any other. ordinals receives the mask ordinal of each masked clear.
+	std::string Replay( FrameSchedule &schedule, const char *events, int frames = 1, std::string *ordinals = nullptr ) {
+		std::string decisions;
+		for (int frame = 0; frame < frames; ++frame) {
+			decisions.clear();
+			if (ordinals)
+				ordinals->clear();
+			std::istringstream tokens( events );
+			std::string token;
+			while (tokens >> token) {
+				FrameSchedule::TargetId depth = FrameSchedule::TargetId( atoi( token.c_str() + 1 ) );
+				switch (token[0]) {
+				case 'C': {
+					int ordinal;
+					bool mask = schedule.OnDepthClear( depth, ordinal );
+					decisions += mask ? 'M' : '.';
+					if (mask && ordinals)
+						*ordinals += char('0' + ordinal);
+					break;
+				}
+				case 'B':
+				case 'b':
+					if (schedule.IsScoring())
+						schedule.OnTargetsBound( depth, token[0] == 'B' );
+					break;
+				default:
+					fprintf( stderr, "bad token %s\n", token.c_str() );
+				}
+			}
+			schedule.OnFrameEnd();
+		}
+		return decisions;
+	}
+
+	// two scene passes drawing a lot into their depth, a UI pass drawing a little and a blit with its own target
+	const char *Game = "C1 B1 B1 B1 B1 C2 B2 C1 B1 B1 B1 C3 b3 B3";
+	// the same clears, but the UI draws more than half as much as the scene
+	const char *BusyUi = "C1 B1 B1 B1 B1 C2 B2 B2 B2 C1 B1 B1 B1 C3 b3 B3";
+
+	void CheckLearning() {
+		FrameSchedule schedule;
+		Check( Replay( schedule, Game, FrameSchedule::LearningFrames - 1 ) == "MMMM", "every clear masked while learning" );
+		Check( !schedule.IsLearned() && schedule.IsScoring(), "still learning" );
+		Replay( schedule, Game );
+		Check( schedule.IsLearned() && schedule.SceneClearsPerFrame() == 2, "scene clears learned" );
+
+		std::string ordinals;
+		Check( Replay( schedule, Game, 1, &ordinals ) == "M.M.", "only scene clears masked" );
+		Check( ordinals == "01", "masked clears counted" );
+		Check( !schedule.IsScoring(), "binds not scored between verifications" );
+
+		// a different stream while not scoring is only noticed by its number of clears
+		Check( Replay( schedule, "C1 B1 C2 B2 B2 B2 B2 B2 C1 C3" ) == "M.M.", "binds ignored between verifications" );
+		Check( schedule.IsLearned(), "same number of clears kept" );
+		Replay( schedule, "C1 B1 C2 C1" );
+		Check( !schedule.IsLearned() && Replay( schedule, Game ) == "MMMM", "different number of clears relearned" );
+	}
+
+	void CheckVerification() {
+		FrameSchedule schedule;
+		Replay( schedule, Game, FrameSchedule::LearningFrames );
+		int frames = FrameSchedule::LearningFrames;
+		// up to the next verification frame
+		for (; frames % FrameSchedule::VerifyInterval != 0; ++frames) {
+			Replay( schedule, Game );
+		}
+		Check( schedule.IsScoring(), "verification frame scored" );
+		Replay( schedule, Game );
+		Check( schedule.IsLearned(), "verification choosing the same clears keeps the schedule" );
+
+		for (++frames; frames % FrameSchedule::VerifyInterval != 0; ++frames) {
+			Replay( schedule, Game );
+		}
+		Check( Replay( schedule, BusyUi ) == "M.M.", "verification frame masked as learned" );
+		Check( !schedule.IsLearned(), "verification choosing differently relearns" );
+		Check( Replay( schedule, BusyUi, FrameSchedule::LearningFrames ) == "MMMM" && schedule.IsLearned(), "relearned" );
+		Check( schedule.SceneClearsPerFrame() == 3 && Replay( schedule, BusyUi ) == "MMM.", "new choice masked" );
+	}
+
+	void CheckUnlearnable() {
+		FrameSchedule schedule;
+		Replay( schedule, "C1 b1 C2 b2", 2 * FrameSchedule::LearningFrames );
+		Check( !schedule.IsLearned(), "nothing learned without a qualifying bind" );
+
+		// alternating choices never become stable
+		for (int i = 0; i < FrameSchedule::LearningFrames; ++i) {
+			Replay( schedule, i % 2 ? "C1 B1 C2" : "C1 C2 B2" );
+		}
+		Check( !schedule.IsLearned(), "unstable choice not learned" );
+
+		std::string many;
+		for (int i = 0; i < FrameSchedule::MaxClears + 1; ++i) {
+			many += " C1 B1";
+		}
+		Replay( schedule, many.c_str(), FrameSchedule::LearningFrames );
+		Check( !schedule.IsLearned(), "too many clears to learn" );
+
+		// a bind counts for the last clear of its depth target only
+		schedule.Reset();
+		Replay( schedule, "C1 B1 C1 B1 B1 B1", FrameSchedule::LearningFrames );
+		Check( schedule.IsLearned() && Replay( schedule, "C1 C1" ) == ".M", "bind attributed to the last clear of its target" );
+
+		schedule.Reset();
+		Check( !schedule.IsLearned() && Replay( schedule, "C1 C2" ) == "MM", "reset starts learning again" );
+	}
+}
+
+int main() {
+	CheckLearning();
+	CheckVerification();
+	CheckUnlearnable();
+	if (failures != 0) {
+		fprintf( stderr, "%d checks failed\n", failures );
+		return 1;
+	}
+	printf( "all checks passed\n" );
+	return 0;
+}
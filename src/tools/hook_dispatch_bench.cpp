@@ -0,0 +1,204 @@
+// Measures what finding the original function costs a hook: the shared open-addressing table the hooks
+// used before against a slot per hook. Hooks are installed into mock vtables by swapping their entries, the
+// same way the real hooks end up being called through the game's vtables. A shadow vtable hook is measured
+// as well, where the object is pointed at a copy of its vtable instead.
+#include "../postprocess/HookSlot.h"
+#include "../postprocess/ShadowVtable.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _MSC_VER
+#define NOINLINE __declspec(noinline)
+#else
+#define NOINLINE __attribute__((noinline))
+#endif
+
+using namespace vr;
+
+namespace {
+	struct Context;
+	typedef void (*Method)( Context *self, uint32_t value );
+
+	struct Context {
+		Method *vtable;
+		uint64_t sum = 0;
+	};
+
+	// the table the hooks used to share, as it was
+	struct HookEntry {
+		std::atomic<void*> hook { nullptr };
+		std::atomic<void*> original { nullptr };
+	};
+	const size_t HOOK_TABLE_SIZE = 256;
+	HookEntry hookTable[HOOK_TABLE_SIZE];
+
+	size_t HookTableIndex( void *hook ) {
+		uintptr_t value = (uintptr_t)hook;
+		return ((value >> 4) ^ (value >> 12)) & (HOOK_TABLE_SIZE - 1);
+	}
+
+	void * FindOriginal( void *hook ) {
+		size_t index = HookTableIndex( hook );
+		for (size_t probe = 0; probe < HOOK_TABLE_SIZE; ++probe) {
+			void *entry = hookTable[index].hook.load( std::memory_order_acquire );
+			if (entry == hook)
+				return hookTable[index].original.load( std::memory_order_relaxed );
+			if (entry == nullptr)
+				return nullptr;
+			index = (index + 1) & (HOOK_TABLE_SIZE - 1);
+		}
+		return nullptr;
+	}
+
+	void StoreOriginal( void *hook, void *original ) {
+		size_t index = HookTableIndex( hook );
+		for (size_t probe = 0; probe < HOOK_TABLE_SIZE; ++probe) {
+			void *entry = hookTable[index].hook.load( std::memory_order_relaxed );
+			if (entry == hook || entry == nullptr) {
+				hookTable[index].original.store( original, std::memory_order_relaxed );
+				hookTable[index].hook.store( hook, std::memory_order_release );
+				return;
+			}
+			index = (index + 1) & (HOOK_TABLE_SIZE - 1);
+		}
+	}
+
+	NOINLINE void Original0( Context *self, uint32_t value ) { self->sum += value; }
+	NOINLINE void Original1( Context *self, uint32_t value ) { self->sum ^= value; }
+	NOINLINE void Original2( Context *self, uint32_t value ) { self->sum += value * 3; }
+	NOINLINE void Original3( Context *self, uint32_t value ) { self->sum -= value; }
+
+	const size_t METHOD_COUNT = 4;
+	Method originals[METHOD_COUNT] = { Original0, Original1, Original2, Original3 };
+
+	template<int Index>
+	NOINLINE void TableHook( Context *self, uint32_t value ) {
+		((Method)FindOriginal( (void*)&TableHook<Index> ))( self, value );
+	}
+
+	template<int Index>
+	NOINLINE void SlotHook( Context *self, uint32_t value ) {
+		HOOK_SLOT(SlotHook<Index>)::Original()( self, value );
+	}
+
+	template<int Index>
+	NOINLINE void ShadowHook( Context *self, uint32_t value ) {
+		HOOK_SLOT(ShadowHook<Index>)::Original()( self, value );
+	}
+
+	// the real table also holds the hooks for the interfaces and the other contexts
+	void FillTableWithOtherHooks() {
+		static char others[48];
+		for (size_t i = 0; i < sizeof(others); ++i) {
+			StoreOriginal( &others[i], &others[i] );
+		}
+	}
+
+	void InstallTableHooks( Method *vtable ) {
+		FillTableWithOtherHooks();
+		Method hooks[METHOD_COUNT] = { TableHook<0>, TableHook<1>, TableHook<2>, TableHook<3> };
+		for (size_t i = 0; i < METHOD_COUNT; ++i) {
+			StoreOriginal( (void*)hooks[i], (void*)vtable[i] );
+			vtable[i] = hooks[i];
+		}
+	}
+
+	void InstallSlotHooks( Method *vtable ) {
+		HOOK_SLOT(SlotHook<0>)::Install( vtable[0], "SlotHook<0>", (void*)vtable[0] );
+		HOOK_SLOT(SlotHook<1>)::Install( vtable[1], "SlotHook<1>", (void*)vtable[1] );
+		HOOK_SLOT(SlotHook<2>)::Install( vtable[2], "SlotHook<2>", (void*)vtable[2] );
+		HOOK_SLOT(SlotHook<3>)::Install( vtable[3], "SlotHook<3>", (void*)vtable[3] );
+		Method hooks[METHOD_COUNT] = { SlotHook<0>, SlotHook<1>, SlotHook<2>, SlotHook<3> };
+		for (size_t i = 0; i < METHOD_COUNT; ++i) {
+			vtable[i] = hooks[i];
+		}
+	}
+
+	void InstallShadowHooks( Context &context ) {
+		ShadowVtables &shadows = ShadowVtables::Instance();
+		HOOK_SLOT(ShadowHook<0>)::Install( (Method)shadows.Hook( &context, METHOD_COUNT, 0, (void*)&ShadowHook<0> ), "ShadowHook<0>", &context );
+		HOOK_SLOT(ShadowHook<1>)::Install( (Method)shadows.Hook( &context, METHOD_COUNT, 1, (void*)&ShadowHook<1> ), "ShadowHook<1>", &context );
+		HOOK_SLOT(ShadowHook<2>)::Install( (Method)shadows.Hook( &context, METHOD_COUNT, 2, (void*)&ShadowHook<2> ), "ShadowHook<2>", &context );
+		HOOK_SLOT(ShadowHook<3>)::Install( (Method)shadows.Hook( &context, METHOD_COUNT, 3, (void*)&ShadowHook<3> ), "ShadowHook<3>", &context );
+	}
+
+	// calls through the vtable like the game does; the vtable pointer is reloaded so the calls stay indirect
+	double NanosecondsPerCall( Context &context, uint64_t calls ) {
+		auto start = std::chrono::steady_clock::now();
+		for (uint64_t i = 0; i < calls; ++i) {
+			Method *volatile vtable = context.vtable;
+			vtable[i % METHOD_COUNT]( &context, uint32_t(i) );
+		}
+		auto end = std::chrono::steady_clock::now();
+		return std::chrono::duration<double, std::nano>( end - start ).count() / calls;
+	}
+
+	int Usage() {
+		fprintf( stderr,
+			"usage: hook_dispatch_bench [--calls count]\n"
+			"Compares the cost of calling hooked methods of a mock vtable (default 50000000 calls).\n" );
+		return 2;
+	}
+}
+
+int main( int argc, char **argv ) {
+	uint64_t calls = 50000000;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp( argv[i], "--calls" ) == 0 && i + 1 < argc) {
+			calls = strtoull( argv[++i], nullptr, 10 );
+			if (calls == 0)
+				return Usage();
+		} else {
+			return Usage();
+		}
+	}
+
+	// shadow vtables copy the entries in front of a vtable, too
+	Method plainVtable[METHOD_COUNT], tableVtable[METHOD_COUNT], slotVtable[METHOD_COUNT];
+	Method shadowedVtable[ShadowVtables::PREFIX_ENTRIES + METHOD_COUNT] = {};
+	for (size_t i = 0; i < METHOD_COUNT; ++i) {
+		plainVtable[i] = tableVtable[i] = slotVtable[i] = originals[i];
+		shadowedVtable[ShadowVtables::PREFIX_ENTRIES + i] = originals[i];
+	}
+	InstallTableHooks( tableVtable );
+	InstallSlotHooks( slotVtable );
+
+	Context plain, table, slot, shadow;
+	plain.vtable = plainVtable;
+	table.vtable = tableVtable;
+	slot.vtable = slotVtable;
+	shadow.vtable = shadowedVtable + ShadowVtables::PREFIX_ENTRIES;
+	InstallShadowHooks( shadow );
+
+	// warm up, then take the best of a few rounds
+	NanosecondsPerCall( plain, calls / 10 );
+	NanosecondsPerCall( table, calls / 10 );
+	NanosecondsPerCall( slot, calls / 10 );
+	NanosecondsPerCall( shadow, calls / 10 );
+	double best[4] = { 1e9, 1e9, 1e9, 1e9 };
+	for (int round = 0; round < 5; ++round) {
+		double measured[4] = {
+			NanosecondsPerCall( plain, calls ), NanosecondsPerCall( table, calls ),
+			NanosecondsPerCall( slot, calls ), NanosecondsPerCall( shadow, calls ),
+		};
+		for (int i = 0; i < 4; ++i) {
+			if (measured[i] < best[i])
+				best[i] = measured[i];
+		}
+	}
+	if (plain.sum != table.sum || plain.sum != slot.sum || plain.sum != shadow.sum || !ShadowVtables::Instance().IsShadowed( &shadow )) {
+		fprintf( stderr, "hooks did not reach the originals\n" );
+		return 1;
+	}
+
+	printf( "unhooked        %.2f ns/call\n", best[0] );
+	printf( "hook table      %.2f ns/call (%+.2f)\n", best[1], best[1] - best[0] );
+	printf( "hook slot       %.2f ns/call (%+.2f)\n", best[2], best[2] - best[0] );
+	printf( "shadow vtable   %.2f ns/call (%+.2f)\n", best[3], best[3] - best[0] );
+	printf( "%zu hooks registered\n", HookRegistry::Instance().Count() );
+	return 0;
+}
@@ -0,0 +1,130 @@
+// Measures what a MinHook code hook costs a call of a real function of this program: jumping into the detour,
+// and additionally calling the original through the trampoline. Hooking itself is checked by minhook_test.
+// Exits with 1 if the hooks cannot be installed or the hooked calls returned the wrong results.
+#include <MinHook.h>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _MSC_VER
+#define NOINLINE __declspec(noinline)
+#else
+#define NOINLINE __attribute__((noinline))
+#endif
+
+namespace {
+	typedef uint32_t (*Function)( uint32_t value );
+
+	uint32_t Mix( uint32_t value, uint32_t offset ) {
+		value ^= value >> 7;
+		return value * 2654435761u + offset;
+	}
+
+	// Targets need a few bytes of code before they return to be patched, so each one mixes its argument.
+	// Every target can only be hooked once; the offsets keep the linker from folding them into one function.
+	template<uint32_t Offset>
+	NOINLINE uint32_t Target( uint32_t value ) { return Mix( value, Offset ); }
+
+	Function const PlainTarget = Target<1>;
+	Function const DetourTarget = Target<2>;
+	Function const TrampolineTarget = Target<3>;
+
+	// stands in for the target without calling it, like a hook replacing a method entirely
+	NOINLINE uint32_t ReplacingDetour( uint32_t value ) { return Mix( value, 5 ); }
+
+	Function trampolineOriginal;
+	NOINLINE uint32_t ForwardingDetour( uint32_t value ) {
+		return trampolineOriginal( value );
+	}
+
+	int failures = 0;
+
+	void Check( bool condition, const char *what ) {
+		printf( "%s  %s\n", condition ? "ok  " : "FAIL", what );
+		if (!condition)
+			++failures;
+	}
+
+	bool Succeeded( MH_STATUS status, const char *what ) {
+		if (status != MH_OK)
+			printf( "      %s: %s\n", what, MH_StatusToString( status ) );
+		return status == MH_OK;
+	}
+
+	// the calls go through a volatile pointer, so they stay calls of the patched code
+	double NanosecondsPerCall( Function function, uint64_t calls, uint32_t &sum ) {
+		Function volatile target = function;
+		auto start = std::chrono::steady_clock::now();
+		for (uint64_t i = 0; i < calls; ++i) {
+			sum += target( uint32_t(i) );
+		}
+		auto end = std::chrono::steady_clock::now();
+		return std::chrono::duration<double, std::nano>( end - start ).count() / calls;
+	}
+
+	int Usage() {
+		fprintf( stderr,
+			"usage: hook_overhead_bench [--calls count]\n"
+			"Measures the cost of a hooked call of a function of this program (default 50000000 calls).\n" );
+		return 2;
+	}
+}
+
+int main( int argc, char **argv ) {
+	uint64_t calls = 50000000;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp( argv[i], "--calls" ) == 0 && i + 1 < argc) {
+			calls = strtoull( argv[++i], nullptr, 10 );
+			if (calls == 0)
+				return Usage();
+		} else {
+			return Usage();
+		}
+	}
+
+	if (!Succeeded( MH_Initialize(), "MH_Initialize" ))
+		return 1;
+
+	Function replaced = nullptr;
+	bool installed = Succeeded( MH_CreateHook( (void*)DetourTarget, (void*)&ReplacingDetour, (void**)&replaced ), "MH_CreateHook" )
+		&& Succeeded( MH_CreateHook( (void*)TrampolineTarget, (void*)&ForwardingDetour, (void**)&trampolineOriginal ), "MH_CreateHook" )
+		&& Succeeded( MH_EnableHook( MH_ALL_HOOKS ), "MH_EnableHook" );
+	Check( installed, "benchmark hooks installed" );
+	if (!installed) {
+		MH_Uninitialize();
+		return 1;
+	}
+
+	// warm up, then take the best of a few rounds
+	uint32_t sums[3] = {};
+	NanosecondsPerCall( PlainTarget, calls / 10, sums[0] );
+	NanosecondsPerCall( DetourTarget, calls / 10, sums[1] );
+	NanosecondsPerCall( TrampolineTarget, calls / 10, sums[2] );
+	double best[3] = { 1e9, 1e9, 1e9 };
+	for (int round = 0; round < 5; ++round) {
+		double measured[3] = {
+			NanosecondsPerCall( PlainTarget, calls, sums[0] ),
+			NanosecondsPerCall( DetourTarget, calls, sums[1] ),
+			NanosecondsPerCall( TrampolineTarget, calls, sums[2] ),
+		};
+		for (int i = 0; i < 3; ++i) {
+			if (measured[i] < best[i])
+				best[i] = measured[i];
+		}
+	}
+	// each call of a target returns its offset more than the unhooked one
+	uint32_t totalCalls = uint32_t(calls / 10 + 5 * calls);
+	Check( sums[1] == sums[0] + 4 * totalCalls && sums[2] == sums[0] + 2 * totalCalls, "hooked calls returned the detour's and the original's results" );
+	Check( Succeeded( MH_Uninitialize(), "MH_Uninitialize" ), "all hooks removed" );
+
+	printf( "unhooked             %.2f ns/call\n", best[0] );
+	printf( "detour               %.2f ns/call (%+.2f)\n", best[1], best[1] - best[0] );
+	printf( "detour + trampoline  %.2f ns/call (%+.2f)\n", best[2], best[2] - best[0] );
+	if (failures != 0) {
+		fprintf( stderr, "%d checks failed\n", failures );
+		return 1;
+	}
+	return 0;
+}
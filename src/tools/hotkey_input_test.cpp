@@ -0,0 +1,275 @@
+// Checks the hotkey command logic against a fake key source: commands firing once per press with the modifiers
+// held, shared keys queried once, and unbound keys ignored. Checks the SPSC queue alone and with a producer and
+// consumer thread, and the input thread queueing and dropping commands. Then measures what the Submit thread
+// pays per frame to drain the queue, against polling the keys itself.
+#include "../postprocess/HotkeyInput.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+using namespace vr;
+
+namespace {
+	int failures = 0;
+
+	void Check( bool condition, const char *what ) {
+		if (!condition) {
+			fprintf( stderr, "FAIL  %s\n", what );
+			++failures;
+		}
+	}
+
+	// keys held down by the test; safe to change while the input thread polls
+	class FakeKeys : public KeySource {
+	public:
+		std::atomic<bool> pressed[KeyCodeCount];
+		std::atomic<int> queries[KeyCodeCount];
+		// if set, the key toggles with every query
+		std::atomic<int> toggling { 0 };
+
+		FakeKeys() {
+			for (int i = 0; i < KeyCodeCount; ++i) {
+				pressed[i] = false;
+				queries[i] = 0;
+			}
+		}
+
+		bool IsPressed( int keyCode ) override {
+			++queries[keyCode];
+			if (keyCode == toggling.load())
+				pressed[keyCode] = !pressed[keyCode];
+			return pressed[keyCode].load();
+		}
+	};
+
+	HotkeyBindings Bindings() {
+		HotkeyBindings bindings;
+		bindings.requireCtrl = true;
+		bindings.keys[size_t(HotkeyCommand::ToggleFfr)] = 'F';
+		bindings.keys[size_t(HotkeyCommand::ToggleDebugMode)] = 'D';
+		bindings.keys[size_t(HotkeyCommand::CaptureOutput)] = 'D';
+		bindings.keys[size_t(HotkeyCommand::IncreaseSharpness)] = 0;
+		bindings.keys[size_t(HotkeyCommand::DecreaseSharpness)] = KeyCodeCount;
+		bindings.keys[size_t(HotkeyCommand::DumpTrace)] = -1;
+		return bindings;
+	}
+
+	// the commands fired by a poll, as their numbers
+	std::string Poll( HotkeyDetector &detector, FakeKeys &keys, const HotkeyBindings &bindings ) {
+		std::string fired;
+		detector.Poll( keys, bindings, [&]( HotkeyCommand command ) {
+			fired += (fired.empty() ? "" : " ") + std::to_string( int(command) );
+		});
+		return fired;
+	}
+
+	void CheckDetector() {
+		HotkeyBindings bindings = Bindings();
+		HotkeyDetector detector;
+		FakeKeys keys;
+		keys.pressed['F'] = true;
+		Check( Poll( detector, keys, bindings ) == "", "nothing without the modifier" );
+		Check( keys.queries['F'] == 0, "keys not queried without the modifier" );
+
+		keys.pressed[KeyRightCtrl] = true;
+		Check( Poll( detector, keys, bindings ) == "0", "fires once the modifier is held" );
+		Check( Poll( detector, keys, bindings ) == "", "held key fires only once" );
+		keys.pressed['F'] = false;
+		Poll( detector, keys, bindings );
+		keys.pressed['F'] = true;
+		Check( Poll( detector, keys, bindings ) == "0", "fires again after release" );
+
+		keys.pressed['D'] = true;
+		int before = keys.queries['D'];
+		Check( Poll( detector, keys, bindings ) == "1 11", "commands sharing a key all fire" );
+		Check( keys.queries['D'] - before == 1, "shared key queried once" );
+		for (int key = 0; key < KeyCodeCount; ++key) {
+			if (key != 'F' && key != 'D' && key != KeyLeftCtrl && key != KeyRightCtrl)
+				Check( keys.queries[key] == 0, "only bound keys and modifiers queried" );
+		}
+
+		// a press while the modifier is up is seen as new once it is held again
+		keys.pressed['F'] = false;
+		Poll( detector, keys, bindings );
+		keys.pressed[KeyRightCtrl] = false;
+		keys.pressed['F'] = true;
+		Check( Poll( detector, keys, bindings ) == "", "press ignored without the modifier" );
+		keys.pressed[KeyLeftCtrl] = true;
+		Check( Poll( detector, keys, bindings ) == "0", "left and right modifiers both count" );
+
+		bindings.requireAlt = true;
+		Check( Poll( detector, keys, bindings ) == "", "every required modifier needed" );
+		bindings = HotkeyBindings();
+		keys.pressed['F'] = false;
+		Check( Poll( detector, keys, bindings ) == "", "nothing bound" );
+	}
+
+	// a value that shows if it was torn between the threads
+	struct Item {
+		uint64_t value;
+		uint64_t check;
+	};
+
+	void CheckQueue() {
+		SpscQueue<int, 4> queue;
+		int value = 0;
+		Check( !queue.TryPop( value ), "empty queue" );
+		for (int round = 0; round < 3; ++round) {
+			for (int i = 0; i < 4; ++i) {
+				Check( queue.TryPush( round * 10 + i ), "pushed until full" );
+			}
+			Check( !queue.TryPush( 99 ), "full queue refuses" );
+			for (int i = 0; i < 4; ++i) {
+				Check( queue.TryPop( value ) && value == round * 10 + i, "popped in order across the wrap" );
+			}
+			Check( !queue.TryPop( value ), "drained" );
+		}
+
+		static SpscQueue<Item, 64> items;
+		const uint64_t count = 1000000;
+		std::thread producer( [&]() {
+			for (uint64_t i = 0; i < count; ) {
+				if (items.TryPush( Item { i, ~i } ))
+					++i;
+				else
+					std::this_thread::yield();
+			}
+		} );
+		uint64_t expected = 0;
+		bool ordered = true;
+		while (expected < count) {
+			Item item;
+			if (!items.TryPop( item )) {
+				std::this_thread::yield();
+				continue;
+			}
+			ordered = ordered && item.value == expected && item.check == ~expected;
+			++expected;
+		}
+		producer.join();
+		Item item;
+		Check( ordered, "items crossed the threads whole and in order" );
+		Check( !items.TryPop( item ), "nothing left over" );
+	}
+
+	// waits for the input thread to queue a command, up to a second
+	bool WaitForCommand( HotkeyInput &input, HotkeyCommand &command ) {
+		for (int i = 0; i < 1000; ++i) {
+			if (input.TryPop( command ))
+				return true;
+			std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+		}
+		return false;
+	}
+
+	void CheckInputThread() {
+		FakeKeys *keys = new FakeKeys;
+		HotkeyBindings bindings = Bindings();
+		bindings.requireCtrl = false;
+		HotkeyInput input;
+		input.Start( std::unique_ptr<KeySource>( keys ), bindings, std::chrono::milliseconds( 1 ) );
+		Check( input.IsRunning(), "input thread started" );
+
+		HotkeyCommand command;
+		keys->pressed['F'] = true;
+		Check( WaitForCommand( input, command ) && command == HotkeyCommand::ToggleFfr, "pressed key queued" );
+		std::this_thread::sleep_for( std::chrono::milliseconds( 20 ) );
+		Check( !input.TryPop( command ), "held key queued once" );
+
+		// a key pressed on every other poll, with nobody draining the queue
+		keys->toggling = 'F';
+		for (int i = 0; i < 2000 && input.DroppedCommands() == 0; ++i) {
+			std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+		}
+		input.Stop();
+		Check( !input.IsRunning() && input.DroppedCommands() > 0, "commands dropped when not drained" );
+		int queued = 0;
+		while (input.TryPop( command ))
+			++queued;
+		Check( queued == 64, "queue kept full" );
+
+		// a new run starts with an empty queue
+		keys = new FakeKeys;
+		input.Start( std::unique_ptr<KeySource>( keys ), bindings, std::chrono::milliseconds( 1 ) );
+		Check( input.DroppedCommands() == 0 && !input.TryPop( command ), "restarted empty" );
+		keys->pressed['D'] = true;
+		Check( WaitForCommand( input, command ) && command == HotkeyCommand::ToggleDebugMode, "first command of a shared key" );
+		Check( WaitForCommand( input, command ) && command == HotkeyCommand::CaptureOutput, "second command of a shared key" );
+		input.Stop();
+	}
+
+	// keeps the polls from being optimized away
+	volatile uint64_t sink;
+
+	// stands in for GetAsyncKeyState, which is a system call
+	class CountingKeys : public KeySource {
+	public:
+		uint64_t queries = 0;
+		bool IsPressed( int ) override {
+			++queries;
+			return false;
+		}
+	};
+
+	void Benchmark( uint64_t frames ) {
+		HotkeyBindings bindings;
+		for (size_t i = 0; i < size_t(HotkeyCommand::Count); ++i) {
+			bindings.keys[i] = int('A' + i);
+		}
+		CountingKeys keys;
+		HotkeyDetector detector;
+		uint64_t fired = 0;
+		auto start = std::chrono::steady_clock::now();
+		for (uint64_t i = 0; i < frames; ++i) {
+			detector.Poll( keys, bindings, [&]( HotkeyCommand ) { ++fired; } );
+		}
+		double polled = std::chrono::duration<double, std::nano>( std::chrono::steady_clock::now() - start ).count() / frames;
+
+		SpscQueue<HotkeyCommand, 64> queue;
+		HotkeyCommand command;
+		start = std::chrono::steady_clock::now();
+		for (uint64_t i = 0; i < frames; ++i) {
+			while (queue.TryPop( command ))
+				++fired;
+		}
+		double drained = std::chrono::duration<double, std::nano>( std::chrono::steady_clock::now() - start ).count() / frames;
+		sink = fired + keys.queries;
+		printf( "poll %d keys on the frame  %8.2f ns per frame, %.0f key queries\n", int(HotkeyCommand::Count), polled, double(keys.queries) / frames );
+		printf( "drain the command queue   %8.2f ns per frame\n", drained );
+	}
+
+	int Usage() {
+		fprintf( stderr,
+			"usage: hotkey_input_test [--frames count]\n"
+			"Checks the hotkey detection and queueing, then compares polling the keys on every frame with\n"
+			"draining the command queue (default 1000000 frames).\n" );
+		return 2;
+	}
+}
+
+int main( int argc, char **argv ) {
+	uint64_t frames = 1000000;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp( argv[i], "--frames" ) == 0 && i + 1 < argc) {
+			frames = strtoull( argv[++i], nullptr, 10 );
+			if (frames == 0)
+				return Usage();
+		} else {
+			return Usage();
+		}
+	}
+
+	CheckDetector();
+	CheckQueue();
+	CheckInputThread();
+	Benchmark( frames );
+
+	if (failures != 0) {
+		fprintf( stderr, "%d checks failed\n", failures );
+		return 1;
+	}
+	printf( "all checks passed\n" );
+	return 0;
+}
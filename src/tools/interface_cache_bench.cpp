@@ -0,0 +1,187 @@
+// Measures what a game pays for requesting an interface it has requested before: the path every request took
+// before, which locks the system mutex, copies the version string and parses it for hooks, against the
+// interface cache. Both run against a stub runtime, on an increasing number of threads requesting at once.
+#include "openvr.h"
+#include "ivrclientcore.h"
+#include "../postprocess/InterfaceCache.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace vr;
+
+namespace {
+	const char *VERSIONS[] = {
+		"IVRSystem_022", "IVRCompositor_027", "IVRChaperone_004", "IVROverlay_027", "IVRInput_010",
+		"IVRRenderModels_006", "IVRApplications_007", "FnTable:IVRSystem_022", "FnTable:IVRCompositor_027",
+	};
+	const size_t VERSION_COUNT = sizeof(VERSIONS) / sizeof(VERSIONS[0]);
+
+	// hands out a distinct address per version, like vrclient's singletons
+	class StubClientCore : public IVRClientCore {
+	public:
+		EVRInitError Init( EVRApplicationType, const char * ) override { return VRInitError_None; }
+		void Cleanup() override {}
+		EVRInitError IsInterfaceVersionValid( const char * ) override { return VRInitError_None; }
+		void * GetGenericInterface( const char *pchNameAndVersion, EVRInitError *peError ) override {
+			for (size_t i = 0; i < VERSION_COUNT; ++i) {
+				if (strcmp( VERSIONS[i], pchNameAndVersion ) == 0) {
+					if (peError)
+						*peError = VRInitError_None;
+					return &interfaces[i];
+				}
+			}
+			if (peError)
+				*peError = VRInitError_Init_InterfaceNotFound;
+			return nullptr;
+		}
+		bool BIsHmdPresent() override { return true; }
+		const char * GetEnglishStringForHmdError( EVRInitError ) override { return ""; }
+		const char * GetIDForVRInitError( EVRInitError ) override { return ""; }
+
+	private:
+		char interfaces[VERSION_COUNT] = {};
+	};
+
+	StubClientCore stubCore;
+	IVRClientCore *hmdSystem = &stubCore;
+	std::recursive_mutex mutexSystem;
+	std::atomic<uint32_t> token( 1 );
+	std::atomic<uint64_t> hooksParsed( 0 );
+
+	// what HookVRInterface does for an interface that is already hooked, without the log line
+	void ParseForHooks( const char *version ) {
+		unsigned int systemVersion = 0, compositorVersion = 0;
+		int matched = sscanf( version, "IVRSystem_%u", &systemVersion ) + sscanf( version, "IVRCompositor_%u", &compositorVersion );
+		hooksParsed.fetch_add( matched > 0 ? 1 : 0, std::memory_order_relaxed );
+	}
+
+	// VR_GetGenericInterface as it was
+	void * UncachedGetGenericInterface( const char *pchInterfaceVersion, EVRInitError *peError ) {
+		std::lock_guard<std::recursive_mutex> lock( mutexSystem );
+		std::string interfaceName( pchInterfaceVersion );
+		if (interfaceName.substr( 0, 7 ) == "FnTable") {
+			UncachedGetGenericInterface( interfaceName.substr( 8 ).c_str(), nullptr );
+		}
+		void *result = hmdSystem->GetGenericInterface( pchInterfaceVersion, peError );
+		ParseForHooks( pchInterfaceVersion );
+		return result;
+	}
+
+	// VR_GetGenericInterface with the cache
+	void * CachedGetGenericInterface( const char *pchInterfaceVersion, EVRInitError *peError ) {
+		void *cached = InterfaceCache::Instance().Find( pchInterfaceVersion, token.load( std::memory_order_acquire ) );
+		if (cached) {
+			if (peError)
+				*peError = VRInitError_None;
+			return cached;
+		}
+
+		std::lock_guard<std::recursive_mutex> lock( mutexSystem );
+		if (strncmp( pchInterfaceVersion, "FnTable:", 8 ) == 0) {
+			CachedGetGenericInterface( pchInterfaceVersion + 8, nullptr );
+		}
+		EVRInitError err = VRInitError_None;
+		void *result = hmdSystem->GetGenericInterface( pchInterfaceVersion, &err );
+		if (peError)
+			*peError = err;
+		ParseForHooks( pchInterfaceVersion );
+		if (result && err == VRInitError_None)
+			InterfaceCache::Instance().Store( pchInterfaceVersion, token, result );
+		return result;
+	}
+
+	typedef void * (*GetGenericInterfaceFn)( const char *pchInterfaceVersion, EVRInitError *peError );
+
+	// Wall time per request of all threads together, so more threads only lower it where they run in parallel.
+	// wrong counts requests that got a different interface than the runtime hands out.
+	double NanosecondsPerRequest( GetGenericInterfaceFn getInterface, int threadCount, uint64_t requests, std::atomic<uint64_t> &wrong ) {
+		void *expected[VERSION_COUNT];
+		for (size_t i = 0; i < VERSION_COUNT; ++i) {
+			expected[i] = stubCore.GetGenericInterface( VERSIONS[i], nullptr );
+		}
+		std::atomic<int> ready( 0 );
+		std::atomic<bool> go( false );
+		std::vector<std::thread> threads;
+		for (int t = 0; t < threadCount; ++t) {
+			threads.emplace_back( [&, t]() {
+				++ready;
+				while (!go.load()) {
+					std::this_thread::yield();
+				}
+				uint64_t mismatches = 0;
+				for (uint64_t i = 0; i < requests; ++i) {
+					size_t index = (i + t) % VERSION_COUNT;
+					EVRInitError err;
+					if (getInterface( VERSIONS[index], &err ) != expected[index] || err != VRInitError_None)
+						++mismatches;
+				}
+				wrong += mismatches;
+			} );
+		}
+		while (ready.load() < threadCount) {
+			std::this_thread::yield();
+		}
+		auto start = std::chrono::steady_clock::now();
+		go = true;
+		for (std::thread &thread : threads) {
+			thread.join();
+		}
+		double elapsed = std::chrono::duration<double, std::nano>( std::chrono::steady_clock::now() - start ).count();
+		return elapsed / (double(requests) * threadCount);
+	}
+
+	int Usage() {
+		fprintf( stderr,
+			"usage: interface_cache_bench [--requests count] [--threads count]\n"
+			"Compares repeated interface requests with and without the interface cache on 1 up to the given number\n"
+			"of threads (default 1000000 requests per thread, up to 8 threads).\n" );
+		return 2;
+	}
+}
+
+int main( int argc, char **argv ) {
+	uint64_t requests = 1000000;
+	int maxThreads = 8;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp( argv[i], "--requests" ) == 0 && i + 1 < argc) {
+			requests = strtoull( argv[++i], nullptr, 10 );
+			if (requests == 0)
+				return Usage();
+		} else if (strcmp( argv[i], "--threads" ) == 0 && i + 1 < argc) {
+			maxThreads = atoi( argv[++i] );
+			if (maxThreads < 1)
+				return Usage();
+		} else {
+			return Usage();
+		}
+	}
+
+	std::atomic<uint64_t> wrong( 0 );
+	printf( "threads   uncached ns/request   cached ns/request\n" );
+	for (int threads = 1; threads <= maxThreads; threads *= 2) {
+		double uncached = NanosecondsPerRequest( UncachedGetGenericInterface, threads, requests, wrong );
+		double cached = NanosecondsPerRequest( CachedGetGenericInterface, threads, requests, wrong );
+		printf( "%7d   %19.1f   %17.1f\n", threads, uncached, cached );
+	}
+
+	// a new token must not return the interfaces of the old one
+	uint64_t parsedBefore = hooksParsed.load();
+	++token;
+	CachedGetGenericInterface( "IVRSystem_022", nullptr );
+	bool invalidated = hooksParsed.load() == parsedBefore + 1;
+
+	if (wrong != 0 || !invalidated || InterfaceCache::Instance().Count() != VERSION_COUNT) {
+		fprintf( stderr, "cache returned wrong interfaces (%llu wrong, %s, %zu cached)\n", (unsigned long long)wrong.load(),
+			invalidated ? "invalidated" : "not invalidated", InterfaceCache::Instance().Count() );
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,269 @@
+// Checks the live metrics block: a reader finding no writer, values published and read back with the writer's
+// process, readers of an older or newer writer, a closed writer, and a reader never seeing a frame half written
+// while the writer publishes. Then measures what publishing costs the Submit thread per frame, and a read.
+#include "../postprocess/LiveMetrics.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <set>
+#include <string>
+#include <thread>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace vr;
+
+namespace {
+	int failures = 0;
+
+	void Check( bool condition, const char *what ) {
+		if (!condition) {
+			fprintf( stderr, "FAIL  %s\n", what );
+			++failures;
+		}
+	}
+
+	uint32_t ProcessId() {
+#ifdef _WIN32
+		return GetCurrentProcessId();
+#else
+		return uint32_t(getpid());
+#endif
+	}
+
+	// unique per run, so that runs in parallel do not share a block
+	std::string BlockName() {
+		return "live_metrics_test_" + std::to_string( ProcessId() );
+	}
+
+	// every value derived from the frame, so that a mix of two frames shows
+	MetricValues FrameValues( uint64_t frame ) {
+		MetricValues metrics;
+		for (size_t i = 0; i < size_t(Metric::Count); ++i) {
+			metrics.values[i] = frame * 1000 + i;
+		}
+		return metrics;
+	}
+
+	bool IsFrame( const MetricValues &metrics, uint64_t frame ) {
+		for (size_t i = 0; i < size_t(Metric::Count); ++i) {
+			if (metrics.values[i] != frame * 1000 + i)
+				return false;
+		}
+		return true;
+	}
+
+	void CheckNames() {
+		std::set<std::string> names;
+		for (size_t i = 0; i < size_t(Metric::Count); ++i) {
+			names.insert( MetricName( Metric(i) ) );
+		}
+		Check( names.size() == size_t(Metric::Count) && names.count( "unknown" ) == 0, "every metric named once" );
+		Check( std::string( MetricName( Metric::Count ) ) == "unknown", "unknown metric" );
+	}
+
+	// the block as the writer of another build would lay it out; changed behind the writer's back
+	class RawBlock {
+	public:
+		SharedMetricsBlock *block = nullptr;
+
+		explicit RawBlock( const std::string &name ) {
+#ifdef _WIN32
+			std::string fullName = "Local\\" + name;
+			handle = OpenFileMappingA( FILE_MAP_READ | FILE_MAP_WRITE, FALSE, fullName.c_str() );
+			if (handle != nullptr)
+				block = static_cast<SharedMetricsBlock*>(MapViewOfFile( handle, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, sizeof(SharedMetricsBlock) ));
+#else
+			int fd = shm_open( ("/" + name).c_str(), O_RDWR, 0600 );
+			if (fd >= 0) {
+				void *mapped = mmap( nullptr, sizeof(SharedMetricsBlock), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+				if (mapped != MAP_FAILED)
+					block = static_cast<SharedMetricsBlock*>(mapped);
+				close( fd );
+			}
+#endif
+		}
+
+		~RawBlock() {
+#ifdef _WIN32
+			if (block != nullptr)
+				UnmapViewOfFile( block );
+			if (handle != nullptr)
+				CloseHandle( handle );
+#else
+			if (block != nullptr)
+				munmap( block, sizeof(SharedMetricsBlock) );
+#endif
+		}
+
+	private:
+#ifdef _WIN32
+		HANDLE handle = nullptr;
+#endif
+	};
+
+	void CheckPublishing() {
+		const std::string name = BlockName();
+		LiveMetricsReader reader;
+		std::string error;
+		MetricValues metrics;
+		uint32_t process = 0;
+		Check( !reader.Open( name, error ) && !error.empty(), "no writer, no block" );
+		Check( !reader.Read( metrics, process ), "closed reader reads nothing" );
+
+		LiveMetricsWriter writer;
+		Check( writer.Open( name, error ) && writer.IsOpen(), "writer opened" );
+		Check( reader.Open( name, error ), "reader opened" );
+		metrics[Metric::Frame] = 99;
+		Check( reader.Read( metrics, process ) && metrics[Metric::Frame] == 0 && process == ProcessId(), "block starts out zero with the writer's process" );
+		writer.Publish( FrameValues( 7 ) );
+		Check( reader.Read( metrics, process ) && IsFrame( metrics, 7 ), "published values read" );
+		writer.Publish( FrameValues( 8 ) );
+		Check( reader.Read( metrics, process ) && IsFrame( metrics, 8 ), "latest values read" );
+
+		{
+			RawBlock raw( name );
+			Check( raw.block != nullptr, "block mapped directly" );
+			if (raw.block != nullptr) {
+				// a writer that knows fewer metrics
+				raw.block->metricCount = 3;
+				Check( reader.Read( metrics, process ) && metrics.values[2] == 8002 && metrics.values[3] == 0, "metrics unknown to the writer left at 0" );
+				// one that knows more
+				raw.block->metricCount = SharedMetricsBlock::CAPACITY;
+				raw.block->values[size_t(Metric::Count)] = 1;
+				Check( reader.Read( metrics, process ) && IsFrame( metrics, 8 ), "metrics unknown to the reader ignored" );
+				raw.block->version = SharedMetricsBlock::VERSION + 1;
+				Check( !reader.Read( metrics, process ), "other version refused" );
+				raw.block->version = SharedMetricsBlock::VERSION;
+				// a writer that died between its two sequence updates
+				raw.block->sequence = raw.block->sequence + 1;
+				Check( !reader.Read( metrics, process ), "write in progress not read" );
+				raw.block->sequence = raw.block->sequence + 1;
+				Check( reader.Read( metrics, process ), "finished write read" );
+			}
+		}
+
+		writer.Close();
+		Check( !writer.IsOpen() && !reader.Read( metrics, process ), "closed writer's values not read" );
+		writer.Publish( FrameValues( 9 ) );
+		reader.Close();
+
+		// a new writer starts from a clean block
+		Check( writer.Open( name, error ), "writer reopened" );
+		Check( reader.Open( name, error ) && reader.Read( metrics, process ) && metrics[Metric::Frame] == 0, "reopened block starts out zero" );
+	}
+
+	void CheckConcurrentReader( uint64_t frames ) {
+		const std::string name = BlockName();
+		LiveMetricsWriter writer;
+		LiveMetricsReader reader;
+		std::string error;
+		if (!writer.Open( name, error ) || !reader.Open( name, error )) {
+			Check( false, "block opened for the concurrent reader" );
+			return;
+		}
+		writer.Publish( FrameValues( 0 ) );
+		std::atomic<bool> writing { true };
+		std::thread publisher( [&]() {
+			for (uint64_t frame = 1; frame <= frames; ++frame) {
+				writer.Publish( FrameValues( frame ) );
+			}
+			writing = false;
+		} );
+		uint64_t reads = 0, failed = 0, lastFrame = 0;
+		bool whole = true, forward = true;
+		do {
+			MetricValues metrics;
+			uint32_t process;
+			if (!reader.Read( metrics, process )) {
+				++failed;
+				continue;
+			}
+			uint64_t frame = metrics[Metric::Frame] / 1000;
+			whole = whole && IsFrame( metrics, frame );
+			forward = forward && frame >= lastFrame;
+			lastFrame = frame;
+			++reads;
+		} while (writing.load());
+		publisher.join();
+		MetricValues metrics;
+		uint32_t process;
+		Check( whole, "no frame read half written" );
+		Check( forward, "frames read in order" );
+		Check( reader.Read( metrics, process ) && IsFrame( metrics, frames ), "last frame read" );
+		printf( "%llu reads, %llu gave up, while %llu frames were published\n", (unsigned long long)reads, (unsigned long long)failed, (unsigned long long)frames );
+	}
+
+	// keeps the reads from being optimized away
+	volatile uint64_t sink;
+
+	void Benchmark( uint64_t frames ) {
+		const std::string name = BlockName();
+		LiveMetricsWriter writer;
+		LiveMetricsReader reader;
+		std::string error;
+		if (!writer.Open( name, error ) || !reader.Open( name, error )) {
+			fprintf( stderr, "%s\n", error.c_str() );
+			return;
+		}
+		MetricValues metrics = FrameValues( 1 );
+		auto start = std::chrono::steady_clock::now();
+		for (uint64_t i = 0; i < frames; ++i) {
+			metrics[Metric::Frame] = i;
+			writer.Publish( metrics );
+		}
+		double published = std::chrono::duration<double, std::nano>( std::chrono::steady_clock::now() - start ).count() / frames;
+		uint64_t sum = 0;
+		uint32_t process;
+		start = std::chrono::steady_clock::now();
+		for (uint64_t i = 0; i < frames; ++i) {
+			reader.Read( metrics, process );
+			sum += metrics[Metric::Frame];
+		}
+		double read = std::chrono::duration<double, std::nano>( std::chrono::steady_clock::now() - start ).count() / frames;
+		sink = sum;
+		printf( "publish %d metrics          %8.2f ns\n", int(Metric::Count), published );
+		printf( "read them                   %8.2f ns\n", read );
+	}
+
+	int Usage() {
+		fprintf( stderr,
+			"usage: live_metrics_test [--frames count]\n"
+			"Checks the live metrics block with a reader running while frames are published, then measures\n"
+			"publishing and reading (default 1000000 frames).\n" );
+		return 2;
+	}
+}
+
+int main( int argc, char **argv ) {
+	uint64_t frames = 1000000;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp( argv[i], "--frames" ) == 0 && i + 1 < argc) {
+			frames = strtoull( argv[++i], nullptr, 10 );
+			if (frames == 0)
+				return Usage();
+		} else {
+			return Usage();
+		}
+	}
+
+	CheckNames();
+	CheckPublishing();
+	CheckConcurrentReader( frames );
+	Benchmark( frames );
+
+	if (failures != 0) {
+		fprintf( stderr, "%d checks failed\n", failures );
+		return 1;
+	}
+	printf( "all checks passed\n" );
+	return 0;
+}
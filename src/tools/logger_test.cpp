@@ -0,0 +1,312 @@
+// Checks the logger: levels and their prefixes, lines built from several writes, manipulators ending with their
+// line, lines of concurrent threads arriving whole and in each thread's order, lines of exited threads kept,
+// overlong lines cut and full buffers counted and reported, the flusher stopped and restarted, and the per call
+// site rate limit. Then measures what a log call costs the calling thread, for disabled, rate limited and written
+// lines.
+#include "../postprocess/Logger.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace vr;
+
+// declared by Config.h in the library; LOG_LIMITED writes through it
+LogLine Log( LogLevel level );
+
+namespace {
+	int failures = 0;
+
+	void Check( bool condition, const char *what ) {
+		if (!condition) {
+			fprintf( stderr, "FAIL  %s\n", what );
+			++failures;
+		}
+	}
+
+	// the logger LOG_LIMITED writes to, like the one Config.cpp sets up
+	Logger *currentLogger = nullptr;
+
+	// a logger writing into a string, which may be read after a Flush while no thread is logging
+	struct TestLogger {
+		std::ostringstream *text;
+		Logger logger;
+
+		explicit TestLogger( std::chrono::milliseconds flushInterval = std::chrono::milliseconds( 100 ) )
+			: text( new std::ostringstream ), logger( std::unique_ptr<std::ostream>( text ), flushInterval ) {
+			currentLogger = &logger;
+		}
+		~TestLogger() {
+			currentLogger = nullptr;
+		}
+
+		std::string Flushed() {
+			logger.Flush();
+			return text->str();
+		}
+
+		// what was written since the last call
+		std::string FlushedSince() {
+			std::string all = Flushed();
+			std::string since = all.substr( read );
+			read = all.size();
+			return since;
+		}
+
+	private:
+		size_t read = 0;
+	};
+
+	// counts how often it is formatted
+	struct Counted {
+		int *count;
+	};
+
+	std::ostream & operator<<( std::ostream &out, Counted counted ) {
+		++*counted.count;
+		return out << "counted";
+	}
+
+	std::vector<std::string> Lines( const std::string &text ) {
+		std::vector<std::string> lines;
+		size_t start = 0;
+		for (size_t end = text.find( '\n' ); end != std::string::npos; end = text.find( '\n', start )) {
+			lines.push_back( text.substr( start, end - start ) );
+			start = end + 1;
+		}
+		return lines;
+	}
+
+	void CheckLines() {
+		TestLogger test;
+		Logger &logger = test.logger;
+		int formatted = 0;
+		Check( !logger.IsEnabled( LogLevel::Debug ) && logger.IsEnabled( LogLevel::Info ), "info and above enabled by default" );
+		LogLine( &logger, LogLevel::Debug ) << Counted { &formatted } << "\n";
+		Check( formatted == 0, "disabled line not formatted" );
+		LogLine( &logger, LogLevel::Info ) << "plain " << 42 << "\n";
+		LogLine( &logger, LogLevel::Warning ) << "careful\n";
+		LogLine( &logger, LogLevel::Error ) << "broken\n";
+		logger.SetLevel( LogLevel::Debug );
+		LogLine( &logger, LogLevel::Debug ) << Counted { &formatted } << "\n";
+		Check( formatted == 1, "enabled line formatted once" );
+		logger.SetLevel( LogLevel::Error );
+		LogLine( &logger, LogLevel::Warning ) << "hidden\n";
+		logger.SetLevel( LogLevel::Info );
+		Check( test.FlushedSince() == "plain 42\n[warning] careful\n[error] broken\ncounted\n", "levels filtered and prefixed" );
+
+		// a line written in parts is prefixed once
+		LogLine( &logger, LogLevel::Warning ) << "first ";
+		LogLine( &logger, LogLevel::Warning ) << "second\n";
+		LogLine( &logger, LogLevel::Info ) << std::hex << 255 << std::endl;
+		LogLine( &logger, LogLevel::Info ) << 255 << "\n";
+		Check( test.FlushedSince() == "[warning] first second\nff\n255\n", "parts joined and manipulators ended with their line" );
+
+		// logging while a line is being formatted, as a function called for a streamed value may do
+		{
+			LogLine outer( &logger, LogLevel::Info );
+			outer << "outer ";
+			LogLine( &logger, LogLevel::Info ) << "inner\n";
+			outer << 1 << "\n";
+		}
+		Check( test.FlushedSince() == "inner\nouter 1\n", "nested line written separately" );
+		Check( logger.DroppedLines() == 0, "nothing dropped" );
+	}
+
+	void CheckThreads( int threadCount, int linesPerThread ) {
+		TestLogger test;
+		std::vector<std::thread> threads;
+		for (int t = 0; t < threadCount; ++t) {
+			threads.emplace_back( [&test, t, linesPerThread]() {
+				for (int i = 0; i < linesPerThread; ++i) {
+					LogLine( &test.logger, LogLevel::Info ) << "thread " << t << " line " << i << "\n";
+				}
+			} );
+		}
+		for (std::thread &thread : threads) {
+			thread.join();
+		}
+		// the buffers of the exited threads still hold the lines the flusher has not taken yet
+		std::vector<std::string> lines = Lines( test.FlushedSince() );
+		std::vector<int> next( threadCount, 0 );
+		bool whole = true, ordered = true;
+		size_t written = 0;
+		for (const std::string &line : lines) {
+			if (line.compare( 0, 10, "[warning] " ) == 0)
+				continue;
+			int t = -1, i = -1;
+			char rest = 0;
+			if (sscanf( line.c_str(), "thread %d line %d%c", &t, &i, &rest ) != 2 || t < 0 || t >= threadCount) {
+				whole = false;
+				continue;
+			}
+			// dropped lines leave gaps
+			ordered = ordered && i >= next[t];
+			next[t] = i + 1;
+			++written;
+		}
+		Check( whole, "lines of concurrent threads not interleaved" );
+		Check( ordered, "lines of each thread in order" );
+		Check( written + test.logger.DroppedLines() == size_t(threadCount) * linesPerThread, "every line written or counted as dropped" );
+
+		// a thread's buffer is retired when it exits, and a new thread gets its own
+		std::thread( [&test]() { LogLine( &test.logger, LogLevel::Info ) << "last\n"; } ).join();
+		Check( test.FlushedSince() == "last\n", "line of an exited thread written" );
+	}
+
+	void CheckOverflow() {
+		// a flusher that only runs when woken by a full buffer
+		TestLogger test( std::chrono::milliseconds( 60000 ) );
+		std::string longLine( Logger::BUFFER_SIZE, 'x' );
+		longLine.back() = '\n';
+		Check( test.logger.Write( LogLevel::Info, longLine.data(), longLine.size() ), "overlong line queued" );
+		test.logger.Write( LogLevel::Info, "\n", 1 );
+		std::string text = test.FlushedSince();
+		Check( text.size() == Logger::BUFFER_SIZE / 2 + 1 && text.find( '\n' ) == Logger::BUFFER_SIZE / 2, "overlong line cut to half the buffer" );
+
+		std::string line( Logger::BUFFER_SIZE / 4, 'y' );
+		line.back() = '\n';
+		int written = 0;
+		for (int i = 0; i < 10000 && test.logger.DroppedLines() == 0; ++i) {
+			if (test.logger.Write( LogLevel::Info, line.data(), line.size() ))
+				++written;
+		}
+		uint64_t dropped = test.logger.DroppedLines();
+		Check( dropped > 0, "full buffer drops lines" );
+		std::vector<std::string> lines = Lines( test.FlushedSince() );
+		Check( lines.size() == size_t(written) + 1, "lines before the drop written" );
+		Check( !lines.empty() && lines.back() == "[warning] " + std::to_string( dropped ) + " log lines dropped because the log buffer was full", "drops reported" );
+		Check( test.FlushedSince().empty(), "drops reported once" );
+	}
+
+	void CheckStop() {
+		// a flusher that would not write on its own during the check
+		TestLogger test( std::chrono::milliseconds( 60000 ) );
+		LogLine( &test.logger, LogLevel::Info ) << "before\n";
+		test.logger.Stop();
+		Check( test.text->str() == "before\n", "queued lines written when stopped" );
+		LogLine( &test.logger, LogLevel::Info ) << "stopped\n";
+		test.logger.Stop();
+		Check( test.text->str() == "before\n", "lines logged while stopped stay queued" );
+		test.logger.Start();
+		test.logger.Start();
+		LogLine( &test.logger, LogLevel::Info ) << "restarted\n";
+		test.logger.Stop();
+		Check( test.text->str() == "before\nstopped\nrestarted\n", "restarted logger writes the queued lines" );
+	}
+
+	void CheckRateLimit() {
+		LogRateLimit limit( 3 );
+		int allowed = 0;
+		uint64_t suppressed = 99, firstSuppressed = 99;
+		for (int i = 0; i < 10; ++i) {
+			if (limit.Allow( suppressed )) {
+				if (allowed == 0)
+					firstSuppressed = suppressed;
+				++allowed;
+			}
+		}
+		Check( allowed == 3 && firstSuppressed == 0, "lines over the limit suppressed" );
+		std::this_thread::sleep_for( std::chrono::milliseconds( 1100 ) );
+		Check( limit.Allow( suppressed ) && suppressed == 7, "suppressed lines counted into the next window" );
+
+		TestLogger test;
+		for (int i = 0; i < 10; ++i) {
+			LOG_LIMITED( LogLevel::Warning, 2 ) << "repeated " << i << "\n";
+			if (i == 4)
+				std::this_thread::sleep_for( std::chrono::milliseconds( 1100 ) );
+		}
+		// each call site has its own limit
+		LOG_LIMITED( LogLevel::Info, 2 ) << "elsewhere\n";
+		Check( test.FlushedSince() == "[warning] repeated 0\n[warning] repeated 1\n[warning] [3 similar lines suppressed] repeated 5\n"
+			"[warning] repeated 6\nelsewhere\n", "call site limited and suppressed lines reported" );
+	}
+
+	// keeps the benchmarked lines from being optimized away
+	volatile uint64_t sink;
+
+	template<typename F>
+	double NanosecondsPerLine( uint64_t lines, F log ) {
+		auto start = std::chrono::steady_clock::now();
+		for (uint64_t i = 0; i < lines; ++i) {
+			log( i );
+		}
+		return std::chrono::duration<double, std::nano>( std::chrono::steady_clock::now() - start ).count() / lines;
+	}
+
+	void Benchmark( uint64_t lines ) {
+		// writing nowhere, so that the flusher keeps up and the numbers show the caller's side only
+		Logger logger( std::unique_ptr<std::ostream>( new std::ostream( nullptr ) ) );
+		currentLogger = &logger;
+		const char text[] = "Error when submitting for eye 0: 108\n";
+		double disabled = NanosecondsPerLine( lines, [&]( uint64_t i ) {
+			LogLine( &logger, LogLevel::Debug ) << "frame " << i << "\n";
+		} );
+		double limited = NanosecondsPerLine( lines, [&]( uint64_t i ) {
+			LOG_LIMITED( LogLevel::Error, 2 ) << "frame " << i << "\n";
+		} );
+		uint64_t droppedBefore = logger.DroppedLines();
+		double written = NanosecondsPerLine( lines, [&]( uint64_t ) {
+			sink = logger.Write( LogLevel::Info, text, sizeof(text) - 1 );
+		} );
+		double formatted = NanosecondsPerLine( lines, [&]( uint64_t i ) {
+			LogLine( &logger, LogLevel::Info ) << "frame " << i << " took " << 11.1 << " ms\n";
+		} );
+		uint64_t dropped = logger.DroppedLines() - droppedBefore;
+		logger.Flush();
+		currentLogger = nullptr;
+		printf( "disabled line               %8.2f ns\n", disabled );
+		printf( "rate limited line           %8.2f ns\n", limited );
+		printf( "write of a %2d byte line     %8.2f ns\n", int(sizeof(text) - 1), written );
+		printf( "formatted line              %8.2f ns\n", formatted );
+		printf( "%llu of %llu written lines dropped\n", (unsigned long long)dropped, (unsigned long long)(2 * lines) );
+	}
+
+	int Usage() {
+		fprintf( stderr,
+			"usage: logger_test [--threads count] [--lines count]\n"
+			"Checks the logger with threads logging at once (default 4 threads writing 1000 lines each), then\n"
+			"measures the cost of a log call to the calling thread (default 200000 lines).\n" );
+		return 2;
+	}
+}
+
+LogLine Log( LogLevel level ) {
+	return LogLine( currentLogger, level );
+}
+
+int main( int argc, char **argv ) {
+	int threads = 4;
+	uint64_t lines = 200000;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp( argv[i], "--threads" ) == 0 && i + 1 < argc) {
+			threads = atoi( argv[++i] );
+			if (threads <= 0)
+				return Usage();
+		} else if (strcmp( argv[i], "--lines" ) == 0 && i + 1 < argc) {
+			lines = strtoull( argv[++i], nullptr, 10 );
+			if (lines == 0)
+				return Usage();
+		} else {
+			return Usage();
+		}
+	}
+
+	CheckLines();
+	CheckThreads( threads, 1000 );
+	CheckOverflow();
+	CheckStop();
+	CheckRateLimit();
+	Benchmark( lines );
+
+	if (failures != 0) {
+		fprintf( stderr, "%d checks failed\n", failures );
+		return 1;
+	}
+	printf( "all checks passed\n" );
+	return 0;
+}
@@ -0,0 +1,84 @@
+// Shows the live metrics a running game publishes through shared memory.
+#include "../postprocess/LiveMetrics.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+using namespace vr;
+
+namespace {
+	int Usage() {
+		fprintf( stderr,
+			"usage: metrics_monitor [--once] [--interval milliseconds] [--name name]\n"
+			"Prints the metrics published by the mod, once or every interval (default 1000 ms).\n" );
+		return 2;
+	}
+
+	const char * ModeName( uint64_t mode ) {
+		switch (mode) {
+		case 1: return "rdm";
+		case 2: return "vrs";
+		default: return "off";
+		}
+	}
+}
+
+int main( int argc, char **argv ) {
+	bool once = false;
+	int intervalMs = 1000;
+	std::string name = "openvr_mod_metrics";
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp( argv[i], "--once" ) == 0) {
+			once = true;
+		} else if (strcmp( argv[i], "--interval" ) == 0 && i + 1 < argc) {
+			intervalMs = atoi( argv[++i] );
+			if (intervalMs < 1)
+				return Usage();
+		} else if (strcmp( argv[i], "--name" ) == 0 && i + 1 < argc) {
+			name = argv[++i];
+		} else {
+			return Usage();
+		}
+	}
+
+	LiveMetricsReader reader;
+	std::string error;
+	if (!reader.Open( name, error )) {
+		fprintf( stderr, "%s: %s\n", name.c_str(), error.c_str() );
+		return 1;
+	}
+
+	MetricValues previous;
+	bool havePrevious = false;
+	while (true) {
+		MetricValues metrics;
+		uint32_t process = 0;
+		if (!reader.Read( metrics, process )) {
+			fprintf( stderr, "no consistent metrics available\n" );
+			if (once)
+				return 1;
+		} else {
+			printf( "pid %u mode %s", process, ModeName( metrics[Metric::Mode] ) );
+			if (havePrevious && metrics[Metric::UpdatedMicros] > previous[Metric::UpdatedMicros]) {
+				double seconds = (metrics[Metric::UpdatedMicros] - previous[Metric::UpdatedMicros]) / 1e6;
+				printf( " fps %.1f", (metrics[Metric::Frame] - previous[Metric::Frame]) / seconds );
+			} else if (havePrevious) {
+				printf( " (not updated)" );
+			}
+			for (size_t i = 0; i < size_t(Metric::Count); ++i) {
+				if (Metric(i) != Metric::Mode)
+					printf( " %s %llu", MetricName( Metric(i) ), (unsigned long long)metrics.values[i] );
+			}
+			printf( "\n" );
+			fflush( stdout );
+			previous = metrics;
+			havePrevious = true;
+		}
+		if (once)
+			return 0;
+		std::this_thread::sleep_for( std::chrono::milliseconds( intervalMs ) );
+	}
+}
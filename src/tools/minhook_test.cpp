@@ -0,0 +1,275 @@
+// Checks the vendored MinHook on real functions of this program: a hook created, enabled, disabled and enabled
+// again, calls reaching the detour and the trampoline running the original code, hooks toggled while another
+// thread keeps calling the target so that it gets stopped inside the patched bytes, a hook removed, and an export
+// of the C library hooked by name. On Linux, also checks that the signal used to stop threads gets MinHook's
+// handler only while threads are stopped, and the handler installed before it back afterwards.
+#include <MinHook.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#ifdef _MSC_VER
+#define NOINLINE __declspec(noinline)
+#else
+#define NOINLINE __attribute__((noinline))
+#endif
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+static const wchar_t *LIBC_MODULE = L"ucrtbase.dll";
+static const char *GETPID_NAME = "_getpid";
+#else
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+static const wchar_t *LIBC_MODULE = L"libc.so.6";
+static const char *GETPID_NAME = "getpid";
+#endif
+
+namespace {
+	int failures = 0;
+
+	void Check( bool condition, const char *what ) {
+		if (!condition) {
+			fprintf( stderr, "FAIL  %s\n", what );
+			++failures;
+		}
+	}
+
+	bool Succeeded( MH_STATUS status, const char *what ) {
+		if (status != MH_OK)
+			fprintf( stderr, "      %s: %s\n", what, MH_StatusToString( status ) );
+		return status == MH_OK;
+	}
+
+	typedef uint32_t (*Function)( uint32_t value );
+
+	uint32_t Mix( uint32_t value, uint32_t offset ) {
+		value ^= value >> 7;
+		return value * 2654435761u + offset;
+	}
+
+	// Targets need a few bytes of code before they return to be patched, so each one mixes its argument.
+	// Every target can only be hooked once; the offsets keep the linker from folding them into one function.
+	template<uint32_t Offset>
+	NOINLINE uint32_t Target( uint32_t value ) { return Mix( value, Offset ); }
+
+	Function const ToggledTarget = Target<1>;
+	Function const SignaledTarget = Target<2>;
+
+	Function toggledOriginal;
+	std::atomic<uint64_t> toggledDetourCalls { 0 };
+	NOINLINE uint32_t CountingDetour( uint32_t value ) {
+		toggledDetourCalls.fetch_add( 1, std::memory_order_relaxed );
+		return toggledOriginal( value ) + 1;
+	}
+
+	Function signaledOriginal;
+	NOINLINE uint32_t ForwardingDetour( uint32_t value ) {
+		return signaledOriginal( value );
+	}
+
+	typedef int (*GetPidFunction)();
+	GetPidFunction getpidOriginal;
+	int getpidDetourCalls = 0;
+	int GetPidDetour() {
+		++getpidDetourCalls;
+		return getpidOriginal();
+	}
+
+	// calls the target on another thread until stopped, counting results that are neither the original's nor the detour's
+	class Caller {
+	public:
+		explicit Caller( Function function, uint32_t offset ) : target( function ), offset( offset ) {
+			thread = std::thread( [this]() {
+				while (!stop.load( std::memory_order_relaxed )) {
+					uint32_t value = uint32_t(calls.load( std::memory_order_relaxed ));
+					uint32_t result = target( value );
+					if (result != Mix( value, this->offset ) && result != Mix( value, this->offset ) + 1)
+						wrong.fetch_add( 1, std::memory_order_relaxed );
+					calls.fetch_add( 1, std::memory_order_relaxed );
+				}
+			} );
+			WaitForCalls( 1 );
+		}
+
+		~Caller() {
+			Stop();
+		}
+
+		void WaitForCalls( uint64_t count ) {
+			uint64_t before = calls.load();
+			while (calls.load() < before + count) {
+				std::this_thread::yield();
+			}
+		}
+
+		void Stop() {
+			stop = true;
+			if (thread.joinable())
+				thread.join();
+		}
+
+		std::thread thread;
+		std::atomic<uint64_t> wrong { 0 }, calls { 0 };
+
+	private:
+		Function volatile target;
+		uint32_t offset;
+		std::atomic<bool> stop { false };
+	};
+
+	void CheckToggling( int toggles ) {
+		Function volatile toggled = ToggledTarget;
+		const uint32_t expected = Mix( 5, 1 );
+		Check( Succeeded( MH_CreateHook( (void*)ToggledTarget, (void*)&CountingDetour, (void**)&toggledOriginal ), "MH_CreateHook" ),
+			"hook created on a function of this program" );
+		Check( MH_CreateHook( (void*)ToggledTarget, (void*)&CountingDetour, nullptr ) == MH_ERROR_ALREADY_CREATED, "hook created once" );
+		Check( toggled( 5 ) == expected && toggledDetourCalls == 0, "target unchanged until the hook is enabled" );
+
+		Check( Succeeded( MH_EnableHook( (void*)ToggledTarget ), "MH_EnableHook" ), "hook enabled" );
+		Check( MH_EnableHook( (void*)ToggledTarget ) == MH_ERROR_ENABLED, "hook enabled once" );
+		Check( toggled( 5 ) == expected + 1 && toggledDetourCalls == 1, "calls reach the detour" );
+		Check( toggledOriginal( 5 ) == expected && toggledDetourCalls == 1, "trampoline runs the original code" );
+
+		Check( Succeeded( MH_DisableHook( (void*)ToggledTarget ), "MH_DisableHook" ), "hook disabled" );
+		Check( MH_DisableHook( (void*)ToggledTarget ) == MH_ERROR_DISABLED, "hook disabled once" );
+		Check( toggled( 5 ) == expected && toggledDetourCalls == 1, "calls skip the detour once disabled" );
+		Check( toggledOriginal( 5 ) == expected, "trampoline still runs the original code while disabled" );
+		Check( Succeeded( MH_EnableHook( (void*)ToggledTarget ), "MH_EnableHook" ), "hook enabled again" );
+		Check( toggled( 5 ) == expected + 1 && toggledDetourCalls == 2, "calls reach the detour again" );
+
+		// patching the target while it runs on another thread
+		bool toggledAll = true;
+		{
+			Caller caller( ToggledTarget, 1 );
+			for (int i = 0; i < toggles; ++i) {
+				toggledAll &= MH_DisableHook( (void*)ToggledTarget ) == MH_OK;
+				toggledAll &= MH_QueueEnableHook( (void*)ToggledTarget ) == MH_OK;
+				toggledAll &= MH_ApplyQueued() == MH_OK;
+			}
+			caller.WaitForCalls( 1000 );
+			caller.Stop();
+			Check( toggledAll, "hook toggled while another thread calls the target" );
+			Check( caller.wrong == 0, "other thread always got the original or the hooked result" );
+			printf( "%d toggles during %llu calls on the other thread\n", toggles, (unsigned long long)caller.calls.load() );
+		}
+		Check( toggled( 5 ) == expected + 1, "hook left enabled" );
+
+		Check( Succeeded( MH_RemoveHook( (void*)ToggledTarget ), "MH_RemoveHook" ), "hook removed" );
+		Check( toggled( 5 ) == expected, "target restored" );
+		Check( MH_EnableHook( (void*)ToggledTarget ) == MH_ERROR_NOT_CREATED, "removed hook forgotten" );
+	}
+
+	void CheckExport() {
+		// a function of the C library, found by name like the DXGI and D3D11 exports
+		GetPidFunction volatile getpidTarget = (GetPidFunction)getpid;
+		int pid = getpidTarget();
+		void *target = nullptr;
+		Check( Succeeded( MH_CreateHookApiEx( LIBC_MODULE, GETPID_NAME, (void*)&GetPidDetour, (void**)&getpidOriginal, &target ), "MH_CreateHookApiEx" )
+			&& Succeeded( MH_EnableHook( target ), "MH_EnableHook" ), "hook created on a C library export" );
+		if (target != nullptr) {
+			Check( getpidTarget() == pid && getpidDetourCalls == 1, "C library calls reach the detour" );
+			Check( Succeeded( MH_RemoveHook( target ), "MH_RemoveHook" ) && getpidTarget() == pid && getpidDetourCalls == 1, "C library export restored" );
+		}
+		Check( MH_CreateHookApiEx( LIBC_MODULE, "no_such_function", (void*)&GetPidDetour, nullptr, nullptr ) == MH_ERROR_FUNCTION_NOT_FOUND,
+			"missing export reported" );
+	}
+
+#ifndef _WIN32
+	// MinHook's default, unless the build overrides MH_SUSPEND_SIGNAL
+	int SuspendSignal() {
+		return SIGRTMIN + 7;
+	}
+
+	std::atomic<int> ownSignals { 0 };
+	void OwnHandler( int ) {
+		ownSignals.fetch_add( 1 );
+	}
+
+	bool OwnHandlerInstalled() {
+		struct sigaction current;
+		return sigaction( SuspendSignal(), nullptr, &current ) == 0 && current.sa_handler == OwnHandler;
+	}
+
+	void CheckSuspendSignal() {
+		struct sigaction own, previous;
+		memset( &own, 0, sizeof(own) );
+		own.sa_handler = OwnHandler;
+		sigemptyset( &own.sa_mask );
+		sigaction( SuspendSignal(), &own, &previous );
+
+		Check( Succeeded( MH_CreateHook( (void*)SignaledTarget, (void*)&ForwardingDetour, (void**)&signaledOriginal ), "MH_CreateHook" ),
+			"hook created for the suspend signal" );
+		{
+			Caller caller( SignaledTarget, 2 );
+			// each of these stops the other thread with the signal
+			bool toggled = true;
+			for (int i = 0; i < 10; ++i) {
+				toggled &= MH_EnableHook( (void*)SignaledTarget ) == MH_OK;
+				toggled &= MH_DisableHook( (void*)SignaledTarget ) == MH_OK;
+			}
+			caller.WaitForCalls( 1000 );
+			Check( toggled && caller.wrong == 0, "hook toggled while the other thread was stopped by the signal" );
+			Check( ownSignals == 0, "stopped thread handled the signal with MinHook's handler" );
+			Check( OwnHandlerInstalled(), "handler restored once the threads are resumed" );
+
+			// the program's own use of the signal reaches its handler again
+			pthread_kill( caller.thread.native_handle(), SuspendSignal() );
+			for (int i = 0; i < 1000 && ownSignals == 0; ++i) {
+				std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+			}
+			Check( ownSignals == 1, "signal reaches the program's handler after the hooks are applied" );
+		}
+
+		// with no other thread to stop, the handler is not touched at all
+		Check( Succeeded( MH_EnableHook( (void*)SignaledTarget ), "MH_EnableHook" ) && OwnHandlerInstalled(), "handler left alone without other threads" );
+		Check( Succeeded( MH_RemoveHook( (void*)SignaledTarget ), "MH_RemoveHook" ), "hook removed for the suspend signal" );
+		sigaction( SuspendSignal(), &previous, nullptr );
+	}
+#endif
+
+	int Usage() {
+		fprintf( stderr,
+			"usage: minhook_test [--toggles count]\n"
+			"Checks MinHook on functions of this program, with the hook toggled while another thread calls the\n"
+			"target (default 500 times).\n" );
+		return 2;
+	}
+}
+
+int main( int argc, char **argv ) {
+	int toggles = 500;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp( argv[i], "--toggles" ) == 0 && i + 1 < argc) {
+			toggles = atoi( argv[++i] );
+			if (toggles <= 0)
+				return Usage();
+		} else {
+			return Usage();
+		}
+	}
+
+	if (!Succeeded( MH_Initialize(), "MH_Initialize" ))
+		return 1;
+	Check( MH_Initialize() == MH_ERROR_ALREADY_INITIALIZED, "initialized once" );
+	CheckToggling( toggles );
+	CheckExport();
+#ifndef _WIN32
+	CheckSuspendSignal();
+#endif
+	Check( Succeeded( MH_Uninitialize(), "MH_Uninitialize" ), "uninitialized" );
+	Check( MH_CreateHook( (void*)ToggledTarget, (void*)&CountingDetour, nullptr ) == MH_ERROR_NOT_INITIALIZED, "no hooks after uninitializing" );
+
+	if (failures != 0) {
+		fprintf( stderr, "%d checks failed\n", failures );
+		return 1;
+	}
+	printf( "all checks passed\n" );
+	return 0;
+}
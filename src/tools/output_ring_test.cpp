@@ -0,0 +1,119 @@
+// Checks the reuse rules of the output texture ring against fake slots standing in for the textures and their
+// fences: a slot per eye and frame modulo the depth, created on first use, and only waited for if the compositor
+// may still be reading it from a previous Submit, and reused anyway when that wait gives up.
+#include "../postprocess/OutputRing.h"
+#include "openvr.h"
+#include <cstdio>
+
+using namespace vr;
+
+namespace {
+	struct FakeSlot {
+		int id = 0;
+		int signals = 0;
+		int waits = 0;
+		// set once the fake GPU has passed the slot's fence
+		bool idle = true;
+		// the fence does not pass within the wait
+		bool stuck = false;
+	};
+
+	struct Counters {
+		int created = 0;
+	};
+
+	int failures = 0;
+
+	void Check( bool condition, const char *what ) {
+		if (!condition) {
+			fprintf( stderr, "FAIL  %s\n", what );
+			++failures;
+		}
+	}
+
+	void InitRing( OutputRing<FakeSlot> &ring, int depth, Counters &counters ) {
+		ring.Init( depth,
+			[&counters](FakeSlot &slot) { slot.id = ++counters.created; },
+			[](FakeSlot &slot) { ++slot.signals; slot.idle = false; },
+			[](FakeSlot &slot) { return slot.idle; },
+			[](FakeSlot &slot) { ++slot.waits; slot.idle = !slot.stuck; return slot.idle; } );
+	}
+
+	void CheckSlotAssignment() {
+		Counters counters;
+		OutputRing<FakeSlot> ring;
+		InitRing( ring, 3, counters );
+		Check( ring.Depth() == 3, "depth as configured" );
+		Check( counters.created == 0, "slots created lazily" );
+
+		int left0 = ring.Acquire( Eye_Left, 0 );
+		int right0 = ring.Acquire( Eye_Right, 0 );
+		Check( left0 != right0, "eyes get separate slots" );
+		Check( counters.created == 2, "slot created on first use" );
+		Check( ring.Acquire( Eye_Left, 1 ) != left0 && ring.Acquire( Eye_Left, 2 ) != left0, "consecutive frames get separate slots" );
+		Check( ring.Acquire( Eye_Left, 3 ) == left0, "slot reused after depth frames" );
+		Check( counters.created == 4, "reused slot not created again" );
+
+		int created = 0;
+		ring.ForEachCreated( [&created](FakeSlot &) { ++created; } );
+		Check( created == 4, "only created slots visited" );
+
+		ring.Reset();
+		ring.Acquire( Eye_Left, 0 );
+		Check( counters.created == 5, "slots recreated after reset" );
+
+		OutputRing<FakeSlot> shallow;
+		InitRing( shallow, 0, counters );
+		Check( shallow.Depth() == 1 && shallow.Acquire( Eye_Left, 0 ) == shallow.Acquire( Eye_Left, 1 ), "depth of at least one" );
+	}
+
+	void CheckWaits() {
+		Counters counters;
+		OutputRing<FakeSlot> ring;
+		InitRing( ring, 2, counters );
+
+		int index = ring.Acquire( Eye_Left, 0 );
+		ring.Submitted( index );
+		Check( ring.Get( index ).signals == 1, "fence signalled after Submit" );
+		ring.Acquire( Eye_Left, 1 );
+		// the compositor is done with frame 0 by the time it comes round again
+		ring.Get( index ).idle = true;
+		Check( ring.Acquire( Eye_Left, 2 ) == index && ring.Get( index ).waits == 0, "idle slot reused without waiting" );
+		ring.Submitted( index );
+
+		// the compositor still reads the slot
+		Check( ring.Acquire( Eye_Left, 4 ) == index, "slot due for reuse" );
+		Check( ring.Get( index ).waits == 1 && ring.ForcedWaits() == 1, "busy slot waited for and counted" );
+
+		// acquired again without a Submit in between, e.g. when the game submits the same eye twice
+		ring.Acquire( Eye_Left, 6 );
+		Check( ring.ForcedWaits() == 1, "slot not submitted since is not waited for" );
+		Check( ring.AbandonedWaits() == 0, "wait for a slot that became idle not given up" );
+
+		// the compositor holds on to the slot for longer than the wait
+		ring.Submitted( index );
+		ring.Get( index ).stuck = true;
+		Check( ring.Acquire( Eye_Left, 8 ) == index && ring.Get( index ).waits == 2, "slot reused when the wait gives up" );
+		Check( ring.ForcedWaits() == 2 && ring.AbandonedWaits() == 1, "given up wait counted" );
+		ring.Acquire( Eye_Left, 10 );
+		Check( ring.Get( index ).waits == 2, "given up slot not waited for again before its next Submit" );
+
+		int right = ring.SlotIndex( Eye_Right, 0 );
+		ring.Submitted( right );
+		Check( ring.Get( right ).signals == 0, "slot never created is not signalled" );
+
+		InitRing( ring, 2, counters );
+		Check( ring.ForcedWaits() == 0 && ring.AbandonedWaits() == 0, "counters start over with a new ring" );
+	}
+}
+
+int main() {
+	CheckSlotAssignment();
+	CheckWaits();
+	if (failures != 0) {
+		fprintf( stderr, "%d checks failed\n", failures );
+		return 1;
+	}
+	printf( "all checks passed\n" );
+	return 0;
+}
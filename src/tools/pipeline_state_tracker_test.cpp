@@ -0,0 +1,467 @@
+// Replays recorded streams of context calls through fake contexts whose backend records what the tracker reads back
+// and re-issues, and checks that saved state comes back as it was: groups kept up to date by the hooks are neither
+// read back nor re-issued if unchanged, groups whose state is unknown are, contexts that are not tracked are read
+// back and restored in full, and snapshots hold a reference on the objects they saved until restored.
+#include "../postprocess/PipelineStateTracker.h"
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <map>
+
+using namespace vr;
+
+namespace {
+	typedef PipelineStateTracker Tracker;
+
+	// calls in a recorded stream that do not set a single group
+	enum Call : uint32_t {
+		ClearState = 1 << 16,
+		ExecuteAndReset = 1 << 17,
+		ExecuteAndRestore = 1 << 18,
+		SwapState = 1 << 19,
+		VSConstantBufferWithOffset = 1 << 20,
+	};
+
+	// a call as recorded from the hooks: a group or one of the calls above, and the object or value it set
+	struct RecordedCall {
+		uint32_t call;
+		int value;
+	};
+
+	// stand-ins for the D3D11 objects; the tracker only compares their addresses and leaves references to the backend
+	char objects[32];
+
+	template<typename T>
+	T * Object( int value ) {
+		return value == 0 ? nullptr : reinterpret_cast<T*>( &objects[value] );
+	}
+
+	// the state a call with the given value sets, in whichever group it is for
+	Tracker::State StateWith( int value ) {
+		Tracker::State state;
+		state.vertexShader = Object<ID3D11VertexShader>( value );
+		state.pixelShader = Object<ID3D11PixelShader>( value );
+		state.computeShader = Object<ID3D11ComputeShader>( value );
+		state.inputLayout = Object<ID3D11InputLayout>( value );
+		state.topology = value;
+		for (int stage = 0; stage < 3; ++stage) {
+			state.constantBuffer[stage] = Object<ID3D11Buffer>( value );
+		}
+		state.csSampler = Object<ID3D11SamplerState>( value );
+		state.rasterizerState = Object<ID3D11RasterizerState>( value );
+		state.depthStencilState = Object<ID3D11DepthStencilState>( value );
+		state.stencilRef = value;
+		state.numViewports = value;
+		for (uint32_t i = 0; i < Tracker::MaxViewports; ++i) {
+			Tracker::Viewport viewport = { 0, 0, float(value * 100 + i), float(value * 100 + i), 0, 1 };
+			state.viewports[i] = viewport;
+		}
+		return state;
+	}
+
+	void CopyGroups( uint32_t groups, const Tracker::State &from, Tracker::State &to ) {
+		if (groups & Tracker::VertexShader) to.vertexShader = from.vertexShader;
+		if (groups & Tracker::PixelShader) to.pixelShader = from.pixelShader;
+		if (groups & Tracker::ComputeShader) to.computeShader = from.computeShader;
+		if (groups & Tracker::InputLayout) to.inputLayout = from.inputLayout;
+		if (groups & Tracker::PrimitiveTopology) to.topology = from.topology;
+		if (groups & Tracker::VSConstantBuffer) to.constantBuffer[Tracker::Stage_VS] = from.constantBuffer[Tracker::Stage_VS];
+		if (groups & Tracker::PSConstantBuffer) to.constantBuffer[Tracker::Stage_PS] = from.constantBuffer[Tracker::Stage_PS];
+		if (groups & Tracker::CSConstantBuffer) to.constantBuffer[Tracker::Stage_CS] = from.constantBuffer[Tracker::Stage_CS];
+		if (groups & Tracker::CSSampler) to.csSampler = from.csSampler;
+		if (groups & Tracker::RasterizerState) to.rasterizerState = from.rasterizerState;
+		if (groups & Tracker::DepthStencilState) {
+			to.depthStencilState = from.depthStencilState;
+			to.stencilRef = from.stencilRef;
+		}
+		// like the runtime, ignore more viewports than the pipeline has
+		if ((groups & Tracker::Viewports) && from.numViewports <= Tracker::MaxViewports) {
+			to.numViewports = from.numViewports;
+			memcpy( to.viewports, from.viewports, sizeof(to.viewports) );
+		}
+	}
+
+	bool SameGroups( uint32_t groups, const Tracker::State &a, const Tracker::State &b ) {
+		Tracker::State copy = a;
+		CopyGroups( groups & ~Tracker::Viewports, b, copy );
+		bool same = memcmp( &copy, &a, offsetof(Tracker::State, numViewports) ) == 0;
+		// viewports past the number set are not part of the state
+		if (groups & Tracker::Viewports) {
+			same = same && a.numViewports == b.numViewports
+				&& memcmp( a.viewports, b.viewports, a.numViewports * sizeof(Tracker::Viewport) ) == 0;
+		}
+		return same;
+	}
+
+	struct FakeContext {
+		Tracker::State state;
+
+		ID3D11DeviceContext * Handle() { return reinterpret_cast<ID3D11DeviceContext*>( this ); }
+	};
+
+	FakeContext & ContextOf( ID3D11DeviceContext *handle ) {
+		return *reinterpret_cast<FakeContext*>( handle );
+	}
+
+	// a call setting a group on the context, passed on to the tracker as the hooks do for the tracked context
+	void Set( Tracker &tracker, FakeContext &context, uint32_t group, const Tracker::State &from ) {
+		CopyGroups( group, from, context.state );
+		if (!tracker.IsTracked( context.Handle() ))
+			return;
+		switch (group) {
+		case Tracker::VertexShader: tracker.OnSetVertexShader( from.vertexShader ); break;
+		case Tracker::PixelShader: tracker.OnSetPixelShader( from.pixelShader ); break;
+		case Tracker::ComputeShader: tracker.OnSetComputeShader( from.computeShader ); break;
+		case Tracker::InputLayout: tracker.OnSetInputLayout( from.inputLayout ); break;
+		case Tracker::PrimitiveTopology: tracker.OnSetPrimitiveTopology( from.topology ); break;
+		case Tracker::VSConstantBuffer: tracker.OnSetConstantBuffers( Tracker::Stage_VS, 0, 1, &from.constantBuffer[Tracker::Stage_VS] ); break;
+		case Tracker::PSConstantBuffer: tracker.OnSetConstantBuffers( Tracker::Stage_PS, 0, 1, &from.constantBuffer[Tracker::Stage_PS] ); break;
+		case Tracker::CSConstantBuffer: tracker.OnSetConstantBuffers( Tracker::Stage_CS, 0, 1, &from.constantBuffer[Tracker::Stage_CS] ); break;
+		case Tracker::CSSampler: tracker.OnSetSamplers( 0, 1, &from.csSampler ); break;
+		case Tracker::RasterizerState: tracker.OnSetRasterizerState( from.rasterizerState ); break;
+		case Tracker::DepthStencilState: tracker.OnSetDepthStencilState( from.depthStencilState, from.stencilRef ); break;
+		case Tracker::Viewports: tracker.OnSetViewports( from.numViewports, from.viewports ); break;
+		}
+	}
+
+	void Replay( Tracker &tracker, FakeContext &context, const RecordedCall *calls, size_t count ) {
+		for (size_t i = 0; i < count; ++i) {
+			const RecordedCall &call = calls[i];
+			bool tracked = tracker.IsTracked( context.Handle() );
+			switch (call.call) {
+			case ClearState:
+				context.state = Tracker::State();
+				if (tracked) tracker.OnClearState();
+				break;
+			case ExecuteAndReset:
+				context.state = Tracker::State();
+				if (tracked) tracker.OnExecuteCommandList( false );
+				break;
+			case ExecuteAndRestore:
+				if (tracked) tracker.OnExecuteCommandList( true );
+				break;
+			case SwapState:
+				context.state = StateWith( call.value );
+				if (tracked) tracker.OnSwapDeviceContextState();
+				break;
+			case VSConstantBufferWithOffset:
+				context.state.constantBuffer[Tracker::Stage_VS] = Object<ID3D11Buffer>( call.value );
+				if (tracked) tracker.OnSetConstantBuffers( Tracker::Stage_VS, 0, 1, &context.state.constantBuffer[Tracker::Stage_VS], true );
+				break;
+			default:
+				Set( tracker, context, call.call, StateWith( call.value ) );
+			}
+		}
+	}
+
+	template<size_t N>
+	void Replay( Tracker &tracker, FakeContext &context, const RecordedCall (&calls)[N] ) {
+		Replay( tracker, context, calls, N );
+	}
+
+	template<size_t N>
+	uint32_t GroupsSetBy( const RecordedCall (&calls)[N] ) {
+		uint32_t groups = 0;
+		for (const RecordedCall &call : calls) {
+			groups |= call.call & Tracker::AllGroups;
+		}
+		return groups;
+	}
+
+	class RecordingBackend : public PipelineStateBackend {
+	public:
+		Tracker *tracker = nullptr;
+		int readBackCalls = 0;
+		uint32_t readBack = 0;
+		uint32_t reissued = 0;
+		int reissueCalls = 0;
+		std::map<const void*, int> references;
+
+		void ReadBack( ID3D11DeviceContext *context, uint32_t groups, Tracker::State &state ) override {
+			++readBackCalls;
+			readBack |= groups;
+			CopyGroups( groups, ContextOf( context ).state, state );
+		}
+
+		void Reissue( ID3D11DeviceContext *context, uint32_t group, const Tracker::State &state ) override {
+			++reissueCalls;
+			reissued |= group;
+			Set( *tracker, ContextOf( context ), group, state );
+		}
+
+		void AddReferences( uint32_t groups, const Tracker::State &state ) override {
+			Count( groups, state, 1 );
+		}
+
+		void ReleaseReferences( uint32_t groups, const Tracker::State &state ) override {
+			Count( groups, state, -1 );
+		}
+
+		void ClearCalls() {
+			readBackCalls = reissueCalls = 0;
+			readBack = reissued = 0;
+		}
+
+		int References( int value ) {
+			return references[&objects[value]];
+		}
+
+		bool Balanced() const {
+			for (auto &entry : references) {
+				if (entry.second != 0)
+					return false;
+			}
+			return true;
+		}
+
+	private:
+		void Count( uint32_t groups, const Tracker::State &state, int change ) {
+			const void *referenced[] = {
+				groups & Tracker::VertexShader ? state.vertexShader : nullptr,
+				groups & Tracker::PixelShader ? state.pixelShader : nullptr,
+				groups & Tracker::ComputeShader ? state.computeShader : nullptr,
+				groups & Tracker::InputLayout ? state.inputLayout : nullptr,
+				groups & Tracker::VSConstantBuffer ? state.constantBuffer[Tracker::Stage_VS] : nullptr,
+				groups & Tracker::PSConstantBuffer ? state.constantBuffer[Tracker::Stage_PS] : nullptr,
+				groups & Tracker::CSConstantBuffer ? state.constantBuffer[Tracker::Stage_CS] : nullptr,
+				groups & Tracker::CSSampler ? state.csSampler : nullptr,
+				groups & Tracker::RasterizerState ? state.rasterizerState : nullptr,
+				groups & Tracker::DepthStencilState ? state.depthStencilState : nullptr,
+			};
+			for (const void *object : referenced) {
+				if (object != nullptr)
+					references[object] += change;
+			}
+		}
+	};
+
+	int CountGroups( uint32_t groups ) {
+		int count = 0;
+		for (; groups != 0; groups &= groups - 1) {
+			++count;
+		}
+		return count;
+	}
+
+	// the game's calls during a frame, as recorded from the hooks
+	const RecordedCall GameFrame[] = {
+		{ ClearState, 0 },
+		{ Tracker::Viewports, 2 },
+		{ Tracker::RasterizerState, 1 },
+		{ Tracker::DepthStencilState, 2 },
+		{ Tracker::InputLayout, 3 },
+		{ Tracker::PrimitiveTopology, 4 },
+		{ Tracker::VertexShader, 5 },
+		{ Tracker::PixelShader, 6 },
+		{ Tracker::VSConstantBuffer, 7 },
+		{ Tracker::PSConstantBuffer, 8 },
+		{ Tracker::PixelShader, 9 },
+		{ Tracker::ComputeShader, 10 },
+		{ Tracker::CSConstantBuffer, 11 },
+		{ Tracker::CSSampler, 12 },
+		{ ExecuteAndRestore, 0 },
+		{ Tracker::Viewports, 1 },
+	};
+
+	// what drawing the radial density mask sets, leaving the compute stage alone
+	const RecordedCall MaskPass[] = {
+		{ Tracker::VertexShader, 13 },
+		{ Tracker::PixelShader, 14 },
+		{ Tracker::InputLayout, 0 },
+		{ Tracker::PrimitiveTopology, 5 },
+		{ Tracker::PSConstantBuffer, 15 },
+		{ Tracker::RasterizerState, 16 },
+		{ Tracker::DepthStencilState, 17 },
+		{ Tracker::Viewports, 1 },
+	};
+
+	int failures = 0;
+
+	void Check( bool condition, const char *what ) {
+		if (!condition) {
+			fprintf( stderr, "FAIL  %s\n", what );
+			++failures;
+		}
+	}
+
+	void CheckTrackedContext() {
+		RecordingBackend backend;
+		Tracker tracker( &backend );
+		backend.tracker = &tracker;
+		FakeContext context;
+		tracker.Attach( context.Handle() );
+
+		Replay( tracker, context, GameFrame );
+		Tracker::State expected = context.state;
+		{
+			Tracker::Snapshot snapshot;
+			tracker.Save( context.Handle(), snapshot, Tracker::AllGroups );
+			Check( backend.readBackCalls == 0 && tracker.GetStats().readbacks == 0, "state known since ClearState not read back" );
+			Check( backend.References( 5 ) == 1 && backend.References( 12 ) == 1, "saved objects referenced" );
+
+			Replay( tracker, context, MaskPass );
+			tracker.Restore( snapshot );
+			Check( SameGroups( Tracker::AllGroups, context.state, expected ), "game's state restored" );
+			// the mask pass sets the same viewports the game had
+			uint32_t changed = GroupsSetBy( MaskPass ) & ~Tracker::Viewports;
+			Check( backend.reissued == changed && backend.reissueCalls == CountGroups( changed ), "only changed groups re-issued" );
+			Check( tracker.GetStats().reissued == uint64_t(CountGroups( changed ))
+				&& tracker.GetStats().skipped == uint64_t(CountGroups( Tracker::AllGroups & ~changed )), "re-issued and skipped groups counted" );
+			Check( backend.Balanced(), "references released on restore" );
+		}
+
+		backend.ClearCalls();
+		Tracker::Snapshot snapshot;
+		tracker.Save( context.Handle(), snapshot, Tracker::AllGroups );
+		tracker.Restore( snapshot );
+		Check( backend.readBackCalls == 0 && backend.reissueCalls == 0, "unchanged state neither read back nor re-issued" );
+
+		// the game's next frame after ours, with the calls re-issued by the restore already seen by the hooks
+		Replay( tracker, context, GameFrame );
+		tracker.Save( context.Handle(), snapshot, Tracker::AllGroups );
+		Replay( tracker, context, MaskPass );
+		tracker.Restore( snapshot );
+		Check( SameGroups( Tracker::AllGroups, context.state, expected ), "restored again on the next frame" );
+		Check( backend.readBackCalls == 0, "still nothing read back" );
+	}
+
+	void CheckUnknownState() {
+		RecordingBackend backend;
+		Tracker tracker( &backend );
+		backend.tracker = &tracker;
+		FakeContext context;
+		context.state = StateWith( 3 );
+		tracker.Attach( context.Handle() );
+
+		const uint32_t maskGroups = GroupsSetBy( MaskPass );
+		Tracker::Snapshot snapshot;
+		tracker.Save( context.Handle(), snapshot, maskGroups );
+		Check( backend.readBack == maskGroups && tracker.GetStats().readbacks == 1, "state before the first hooked call read back" );
+		Replay( tracker, context, MaskPass );
+		tracker.Restore( snapshot );
+		Check( SameGroups( maskGroups, context.state, StateWith( 3 ) ), "state read back restored" );
+
+		backend.ClearCalls();
+		tracker.Save( context.Handle(), snapshot, Tracker::AllGroups );
+		Check( backend.readBack == (Tracker::AllGroups & ~maskGroups), "only groups never read back read back" );
+		tracker.Restore( snapshot );
+
+		const RecordedCall withOffset[] = { { VSConstantBufferWithOffset, 4 } };
+		Replay( tracker, context, withOffset );
+		backend.ClearCalls();
+		tracker.Save( context.Handle(), snapshot, Tracker::AllGroups );
+		Check( backend.readBack == Tracker::VSConstantBuffer, "constant buffer bound with an offset read back" );
+		tracker.Restore( snapshot );
+		Check( backend.reissueCalls == 0, "constant buffer read back is known again" );
+
+		const RecordedCall swap[] = { { SwapState, 6 } };
+		Replay( tracker, context, swap );
+		backend.ClearCalls();
+		tracker.Save( context.Handle(), snapshot, maskGroups );
+		Check( backend.readBack == maskGroups, "state swapped in read back" );
+		Replay( tracker, context, MaskPass );
+		tracker.Restore( snapshot );
+		Check( SameGroups( maskGroups, context.state, StateWith( 6 ) ), "state swapped in restored" );
+
+		// groups the game sets in full after a swap are known again
+		Replay( tracker, context, swap );
+		for (uint32_t group = 1; group & Tracker::AllGroups; group <<= 1) {
+			Set( tracker, context, group, StateWith( 8 ) );
+		}
+		backend.ClearCalls();
+		tracker.Save( context.Handle(), snapshot, Tracker::AllGroups );
+		Check( backend.readBackCalls == 0, "groups set after a swap not read back" );
+		tracker.Restore( snapshot );
+		Check( backend.reissueCalls == 0, "groups set after a swap not re-issued" );
+
+		const RecordedCall reset[] = { { Tracker::VertexShader, 7 }, { ExecuteAndReset, 0 } };
+		Replay( tracker, context, reset );
+		backend.ClearCalls();
+		tracker.Save( context.Handle(), snapshot, maskGroups );
+		Replay( tracker, context, MaskPass );
+		tracker.Restore( snapshot );
+		Check( backend.readBackCalls == 0, "default state after a command list not read back" );
+		Check( SameGroups( maskGroups, context.state, Tracker::State() ), "default state restored" );
+
+		const RecordedCall invalid[] = { { Tracker::Viewports, 2 }, { Tracker::Viewports, 17 } };
+		Replay( tracker, context, invalid );
+		tracker.Save( context.Handle(), snapshot, Tracker::Viewports );
+		Replay( tracker, context, MaskPass );
+		tracker.Restore( snapshot );
+		Check( SameGroups( Tracker::Viewports, context.state, StateWith( 2 ) ), "invalid viewport call ignored" );
+
+		RecordingBackend otherBackend;
+		otherBackend.tracker = &tracker;
+		tracker.SetBackend( &otherBackend );
+		tracker.Save( context.Handle(), snapshot, maskGroups );
+		Check( otherBackend.readBack == maskGroups, "state read back through a new backend" );
+		tracker.Restore( snapshot );
+		Check( backend.Balanced() && otherBackend.Balanced(), "references balanced across backends" );
+	}
+
+	void CheckUntrackedContexts() {
+		RecordingBackend backend;
+		Tracker tracker( &backend );
+		backend.tracker = &tracker;
+		FakeContext immediate, deferred;
+		tracker.Attach( immediate.Handle() );
+		Check( tracker.IsTracked( immediate.Handle() ) && !tracker.IsTracked( deferred.Handle() ) && !tracker.IsTracked( nullptr ), "only the attached context tracked" );
+
+		Replay( tracker, deferred, GameFrame );
+		Tracker::State expected = deferred.state;
+		const uint32_t maskGroups = GroupsSetBy( MaskPass );
+		for (int frame = 0; frame < 2; ++frame) {
+			backend.ClearCalls();
+			Tracker::Snapshot snapshot;
+			tracker.Save( deferred.Handle(), snapshot, maskGroups );
+			Replay( tracker, deferred, MaskPass );
+			tracker.Restore( snapshot );
+			Check( backend.readBack == maskGroups && backend.reissueCalls == CountGroups( maskGroups ), "untracked context read back and restored in full" );
+			Check( SameGroups( maskGroups, deferred.state, expected ), "untracked context restored" );
+		}
+		Check( tracker.GetStats().readbacks == 0 && tracker.GetStats().reissued == 0 && tracker.GetStats().skipped == 0, "untracked context not counted" );
+
+		tracker.Detach();
+		Replay( tracker, immediate, GameFrame );
+		backend.ClearCalls();
+		Tracker::Snapshot snapshot;
+		tracker.Save( immediate.Handle(), snapshot, maskGroups );
+		Check( backend.readBack == maskGroups, "detached context read back" );
+		tracker.Restore( snapshot );
+		Check( backend.reissueCalls == CountGroups( maskGroups ), "detached context restored in full" );
+	}
+
+	void CheckReferences() {
+		RecordingBackend backend;
+		Tracker tracker( &backend );
+		backend.tracker = &tracker;
+		FakeContext context;
+		tracker.Attach( context.Handle() );
+		Replay( tracker, context, GameFrame );
+		{
+			Tracker::Snapshot snapshot;
+			tracker.Save( context.Handle(), snapshot, Tracker::VertexShader | Tracker::PixelShader );
+			Check( backend.References( 5 ) == 1 && backend.References( 9 ) == 1 && backend.References( 10 ) == 0, "only objects in the saved groups referenced" );
+			tracker.Save( context.Handle(), snapshot, Tracker::ComputeShader );
+			Check( backend.References( 5 ) == 0 && backend.References( 10 ) == 1, "saving again releases the previous objects" );
+		}
+		Check( backend.Balanced(), "snapshot releases its objects when destroyed" );
+
+		Tracker::Snapshot unused;
+		tracker.Restore( unused );
+		Check( backend.reissueCalls == 0, "snapshot never saved restores nothing" );
+	}
+}
+
+int main() {
+	CheckTrackedContext();
+	CheckUnknownState();
+	CheckUntrackedContexts();
+	CheckReferences();
+	if (failures != 0) {
+		fprintf( stderr, "%d checks failed\n", failures );
+		return 1;
+	}
+	printf( "all checks passed\n" );
+	return 0;
+}
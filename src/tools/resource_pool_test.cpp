@@ -0,0 +1,143 @@
+// Checks the policy of the pool for size-dependent textures against a fake allocator handing out numbered
+// resources: which free resource serves a request, when a new one is allocated, which free ones are destroyed,
+// and the hit, miss and memory counters.
+#include "../postprocess/ResourcePool.h"
+#include <cstdio>
+
+using namespace vr;
+
+namespace {
+	const uint32_t Format = 28;
+	const uint32_t OtherFormat = 10;
+	const uint32_t BindFlags = 0x88;
+
+	class FakeAllocator : public ResourcePool<int>::Allocator {
+	public:
+		int allocations = 0;
+		PoolKey lastKey;
+
+		int Allocate( const PoolKey &key ) override {
+			lastKey = key;
+			return ++allocations;
+		}
+
+		uint64_t SizeInBytes( const PoolKey &key ) override {
+			return uint64_t(4) * key.width * key.height;
+		}
+	};
+
+	int failures = 0;
+
+	void Check( bool condition, const char *what ) {
+		if (!condition) {
+			fprintf( stderr, "FAIL  %s\n", what );
+			++failures;
+		}
+	}
+
+	void CheckBuckets() {
+		FakeAllocator allocator;
+		ResourcePool<int> pool( &allocator );
+		Check( pool.Bucket( 1 ) == 256 && pool.Bucket( 256 ) == 256 && pool.Bucket( 257 ) == 512, "sizes rounded up to the granularity" );
+
+		PoolKey key;
+		int first = pool.Acquire( Format, BindFlags, 2016, 2240, &key );
+		Check( key.width == 2048 && key.height == 2304 && key.format == Format && key.bindFlags == BindFlags, "allocated size reported" );
+		Check( allocator.lastKey.width == 2048 && allocator.lastKey.height == 2304, "allocated at the bucket size" );
+		Check( pool.Stats().misses == 1 && pool.Stats().hits == 0, "first request is a miss" );
+		Check( pool.Stats().bytesAllocated == 4ull * 2048 * 2304 && pool.Stats().bytesInUse == pool.Stats().bytesAllocated, "memory counted" );
+
+		int second = pool.Acquire( Format, BindFlags, 2016, 2240 );
+		Check( second != first && pool.Stats().misses == 2, "resource in use not handed out again" );
+
+		pool.Release( first );
+		Check( pool.Stats().bytesInUse == 4ull * 2048 * 2304, "released memory no longer in use" );
+		Check( pool.Acquire( Format, BindFlags, 2040, 2300 ) == first && pool.Stats().hits == 1, "same bucket served from the pool" );
+	}
+
+	void CheckLargerResources() {
+		FakeAllocator allocator;
+		ResourcePool<int> pool( &allocator );
+		PoolKey key;
+		int large = pool.Acquire( Format, BindFlags, 2048, 2048 );
+		int larger = pool.Acquire( Format, BindFlags, 2560, 2560 );
+		pool.Release( large );
+		pool.Release( larger );
+
+		// a slightly lower resolution keeps using the textures we have
+		Check( pool.Acquire( Format, BindFlags, 1800, 1800, &key ) == large, "smallest fitting free resource chosen" );
+		Check( key.width == 2048 && key.height == 2048, "size of the resource handed out reported, not the one requested" );
+		Check( pool.Acquire( Format, BindFlags, 1800, 1800, &key ) == larger && key.width == 2560, "next fitting resource reports its own size" );
+		pool.Release( large );
+		pool.Release( larger );
+
+		Check( pool.Serves( key, 1800, 1800 ), "resource within twice the memory serves" );
+		Check( !pool.Serves( key, 1024, 1024 ), "resource of more than twice the memory does not serve" );
+		Check( !pool.Serves( key, 2600, 2560 ), "smaller resource does not serve" );
+
+		uint64_t misses = pool.Stats().misses;
+		int small = pool.Acquire( Format, BindFlags, 1024, 1024, &key );
+		Check( small != large && small != larger && pool.Stats().misses == misses + 1, "much larger free resources not handed out" );
+		Check( key.width == 1024 && key.height == 1024, "smaller resource allocated" );
+
+		Check( pool.Acquire( OtherFormat, BindFlags, 2048, 2048 ) != large && pool.Stats().misses == misses + 2, "format must match" );
+		Check( pool.Acquire( Format, 0x8, 2048, 2048 ) != large && pool.Stats().misses == misses + 3, "bind flags must match" );
+	}
+
+	void CheckTrimming() {
+		FakeAllocator allocator;
+		ResourcePool<int> pool( &allocator, 256, 2 );
+		int a = pool.Acquire( Format, BindFlags, 512, 512 );
+		int b = pool.Acquire( Format, BindFlags, 512, 512 );
+		int c = pool.Acquire( Format, BindFlags, 512, 512 );
+		uint64_t bytes = 4ull * 512 * 512;
+		pool.Release( a );
+		pool.Release( b );
+		Check( pool.Stats().bytesAllocated == 3 * bytes, "free resources up to maxFree kept" );
+		pool.Release( c );
+		Check( pool.Stats().bytesAllocated == 2 * bytes, "oldest free resource destroyed beyond maxFree" );
+		int reused = pool.Acquire( Format, BindFlags, 512, 512 );
+		Check( reused == b || reused == c, "destroyed resource not handed out" );
+		Check( reused != a, "oldest free resource was the one destroyed" );
+
+		pool.Trim();
+		Check( pool.Stats().bytesAllocated == bytes && pool.Stats().bytesInUse == bytes, "trim keeps only resources in use" );
+		pool.Clear();
+		Check( pool.Stats().bytesAllocated == 0 && pool.Stats().bytesInUse == 0, "clear drops everything" );
+		Check( pool.Acquire( Format, BindFlags, 512, 512 ) == 4, "allocated again after clear" );
+	}
+
+	// the output ring keeps its textures across a resize only while the pool would still hand them out
+	void CheckResizePolicy() {
+		FakeAllocator allocator;
+		ResourcePool<int> pool( &allocator );
+		PoolKey keys[2];
+		int textures[2];
+		for (int i = 0; i < 2; ++i) {
+			textures[i] = pool.Acquire( Format, BindFlags, 2016, 2240, &keys[i] );
+		}
+		Check( pool.Serves( keys[0], 1900, 2200 ), "textures kept for a slightly smaller size" );
+		Check( !pool.Serves( keys[0], 1008, 1120 ), "textures released for half the size" );
+
+		for (int i = 0; i < 2; ++i) {
+			pool.Release( textures[i] );
+		}
+		pool.Trim();
+		PoolKey key;
+		pool.Acquire( Format, BindFlags, 1008, 1120, &key );
+		Check( key.width == 1024 && key.height == 1280, "textures for the smaller size allocated at that size" );
+	}
+}
+
+int main() {
+	CheckBuckets();
+	CheckLargerResources();
+	CheckTrimming();
+	CheckResizePolicy();
+	if (failures != 0) {
+		fprintf( stderr, "%d checks failed\n", failures );
+		return 1;
+	}
+	printf( "all checks passed\n" );
+	return 0;
+}
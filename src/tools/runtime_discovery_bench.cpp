@@ -0,0 +1,189 @@
+// Measures what a launcher polling VR_IsRuntimeInstalled or VR_GetRuntimePath pays per call: reading and parsing
+// the path registry every time, as before, against the runtime discovery cache. Both run against a stub runtime
+// directory and registry file created for the run, and the cache is checked to notice the registry file being
+// rewritten and the override variables changing, within its check interval. POSIX only, as it sets environment
+// variables with setenv and redirects stderr.
+#include "../postprocess/RuntimeDiscovery.h"
+#include <vrcommon/pathtools_public.h>
+#include <vrcommon/vrpathregistry_public.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace vr;
+
+namespace {
+	// what VR_IsRuntimeInstalled did before the cache
+	bool UncachedIsRuntimeInstalled() {
+		std::string runtimePath, configPath, logPath;
+		if (!CVRPathRegistry_Public::GetPaths( &runtimePath, &configPath, &logPath, nullptr, nullptr ))
+			return false;
+		return Path_IsDirectory( runtimePath );
+	}
+
+	bool CachedIsRuntimeInstalled() {
+		std::string runtimePath, configPath, logPath;
+		if (!RuntimeDiscovery::Instance().GetPaths( &runtimePath, &configPath, &logPath ))
+			return false;
+		return Path_IsDirectory( runtimePath );
+	}
+
+	std::string CachedRuntimePath() {
+		std::string runtimePath;
+		RuntimeDiscovery::Instance().GetPaths( &runtimePath, nullptr, nullptr );
+		return runtimePath;
+	}
+
+	bool WriteRegistry( const std::string &file, const std::string &runtimePath, const std::string &directory ) {
+		std::string contents = "{\n"
+			"\t\"jsonid\" : \"vrpathreg\",\n"
+			"\t\"version\" : 1,\n"
+			"\t\"runtime\" : [ \"" + runtimePath + "\" ],\n"
+			"\t\"config\" : [ \"" + Path_Join( directory, "config" ) + "\" ],\n"
+			"\t\"log\" : [ \"" + Path_Join( directory, "logs" ) + "\" ]\n"
+			"}\n";
+		return Path_WriteStringToTextFile( file, contents.c_str() );
+	}
+
+	double NanosecondsPerCall( bool (*isRuntimeInstalled)(), uint64_t calls, uint64_t &installed ) {
+		auto start = std::chrono::steady_clock::now();
+		for (uint64_t i = 0; i < calls; ++i) {
+			installed += isRuntimeInstalled() ? 1 : 0;
+		}
+		auto end = std::chrono::steady_clock::now();
+		return std::chrono::duration<double, std::nano>( end - start ).count() / calls;
+	}
+
+	// runs the call with stderr going to the file and returns what it wrote there, as the path registry reports
+	// load errors on stderr
+	template<typename F>
+	std::string CaptureStderr( const std::string &file, F call ) {
+		fflush( stderr );
+		int saved = dup( 2 );
+		int captured = open( file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600 );
+		if (saved < 0 || captured < 0) {
+			call();
+			return std::string();
+		}
+		dup2( captured, 2 );
+		close( captured );
+		call();
+		fflush( stderr );
+		dup2( saved, 2 );
+		close( saved );
+		std::string text = Path_ReadTextFile( file );
+		unlink( file.c_str() );
+		return text;
+	}
+
+	int failures = 0;
+
+	void Check( bool condition, const char *what ) {
+		if (!condition) {
+			fprintf( stderr, "FAIL  %s\n", what );
+			++failures;
+		}
+	}
+
+	int Usage() {
+		fprintf( stderr,
+			"usage: runtime_discovery_bench [--calls count]\n"
+			"Compares polling for the runtime with and without the discovery cache (default 20000 calls).\n" );
+		return 2;
+	}
+}
+
+int main( int argc, char **argv ) {
+	uint64_t calls = 20000;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp( argv[i], "--calls" ) == 0 && i + 1 < argc) {
+			calls = strtoull( argv[++i], nullptr, 10 );
+			if (calls == 0)
+				return Usage();
+		} else {
+			return Usage();
+		}
+	}
+
+	char directoryTemplate[] = "/tmp/runtime_discovery_XXXXXX";
+	if (mkdtemp( directoryTemplate ) == nullptr) {
+		perror( "mkdtemp" );
+		return 1;
+	}
+	std::string directory = directoryTemplate;
+	std::string runtimePath = Path_Join( directory, "runtime" );
+	std::string movedRuntimePath = Path_Join( directory, "moved_runtime" );
+	std::string registryFile = Path_Join( directory, "openvrpaths.vrpath" );
+	for (const std::string &path : { runtimePath, Path_Join( runtimePath, "bin" ), movedRuntimePath }) {
+		if (mkdir( path.c_str(), 0755 ) != 0) {
+			perror( "mkdir" );
+			return 1;
+		}
+	}
+	unsetenv( k_pchRuntimeOverrideVar );
+	unsetenv( k_pchConfigOverrideVar );
+	unsetenv( k_pchLogOverrideVar );
+	setenv( "VR_PATHREG_OVERRIDE", registryFile.c_str(), 1 );
+	if (!WriteRegistry( registryFile, runtimePath, directory )) {
+		fprintf( stderr, "could not write %s\n", registryFile.c_str() );
+		return 1;
+	}
+
+	RuntimeDiscovery &discovery = RuntimeDiscovery::Instance();
+	uint64_t installed = 0;
+	NanosecondsPerCall( UncachedIsRuntimeInstalled, calls / 10, installed );
+	NanosecondsPerCall( CachedIsRuntimeInstalled, calls / 10, installed );
+	double uncached = NanosecondsPerCall( UncachedIsRuntimeInstalled, calls, installed );
+	double cached = NanosecondsPerCall( CachedIsRuntimeInstalled, calls, installed );
+	discovery.SetCheckInterval( std::chrono::milliseconds( 0 ) );
+	double checked = NanosecondsPerCall( CachedIsRuntimeInstalled, calls, installed );
+	Check( installed == 3 * calls + 2 * (calls / 10), "runtime found on every call" );
+	Check( discovery.ReadCount() == 1, "registry read once while nothing changed" );
+
+	// a change is only looked for once the interval has passed
+	discovery.SetCheckInterval( std::chrono::milliseconds( 100 ) );
+	CachedRuntimePath();
+	WriteRegistry( registryFile, movedRuntimePath, directory );
+	Check( CachedRuntimePath() == runtimePath, "registry not looked at again within the interval" );
+	std::this_thread::sleep_for( std::chrono::milliseconds( 150 ) );
+	Check( CachedRuntimePath() == movedRuntimePath, "rewritten registry noticed after the interval" );
+	WriteRegistry( registryFile, runtimePath, directory );
+	discovery.Invalidate();
+	Check( CachedRuntimePath() == runtimePath, "invalidation looks at the registry right away" );
+
+	// another registry contents, as when the runtime is moved
+	discovery.SetCheckInterval( std::chrono::milliseconds( 0 ) );
+	Check( WriteRegistry( registryFile, movedRuntimePath, directory ) && CachedRuntimePath() == movedRuntimePath, "rewritten registry noticed" );
+	setenv( k_pchRuntimeOverrideVar, runtimePath.c_str(), 1 );
+	Check( CachedRuntimePath() == runtimePath, "runtime override noticed" );
+	unsetenv( k_pchRuntimeOverrideVar );
+	Check( CachedRuntimePath() == movedRuntimePath, "runtime override removal noticed" );
+	uint64_t reads = discovery.ReadCount();
+	discovery.Invalidate();
+	Check( CachedRuntimePath() == movedRuntimePath && discovery.ReadCount() == reads + 1, "registry read again once invalidated" );
+	unlink( registryFile.c_str() );
+	bool removedInstalled = true;
+	std::string error = CaptureStderr( Path_Join( directory, "stderr.txt" ), [&]() { removedInstalled = CachedIsRuntimeInstalled(); } );
+	Check( !removedInstalled, "removed registry noticed" );
+	Check( error == "Unable to read VR Path Registry from " + registryFile + "\n", "removed registry reported" );
+
+	for (const char *name : { "moved_runtime", "runtime/bin", "runtime", "" }) {
+		rmdir( Path_Join( directory, name ).c_str() );
+	}
+
+	printf( "uncached   %.0f ns/call\n", uncached );
+	printf( "cached     %.0f ns/call\n", cached );
+	printf( "cached, checking for changes on every call  %.0f ns/call\n", checked );
+	printf( "%llu registry reads\n", (unsigned long long)discovery.ReadCount() );
+	if (failures != 0) {
+		fprintf( stderr, "%d checks failed\n", failures );
+		return 1;
+	}
+	return 0;
+}
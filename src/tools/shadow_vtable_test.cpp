@@ -0,0 +1,218 @@
+// Checks shadow vtables on mock objects: a hook replacing a method of one object and not of others of its class,
+// the original methods found through the hooked object, hooks restored per object and unhooked all at once, and
+// a table reused for a new object created at the address of a destroyed one, also when the new object has more
+// methods. Then checks that a thread calling through an object always reaches a valid method while the object
+// is hooked and restored, and while its table is reused.
+#include "../postprocess/ShadowVtable.h"
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#ifdef _MSC_VER
+#define NOINLINE __declspec(noinline)
+#else
+#define NOINLINE __attribute__((noinline))
+#endif
+
+using namespace vr;
+
+namespace {
+	int failures = 0;
+
+	void Check( bool condition, const char *what ) {
+		if (!condition) {
+			fprintf( stderr, "FAIL  %s\n", what );
+			++failures;
+		}
+	}
+
+	struct Object;
+	typedef uint32_t (*Method)( Object *self, uint32_t value );
+
+	// laid out like a C++ object with a vtable
+	struct Object {
+		std::atomic<void**> vtable;
+
+		uint32_t Call( uint32_t methodPos, uint32_t value ) {
+			return ((Method)vtable.load()[methodPos])( this, value );
+		}
+	};
+
+	template<uint32_t Offset>
+	NOINLINE uint32_t Add( Object *, uint32_t value ) { return value + Offset; }
+
+	template<uint32_t Offset>
+	NOINLINE uint32_t Hooked( Object *, uint32_t value ) { return value + 1000 + Offset; }
+
+	// a class's vtable, with the entries the ABI keeps before it
+	template<size_t MethodCount>
+	struct Vtable {
+		void *entries[ShadowVtables::PREFIX_ENTRIES + MethodCount];
+
+		explicit Vtable( uint32_t offset ) {
+			entries[0] = (void*)(uintptr_t)(0x7f00 + offset);
+			entries[1] = (void*)(uintptr_t)(0x7e00 + offset);
+			static const Method methods[] = { Add<0>, Add<1>, Add<2>, Add<3>, Add<4>, Add<5>, Add<6>, Add<7> };
+			for (size_t i = 0; i < MethodCount; ++i) {
+				entries[ShadowVtables::PREFIX_ENTRIES + i] = (void*)methods[(offset + i) % 8];
+			}
+		}
+
+		void ** Methods() {
+			return entries + ShadowVtables::PREFIX_ENTRIES;
+		}
+	};
+
+	// The tables are kept for as long as the program runs and hold on to the vtables they were made from, so every
+	// check has objects at addresses of its own and vtables that outlive it.
+	Object hookedObject, otherObject, reusedObject, calledObject;
+
+	void CheckHooks() {
+		ShadowVtables &vtables = ShadowVtables::Instance();
+		const size_t tables = vtables.Count();
+		static Vtable<4> classVtable( 0 );
+		Object &object = hookedObject, &other = otherObject;
+		object.vtable = classVtable.Methods();
+		other.vtable = classVtable.Methods();
+
+		Check( !vtables.IsShadowed( &object ) && vtables.Original( &object, 2 ) == (void*)Add<2>, "unhooked object's methods are its own" );
+		Check( vtables.Hook( &object, 4, 4, (void*)Hooked<4> ) == nullptr && vtables.Count() == tables, "method out of range not hooked" );
+		Check( vtables.Hook( &object, 4, 1, (void*)Hooked<1> ) == (void*)Add<1>, "hook returns the replaced method" );
+		Check( vtables.IsShadowed( &object ) && vtables.Count() == tables + 1, "object shadowed" );
+		Check( object.vtable.load() != classVtable.Methods(), "object points at its own copy of the vtable" );
+		Check( object.Call( 1, 5 ) == 1006 && object.Call( 2, 5 ) == 7, "hooked method replaced, others kept" );
+		Check( other.Call( 1, 5 ) == 6 && !vtables.IsShadowed( &other ), "other objects of the class left alone" );
+		Check( classVtable.Methods()[1] == (void*)Add<1>, "class vtable left alone" );
+		Check( object.vtable.load()[-1] == classVtable.entries[1] && object.vtable.load()[-2] == classVtable.entries[0], "type information copied" );
+
+		Check( vtables.Hook( &object, 4, 3, (void*)Hooked<3> ) == (void*)Add<3> && vtables.Count() == tables + 1, "second hook uses the same table" );
+		Check( vtables.Hook( &object, 8, 5, (void*)Hooked<5> ) == nullptr, "hooked object keeps its method count" );
+		Check( object.Call( 1, 5 ) == 1006 && object.Call( 3, 5 ) == 1008, "both hooks called" );
+		Check( vtables.Original( &object, 1 ) == (void*)Add<1> && vtables.Original( &object, 3 ) == (void*)Add<3>, "originals found through the hooked object" );
+		Check( vtables.Hook( &object, 4, 1, (void*)Hooked<2> ) == (void*)Add<1> && object.Call( 1, 5 ) == 1007, "hook replaced, original kept" );
+
+		vtables.Restore( &object );
+		Check( object.vtable.load() == classVtable.Methods() && !vtables.IsShadowed( &object ), "restored object points at the class vtable" );
+		Check( object.Call( 1, 5 ) == 6 && object.Call( 3, 5 ) == 8, "restored object calls its own methods" );
+		vtables.Restore( &other );
+		Check( other.vtable.load() == classVtable.Methods(), "restoring an unhooked object does nothing" );
+
+		// hooked again after a restore, with the table the object had
+		Check( vtables.Hook( &object, 4, 0, (void*)Hooked<0> ) == (void*)Add<0> && vtables.Count() == tables + 1, "restored object hooked again" );
+		Check( object.Call( 0, 5 ) == 1005 && object.Call( 1, 5 ) == 6, "only the new hook installed" );
+
+		Check( vtables.Hook( &other, 4, 2, (void*)Hooked<2> ) == (void*)Add<2> && vtables.Count() == tables + 2, "second object gets its own table" );
+		void **shadow = object.vtable.load();
+		vtables.UnhookAll();
+		Check( object.vtable.load() == shadow, "objects not touched when unhooking all" );
+		Check( object.Call( 0, 5 ) == 5 && other.Call( 2, 5 ) == 7, "objects still using a table call the originals" );
+	}
+
+	void CheckReuse() {
+		ShadowVtables &vtables = ShadowVtables::Instance();
+		const size_t tables = vtables.Count();
+		static Vtable<4> firstClass( 0 );
+		static Vtable<4> secondClass( 4 );
+		static Vtable<8> largerClass( 2 );
+		Object &object = reusedObject;
+		object.vtable = firstClass.Methods();
+		vtables.Hook( &object, 4, 0, (void*)Hooked<0> );
+		void **firstShadow = object.vtable.load();
+
+		// the object is destroyed and another one of a different class created at its address
+		object.vtable = secondClass.Methods();
+		Check( !vtables.IsShadowed( &object ), "new object at the address not shadowed" );
+		Check( vtables.Original( &object, 0 ) == (void*)Add<4>, "new object's methods are its own" );
+		Check( vtables.Hook( &object, 4, 1, (void*)Hooked<1> ) == (void*)Add<5> && vtables.Count() == tables + 1, "table reused for the new object" );
+		Check( object.vtable.load() == firstShadow, "entries reused when they fit" );
+		Check( object.Call( 0, 5 ) == 9 && object.Call( 1, 5 ) == 1006, "reused table holds the new object's methods and hook" );
+		Check( vtables.Original( &object, 1 ) == (void*)Add<5>, "original of the new object found" );
+
+		// a new object with more methods than the table holds
+		object.vtable = largerClass.Methods();
+		Check( vtables.Hook( &object, 8, 7, (void*)Hooked<7> ) == (void*)Add<1> && vtables.Count() == tables + 1, "table grown for a larger object" );
+		Check( object.vtable.load() != firstShadow && object.Call( 7, 5 ) == 1012 && object.Call( 6, 5 ) == 5, "grown table holds the new object's methods" );
+		// a thread that loaded the old entries before they were outgrown still calls through them
+		Check( ((Method)firstShadow[1])( &object, 5 ) == 1006, "outgrown entries kept" );
+		vtables.Restore( &object );
+		Check( object.vtable.load() == largerClass.Methods(), "grown table restored" );
+	}
+
+	// keeps calling through the object, counting calls that did not reach one of the expected methods
+	void CheckConcurrentCalls( int rounds ) {
+		ShadowVtables &vtables = ShadowVtables::Instance();
+		const size_t tables = vtables.Count();
+		static Vtable<4> firstClass( 0 );
+		static Vtable<8> largerClass( 0 );
+		Object &object = calledObject;
+		object.vtable = firstClass.Methods();
+		std::atomic<bool> stop { false };
+		std::atomic<uint64_t> calls { 0 }, wrong { 0 };
+		std::thread caller( [&]() {
+			while (!stop.load( std::memory_order_relaxed )) {
+				uint32_t result = object.Call( 1, 5 );
+				if (result != 6 && result != 1006)
+					wrong.fetch_add( 1, std::memory_order_relaxed );
+				calls.fetch_add( 1, std::memory_order_relaxed );
+			}
+		} );
+		while (calls.load() == 0) {
+			std::this_thread::yield();
+		}
+		size_t methodCount = 4;
+		for (int i = 0; i < rounds; ++i) {
+			vtables.Hook( &object, methodCount, 1, (void*)Hooked<1> );
+			vtables.Restore( &object );
+			// replaced by an object of the other class, which has the same method; the first hook of the larger one grows the table
+			bool larger = i % 2 == 0;
+			object.vtable = larger ? largerClass.Methods() : firstClass.Methods();
+			methodCount = larger ? 8 : 4;
+		}
+		vtables.Hook( &object, methodCount, 1, (void*)Hooked<1> );
+		vtables.UnhookAll();
+		uint64_t before = calls.load();
+		while (calls.load() < before + 1000) {
+			std::this_thread::yield();
+		}
+		stop = true;
+		caller.join();
+		Check( wrong == 0, "calls during hooking reached the original or the hook" );
+		Check( vtables.Count() == tables + 1, "one table for the address" );
+		printf( "%d rounds during %llu calls on the other thread\n", rounds, (unsigned long long)calls.load() );
+	}
+
+	int Usage() {
+		fprintf( stderr,
+			"usage: shadow_vtable_test [--rounds count]\n"
+			"Checks shadow vtables on mock objects, with an object hooked and restored while another thread calls\n"
+			"through it (default 100000 rounds).\n" );
+		return 2;
+	}
+}
+
+int main( int argc, char **argv ) {
+	int rounds = 100000;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp( argv[i], "--rounds" ) == 0 && i + 1 < argc) {
+			rounds = atoi( argv[++i] );
+			if (rounds <= 0)
+				return Usage();
+		} else {
+			return Usage();
+		}
+	}
+
+	CheckHooks();
+	CheckReuse();
+	CheckConcurrentCalls( rounds );
+
+	if (failures != 0) {
+		fprintf( stderr, "%d checks failed\n", failures );
+		return 1;
+	}
+	printf( "all checks passed\n" );
+	return 0;
+}
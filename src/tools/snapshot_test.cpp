@@ -0,0 +1,196 @@
+// Checks the config snapshot publisher: generations, Refresh only replacing stale snapshots, and snapshots kept
+// alive by their readers. Then has threads publishing while others refresh and read, checking that no reader ever
+// sees a value half written, that generations never go back, and that every snapshot is freed in the end. Finally
+// measures Refresh on an unchanged snapshot, which every pass does per frame, against taking the current one.
+#include "../postprocess/Snapshot.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+using namespace vr;
+
+namespace {
+	std::atomic<int> liveSettings { 0 };
+
+	// fields that must always be seen together, like the radii and sharpness a pass reads
+	struct Settings {
+		uint64_t number = 0;
+		float radius = 0;
+		uint64_t table[16] = {};
+
+		Settings() { ++liveSettings; }
+		Settings( const Settings &other ) : number( other.number ), radius( other.radius ) {
+			memcpy( table, other.table, sizeof(table) );
+			++liveSettings;
+		}
+		~Settings() { --liveSettings; }
+
+		static Settings Make( uint64_t number ) {
+			Settings settings;
+			settings.number = number;
+			settings.radius = float(number) * .5f;
+			for (uint64_t &entry : settings.table)
+				entry = ~number;
+			return settings;
+		}
+
+		bool IsConsistent() const {
+			if (radius != float(number) * .5f)
+				return false;
+			for (uint64_t entry : table) {
+				if (entry != ~number)
+					return false;
+			}
+			return true;
+		}
+	};
+
+	typedef SnapshotPublisher<Settings> Publisher;
+
+	int failures = 0;
+
+	void Check( bool condition, const char *what ) {
+		if (!condition) {
+			fprintf( stderr, "FAIL  %s\n", what );
+			++failures;
+		}
+	}
+
+	void CheckPublishing() {
+		{
+			Publisher publisher( Settings::Make( 1 ) );
+			Check( publisher.Generation() == 1 && publisher.Current()->value.number == 1, "initial value published" );
+
+			Publisher::Ptr held;
+			Check( publisher.Refresh( held ) && held->generation == 1, "empty snapshot refreshed" );
+			Check( !publisher.Refresh( held ), "current snapshot kept" );
+
+			Check( publisher.Publish( Settings::Make( 2 ) ) == 2 && publisher.Generation() == 2, "generation increases" );
+			Check( held->value.number == 1, "held snapshot unchanged by a publish" );
+			Publisher::Ptr old = held;
+			Check( publisher.Refresh( held ) && held->value.number == 2 && held->generation == 2, "stale snapshot refreshed" );
+			Check( old->value.number == 1 && old->value.IsConsistent(), "replaced snapshot alive while held" );
+			old.reset();
+			publisher.Publish( Settings::Make( 3 ) );
+			held.reset();
+			Check( liveSettings == 1, "snapshots freed with their last reader" );
+		}
+		Check( liveSettings == 0, "current snapshot freed with the publisher" );
+	}
+
+	void CheckConcurrentReaders( int writers, int readers, uint64_t publishes ) {
+		{
+			Publisher publisher( Settings::Make( 0 ) );
+			std::atomic<int> writing { writers };
+			std::atomic<int> torn { 0 };
+			std::atomic<int> backwards { 0 };
+			std::atomic<uint64_t> refreshes { 0 };
+			std::vector<std::thread> threads;
+			for (int w = 0; w < writers; ++w) {
+				threads.emplace_back( [&, w]() {
+					for (uint64_t i = 0; i < publishes; ++i) {
+						publisher.Publish( Settings::Make( i * writers + w + 1 ) );
+					}
+					--writing;
+				} );
+			}
+			for (int r = 0; r < readers; ++r) {
+				threads.emplace_back( [&]() {
+					// like a frame's passes: one refresh, then several reads of the same snapshot
+					Publisher::Ptr snapshot;
+					uint64_t lastGeneration = 0;
+					uint64_t count = 0;
+					do {
+						if (publisher.Refresh( snapshot ))
+							++count;
+						if (snapshot->generation < lastGeneration)
+							++backwards;
+						lastGeneration = snapshot->generation;
+						for (int pass = 0; pass < 3; ++pass) {
+							if (!snapshot->value.IsConsistent())
+								++torn;
+						}
+					} while (writing.load() > 0);
+					refreshes += count;
+				} );
+			}
+			for (std::thread &thread : threads) {
+				thread.join();
+			}
+			Check( torn == 0, "no value seen half written" );
+			Check( backwards == 0, "generations never go back" );
+			Check( refreshes > 0, "readers saw new snapshots" );
+			Check( publisher.Generation() == 1 + uint64_t(writers) * publishes && publisher.Current()->generation == publisher.Generation(), "every publish counted" );
+			Check( liveSettings == 1, "only the current snapshot left" );
+		}
+		Check( liveSettings == 0, "all snapshots freed" );
+	}
+
+	// keeps the reads from being optimized away
+	volatile uint64_t sink;
+
+	void Benchmark( uint64_t frames ) {
+		Publisher publisher( Settings::Make( 1 ) );
+		Publisher::Ptr snapshot;
+		uint64_t sum = 0;
+		auto start = std::chrono::steady_clock::now();
+		for (uint64_t i = 0; i < frames; ++i) {
+			publisher.Refresh( snapshot );
+			sum += snapshot->value.number;
+		}
+		double refreshed = std::chrono::duration<double, std::nano>( std::chrono::steady_clock::now() - start ).count() / frames;
+		start = std::chrono::steady_clock::now();
+		for (uint64_t i = 0; i < frames; ++i) {
+			snapshot = publisher.Current();
+			sum += snapshot->value.number;
+		}
+		double taken = std::chrono::duration<double, std::nano>( std::chrono::steady_clock::now() - start ).count() / frames;
+		sink = sum;
+		printf( "refresh unchanged snapshot  %8.2f ns\n", refreshed );
+		printf( "take current snapshot       %8.2f ns\n", taken );
+	}
+
+	int Usage() {
+		fprintf( stderr,
+			"usage: snapshot_test [--writers count] [--readers count] [--publishes count]\n"
+			"Checks the snapshot publisher with threads publishing and reading (default 2 writers publishing\n"
+			"20000 values each, 3 readers), then measures refreshing a snapshot against taking the current one.\n" );
+		return 2;
+	}
+}
+
+int main( int argc, char **argv ) {
+	int writers = 2, readers = 3;
+	uint64_t publishes = 20000;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp( argv[i], "--writers" ) == 0 && i + 1 < argc) {
+			writers = atoi( argv[++i] );
+			if (writers <= 0)
+				return Usage();
+		} else if (strcmp( argv[i], "--readers" ) == 0 && i + 1 < argc) {
+			readers = atoi( argv[++i] );
+			if (readers <= 0)
+				return Usage();
+		} else if (strcmp( argv[i], "--publishes" ) == 0 && i + 1 < argc) {
+			publishes = strtoull( argv[++i], nullptr, 10 );
+			if (publishes == 0)
+				return Usage();
+		} else {
+			return Usage();
+		}
+	}
+
+	CheckPublishing();
+	CheckConcurrentReaders( writers, readers, publishes );
+	Benchmark( 2000000 );
+
+	if (failures != 0) {
+		fprintf( stderr, "%d checks failed\n", failures );
+		return 1;
+	}
+	printf( "all checks passed\n" );
+	return 0;
+}
@@ -0,0 +1,289 @@
+// A stand-in for SteamVR's vrclient, so that the mod can be initialized and fed frames without SteamVR: it
+// exports VRClientCoreFactory and hands out an IVRSystem and an IVRCompositor that only report a configurable
+// headset and take a configurable time to initialize, wait for poses and accept submitted frames. Whatever the
+// mod and the benchmark do not need returns nothing. All interface versions are served by the ones in
+// headers/openvr.h, so only applications built against those should be run with it.
+//
+// Configured through environment variables, read when the runtime is loaded:
+//   STUB_VRCLIENT_RENDER_SIZE       recommended render target size per eye, e.g. 2016x2240
+//   STUB_VRCLIENT_PROJECTION        raw projection of the left eye as left,right,top,bottom
+//   STUB_VRCLIENT_IPD               distance between the eyes in meters
+//   STUB_VRCLIENT_HMD_PRESENT       0 to report no headset
+//   STUB_VRCLIENT_INIT_LATENCY_US   time Init takes
+//   STUB_VRCLIENT_WAIT_LATENCY_US   time WaitGetPoses takes
+//   STUB_VRCLIENT_SUBMIT_LATENCY_US time Submit takes
+#include "openvr.h"
+#include "ivrclientcore.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#if defined(_WIN32)
+#define STUB_EXPORT extern "C" __declspec(dllexport)
+#else
+#define STUB_EXPORT extern "C" __attribute__((visibility("default")))
+#endif
+
+using namespace vr;
+
+namespace {
+	struct Settings {
+		uint32_t renderWidth = 2016;
+		uint32_t renderHeight = 2240;
+		float projectionLeft = -1.39f;
+		float projectionRight = 1.24f;
+		float projectionTop = -1.47f;
+		float projectionBottom = 1.45f;
+		float ipd = 0.064f;
+		bool hmdPresent = true;
+		std::chrono::microseconds initLatency { 0 };
+		std::chrono::microseconds waitLatency { 0 };
+		std::chrono::microseconds submitLatency { 0 };
+
+		void Read() {
+			if (const char *value = getenv( "STUB_VRCLIENT_RENDER_SIZE" ))
+				sscanf( value, "%ux%u", &renderWidth, &renderHeight );
+			if (const char *value = getenv( "STUB_VRCLIENT_PROJECTION" ))
+				sscanf( value, "%f,%f,%f,%f", &projectionLeft, &projectionRight, &projectionTop, &projectionBottom );
+			if (const char *value = getenv( "STUB_VRCLIENT_IPD" ))
+				ipd = float(atof( value ));
+			if (const char *value = getenv( "STUB_VRCLIENT_HMD_PRESENT" ))
+				hmdPresent = atoi( value ) != 0;
+			ReadMicroseconds( "STUB_VRCLIENT_INIT_LATENCY_US", initLatency );
+			ReadMicroseconds( "STUB_VRCLIENT_WAIT_LATENCY_US", waitLatency );
+			ReadMicroseconds( "STUB_VRCLIENT_SUBMIT_LATENCY_US", submitLatency );
+		}
+
+		static void ReadMicroseconds( const char *name, std::chrono::microseconds &latency ) {
+			if (const char *value = getenv( name ))
+				latency = std::chrono::microseconds( strtoll( value, nullptr, 10 ) );
+		}
+	};
+
+	Settings settings;
+
+	// spins for short waits, as sleeping would overshoot them by far
+	void Wait( std::chrono::microseconds latency ) {
+		if (latency.count() <= 0)
+			return;
+		if (latency > std::chrono::milliseconds( 2 )) {
+			std::this_thread::sleep_for( latency );
+			return;
+		}
+		auto end = std::chrono::steady_clock::now() + latency;
+		while (std::chrono::steady_clock::now() < end) {
+		}
+	}
+
+	// everything at the origin, with only the headset connected
+	void FillPoses( TrackedDevicePose_t *poses, uint32_t count ) {
+		for (uint32_t i = 0; i < count && poses != nullptr; ++i) {
+			poses[i] = TrackedDevicePose_t();
+			poses[i].mDeviceToAbsoluteTracking.m[0][0] = 1.0f;
+			poses[i].mDeviceToAbsoluteTracking.m[1][1] = 1.0f;
+			poses[i].mDeviceToAbsoluteTracking.m[2][2] = 1.0f;
+			poses[i].eTrackingResult = i == k_unTrackedDeviceIndex_Hmd ? TrackingResult_Running_OK : TrackingResult_Uninitialized;
+			poses[i].bPoseIsValid = i == k_unTrackedDeviceIndex_Hmd;
+			poses[i].bDeviceIsConnected = i == k_unTrackedDeviceIndex_Hmd;
+		}
+	}
+
+	class StubSystem : public IVRSystem {
+	public:
+		void GetRecommendedRenderTargetSize( uint32_t *pnWidth, uint32_t *pnHeight ) override {
+			*pnWidth = settings.renderWidth;
+			*pnHeight = settings.renderHeight;
+		}
+		HmdMatrix44_t GetProjectionMatrix( EVREye eEye, float fNearZ, float fFarZ ) override {
+			float left, right, top, bottom;
+			GetProjectionRaw( eEye, &left, &right, &top, &bottom );
+			// as the OpenVR documentation builds it from the raw values
+			float idx = 1.0f / (right - left), idy = 1.0f / (bottom - top), idz = 1.0f / (fFarZ - fNearZ);
+			float sx = right + left, sy = bottom + top;
+			HmdMatrix44_t m = {};
+			m.m[0][0] = 2 * idx; m.m[0][2] = sx * idx;
+			m.m[1][1] = 2 * idy; m.m[1][2] = sy * idy;
+			m.m[2][2] = -fFarZ * idz; m.m[2][3] = -fFarZ * fNearZ * idz;
+			m.m[3][2] = -1.0f;
+			return m;
+		}
+		void GetProjectionRaw( EVREye eEye, float *pfLeft, float *pfRight, float *pfTop, float *pfBottom ) override {
+			// the right eye mirrors the left one
+			*pfLeft = eEye == Eye_Left ? settings.projectionLeft : -settings.projectionRight;
+			*pfRight = eEye == Eye_Left ? settings.projectionRight : -settings.projectionLeft;
+			*pfTop = settings.projectionTop;
+			*pfBottom = settings.projectionBottom;
+		}
+		bool ComputeDistortion( EVREye /*eEye*/, float /*fU*/, float /*fV*/, DistortionCoordinates_t * /*pDistortionCoordinates*/ ) override { return {}; }
+		HmdMatrix34_t GetEyeToHeadTransform( EVREye eEye ) override {
+			HmdMatrix34_t m = {};
+			m.m[0][0] = m.m[1][1] = m.m[2][2] = 1.0f;
+			m.m[0][3] = (eEye == Eye_Left ? -0.5f : 0.5f) * settings.ipd;
+			return m;
+		}
+		bool GetTimeSinceLastVsync( float * /*pfSecondsSinceLastVsync*/, uint64_t * /*pulFrameCounter*/ ) override { return {}; }
+		int32_t GetD3D9AdapterIndex() override { return {}; }
+		void GetDXGIOutputInfo( int32_t * /*pnAdapterIndex*/ ) override {}
+		void GetOutputDevice( uint64_t * /*pnDevice*/, ETextureType /*textureType*/, VkInstance_T * /*pInstance*/ ) override {}
+		bool IsDisplayOnDesktop() override { return {}; }
+		bool SetDisplayVisibility( bool /*bIsVisibleOnDesktop*/ ) override { return {}; }
+		void GetDeviceToAbsoluteTrackingPose( ETrackingUniverseOrigin /*eOrigin*/, float /*fPredictedSecondsToPhotonsFromNow*/, TrackedDevicePose_t * /*pTrackedDevicePoseArray*/, uint32_t /*unTrackedDevicePoseArrayCount*/ ) override {}
+		HmdMatrix34_t GetSeatedZeroPoseToStandingAbsoluteTrackingPose() override { return {}; }
+		HmdMatrix34_t GetRawZeroPoseToStandingAbsoluteTrackingPose() override { return {}; }
+		uint32_t GetSortedTrackedDeviceIndicesOfClass( ETrackedDeviceClass /*eTrackedDeviceClass*/, vr::TrackedDeviceIndex_t * /*punTrackedDeviceIndexArray*/, uint32_t /*unTrackedDeviceIndexArrayCount*/, vr::TrackedDeviceIndex_t /*unRelativeToTrackedDeviceIndex*/ ) override { return {}; }
+		EDeviceActivityLevel GetTrackedDeviceActivityLevel( vr::TrackedDeviceIndex_t /*unDeviceId*/ ) override { return {}; }
+		void ApplyTransform( TrackedDevicePose_t * /*pOutputPose*/, const TrackedDevicePose_t * /*pTrackedDevicePose*/, const HmdMatrix34_t * /*pTransform*/ ) override {}
+		vr::TrackedDeviceIndex_t GetTrackedDeviceIndexForControllerRole( vr::ETrackedControllerRole /*unDeviceType*/ ) override { return {}; }
+		vr::ETrackedControllerRole GetControllerRoleForTrackedDeviceIndex( vr::TrackedDeviceIndex_t /*unDeviceIndex*/ ) override { return {}; }
+		ETrackedDeviceClass GetTrackedDeviceClass( vr::TrackedDeviceIndex_t /*unDeviceIndex*/ ) override { return {}; }
+		bool IsTrackedDeviceConnected( vr::TrackedDeviceIndex_t /*unDeviceIndex*/ ) override { return {}; }
+		bool GetBoolTrackedDeviceProperty( vr::TrackedDeviceIndex_t /*unDeviceIndex*/, ETrackedDeviceProperty /*prop*/, ETrackedPropertyError * /*pError*/ ) override { return {}; }
+		float GetFloatTrackedDeviceProperty( vr::TrackedDeviceIndex_t /*unDeviceIndex*/, ETrackedDeviceProperty /*prop*/, ETrackedPropertyError * /*pError*/ ) override { return {}; }
+		int32_t GetInt32TrackedDeviceProperty( vr::TrackedDeviceIndex_t /*unDeviceIndex*/, ETrackedDeviceProperty /*prop*/, ETrackedPropertyError * /*pError*/ ) override { return {}; }
+		uint64_t GetUint64TrackedDeviceProperty( vr::TrackedDeviceIndex_t /*unDeviceIndex*/, ETrackedDeviceProperty /*prop*/, ETrackedPropertyError * /*pError*/ ) override { return {}; }
+		HmdMatrix34_t GetMatrix34TrackedDeviceProperty( vr::TrackedDeviceIndex_t /*unDeviceIndex*/, ETrackedDeviceProperty /*prop*/, ETrackedPropertyError * /*pError*/ ) override { return {}; }
+		uint32_t GetArrayTrackedDeviceProperty( vr::TrackedDeviceIndex_t /*unDeviceIndex*/, ETrackedDeviceProperty /*prop*/, PropertyTypeTag_t /*propType*/, void * /*pBuffer*/, uint32_t /*unBufferSize*/, ETrackedPropertyError * /*pError*/ ) override { return {}; }
+		uint32_t GetStringTrackedDeviceProperty( vr::TrackedDeviceIndex_t /*unDeviceIndex*/, ETrackedDeviceProperty /*prop*/, char * /*pchValue*/, uint32_t /*unBufferSize*/, ETrackedPropertyError * /*pError*/ ) override { return {}; }
+		const char * GetPropErrorNameFromEnum( ETrackedPropertyError /*error*/ ) override { return {}; }
+		bool PollNextEvent( VREvent_t * /*pEvent*/, uint32_t /*uncbVREvent*/ ) override { return {}; }
+		bool PollNextEventWithPose( ETrackingUniverseOrigin /*eOrigin*/, VREvent_t * /*pEvent*/, uint32_t /*uncbVREvent*/, vr::TrackedDevicePose_t * /*pTrackedDevicePose*/ ) override { return {}; }
+		const char * GetEventTypeNameFromEnum( EVREventType /*eType*/ ) override { return {}; }
+		HiddenAreaMesh_t GetHiddenAreaMesh( EVREye /*eEye*/, EHiddenAreaMeshType /*type*/ ) override { return {}; }
+		bool GetControllerState( vr::TrackedDeviceIndex_t /*unControllerDeviceIndex*/, vr::VRControllerState_t * /*pControllerState*/, uint32_t /*unControllerStateSize*/ ) override { return {}; }
+		bool GetControllerStateWithPose( ETrackingUniverseOrigin /*eOrigin*/, vr::TrackedDeviceIndex_t /*unControllerDeviceIndex*/, vr::VRControllerState_t * /*pControllerState*/, uint32_t /*unControllerStateSize*/, TrackedDevicePose_t * /*pTrackedDevicePose*/ ) override { return {}; }
+		void TriggerHapticPulse( vr::TrackedDeviceIndex_t /*unControllerDeviceIndex*/, uint32_t /*unAxisId*/, unsigned short /*usDurationMicroSec*/ ) override {}
+		const char * GetButtonIdNameFromEnum( EVRButtonId /*eButtonId*/ ) override { return {}; }
+		const char * GetControllerAxisTypeNameFromEnum( EVRControllerAxisType /*eAxisType*/ ) override { return {}; }
+		bool IsInputAvailable() override { return {}; }
+		bool IsSteamVRDrawingControllers() override { return {}; }
+		bool ShouldApplicationPause() override { return {}; }
+		bool ShouldApplicationReduceRenderingWork() override { return {}; }
+		vr::EVRFirmwareError PerformFirmwareUpdate( vr::TrackedDeviceIndex_t /*unDeviceIndex*/ ) override { return {}; }
+		void AcknowledgeQuit_Exiting() override {}
+		uint32_t GetAppContainerFilePaths( char * /*pchBuffer*/, uint32_t /*unBufferSize*/ ) override { return {}; }
+		const char * GetRuntimeVersion() override { return "stub"; }
+	};
+
+	class StubCompositor : public IVRCompositor {
+	public:
+		void SetTrackingSpace( ETrackingUniverseOrigin /*eOrigin*/ ) override {}
+		ETrackingUniverseOrigin GetTrackingSpace() override { return TrackingUniverseStanding; }
+		EVRCompositorError WaitGetPoses( TrackedDevicePose_t *pRenderPoseArray, uint32_t unRenderPoseArrayCount, TrackedDevicePose_t *pGamePoseArray, uint32_t unGamePoseArrayCount ) override {
+			Wait( settings.waitLatency );
+			FillPoses( pRenderPoseArray, unRenderPoseArrayCount );
+			FillPoses( pGamePoseArray, unGamePoseArrayCount );
+			return VRCompositorError_None;
+		}
+		EVRCompositorError GetLastPoses( TrackedDevicePose_t *pRenderPoseArray, uint32_t unRenderPoseArrayCount, TrackedDevicePose_t *pGamePoseArray, uint32_t unGamePoseArrayCount ) override {
+			FillPoses( pRenderPoseArray, unRenderPoseArrayCount );
+			FillPoses( pGamePoseArray, unGamePoseArrayCount );
+			return VRCompositorError_None;
+		}
+		EVRCompositorError GetLastPoseForTrackedDeviceIndex( TrackedDeviceIndex_t /*unDeviceIndex*/, TrackedDevicePose_t * /*pOutputPose*/, TrackedDevicePose_t * /*pOutputGamePose*/ ) override { return {}; }
+		EVRCompositorError Submit( EVREye /*eEye*/, const Texture_t *pTexture, const VRTextureBounds_t * /*pBounds*/, EVRSubmitFlags /*nSubmitFlags*/ ) override {
+			Wait( settings.submitLatency );
+			return pTexture != nullptr ? VRCompositorError_None : VRCompositorError_InvalidTexture;
+		}
+		void ClearLastSubmittedFrame() override {}
+		void PostPresentHandoff() override {}
+		bool GetFrameTiming( Compositor_FrameTiming * /*pTiming*/, uint32_t /*unFramesAgo*/ ) override { return {}; }
+		uint32_t GetFrameTimings( Compositor_FrameTiming * /*pTiming*/, uint32_t /*nFrames*/ ) override { return {}; }
+		float GetFrameTimeRemaining() override { return {}; }
+		void GetCumulativeStats( Compositor_CumulativeStats * /*pStats*/, uint32_t /*nStatsSizeInBytes*/ ) override {}
+		void FadeToColor( float /*fSeconds*/, float /*fRed*/, float /*fGreen*/, float /*fBlue*/, float /*fAlpha*/, bool /*bBackground*/ ) override {}
+		HmdColor_t GetCurrentFadeColor( bool /*bBackground*/ ) override { return {}; }
+		void FadeGrid( float /*fSeconds*/, bool /*bFadeGridIn*/ ) override {}
+		float GetCurrentGridAlpha() override { return {}; }
+		EVRCompositorError SetSkyboxOverride( const Texture_t * /*pTextures*/, uint32_t /*unTextureCount*/ ) override { return {}; }
+		void ClearSkyboxOverride() override {}
+		void CompositorBringToFront() override {}
+		void CompositorGoToBack() override {}
+		void CompositorQuit() override {}
+		bool IsFullscreen() override { return {}; }
+		uint32_t GetCurrentSceneFocusProcess() override { return {}; }
+		uint32_t GetLastFrameRenderer() override { return {}; }
+		bool CanRenderScene() override { return true; }
+		void ShowMirrorWindow() override {}
+		void HideMirrorWindow() override {}
+		bool IsMirrorWindowVisible() override { return {}; }
+		void CompositorDumpImages() override {}
+		bool ShouldAppRenderWithLowResources() override { return {}; }
+		void ForceInterleavedReprojectionOn( bool /*bOverride*/ ) override {}
+		void ForceReconnectProcess() override {}
+		void SuspendRendering( bool /*bSuspend*/ ) override {}
+		vr::EVRCompositorError GetMirrorTextureD3D11( vr::EVREye /*eEye*/, void * /*pD3D11DeviceOrResource*/, void ** /*ppD3D11ShaderResourceView*/ ) override { return {}; }
+		void ReleaseMirrorTextureD3D11( void * /*pD3D11ShaderResourceView*/ ) override {}
+		vr::EVRCompositorError GetMirrorTextureGL( vr::EVREye /*eEye*/, vr::glUInt_t * /*pglTextureId*/, vr::glSharedTextureHandle_t * /*pglSharedTextureHandle*/ ) override { return {}; }
+		bool ReleaseSharedGLTexture( vr::glUInt_t /*glTextureId*/, vr::glSharedTextureHandle_t /*glSharedTextureHandle*/ ) override { return {}; }
+		void LockGLSharedTextureForAccess( vr::glSharedTextureHandle_t /*glSharedTextureHandle*/ ) override {}
+		void UnlockGLSharedTextureForAccess( vr::glSharedTextureHandle_t /*glSharedTextureHandle*/ ) override {}
+		uint32_t GetVulkanInstanceExtensionsRequired( char * /*pchValue*/, uint32_t /*unBufferSize*/ ) override { return {}; }
+		uint32_t GetVulkanDeviceExtensionsRequired( VkPhysicalDevice_T * /*pPhysicalDevice*/, char * /*pchValue*/, uint32_t /*unBufferSize*/ ) override { return {}; }
+		void SetExplicitTimingMode( EVRCompositorTimingMode /*eTimingMode*/ ) override {}
+		EVRCompositorError SubmitExplicitTimingData() override { return {}; }
+		bool IsMotionSmoothingEnabled() override { return {}; }
+		bool IsMotionSmoothingSupported() override { return {}; }
+		bool IsCurrentSceneFocusAppLoading() override { return {}; }
+		EVRCompositorError SetStageOverride_Async( const char * /*pchRenderModelPath*/, const HmdMatrix34_t * /*pTransform*/, const Compositor_StageRenderSettings * /*pRenderSettings*/, uint32_t /*nSizeOfRenderSettings*/ ) override { return {}; }
+		void ClearStageOverride() override {}
+		bool GetCompositorBenchmarkResults( Compositor_BenchmarkResults * /*pBenchmarkResults*/, uint32_t /*nSizeOfBenchmarkResults*/ ) override { return {}; }
+		EVRCompositorError GetLastPosePredictionIDs( uint32_t * /*pRenderPosePredictionID*/, uint32_t * /*pGamePosePredictionID*/ ) override { return {}; }
+		EVRCompositorError GetPosesForFrame( uint32_t /*unPosePredictionID*/, TrackedDevicePose_t * /*pPoseArray*/, uint32_t /*unPoseArrayCount*/ ) override { return {}; }
+	};
+
+	bool IsVersionOf( const char *version, const char *interfaceName ) {
+		size_t length = strlen( interfaceName );
+		return strncmp( version, interfaceName, length ) == 0 && version[length] == '_';
+	}
+
+	class StubClientCore : public IVRClientCore {
+	public:
+		EVRInitError Init( EVRApplicationType /*eApplicationType*/, const char * /*pStartupInfo*/ ) override {
+			Wait( settings.initLatency );
+			return VRInitError_None;
+		}
+
+		void Cleanup() override {}
+
+		EVRInitError IsInterfaceVersionValid( const char *pchInterfaceVersion ) override {
+			if (IsVersionOf( pchInterfaceVersion, "IVRSystem" ) || IsVersionOf( pchInterfaceVersion, "IVRCompositor" ))
+				return VRInitError_None;
+			return VRInitError_Init_InterfaceNotFound;
+		}
+
+		void * GetGenericInterface( const char *pchNameAndVersion, EVRInitError *peError ) override {
+			void *result = nullptr;
+			if (IsVersionOf( pchNameAndVersion, "IVRSystem" ))
+				result = &system;
+			else if (IsVersionOf( pchNameAndVersion, "IVRCompositor" ))
+				result = &compositor;
+			if (peError)
+				*peError = result != nullptr ? VRInitError_None : VRInitError_Init_InterfaceNotFound;
+			return result;
+		}
+
+		bool BIsHmdPresent() override { return settings.hmdPresent; }
+		const char * GetEnglishStringForHmdError( EVRInitError /*eError*/ ) override { return "Error in the stub runtime"; }
+		const char * GetIDForVRInitError( EVRInitError /*eError*/ ) override { return "VRInitError_Stub"; }
+
+	private:
+		StubSystem system;
+		StubCompositor compositor;
+	};
+
+	StubClientCore clientCore;
+}
+
+STUB_EXPORT void * VRClientCoreFactory( const char *pInterfaceName, int *pReturnCode ) {
+	if (strcmp( pInterfaceName, IVRClientCore_Version ) != 0) {
+		if (pReturnCode)
+			*pReturnCode = VRInitError_Init_InterfaceNotFound;
+		return nullptr;
+	}
+	settings.Read();
+	if (pReturnCode)
+		*pReturnCode = VRInitError_None;
+	return &clientCore;
+}
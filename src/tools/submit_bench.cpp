@@ -0,0 +1,320 @@
+// Measures what the mod costs a game at startup and per frame, against the stub runtime instead of SteamVR: the
+// time VR_InitInternal2 takes, the first requests for IVRSystem and IVRCompositor, which install the hooks, and
+// the time the hooked Submit takes for both eyes of a frame. The mod is copied into a work directory together
+// with its settings, where FFR is switched on or off, so that runs can be compared.
+//
+// On Windows, each frame clears a D3D11 render target and depth buffer, the way a game's frame would start, and
+// submits it. Elsewhere there is no D3D11, so Submit is called without a texture, which the mod passes through
+// untouched; that still measures the hooks and the per-frame bookkeeping.
+#include "openvr.h"
+#include <json/json.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <d3d11.h>
+#include <wrl/client.h>
+#else
+#include <dlfcn.h>
+#include <sys/stat.h>
+#endif
+
+using namespace vr;
+
+namespace {
+	typedef uint32_t (*InitInternal2Fn)( EVRInitError *peError, EVRApplicationType eApplicationType, const char *pStartupInfo );
+	typedef void (*ShutdownInternalFn)();
+	typedef void * (*GetGenericInterfaceFn)( const char *pchInterfaceVersion, EVRInitError *peError );
+
+#ifdef _WIN32
+	const char *LIBRARY_NAME = "openvr_api.dll";
+	const char SLASH = '\\';
+#else
+	const char *LIBRARY_NAME = "libopenvr_api.so";
+	const char SLASH = '/';
+#endif
+
+	std::string DirectoryOf( const std::string &path ) {
+		size_t slash = path.find_last_of( "/\\" );
+		return slash == std::string::npos ? "." : path.substr( 0, slash );
+	}
+
+	bool ReadFile( const std::string &path, std::string &contents ) {
+		std::ifstream file( path, std::ios::binary );
+		if (!file)
+			return false;
+		std::ostringstream stream;
+		stream << file.rdbuf();
+		contents = stream.str();
+		return true;
+	}
+
+	bool WriteFile( const std::string &path, const std::string &contents ) {
+		std::ofstream file( path, std::ios::binary | std::ios::trunc );
+		file << contents;
+		return bool(file);
+	}
+
+	bool MakeDirectory( const std::string &path ) {
+#ifdef _WIN32
+		return CreateDirectoryA( path.c_str(), nullptr ) || GetLastError() == ERROR_ALREADY_EXISTS;
+#else
+		struct stat buf;
+		return mkdir( path.c_str(), 0755 ) == 0 || (stat( path.c_str(), &buf ) == 0 && S_ISDIR( buf.st_mode ));
+#endif
+	}
+
+	// the mod's settings from next to the library, with FFR switched as requested
+	bool WriteConfig( const std::string &source, const std::string &target, bool ffr ) {
+		std::string contents;
+		if (!ReadFile( source, contents )) {
+			fprintf( stderr, "could not read %s\n", source.c_str() );
+			return false;
+		}
+		Json::Value root;
+		Json::CharReaderBuilder reader;
+		std::istringstream stream( contents );
+		std::string errors;
+		if (!Json::parseFromStream( reader, stream, &root, &errors )) {
+			fprintf( stderr, "could not parse %s: %s\n", source.c_str(), errors.c_str() );
+			return false;
+		}
+		root["foveated"]["enabled"] = ffr;
+		Json::StreamWriterBuilder writer;
+		return WriteFile( target, Json::writeString( writer, root ) );
+	}
+
+	class Library {
+	public:
+		bool Load( const std::string &path ) {
+#ifdef _WIN32
+			handle = LoadLibraryA( path.c_str() );
+#else
+			handle = dlopen( path.c_str(), RTLD_NOW | RTLD_LOCAL );
+#endif
+			return handle != nullptr;
+		}
+
+		template<typename T>
+		T Function( const char *name ) const {
+#ifdef _WIN32
+			return (T)GetProcAddress( (HMODULE)handle, name );
+#else
+			return (T)dlsym( handle, name );
+#endif
+		}
+
+	private:
+		void *handle = nullptr;
+	};
+
+	double Milliseconds( std::chrono::steady_clock::time_point start ) {
+		return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+	}
+
+#ifdef _WIN32
+	// a game's eye buffer with both eyes side by side, and its depth buffer
+	struct Frame {
+		Microsoft::WRL::ComPtr<ID3D11Device> device;
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+		Microsoft::WRL::ComPtr<ID3D11Texture2D> color;
+		Microsoft::WRL::ComPtr<ID3D11RenderTargetView> colorView;
+		Microsoft::WRL::ComPtr<ID3D11Texture2D> depth;
+		Microsoft::WRL::ComPtr<ID3D11DepthStencilView> depthView;
+
+		bool Create( uint32_t eyeWidth, uint32_t eyeHeight ) {
+			if (FAILED( D3D11CreateDevice( nullptr, D3D_DRIVER_TYPE_HARDWARE, nullptr, 0, nullptr, 0, D3D11_SDK_VERSION,
+					device.GetAddressOf(), nullptr, context.GetAddressOf() ) ))
+				return false;
+			D3D11_TEXTURE2D_DESC td = {};
+			td.Width = 2 * eyeWidth;
+			td.Height = eyeHeight;
+			td.MipLevels = 1;
+			td.ArraySize = 1;
+			td.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+			td.SampleDesc.Count = 1;
+			td.Usage = D3D11_USAGE_DEFAULT;
+			td.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+			if (FAILED( device->CreateTexture2D( &td, nullptr, color.GetAddressOf() ) )
+					|| FAILED( device->CreateRenderTargetView( color.Get(), nullptr, colorView.GetAddressOf() ) ))
+				return false;
+			td.Format = DXGI_FORMAT_D24_UNORM_S8_UINT;
+			td.BindFlags = D3D11_BIND_DEPTH_STENCIL;
+			return SUCCEEDED( device->CreateTexture2D( &td, nullptr, depth.GetAddressOf() ) )
+				&& SUCCEEDED( device->CreateDepthStencilView( depth.Get(), nullptr, depthView.GetAddressOf() ) );
+		}
+
+		void Render() {
+			const float black[4] = { 0, 0, 0, 1 };
+			context->OMSetRenderTargets( 1, colorView.GetAddressOf(), depthView.Get() );
+			context->ClearRenderTargetView( colorView.Get(), black );
+			context->ClearDepthStencilView( depthView.Get(), D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0 );
+		}
+
+		void * Handle() const { return color.Get(); }
+	};
+#else
+	struct Frame {
+		bool Create( uint32_t, uint32_t ) { return true; }
+		void Render() {}
+		void * Handle() const { return nullptr; }
+	};
+#endif
+
+	int Usage() {
+		fprintf( stderr,
+			"usage: submit_bench [--library path] [--registry path] [--work-dir path] [--frames count] [--ffr on|off]\n"
+			"Initializes the mod against the stub runtime and measures init and Submit (default 1000 frames, FFR on).\n" );
+		return 2;
+	}
+}
+
+int main( int argc, char **argv ) {
+#ifdef SUBMIT_BENCH_LIBRARY
+	std::string libraryPath = SUBMIT_BENCH_LIBRARY;
+#else
+	std::string libraryPath = LIBRARY_NAME;
+#endif
+#ifdef SUBMIT_BENCH_REGISTRY
+	std::string registryPath = SUBMIT_BENCH_REGISTRY;
+#else
+	std::string registryPath;
+#endif
+	std::string workDirectory = "submit_bench_work";
+	int frames = 1000;
+	bool ffr = true;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp( argv[i], "--library" ) == 0 && i + 1 < argc) {
+			libraryPath = argv[++i];
+		} else if (strcmp( argv[i], "--registry" ) == 0 && i + 1 < argc) {
+			registryPath = argv[++i];
+		} else if (strcmp( argv[i], "--work-dir" ) == 0 && i + 1 < argc) {
+			workDirectory = argv[++i];
+		} else if (strcmp( argv[i], "--frames" ) == 0 && i + 1 < argc) {
+			frames = atoi( argv[++i] );
+			if (frames < 1)
+				return Usage();
+		} else if (strcmp( argv[i], "--ffr" ) == 0 && i + 1 < argc) {
+			++i;
+			if (strcmp( argv[i], "on" ) != 0 && strcmp( argv[i], "off" ) != 0)
+				return Usage();
+			ffr = strcmp( argv[i], "on" ) == 0;
+		} else {
+			return Usage();
+		}
+	}
+	if (registryPath.empty()) {
+		fprintf( stderr, "no path registry given for the stub runtime\n" );
+		return Usage();
+	}
+
+	// the mod reads its settings from next to itself
+	std::string library, copiedLibrary = workDirectory + SLASH + LIBRARY_NAME;
+	if (!MakeDirectory( workDirectory ) || !ReadFile( libraryPath, library ) || !WriteFile( copiedLibrary, library )) {
+		fprintf( stderr, "could not copy %s to %s\n", libraryPath.c_str(), workDirectory.c_str() );
+		return 1;
+	}
+	if (!WriteConfig( DirectoryOf( libraryPath ) + SLASH + "openvr_mod.cfg", workDirectory + SLASH + "openvr_mod.cfg", ffr ))
+		return 1;
+
+#ifdef _WIN32
+	SetEnvironmentVariableA( "VR_PATHREG_OVERRIDE", registryPath.c_str() );
+#else
+	setenv( "VR_PATHREG_OVERRIDE", registryPath.c_str(), 1 );
+#endif
+
+	Library openvr;
+	auto start = std::chrono::steady_clock::now();
+	if (!openvr.Load( copiedLibrary )) {
+		fprintf( stderr, "could not load %s\n", copiedLibrary.c_str() );
+		return 1;
+	}
+	double loadMs = Milliseconds( start );
+	InitInternal2Fn initInternal2 = openvr.Function<InitInternal2Fn>( "VR_InitInternal2" );
+	ShutdownInternalFn shutdownInternal = openvr.Function<ShutdownInternalFn>( "VR_ShutdownInternal" );
+	GetGenericInterfaceFn getGenericInterface = openvr.Function<GetGenericInterfaceFn>( "VR_GetGenericInterface" );
+	if (!initInternal2 || !shutdownInternal || !getGenericInterface) {
+		fprintf( stderr, "%s does not export the OpenVR API\n", copiedLibrary.c_str() );
+		return 1;
+	}
+
+	EVRInitError error = VRInitError_None;
+	start = std::chrono::steady_clock::now();
+	initInternal2( &error, VRApplication_Scene, nullptr );
+	double initMs = Milliseconds( start );
+	if (error != VRInitError_None) {
+		fprintf( stderr, "VR_InitInternal2 failed with error %d\n", int(error) );
+		return 1;
+	}
+
+	start = std::chrono::steady_clock::now();
+	IVRSystem *system = (IVRSystem*)getGenericInterface( IVRSystem_Version, &error );
+	IVRCompositor *compositor = (IVRCompositor*)getGenericInterface( IVRCompositor_Version, &error );
+	double interfacesMs = Milliseconds( start );
+	if (!system || !compositor) {
+		fprintf( stderr, "the runtime did not hand out IVRSystem and IVRCompositor\n" );
+		shutdownInternal();
+		return 1;
+	}
+
+	// through the hook, which may change the size
+	uint32_t eyeWidth = 0, eyeHeight = 0;
+	system->GetRecommendedRenderTargetSize( &eyeWidth, &eyeHeight );
+	Frame frame;
+	if (!frame.Create( eyeWidth, eyeHeight )) {
+		fprintf( stderr, "could not create a %ux%u D3D11 eye buffer\n", 2 * eyeWidth, eyeHeight );
+		shutdownInternal();
+		return 1;
+	}
+
+	Texture_t texture = { frame.Handle(), TextureType_DirectX, ColorSpace_Auto };
+	const VRTextureBounds_t bounds[2] = { { 0.0f, 0.0f, 0.5f, 1.0f }, { 0.5f, 0.0f, 1.0f, 1.0f } };
+	TrackedDevicePose_t poses[k_unMaxTrackedDeviceCount];
+	std::vector<double> submitMicroseconds;
+	submitMicroseconds.reserve( frames );
+	int failedSubmits = 0;
+	for (int i = 0; i < frames; ++i) {
+		compositor->WaitGetPoses( poses, k_unMaxTrackedDeviceCount, nullptr, 0 );
+		frame.Render();
+		auto submitStart = std::chrono::steady_clock::now();
+		failedSubmits += compositor->Submit( Eye_Left, &texture, &bounds[0] ) != VRCompositorError_None ? 1 : 0;
+		failedSubmits += compositor->Submit( Eye_Right, &texture, &bounds[1] ) != VRCompositorError_None ? 1 : 0;
+		submitMicroseconds.push_back( std::chrono::duration<double, std::micro>( std::chrono::steady_clock::now() - submitStart ).count() );
+	}
+
+	start = std::chrono::steady_clock::now();
+	shutdownInternal();
+	double shutdownMs = Milliseconds( start );
+
+	// the first frames create the mod's resources, so they are reported apart
+	double firstFrameUs = submitMicroseconds.front();
+	std::vector<double> sorted( submitMicroseconds.begin() + (frames > 1 ? 1 : 0), submitMicroseconds.end() );
+	std::sort( sorted.begin(), sorted.end() );
+	double sum = 0;
+	for (double us : sorted) {
+		sum += us;
+	}
+
+	printf( "FFR %s, %d frames of %ux%u per eye\n", ffr ? "on" : "off", frames, eyeWidth, eyeHeight );
+	printf( "load library         %8.2f ms\n", loadMs );
+	printf( "VR_InitInternal2     %8.2f ms\n", initMs );
+	printf( "first interfaces     %8.2f ms\n", interfacesMs );
+	printf( "VR_ShutdownInternal  %8.2f ms\n", shutdownMs );
+	printf( "first frame Submit   %8.2f us\n", firstFrameUs );
+	printf( "frame Submit mean    %8.2f us\n", sum / sorted.size() );
+	printf( "frame Submit p50     %8.2f us\n", sorted[sorted.size() / 2] );
+	printf( "frame Submit p99     %8.2f us\n", sorted[(std::min)( sorted.size() - 1, sorted.size() * 99 / 100 )] );
+	if (failedSubmits != 0) {
+		fprintf( stderr, "%d submits failed\n", failedSubmits );
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,252 @@
+// Checks the rules that classify the game's render and depth targets against the submitted textures, and the
+// cached classification by view that the hooks use: a view is only described and classified on its first bind
+// and again once its tag shows a new view at the same address. Then measures a bind classified from scratch
+// against one answered from the cache. The fake views make virtual, reference counted calls like the GetDesc,
+// GetResource and GetPrivateData calls on a D3D11 view, but do not enter a driver, so the uncached time is a
+// lower bound.
+#include "../postprocess/TargetClassification.h"
+#include "../postprocess/ViewCache.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+using namespace vr;
+
+namespace {
+	class FakeTexture {
+	public:
+		FakeTexture( const TargetDesc &desc = TargetDesc(), const char *name = "" ) : desc( desc ) {
+			snprintf( debugName, sizeof(debugName), "%s", name );
+		}
+		virtual ~FakeTexture() {}
+
+		virtual void GetDesc( TargetDesc *desc ) { *desc = this->desc; }
+		virtual void GetDebugName( char *name, size_t size ) { snprintf( name, size, "%s", debugName ); }
+		virtual void AddRef() { ++references; }
+		virtual void Release() { --references; }
+
+		TargetDesc desc;
+		char debugName[32];
+		std::atomic<int> references { 1 };
+	};
+
+	// stands in for a render target or depth stencil view, with its tag stored as private data
+	class FakeView {
+	public:
+		virtual ~FakeView() {}
+
+		virtual FakeTexture * GetResource() {
+			texture->AddRef();
+			return texture;
+		}
+
+		FakeTexture *texture = nullptr;
+		uint64_t tag = 0;
+	};
+
+	struct FakeTagger {
+		uint64_t GetTag( FakeView *view ) { return view->tag; }
+		void SetTag( FakeView *view, uint64_t tag ) { view->tag = tag; }
+	};
+
+	struct ClassifiedTarget {
+		FakeTexture *texture = nullptr;
+		TargetDesc desc;
+		TargetClass targetClass = TargetClass::Ignore;
+	};
+
+	typedef ViewCache<FakeView*, ClassifiedTarget, FakeTagger, 64> ClassCache;
+
+	int descriptions = 0;
+
+	// what the hooks do on a miss: describe the view's texture and classify it
+	ClassifiedTarget Describe( FakeView *view, const SubmitLayout &layout, bool depth ) {
+		++descriptions;
+		ClassifiedTarget target;
+		target.texture = view->GetResource();
+		target.texture->GetDesc( &target.desc );
+		if (depth) {
+			char debugName[255] = { 0 };
+			target.texture->GetDebugName( debugName, sizeof(debugName) );
+			target.desc.blacklistedName = strncmp( debugName, "Camera DepthTexture", sizeof(debugName) ) == 0;
+			target.targetClass = ClassifyDepthTarget( target.desc, layout );
+		} else {
+			target.targetClass = ClassifyRenderTarget( target.desc, layout );
+		}
+		target.texture->Release();
+		return target;
+	}
+
+	const ClassifiedTarget & Classify( ClassCache &cache, FakeView *view, const SubmitLayout &layout, bool depth ) {
+		if (const ClassifiedTarget *cached = cache.Find( view ))
+			return *cached;
+		ClassifiedTarget &target = cache.Insert( view );
+		target = Describe( view, layout, depth );
+		return target;
+	}
+
+	TargetDesc Desc( uint32_t width, uint32_t height, uint32_t arraySize = 1, bool isTexture2D = true ) {
+		TargetDesc desc;
+		desc.width = width;
+		desc.height = height;
+		desc.arraySize = arraySize;
+		desc.isTexture2D = isTexture2D;
+		return desc;
+	}
+
+	TargetDesc Blacklisted( TargetDesc desc ) {
+		desc.blacklistedName = true;
+		return desc;
+	}
+
+	SubmitLayout Layout( uint32_t width, uint32_t height, bool onlyOneEye ) {
+		SubmitLayout layout;
+		layout.textureWidth = width;
+		layout.textureHeight = height;
+		layout.textureContainsOnlyOneEye = onlyOneEye;
+		return layout;
+	}
+
+	int failures = 0;
+
+	void Check( bool condition, const char *what ) {
+		if (!condition) {
+			fprintf( stderr, "FAIL  %s\n", what );
+			++failures;
+		}
+	}
+
+	void CheckRenderTargets() {
+		SubmitLayout single = Layout( 2016, 2240, true );
+		Check( ClassifyRenderTarget( Desc( 2016, 2240 ), single ) == TargetClass::SingleEye, "eye sized target holds a single eye" );
+		Check( ClassifyRenderTarget( Desc( 2304, 2560 ), single ) == TargetClass::SingleEye, "larger target holds a single eye" );
+		Check( ClassifyRenderTarget( Desc( 2016, 2240, 2 ), single ) == TargetClass::Array, "array of two holds both eyes" );
+		Check( ClassifyRenderTarget( Desc( 2016, 2240, 6 ), single ) == TargetClass::Ignore, "larger arrays ignored" );
+		Check( ClassifyRenderTarget( Desc( 4032, 2240 ), single ) == TargetClass::Combined, "twice as wide holds both eyes" );
+		Check( ClassifyRenderTarget( Desc( 2015, 2240 ), single ) == TargetClass::Ignore, "narrower than an eye ignored" );
+		Check( ClassifyRenderTarget( Desc( 2016, 2239 ), single ) == TargetClass::Ignore, "lower than an eye ignored" );
+		Check( ClassifyRenderTarget( Desc( 4096, 4096 ), single ) == TargetClass::ShadowMap, "square target is a shadow map" );
+		Check( ClassifyRenderTarget( Desc( 1024, 1024 ), single ) == TargetClass::ShadowMap, "small square target is a shadow map too" );
+		Check( ClassifyRenderTarget( Desc( 4032, 2240, 1, false ), single ) == TargetClass::Ignore, "view on something other than a 2D texture ignored" );
+
+		SubmitLayout combined = Layout( 4032, 2240, false );
+		Check( ClassifyRenderTarget( Desc( 4032, 2240 ), combined ) == TargetClass::Combined, "submitted side by side texture holds both eyes" );
+		Check( ClassifyRenderTarget( Desc( 2016, 2240 ), combined ) == TargetClass::Ignore, "half of a side by side texture ignored" );
+	}
+
+	void CheckDepthTargets() {
+		SubmitLayout single = Layout( 2016, 2240, true );
+		Check( ClassifyDepthTarget( Desc( 2016, 2240 ), single ) == TargetClass::SingleEye, "eye sized depth holds a single eye" );
+		Check( ClassifyDepthTarget( Desc( 2016, 2240, 2 ), single ) == TargetClass::Array, "depth array of two holds both eyes" );
+		Check( ClassifyDepthTarget( Desc( 2016, 2240, 6 ), single ) == TargetClass::SingleEye, "larger depth arrays taken for a single eye" );
+		Check( ClassifyDepthTarget( Desc( 4032, 2240 ), single ) == TargetClass::Combined, "twice as wide depth holds both eyes" );
+		Check( ClassifyDepthTarget( Desc( 4096, 4096 ), single ) == TargetClass::ShadowMap, "large square depth is a shadow map" );
+		Check( ClassifyDepthTarget( Desc( 1024, 1024 ), single ) == TargetClass::Ignore, "small square depth ignored for its size" );
+		Check( ClassifyDepthTarget( Blacklisted( Desc( 2016, 2240 ) ), single ) == TargetClass::Blacklisted, "depth blacklisted by name" );
+		Check( ClassifyDepthTarget( Blacklisted( Desc( 4096, 4096 ) ), single ) == TargetClass::ShadowMap, "square wins over the name" );
+		Check( ClassifyDepthTarget( Desc( 4032, 2240, 1, false ), single ) == TargetClass::Ignore, "depth view on a 1D texture ignored" );
+		Check( ClassifyDepthTarget( Desc( 4032, 2240 ), Layout( 4032, 2240, false ) ) == TargetClass::Combined, "depth of a side by side submit holds both eyes" );
+	}
+
+	void CheckCache() {
+		SubmitLayout layout = Layout( 2016, 2240, true );
+		FakeTexture eye( Desc( 2016, 2240 ) );
+		FakeTexture shadow( Desc( 4096, 4096 ) );
+		FakeTexture unityDepth( Desc( 2016, 2240 ), "Camera DepthTexture" );
+		FakeView eyeView, shadowView, depthView;
+		eyeView.texture = &eye;
+		shadowView.texture = &shadow;
+		depthView.texture = &unityDepth;
+
+		ClassCache renderTargets, depthTargets;
+		descriptions = 0;
+		Check( Classify( renderTargets, &eyeView, layout, false ).targetClass == TargetClass::SingleEye, "first bind classified" );
+		Check( Classify( renderTargets, &shadowView, layout, false ).targetClass == TargetClass::ShadowMap, "other view classified" );
+		Check( Classify( depthTargets, &depthView, layout, true ).targetClass == TargetClass::Blacklisted, "blacklisted name found" );
+		Check( descriptions == 3, "each view described once" );
+		for (int i = 0; i < 100; ++i) {
+			Classify( renderTargets, &eyeView, layout, false );
+			Classify( renderTargets, &shadowView, layout, false );
+			Classify( depthTargets, &depthView, layout, true );
+		}
+		Check( descriptions == 3, "repeated binds answered from the cache" );
+		Check( Classify( renderTargets, &eyeView, layout, false ).texture == &eye, "cached texture" );
+		Check( eye.references == 1 && unityDepth.references == 1, "no reference kept on the textures" );
+
+		// the game releases the view and creates one for a different texture at the same address
+		eyeView = FakeView();
+		eyeView.texture = &shadow;
+		Check( Classify( renderTargets, &eyeView, layout, false ).targetClass == TargetClass::ShadowMap && descriptions == 4, "new view at the same address classified again" );
+
+		// the verdicts depend on the submitted size, so the hooks drop them when it changes
+		renderTargets.Clear();
+		Check( Classify( renderTargets, &shadowView, Layout( 4096, 4096, true ), false ).targetClass == TargetClass::ShadowMap && descriptions == 5, "classified again for the new layout" );
+	}
+
+	// keeps the classifications from being optimized away
+	volatile uint64_t sink;
+
+	// nanoseconds per classification of binds cycling through the views
+	double NanosecondsPerBind( ClassCache *cache, std::vector<FakeView> &views, const SubmitLayout &layout, uint64_t binds ) {
+		uint64_t sum = 0;
+		auto start = std::chrono::steady_clock::now();
+		for (uint64_t i = 0; i < binds; ++i) {
+			FakeView *view = &views[i % views.size()];
+			TargetClass targetClass = cache ? Classify( *cache, view, layout, true ).targetClass : Describe( view, layout, true ).targetClass;
+			sum += uint64_t(targetClass);
+		}
+		double elapsed = std::chrono::duration<double, std::nano>( std::chrono::steady_clock::now() - start ).count();
+		sink = sum;
+		return elapsed / double(binds);
+	}
+
+	int Usage() {
+		fprintf( stderr,
+			"usage: target_classification_test [--binds count]\n"
+			"Checks the target classification, then compares classifying depth targets on every bind with looking\n"
+			"them up in the cache, cycling through 8 views (default 2000000 binds).\n" );
+		return 2;
+	}
+}
+
+int main( int argc, char **argv ) {
+	uint64_t binds = 2000000;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp( argv[i], "--binds" ) == 0 && i + 1 < argc) {
+			binds = strtoull( argv[++i], nullptr, 10 );
+			if (binds == 0)
+				return Usage();
+		} else {
+			return Usage();
+		}
+	}
+
+	CheckRenderTargets();
+	CheckDepthTargets();
+	CheckCache();
+
+	SubmitLayout layout = Layout( 2016, 2240, true );
+	std::vector<FakeTexture> textures( 8 );
+	std::vector<FakeView> views( textures.size() );
+	for (size_t i = 0; i < textures.size(); ++i) {
+		textures[i].desc = Desc( 1024 + 512 * uint32_t(i), 2240, 1 + uint32_t(i % 2) );
+		snprintf( textures[i].debugName, sizeof(textures[i].debugName), "Depth %u", unsigned(i) );
+		views[i].texture = &textures[i];
+	}
+	double uncached = NanosecondsPerBind( nullptr, views, layout, binds );
+	ClassCache cache;
+	double cached = NanosecondsPerBind( &cache, views, layout, binds );
+	Check( cache.Size() == views.size(), "all views cached" );
+	printf( "classified on every bind  %8.2f ns\n", uncached );
+	printf( "cached                    %8.2f ns\n", cached );
+
+	if (failures != 0) {
+		fprintf( stderr, "%d checks failed\n", failures );
+		return 1;
+	}
+	printf( "all checks passed\n" );
+	return 0;
+}
@@ -0,0 +1,237 @@
+// Checks the tracer: events collected by frame and ordered by start time, each thread's ring keeping its newest
+// events, thread names, and no event read half written while threads record during a collection. Checks the Chrome
+// trace JSON for a fixed set of events, and that the instrumentation macros record only in tracing builds. Then
+// measures what recording an event costs the recording thread, and what collecting and writing a trace takes.
+#include "../postprocess/Trace.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace vr;
+
+namespace {
+	int failures = 0;
+
+	void Check( bool condition, const char *what ) {
+		if (!condition) {
+			fprintf( stderr, "FAIL  %s\n", what );
+			++failures;
+		}
+	}
+
+	const char *const names[] = { "Submit", "ApplyPostProcess", "FFR", "Sharpen" };
+
+	void CheckFrames() {
+		Tracer tracer;
+		Check( tracer.Collect( 100 ).empty() && tracer.ThreadNames().empty(), "nothing recorded" );
+		// three events per frame, recorded out of start order
+		for (uint32_t frame = 0; frame < 10; ++frame) {
+			uint64_t base = 1000 * uint64_t(frame);
+			tracer.Record( names[0], 'X', base + 20, 5 );
+			tracer.Record( names[1], 'X', base + 10, 30 );
+			tracer.Record( names[2], 'i', base + 15, 0 );
+			tracer.NextFrame();
+		}
+		Check( tracer.Frame() == 10, "frames counted" );
+
+		std::vector<TraceEvent> events = tracer.Collect( 3 );
+		bool ordered = true, framed = true;
+		for (size_t i = 0; i < events.size(); ++i) {
+			ordered = ordered && (i == 0 || events[i - 1].start <= events[i].start);
+			framed = framed && events[i].frame >= 7 && events[i].start / 1000 == events[i].frame;
+		}
+		Check( events.size() == 9, "events of the last frames collected" );
+		Check( ordered, "events ordered by start" );
+		Check( framed, "events carry their frame" );
+		Check( events.size() == 9 && events[0].name == names[1] && events[1].name == names[2] && events[1].phase == 'i' && events[2].duration == 5,
+			"event fields kept" );
+		Check( tracer.Collect( 100 ).size() == 30, "all frames collected" );
+		tracer.Record( names[3], 'X', 20000, 1 );
+		Check( tracer.Collect( 0 ).size() == 1, "current frame collected alone" );
+
+		// each thread records into its own buffer, which it keeps across calls
+		std::thread( [&tracer]() {
+			tracer.SetThreadName( "Render \"main\"" );
+			tracer.Record( names[3], 'X', 30000, 1 );
+		} ).join();
+		events = tracer.Collect( 0 );
+		std::vector<std::pair<uint32_t, std::string>> threadNames = tracer.ThreadNames();
+		Check( events.size() == 2 && events[0].thread == 1 && events[1].thread == 2, "threads numbered in order" );
+		Check( threadNames.size() == 1 && threadNames[0].first == 2 && threadNames[0].second == "Render \"main\"", "thread named" );
+	}
+
+	void CheckWrap() {
+		Tracer tracer;
+		const uint64_t count = Tracer::EVENTS_PER_THREAD + 1000;
+		for (uint64_t i = 0; i < count; ++i) {
+			tracer.Record( names[i % 4], 'X', i, 1 );
+		}
+		std::vector<TraceEvent> events = tracer.Collect( 0 );
+		Check( events.size() == Tracer::EVENTS_PER_THREAD, "ring keeps a buffer of events" );
+		Check( !events.empty() && events.front().start == count - Tracer::EVENTS_PER_THREAD && events.back().start == count - 1, "newest events kept" );
+	}
+
+	// events whose fields show if they were read while being overwritten
+	void RecordChecked( Tracer &tracer, uint64_t start ) {
+		tracer.Record( names[start % 4], 'X', start, start ^ 0x5a5a5a5a5a5aull );
+	}
+
+	bool IsIntact( const TraceEvent &event ) {
+		return event.duration == (event.start ^ 0x5a5a5a5a5a5aull) && event.name == names[event.start % 4] && event.phase == 'X';
+	}
+
+	void CheckConcurrentRecording( int threadCount, uint64_t eventsPerThread ) {
+		Tracer tracer;
+		std::atomic<int> recording { threadCount };
+		std::vector<std::thread> threads;
+		for (int t = 0; t < threadCount; ++t) {
+			threads.emplace_back( [&, t]() {
+				for (uint64_t i = 0; i < eventsPerThread; ++i) {
+					RecordChecked( tracer, (uint64_t(t) << 40) | i );
+					if (t == 0 && i % 256 == 0)
+						tracer.NextFrame();
+				}
+				--recording;
+			} );
+		}
+		int collections = 0;
+		bool intact = true, ordered = true;
+		do {
+			std::vector<TraceEvent> events = tracer.Collect( 1000000 );
+			for (size_t i = 0; i < events.size(); ++i) {
+				intact = intact && IsIntact( events[i] );
+				ordered = ordered && (i == 0 || events[i - 1].start <= events[i].start);
+			}
+			++collections;
+		} while (recording.load() > 0);
+		for (std::thread &thread : threads) {
+			thread.join();
+		}
+		Check( intact, "no event read half written" );
+		Check( ordered, "collected events ordered" );
+		std::vector<TraceEvent> events = tracer.Collect( 1000000 );
+		Check( events.size() == size_t(threadCount) * (std::min)( eventsPerThread, uint64_t(Tracer::EVENTS_PER_THREAD) ), "every thread's newest events left" );
+		printf( "%d collections while %d threads recorded\n", collections, threadCount );
+	}
+
+	void CheckChromeTrace() {
+		std::vector<TraceEvent> events;
+		events.push_back( TraceEvent { 5000000, 1500, "Submit", 7, 1, 'X' } );
+		events.push_back( TraceEvent { 5002345, 0, "quote \" back\\slash\ttab", 7, 2, 'i' } );
+		events.push_back( TraceEvent { 6000000, 999, nullptr, 8, 1, 'X' } );
+		std::vector<std::pair<uint32_t, std::string>> threadNames;
+		threadNames.push_back( std::make_pair( 1u, std::string( "Submit" ) ) );
+		std::ostringstream out;
+		WriteChromeTrace( out, events, threadNames );
+		Check( out.str() ==
+			"{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+			"{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"Submit\"}},\n"
+			"{\"name\":\"Submit\",\"ph\":\"X\",\"ts\":0.000,\"dur\":1.500,\"pid\":1,\"tid\":1,\"args\":{\"frame\":7}},\n"
+			"{\"name\":\"quote \\\" back\\\\slash\\u0009tab\",\"ph\":\"i\",\"ts\":2.345,\"s\":\"t\",\"pid\":1,\"tid\":2,\"args\":{\"frame\":7}},\n"
+			"{\"name\":\"\",\"ph\":\"X\",\"ts\":1000.000,\"dur\":0.999,\"pid\":1,\"tid\":1,\"args\":{\"frame\":8}}\n"
+			"]}\n", "Chrome trace written" );
+
+		std::ostringstream empty;
+		WriteChromeTrace( empty, std::vector<TraceEvent>(), std::vector<std::pair<uint32_t, std::string>>() );
+		Check( empty.str() == "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n]}\n", "empty trace written" );
+	}
+
+	void CheckMacros() {
+		size_t before = Tracer::Instance().Collect( 1000000 ).size();
+		{
+			TRACE_THREAD_NAME( "test" );
+			TRACE_SCOPE( "scope" );
+			TRACE_INSTANT( "instant" );
+		}
+		size_t recorded = Tracer::Instance().Collect( 1000000 ).size() - before;
+#ifdef OPENVR_MOD_TRACING
+		Check( recorded == 2, "macros record in tracing builds" );
+#else
+		Check( recorded == 0 && Tracer::Instance().ThreadNames().empty(), "macros record nothing unless tracing" );
+#endif
+	}
+
+	// keeps the benchmarked results from being optimized away
+	volatile uint64_t sink;
+
+	void Benchmark( uint64_t count ) {
+		Tracer tracer;
+		auto start = std::chrono::steady_clock::now();
+		for (uint64_t i = 0; i < count; ++i) {
+			tracer.Record( names[i % 4], 'X', i, 1 );
+		}
+		double recorded = std::chrono::duration<double, std::nano>( std::chrono::steady_clock::now() - start ).count() / count;
+
+		uint64_t sum = 0;
+		start = std::chrono::steady_clock::now();
+		for (uint64_t i = 0; i < count; ++i) {
+			sum += Tracer::Now();
+		}
+		double clock = std::chrono::duration<double, std::nano>( std::chrono::steady_clock::now() - start ).count() / count;
+
+		// what TRACE_SCOPE expands to, against the global tracer
+		start = std::chrono::steady_clock::now();
+		for (uint64_t i = 0; i < count; ++i) {
+			TraceScope scope( "scope" );
+		}
+		double scoped = std::chrono::duration<double, std::nano>( std::chrono::steady_clock::now() - start ).count() / count;
+
+		start = std::chrono::steady_clock::now();
+		std::vector<TraceEvent> events = tracer.Collect( 1 );
+		std::ostringstream out;
+		WriteChromeTrace( out, events, tracer.ThreadNames() );
+		double written = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+		sink = sum + out.str().size();
+
+		printf( "record an event             %8.2f ns\n", recorded );
+		printf( "read the clock              %8.2f ns\n", clock );
+		printf( "trace a scope               %8.2f ns\n", scoped );
+		printf( "collect and write %zu events  %8.2f ms, %zu bytes\n", events.size(), written, out.str().size() );
+	}
+
+	int Usage() {
+		fprintf( stderr,
+			"usage: trace_test [--threads count] [--events count]\n"
+			"Checks the tracer with threads recording while it collects (default 4 threads recording 100000\n"
+			"events each), then measures recording an event and writing a full trace (default 1000000 events).\n" );
+		return 2;
+	}
+}
+
+int main( int argc, char **argv ) {
+	int threads = 4;
+	uint64_t events = 1000000;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp( argv[i], "--threads" ) == 0 && i + 1 < argc) {
+			threads = atoi( argv[++i] );
+			if (threads <= 0)
+				return Usage();
+		} else if (strcmp( argv[i], "--events" ) == 0 && i + 1 < argc) {
+			events = strtoull( argv[++i], nullptr, 10 );
+			if (events == 0)
+				return Usage();
+		} else {
+			return Usage();
+		}
+	}
+
+	CheckFrames();
+	CheckWrap();
+	CheckConcurrentRecording( threads, 100000 );
+	CheckChromeTrace();
+	CheckMacros();
+	Benchmark( events );
+
+	if (failures != 0) {
+		fprintf( stderr, "%d checks failed\n", failures );
+		return 1;
+	}
+	printf( "all checks passed\n" );
+	return 0;
+}
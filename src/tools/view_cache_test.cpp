@@ -0,0 +1,155 @@
+// Checks the cache for views on the game's textures with fake textures that carry their tag the way private data
+// is stored on a D3D11 resource, and fake views that count how many are still alive: hits, stale entries for a
+// texture address reused by a new texture, least-recently-used eviction, and removal with colliding keys.
+#include "../postprocess/ViewCache.h"
+#include <cstdio>
+#include <memory>
+#include <new>
+
+using namespace vr;
+
+namespace {
+	struct FakeTexture {
+		// private data, lost when the texture is destroyed
+		uint64_t tag = 0;
+	};
+
+	struct FakeTagger {
+		uint64_t GetTag( FakeTexture *texture ) { return texture->tag; }
+		void SetTag( FakeTexture *texture, uint64_t tag ) { texture->tag = tag; }
+	};
+
+	// stands in for the ComPtr to a view; the shared count tells how many views are alive
+	struct FakeViews {
+		std::shared_ptr<int> view;
+		int id = 0;
+	};
+
+	typedef ViewCache<FakeTexture*, FakeViews, FakeTagger, 16> Cache;
+
+	int failures = 0;
+
+	void Check( bool condition, const char *what ) {
+		if (!condition) {
+			fprintf( stderr, "FAIL  %s\n", what );
+			++failures;
+		}
+	}
+
+	void Fill( Cache &cache, FakeTexture *texture, const std::shared_ptr<int> &alive, int id ) {
+		FakeViews &views = cache.Insert( texture );
+		views.view = alive;
+		views.id = id;
+	}
+
+	void CheckHits() {
+		Cache cache;
+		FakeTexture textures[2];
+		std::shared_ptr<int> alive = std::make_shared<int>();
+		Check( cache.Find( &textures[0] ) == nullptr, "empty cache misses" );
+		Fill( cache, &textures[0], alive, 1 );
+		Fill( cache, &textures[1], alive, 2 );
+		Check( cache.Size() == 2 && textures[0].tag != 0 && textures[0].tag != textures[1].tag, "entries tagged with their own generation" );
+		Check( cache.Find( &textures[0] ) && cache.Find( &textures[0] )->id == 1, "hit returns the entry's views" );
+		Check( cache.Find( &textures[1] ) && cache.Find( &textures[1] )->id == 2, "other entry hit" );
+
+		Fill( cache, &textures[0], alive, 3 );
+		Check( cache.Size() == 2 && cache.Find( &textures[0] )->id == 3, "inserting again replaces the entry" );
+
+		cache.Erase( &textures[1] );
+		Check( cache.Find( &textures[1] ) == nullptr && cache.Size() == 1, "erased entry gone" );
+		cache.Clear();
+		Check( cache.Size() == 0 && alive.use_count() == 1, "clear releases all views" );
+	}
+
+	void CheckStaleEntries() {
+		Cache cache;
+		std::shared_ptr<int> alive = std::make_shared<int>();
+		FakeTexture *texture = new FakeTexture();
+		Fill( cache, texture, alive, 1 );
+		// the game frees the texture and creates a new one at the same address, without our tag
+		texture->~FakeTexture();
+		new (texture) FakeTexture();
+		Check( cache.Find( texture ) == nullptr, "reused address not served the old views" );
+		Check( cache.StaleHits() == 1 && cache.Size() == 0 && alive.use_count() == 1, "stale entry counted and released" );
+
+		// a texture tagged by another entry that has since been replaced
+		Fill( cache, texture, alive, 2 );
+		uint64_t oldTag = texture->tag;
+		Fill( cache, texture, alive, 3 );
+		texture->tag = oldTag;
+		Check( cache.Find( texture ) == nullptr, "old generation does not match" );
+		delete texture;
+	}
+
+	void CheckEviction() {
+		Cache cache;
+		FakeTexture textures[20];
+		std::shared_ptr<int> alive = std::make_shared<int>();
+		// three quarters of the slots are used at most
+		for (int i = 0; i < 12; ++i) {
+			Fill( cache, &textures[i], alive, i );
+		}
+		Check( cache.Size() == 12 && cache.Evictions() == 0, "filled up to three quarters" );
+		// touch all but the second one, so that it is the least recently used
+		for (int i = 0; i < 12; ++i) {
+			if (i != 1)
+				cache.Find( &textures[i] );
+		}
+		Fill( cache, &textures[12], alive, 12 );
+		Check( cache.Size() == 12 && cache.Evictions() == 1, "full cache evicts one entry" );
+		Check( cache.Find( &textures[1] ) == nullptr, "least recently used entry evicted" );
+		Check( alive.use_count() == 1 + 12, "evicted views released right away" );
+		bool othersKept = true;
+		for (int i = 0; i <= 12; ++i) {
+			if (i != 1 && (cache.Find( &textures[i] ) == nullptr || cache.Find( &textures[i] )->id != i))
+				othersKept = false;
+		}
+		Check( othersKept, "other entries kept" );
+	}
+
+	// keys placed at addresses that hash to few slots, so that entries have to be moved back on removal
+	void CheckCollisions() {
+		Cache cache;
+		std::shared_ptr<int> alive = std::make_shared<int>();
+		FakeTexture textures[64];
+		FakeTexture *colliding[8];
+		size_t count = 0;
+		size_t home = std::hash<FakeTexture*>()( &textures[0] ) & 15;
+		for (FakeTexture &texture : textures) {
+			if (count < 8 && (std::hash<FakeTexture*>()( &texture ) & 15) == home)
+				colliding[count++] = &texture;
+		}
+		// a hash spreading the addresses well leaves nothing to probe, but still has to find everything
+		for (FakeTexture &texture : textures) {
+			if (count < 8 && (std::hash<FakeTexture*>()( &texture ) & 15) != home)
+				colliding[count++] = &texture;
+		}
+		for (size_t i = 0; i < count; ++i) {
+			Fill( cache, colliding[i], alive, int(i) );
+		}
+		for (size_t removed = 0; removed < count; ++removed) {
+			cache.Erase( colliding[removed] );
+			bool found = true;
+			for (size_t i = removed + 1; i < count; ++i) {
+				if (cache.Find( colliding[i] ) == nullptr || cache.Find( colliding[i] )->id != int(i))
+					found = false;
+			}
+			Check( found, "entries after a removed one still found" );
+		}
+		Check( cache.Size() == 0 && alive.use_count() == 1, "all colliding entries removed" );
+	}
+}
+
+int main() {
+	CheckHits();
+	CheckStaleEntries();
+	CheckEviction();
+	CheckCollisions();
+	if (failures != 0) {
+		fprintf( stderr, "%d checks failed\n", failures );
+		return 1;
+	}
+	printf( "all checks passed\n" );
+	return 0;
+}
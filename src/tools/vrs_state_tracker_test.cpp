@@ -0,0 +1,148 @@
+// Checks which VRS updates reach the driver through a backend that records its calls in place of NVAPI: repeated
+// binds of the same view and table are avoided, anything that may have reset the context's state makes the next
+// update go through again, failed driver calls are retried, and the calls issued and avoided are counted by frame.
+#include "../vrs/VrsStateTracker.h"
+#include <cstdio>
+#include <string>
+
+using namespace vr;
+
+namespace {
+	// stand-ins for shading rate views; the tracker only compares their addresses
+	char views[4];
+
+	ID3D11NvShadingRateResourceView * View( int index ) {
+		return reinterpret_cast<ID3D11NvShadingRateResourceView*>( &views[index] );
+	}
+
+	// appends a letter per driver call: the index of the view bound, R for rates on and O for off
+	class RecordingBackend : public VrsBackend {
+	public:
+		std::string calls;
+		bool failing = false;
+		bool failingRates = false;
+
+		bool BindShadingRateView( ID3D11NvShadingRateResourceView *view ) override {
+			calls += char('0' + (reinterpret_cast<char*>( view ) - views));
+			return !failing;
+		}
+
+		bool SetShadingRates( bool enabled ) override {
+			calls += enabled ? 'R' : 'O';
+			return !failing && !failingRates;
+		}
+
+		// the calls since the last time taken
+		std::string Take() {
+			std::string taken;
+			taken.swap( calls );
+			return taken;
+		}
+	};
+
+	int failures = 0;
+
+	void Check( bool condition, const char *what ) {
+		if (!condition) {
+			fprintf( stderr, "FAIL  %s\n", what );
+			++failures;
+		}
+	}
+
+	void CheckRedundantCalls() {
+		RecordingBackend backend;
+		VrsStateTracker tracker;
+		tracker.SetBackend( &backend );
+
+		// the game binds the same eye target for many draws
+		for (int i = 0; i < 10; ++i) {
+			Check( tracker.Enable( View( 1 ) ), "enable succeeds" );
+		}
+		Check( backend.Take() == "1R", "view and rates sent once" );
+
+		tracker.Enable( View( 2 ) );
+		Check( backend.Take() == "2", "other view bound, rates unchanged" );
+		tracker.Disable();
+		tracker.Disable();
+		Check( backend.Take() == "O", "disabled once" );
+		tracker.Enable( View( 2 ) );
+		Check( backend.Take() == "R", "bound view kept while disabled" );
+
+		tracker.Invalidate();
+		tracker.Enable( View( 2 ) );
+		Check( backend.Take() == "2R", "everything sent again after the state may have been reset" );
+
+		tracker.ForgetView( View( 1 ) );
+		tracker.Enable( View( 2 ) );
+		Check( backend.Take() == "", "forgetting another view changes nothing" );
+		tracker.ForgetView( View( 2 ) );
+		tracker.Enable( View( 2 ) );
+		Check( backend.Take() == "2", "view recreated at the same address bound again" );
+
+		tracker.SetBackend( &backend );
+		tracker.Enable( View( 2 ) );
+		Check( backend.Take() == "2R", "new backend starts from scratch" );
+	}
+
+	void CheckFailures() {
+		RecordingBackend backend;
+		VrsStateTracker tracker;
+		tracker.SetBackend( &backend );
+
+		backend.failing = true;
+		Check( !tracker.Enable( View( 1 ) ), "failed bind reported" );
+		Check( backend.Take() == "1", "rates not set after a failed bind" );
+		backend.failing = false;
+		Check( tracker.Enable( View( 1 ) ) && backend.Take() == "1R", "failed bind retried" );
+
+		backend.failing = true;
+		Check( !tracker.Disable(), "failed disable reported" );
+		backend.failing = false;
+		Check( backend.Take() == "O", "disable sent" );
+		tracker.Disable();
+		Check( backend.Take() == "O", "failed disable retried" );
+
+		// a failed rates call leaves the driver state unknown, even if it was what we sent last time
+		tracker.Enable( View( 1 ) );
+		backend.Take();
+		backend.failingRates = true;
+		tracker.Invalidate();
+		Check( !tracker.Enable( View( 1 ) ) && backend.Take() == "1R", "failed rates reported" );
+		backend.failingRates = false;
+		tracker.Enable( View( 1 ) );
+		Check( backend.Take() == "R", "rates sent again, view kept" );
+	}
+
+	void CheckFrameStats() {
+		RecordingBackend backend;
+		VrsStateTracker tracker;
+		tracker.SetBackend( &backend );
+
+		for (int i = 0; i < 4; ++i) {
+			tracker.Enable( View( 1 ) );
+		}
+		tracker.Disable();
+		// 1 + 1 issued for the first enable, 2 avoided for each further one, 1 issued for the disable
+		Check( tracker.LastFrameStats().issued == 0, "nothing reported before the frame ends" );
+		tracker.EndFrame();
+		Check( tracker.LastFrameStats().issued == 3 && tracker.LastFrameStats().avoided == 6, "frame's calls counted" );
+
+		tracker.Enable( View( 1 ) );
+		Check( backend.Take() == "1RO1R", "state forgotten at the end of the frame" );
+		tracker.EndFrame();
+		Check( tracker.LastFrameStats().issued == 2 && tracker.LastFrameStats().avoided == 0, "next frame counted on its own" );
+		Check( tracker.TotalStats().issued == 5 && tracker.TotalStats().avoided == 6, "totals add up the frames" );
+	}
+}
+
+int main() {
+	CheckRedundantCalls();
+	CheckFailures();
+	CheckFrameStats();
+	if (failures != 0) {
+		fprintf( stderr, "%d checks failed\n", failures );
+		return 1;
+	}
+	printf( "all checks passed\n" );
+	return 0;
+}
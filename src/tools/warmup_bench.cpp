@@ -0,0 +1,303 @@
+// Checks the order in which ResourceWarmup runs, hands out and drops jobs, with or without waiting for a running
+// one, against a mock device whose objects take a while to create, and measures what the first use of those
+// objects stalls for with and without warm-up: once created inline, as on the first Submit before, and once taken
+// from a warm-up requested while the game loads.
+#include "../postprocess/ResourceWarmup.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+using namespace vr;
+
+namespace {
+	// stands in for ID3D11Device, with creation calls as slow as a driver compiling shaders
+	class MockDevice {
+	public:
+		explicit MockDevice( std::chrono::microseconds createTime ) : createTime( createTime ) {}
+
+		std::shared_ptr<int> CreateObjects( int value ) {
+			std::this_thread::sleep_for( createTime );
+			++created;
+			return std::make_shared<int>( value );
+		}
+
+		std::atomic<uint64_t> created { 0 };
+
+	private:
+		std::chrono::microseconds createTime;
+	};
+
+	// holds a job until opened, to order the worker against the checks
+	class Gate {
+	public:
+		void Open() {
+			std::lock_guard<std::mutex> lock( mutex );
+			open = true;
+			changed.notify_all();
+		}
+
+		void Pass() {
+			std::unique_lock<std::mutex> lock( mutex );
+			entered = true;
+			changed.notify_all();
+			changed.wait( lock, [this] { return open; } );
+		}
+
+		void WaitEntered() {
+			std::unique_lock<std::mutex> lock( mutex );
+			changed.wait( lock, [this] { return entered; } );
+		}
+
+	private:
+		std::mutex mutex;
+		std::condition_variable changed;
+		bool open = false;
+		bool entered = false;
+	};
+
+	int objects[16];
+
+	ResourceWarmup::Key KeyFor( int index, uint32_t kind = 0 ) {
+		return ResourceWarmup::Key { &objects[index], kind };
+	}
+
+	ResourceWarmup::Job ValueJob( int value ) {
+		return [value]() -> std::shared_ptr<void> { return std::make_shared<int>( value ); };
+	}
+
+	ResourceWarmup::Job GatedJob( Gate &gate, int value ) {
+		return [&gate, value]() -> std::shared_ptr<void> {
+			gate.Pass();
+			return std::make_shared<int>( value );
+		};
+	}
+
+	// jobs run in the order requested, so once a later job has run, all earlier ones have finished
+	void WaitForEarlierJobs( ResourceWarmup &warmup ) {
+		Gate marker;
+		marker.Open();
+		warmup.Request( KeyFor( 15 ), GatedJob( marker, 0 ) );
+		marker.WaitEntered();
+		warmup.Take<int>( KeyFor( 15 ) );
+	}
+
+	int failures = 0;
+
+	void Check( bool condition, const char *what ) {
+		if (!condition) {
+			fprintf( stderr, "FAIL  %s\n", what );
+			++failures;
+		}
+	}
+
+	bool HasValue( const std::shared_ptr<int> &result, int value ) {
+		return result && *result == value;
+	}
+
+	void CheckScheduling() {
+		{
+			ResourceWarmup warmup;
+			Check( warmup.Request( KeyFor( 0 ), ValueJob( 1 ) ), "request queued" );
+			Check( !warmup.Request( KeyFor( 0 ), ValueJob( 2 ) ), "pending key not requested again" );
+			Check( warmup.Request( KeyFor( 0, 1 ), ValueJob( 3 ) ), "same object, other kind queued" );
+			WaitForEarlierJobs( warmup );
+			// the marker job may have been waited for
+			uint64_t waited = warmup.Stats().waited;
+			Check( warmup.IsPending( KeyFor( 0 ) ), "finished result pending until taken" );
+			Check( HasValue( warmup.Take<int>( KeyFor( 0 ) ), 1 ), "finished result taken" );
+			Check( HasValue( warmup.Take<int>( KeyFor( 0, 1 ) ), 3 ), "result of other kind taken" );
+			Check( !warmup.IsPending( KeyFor( 0 ) ) && !warmup.Take<int>( KeyFor( 0 ) ), "result taken only once" );
+			Check( !warmup.Take<int>( KeyFor( 1 ) ), "nothing for a key never requested" );
+			Check( warmup.Stats().waited == waited, "finished results not waited for" );
+		}
+		{
+			ResourceWarmup warmup;
+			Gate gate;
+			std::atomic<bool> ran( false );
+			warmup.Request( KeyFor( 0 ), GatedJob( gate, 1 ) );
+			warmup.Request( KeyFor( 1 ), [&ran]() -> std::shared_ptr<void> { ran = true; return std::make_shared<int>( 2 ); } );
+			gate.WaitEntered();
+			Check( !warmup.Take<int>( KeyFor( 1 ) ) && !warmup.IsPending( KeyFor( 1 ) ), "queued job cancelled by taking it" );
+			gate.Open();
+			WaitForEarlierJobs( warmup );
+			Check( !ran, "cancelled job never run" );
+			Check( warmup.Stats().cancelled == 1, "cancellation counted" );
+		}
+		{
+			ResourceWarmup warmup;
+			Gate gate;
+			warmup.Request( KeyFor( 0 ), GatedJob( gate, 1 ) );
+			gate.WaitEntered();
+			std::thread opener( [&gate] {
+				std::this_thread::sleep_for( std::chrono::milliseconds( 100 ) );
+				gate.Open();
+			} );
+			Check( HasValue( warmup.Take<int>( KeyFor( 0 ) ), 1 ), "running job waited for" );
+			opener.join();
+			WarmupStats stats = warmup.Stats();
+			Check( stats.waited == 1 && stats.taken == 1, "wait counted" );
+		}
+		{
+			ResourceWarmup warmup;
+			Gate gate;
+			std::atomic<bool> finished( false );
+			warmup.Request( KeyFor( 0 ), ValueJob( 1 ) );
+			WaitForEarlierJobs( warmup );
+			warmup.Request( KeyFor( 1 ), [&]() -> std::shared_ptr<void> {
+				gate.Pass();
+				finished = true;
+				return std::make_shared<int>( 2 );
+			} );
+			warmup.Request( KeyFor( 2 ), ValueJob( 3 ) );
+			gate.WaitEntered();
+			std::thread opener( [&gate] {
+				std::this_thread::sleep_for( std::chrono::milliseconds( 100 ) );
+				gate.Open();
+			} );
+			warmup.Clear();
+			Check( finished, "clear waits for the running job" );
+			opener.join();
+			Check( !warmup.IsPending( KeyFor( 0 ) ) && !warmup.IsPending( KeyFor( 1 ) ) && !warmup.IsPending( KeyFor( 2 ) ), "clear drops everything" );
+			Check( warmup.Stats().discarded == 2, "finished and running results discarded" );
+			Check( warmup.Request( KeyFor( 1 ), ValueJob( 4 ) ), "request after clear queued" );
+			WaitForEarlierJobs( warmup );
+			Check( HasValue( warmup.Take<int>( KeyFor( 1 ) ), 4 ), "result after clear taken" );
+		}
+		{
+			ResourceWarmup warmup;
+			Gate gate;
+			warmup.Request( KeyFor( 0 ), ValueJob( 1 ) );
+			WaitForEarlierJobs( warmup );
+			warmup.Request( KeyFor( 1 ), GatedJob( gate, 2 ) );
+			warmup.Request( KeyFor( 2 ), ValueJob( 3 ) );
+			gate.WaitEntered();
+			// returns while the job is held up at the gate
+			warmup.Discard();
+			Check( !warmup.IsPending( KeyFor( 0 ) ) && !warmup.IsPending( KeyFor( 1 ) ) && !warmup.IsPending( KeyFor( 2 ) ), "discard drops everything" );
+			const uint64_t waited = warmup.Stats().waited;
+			Check( !warmup.Take<int>( KeyFor( 1 ) ) && warmup.Stats().waited == waited, "discarded running job not waited for" );
+			Check( !warmup.Request( KeyFor( 1 ), ValueJob( 4 ) ), "key of a discarded running job not requested again" );
+			gate.Open();
+			WaitForEarlierJobs( warmup );
+			Check( warmup.Stats().discarded == 2, "finished and running results discarded" );
+			Check( warmup.Request( KeyFor( 1 ), ValueJob( 5 ) ), "key requested again once its discarded job is done" );
+			WaitForEarlierJobs( warmup );
+			Check( HasValue( warmup.Take<int>( KeyFor( 1 ) ), 5 ), "result after discard taken" );
+		}
+		{
+			// room for the marker job of WaitForEarlierJobs
+			ResourceWarmup warmup( 3 );
+			warmup.Request( KeyFor( 0 ), ValueJob( 1 ) );
+			warmup.Request( KeyFor( 1 ), ValueJob( 2 ) );
+			WaitForEarlierJobs( warmup );
+			warmup.Request( KeyFor( 2 ), ValueJob( 3 ) );
+			Check( warmup.Request( KeyFor( 3 ), ValueJob( 4 ) ), "full warm-up makes room" );
+			Check( !warmup.IsPending( KeyFor( 0 ) ) && warmup.IsPending( KeyFor( 1 ) ), "oldest result dropped for room" );
+			warmup.Clear();
+
+			Gate gate;
+			warmup.Request( KeyFor( 0 ), GatedJob( gate, 1 ) );
+			warmup.Request( KeyFor( 1 ), ValueJob( 2 ) );
+			warmup.Request( KeyFor( 2 ), ValueJob( 3 ) );
+			gate.WaitEntered();
+			Check( !warmup.Request( KeyFor( 3 ), ValueJob( 4 ) ), "request rejected while only unfinished jobs are pending" );
+			Check( warmup.Stats().rejected == 1, "rejection counted" );
+			gate.Open();
+			// the destructor leaves the thread running, which must not outlive the gate
+			warmup.Stop();
+		}
+		{
+			ResourceWarmup warmup;
+			warmup.Request( KeyFor( 0 ), []() -> std::shared_ptr<void> { return nullptr; } );
+			warmup.Request( KeyFor( 1 ), []() -> std::shared_ptr<void> { throw std::runtime_error( "device removed" ); } );
+			WaitForEarlierJobs( warmup );
+			Check( !warmup.IsPending( KeyFor( 0 ) ) && !warmup.Take<int>( KeyFor( 0 ) ), "failed job leaves nothing to take" );
+			Check( !warmup.IsPending( KeyFor( 1 ) ) && !warmup.Take<int>( KeyFor( 1 ) ), "throwing job leaves nothing to take" );
+			Check( warmup.Stats().failed == 2, "failures counted" );
+		}
+		{
+			ResourceWarmup warmup;
+			warmup.Request( KeyFor( 0 ), ValueJob( 1 ) );
+			WaitForEarlierJobs( warmup );
+			warmup.Stop();
+			Check( !warmup.IsPending( KeyFor( 0 ) ), "stop drops results" );
+			Check( warmup.Request( KeyFor( 0 ), ValueJob( 2 ) ), "request after stop queued" );
+			WaitForEarlierJobs( warmup );
+			Check( HasValue( warmup.Take<int>( KeyFor( 0 ) ), 2 ), "thread restarted after stop" );
+		}
+	}
+
+	// what the first frame waits for: creating the objects inline, or taking them after the game loaded for loadTime
+	double FirstUseMilliseconds( MockDevice &device, ResourceWarmup *warmup, std::chrono::milliseconds loadTime, int objectCount ) {
+		if (warmup) {
+			for (int i = 0; i < objectCount; ++i) {
+				warmup->Request( KeyFor( i ), [&device, i]() -> std::shared_ptr<void> { return device.CreateObjects( i ); } );
+			}
+		}
+		std::this_thread::sleep_for( loadTime );
+
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < objectCount; ++i) {
+			std::shared_ptr<int> result = warmup ? warmup->Take<int>( KeyFor( i ) ) : nullptr;
+			if (!result)
+				result = device.CreateObjects( i );
+			Check( HasValue( result, i ), "first use gets the right objects" );
+		}
+		return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+	}
+
+	int Usage() {
+		fprintf( stderr,
+			"usage: warmup_bench [--create-ms time] [--load-ms time]\n"
+			"Checks the warm-up scheduling, then compares the stall on first use of 8 objects that take create-ms each\n"
+			"to create (default 5) with and without warm-up requested load-ms before (default 60).\n" );
+		return 2;
+	}
+}
+
+int main( int argc, char **argv ) {
+	long createMs = 5;
+	long loadMs = 60;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp( argv[i], "--create-ms" ) == 0 && i + 1 < argc) {
+			createMs = atol( argv[++i] );
+			if (createMs < 0)
+				return Usage();
+		} else if (strcmp( argv[i], "--load-ms" ) == 0 && i + 1 < argc) {
+			loadMs = atol( argv[++i] );
+			if (loadMs < 0)
+				return Usage();
+		} else {
+			return Usage();
+		}
+	}
+
+	CheckScheduling();
+
+	const int objectCount = 8;
+	std::chrono::milliseconds createTime( createMs ), loadTime( loadMs );
+	MockDevice device( createTime );
+	double inlineMs = FirstUseMilliseconds( device, nullptr, loadTime, objectCount );
+	ResourceWarmup warmup;
+	double warmedMs = FirstUseMilliseconds( device, &warmup, loadTime, objectCount );
+	WarmupStats stats = warmup.Stats();
+	Check( device.created == 2 * objectCount, "objects created once per run" );
+
+	printf( "first use, created inline   %8.2f ms\n", inlineMs );
+	printf( "first use, warmed up        %8.2f ms\n", warmedMs );
+	printf( "%llu taken, %llu waited for, %llu cancelled\n", (unsigned long long)stats.taken, (unsigned long long)stats.waited,
+		(unsigned long long)stats.cancelled );
+	if (failures != 0) {
+		fprintf( stderr, "%d checks failed\n", failures );
+		return 1;
+	}
+	return 0;
+}
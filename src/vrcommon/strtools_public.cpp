@@ -1,5 +1,6 @@
 //========= Copyright Valve Corporation ============//
 #include <vrcommon/strtools_public.h>
+#include <stdarg.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
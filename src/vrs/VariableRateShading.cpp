@@ -7,25 +7,25 @@ namespace vr {
 
 	void CheckResult(const std::string &operation, NvAPI_Status result) {
 		if (result != NVAPI_OK) {
-			Log() << "Failed (" << std::hex << result << std::dec << "): " << operation << std::endl;
+			Log(LogLevel::Error) << "Failed (" << std::hex << result << std::dec << "): " << operation << "\n";
 			throw std::exception();
 		}
 	}
 
-	uint8_t DistanceToVRSLevel(float distance) {
-		if (distance < Config::Instance().innerRadius) {
+	uint8_t DistanceToVRSLevel(float distance, const float (&radii)[3]) {
+		if (distance < radii[0]) {
 			return 0;
 		}
-		if (distance < Config::Instance().midRadius) {
+		if (distance < radii[1]) {
 			return 1;
 		}
-		if (distance < Config::Instance().outerRadius) {
+		if (distance < radii[2]) {
 			return 2;
 		}
 		return 3;
 	}
 
-	std::vector<uint8_t> CreateCombinedFixedFoveatedVRSPattern( int width, int height, float leftProjX, float leftProjY, float rightProjX, float rightProjY ) {
+	std::vector<uint8_t> CreateCombinedFixedFoveatedVRSPattern( int width, int height, float leftProjX, float leftProjY, float rightProjX, float rightProjY, const float (&radii)[3] ) {
 		std::vector<uint8_t> data (width * height);
 		int halfWidth = width / 2;
 
@@ -34,20 +34,20 @@ namespace vr {
 				float fx = float(x) / halfWidth;
 				float fy = float(y) / height;
 				float distance = 2 * sqrtf((fx - leftProjX) * (fx - leftProjX) + (fy - leftProjY) * (fy - leftProjY));
-				data[y * width + x] = DistanceToVRSLevel(distance);
+				data[y * width + x] = DistanceToVRSLevel(distance, radii);
 			}
 			for (int x = halfWidth; x < width; ++x) {
 				float fx = float(x - halfWidth) / halfWidth;
 				float fy = float(y) / height;
 				float distance = 2 * sqrtf((fx - rightProjX) * (fx - rightProjX) + (fy - rightProjY) * (fy - rightProjY));
-				data[y * width + x] = DistanceToVRSLevel(distance);
+				data[y * width + x] = DistanceToVRSLevel(distance, radii);
 			}
 		}
 
 		return data;
 	}
 
-	std::vector<uint8_t> CreateSingleEyeFixedFoveatedVRSPattern( int width, int height, float projX, float projY ) {
+	std::vector<uint8_t> CreateSingleEyeFixedFoveatedVRSPattern( int width, int height, float projX, float projY, const float (&radii)[3] ) {
 		std::vector<uint8_t> data (width * height);
 
 		for (int y = 0; y < height; ++y) {
@@ -55,13 +55,21 @@ namespace vr {
 				float fx = float(x) / width;
 				float fy = float(y) / height;
 				float distance = 2 * sqrtf((fx - projX) * (fx - projX) + (fy - projY) * (fy - projY));
-				data[y * width + x] = DistanceToVRSLevel(distance);
+				data[y * width + x] = DistanceToVRSLevel(distance, radii);
 			}
 		}
 
 		return data;
 	}
 
+	// NVAPI counts how often it was initialized and only unloads with the last NvAPI_Unload
+	NvapiPreload::NvapiPreload() : loaded(NvAPI_Initialize() == NVAPI_OK) {}
+
+	NvapiPreload::~NvapiPreload() {
+		if (loaded)
+			NvAPI_Unload();
+	}
+
 	VariableRateShading & VariableRateShading::Instance() {
 		static VariableRateShading instance;
 		return instance;
@@ -69,7 +77,7 @@ namespace vr {
 
 	void VariableRateShading::Init(ComPtr<ID3D11Device> device, ComPtr<ID3D11DeviceContext> context) {
 		initialized = false;
-		Log() << "Trying to load NVAPI..." << std::endl;
+		Log() << "Trying to load NVAPI...\n";
 
 		if (!nvapiLoaded) {
 			NvAPI_Status result = NvAPI_Initialize();
@@ -83,14 +91,16 @@ namespace vr {
 		memset(&caps, 0, sizeof(NV_D3D1x_GRAPHICS_CAPS));
 		NvAPI_Status status = NvAPI_D3D1x_GetGraphicsCapabilities(device.Get(), NV_D3D1x_GRAPHICS_CAPS_VER, &caps);
 		if (status != NVAPI_OK || !caps.bVariablePixelRateShadingSupported) {
-			Log() << "Variable rate shading is not available." << std::endl;
+			Log() << "Variable rate shading is not available.\n";
 			return;
 		}
 
 		this->device = device;
 		this->context = context;
+		nvapiBackend.context = context;
+		stateTracker.Invalidate();
 		initialized = true;
-		Log() << "Successfully initialized NVAPI; Variable Rate Shading is available." << std::endl;
+		Log() << "Successfully initialized NVAPI; Variable Rate Shading is available.\n";
 	}
 
 	void VariableRateShading::Reset() {
@@ -108,6 +118,8 @@ namespace vr {
 		arrayVRSView.Reset();
 		device.Reset();
 		context.Reset();
+		nvapiBackend.context.Reset();
+		stateTracker.Invalidate();
 	}
 
 	void VariableRateShading::ApplyCombinedVRS( int width, int height, float leftProjX, float leftProjY, float rightProjX, float rightProjY ) {
@@ -115,14 +127,11 @@ namespace vr {
 			return;
 
 		SetupCombinedVRS( width, height, leftProjX, leftProjY, rightProjX, rightProjY );
-		NvAPI_Status status = NvAPI_D3D11_RSSetShadingRateResourceView( context.Get(), combinedVRSView.Get() );
-		if (status != NVAPI_OK) {
-			Log() << "Error while setting shading rate resource view: " << status << std::endl;
-			Reset();
+		if (!initialized)
 			return;
+		if (!stateTracker.Enable( combinedVRSView.Get() )) {
+			Reset();
 		}
-
-		EnableVRS();
 	}
 
 	void VariableRateShading::ApplyArrayVRS( int width, int height, float leftProjX, float leftProjY, float rightProjX, float rightProjY ) {
@@ -130,14 +139,11 @@ namespace vr {
 			return;
 
 		SetupArrayVRS( width, height, leftProjX, leftProjY, rightProjX, rightProjY );
-		NvAPI_Status status = NvAPI_D3D11_RSSetShadingRateResourceView( context.Get(), arrayVRSView.Get() );
-		if (status != NVAPI_OK) {
-			Log() << "Error while setting shading rate resource view: " << status << std::endl;
-			Reset();
+		if (!initialized)
 			return;
+		if (!stateTracker.Enable( arrayVRSView.Get() )) {
+			Reset();
 		}
-
-		EnableVRS();
 	}
 
 	void VariableRateShading::ApplySingleEyeVRS( EVREye eye, int width, int height, float projX, float projY ) {
@@ -145,45 +151,64 @@ namespace vr {
 			return;
 
 		SetupSingleEyeVRS( eye, width, height, projX, projY );
-		NvAPI_Status status = NvAPI_D3D11_RSSetShadingRateResourceView( context.Get(), singleEyeVRSView[eye].Get() );
-		if (status != NVAPI_OK) {
-			Log() << "Error while setting shading rate resource view: " << status << std::endl;
-			Reset();
+		if (!initialized)
 			return;
+		if (!stateTracker.Enable( singleEyeVRSView[eye].Get() )) {
+			Reset();
 		}
+	}
 
-		EnableVRS();
+	void VariableRateShading::SetRadii( float inner, float mid, float outer ) {
+		if (inner == radii[0] && mid == radii[1] && outer == radii[2])
+			return;
+		radii[0] = inner;
+		radii[1] = mid;
+		radii[2] = outer;
+		// the patterns are recreated with the new radii when next applied
+		for (int eye = 0; eye < 2; ++eye) {
+			stateTracker.ForgetView( singleEyeVRSView[eye].Get() );
+			singleEyeVRSTex[eye].Reset();
+			singleEyeVRSView[eye].Reset();
+		}
+		stateTracker.ForgetView( combinedVRSView.Get() );
+		combinedVRSTex.Reset();
+		combinedVRSView.Reset();
+		stateTracker.ForgetView( arrayVRSView.Get() );
+		arrayVRSTex.Reset();
+		arrayVRSView.Reset();
 	}
 
 	void VariableRateShading::DisableVRS() {
 		if (!initialized)
 			return;
 
-		NV_D3D11_VIEWPORT_SHADING_RATE_DESC vsrd[2];
-		vsrd[0].enableVariablePixelShadingRate = false;
-		vsrd[1].enableVariablePixelShadingRate = false;
-		memset(vsrd[0].shadingRateTable, 0, sizeof(vsrd[0].shadingRateTable));
-		memset(vsrd[1].shadingRateTable, 0, sizeof(vsrd[1].shadingRateTable));
-		NV_D3D11_VIEWPORTS_SHADING_RATE_DESC srd;
-		srd.version = NV_D3D11_VIEWPORTS_SHADING_RATE_DESC_VER;
-		srd.numViewports = 2;
-		srd.pViewports = vsrd;
-		NvAPI_Status status = NvAPI_D3D11_RSSetViewportsPixelShadingRates( context.Get(), &srd );
-		if (status != NVAPI_OK) {
-			Log() << "Error while setting shading rates: " << status << std::endl;
+		if (!stateTracker.Disable()) {
 			Reset();
 		}
 	}
 
-	void VariableRateShading::EnableVRS() {
+	bool VariableRateShading::NvapiBackend::BindShadingRateView( ID3D11NvShadingRateResourceView *view ) {
+		NvAPI_Status status = NvAPI_D3D11_RSSetShadingRateResourceView( context.Get(), view );
+		if (status != NVAPI_OK) {
+			LOG_LIMITED(LogLevel::Error, 1) << "Error while setting shading rate resource view: " << status << "\n";
+			return false;
+		}
+		return true;
+	}
+
+	bool VariableRateShading::NvapiBackend::SetShadingRates( bool enabled ) {
 		NV_D3D11_VIEWPORT_SHADING_RATE_DESC vsrd[2];
 		for (int i = 0; i < 2; ++i) {
-			vsrd[i].enableVariablePixelShadingRate = true;
-			memset(vsrd[i].shadingRateTable, 5, sizeof(vsrd[i].shadingRateTable));
-			vsrd[i].shadingRateTable[0] = NV_PIXEL_X1_PER_RASTER_PIXEL;
-			vsrd[i].shadingRateTable[1] = NV_PIXEL_X1_PER_1X2_RASTER_PIXELS;
-			vsrd[i].shadingRateTable[2] = NV_PIXEL_X1_PER_2X2_RASTER_PIXELS;
-			vsrd[i].shadingRateTable[3] = NV_PIXEL_X1_PER_4X4_RASTER_PIXELS;
+			vsrd[i].enableVariablePixelShadingRate = enabled;
+			if (enabled) {
+				memset(vsrd[i].shadingRateTable, 5, sizeof(vsrd[i].shadingRateTable));
+				vsrd[i].shadingRateTable[0] = NV_PIXEL_X1_PER_RASTER_PIXEL;
+				vsrd[i].shadingRateTable[1] = NV_PIXEL_X1_PER_1X2_RASTER_PIXELS;
+				vsrd[i].shadingRateTable[2] = NV_PIXEL_X1_PER_2X2_RASTER_PIXELS;
+				vsrd[i].shadingRateTable[3] = NV_PIXEL_X1_PER_4X4_RASTER_PIXELS;
+			} else {
+				memset(vsrd[i].shadingRateTable, 0, sizeof(vsrd[i].shadingRateTable));
+			}
 		}
 		NV_D3D11_VIEWPORTS_SHADING_RATE_DESC srd;
 		srd.version = NV_D3D11_VIEWPORTS_SHADING_RATE_DESC_VER;
@@ -191,24 +216,32 @@ namespace vr {
 		srd.pViewports = vsrd;
 		NvAPI_Status status = NvAPI_D3D11_RSSetViewportsPixelShadingRates( context.Get(), &srd );
 		if (status != NVAPI_OK) {
-			Log() << "Error while setting shading rates: " << status << std::endl;
-			Reset();
+			LOG_LIMITED(LogLevel::Error, 1) << "Error while setting shading rates: " << status << "\n";
+			return false;
 		}
+		return true;
 	}
 
 	void VariableRateShading::SetupSingleEyeVRS( EVREye eye, int width, int height, float projX, float projY ) {
-		if (!initialized || (singleEyeVRSTex[eye] && width == singleWidth[eye] && height == singleHeight[eye])) {
+		int vrsWidth = width / NV_VARIABLE_PIXEL_SHADING_TILE_WIDTH;
+		int vrsHeight = height / NV_VARIABLE_PIXEL_SHADING_TILE_HEIGHT;
+		// the center follows the eye's viewport, but the pattern only changes once it moves to another tile
+		int centerX = int(projX * vrsWidth);
+		int centerY = int(projY * vrsHeight);
+		if (!initialized || (singleEyeVRSTex[eye] && width == singleWidth[eye] && height == singleHeight[eye]
+				&& centerX == singleCenterX[eye] && centerY == singleCenterY[eye])) {
 			return;
 		}
+		stateTracker.ForgetView( singleEyeVRSView[eye].Get() );
 		singleEyeVRSTex[eye].Reset();
 		singleEyeVRSView[eye].Reset();
 
 		singleWidth[eye] = width;
 		singleHeight[eye] = height;
-		int vrsWidth = width / NV_VARIABLE_PIXEL_SHADING_TILE_WIDTH;
-		int vrsHeight = height / NV_VARIABLE_PIXEL_SHADING_TILE_HEIGHT;
+		singleCenterX[eye] = centerX;
+		singleCenterY[eye] = centerY;
 
-		Log() << "Creating VRS pattern texture for eye " << eye << " of size " << vrsWidth << "x" << vrsHeight << std::endl;
+		Log() << "Creating VRS pattern texture for eye " << eye << " of size " << vrsWidth << "x" << vrsHeight << "\n";
 
 		D3D11_TEXTURE2D_DESC td = {};
 		td.Width = vrsWidth;
@@ -222,7 +255,7 @@ namespace vr {
 		td.CPUAccessFlags = 0;
 		td.MiscFlags= 0;
 		td.MipLevels = 1;
-		auto data = CreateSingleEyeFixedFoveatedVRSPattern(vrsWidth, vrsHeight, projX, projY);
+		auto data = CreateSingleEyeFixedFoveatedVRSPattern(vrsWidth, vrsHeight, projX, projY, radii);
 		D3D11_SUBRESOURCE_DATA srd;
 		srd.pSysMem = data.data();
 		srd.SysMemPitch = vrsWidth;
@@ -230,11 +263,11 @@ namespace vr {
 		HRESULT result = device->CreateTexture2D( &td, &srd, singleEyeVRSTex[eye].GetAddressOf() );
 		if (FAILED(result)) {
 			Reset();
-			Log() << "Failed to create VRS pattern texture for eye " << eye << ": " << std::hex << result << std::dec << std::endl;
+			Log() << "Failed to create VRS pattern texture for eye " << eye << ": " << std::hex << result << std::dec << "\n";
 			return;
 		}
 
-		Log() << "Creating shading rate resource view for eye " << eye << std::endl;
+		Log() << "Creating shading rate resource view for eye " << eye << "\n";
 		NV_D3D11_SHADING_RATE_RESOURCE_VIEW_DESC vd = {};
 		vd.version = NV_D3D11_SHADING_RATE_RESOURCE_VIEW_DESC_VER;
 		vd.Format = td.Format;
@@ -243,7 +276,7 @@ namespace vr {
 		NvAPI_Status status = NvAPI_D3D11_CreateShadingRateResourceView( device.Get(), singleEyeVRSTex[eye].Get(), &vd, singleEyeVRSView[eye].GetAddressOf() );
 		if (status != NVAPI_OK) {
 			Reset();
-			Log() << "Failed to create VRS pattern view for eye " << eye << ": " << status << std::endl;
+			Log() << "Failed to create VRS pattern view for eye " << eye << ": " << status << "\n";
 			return;
 		}
 	}
@@ -252,6 +285,7 @@ namespace vr {
 		if (!initialized || (combinedVRSTex && width == combinedWidth && height == combinedHeight)) {
 			return;
 		}
+		stateTracker.ForgetView( combinedVRSView.Get() );
 		combinedVRSTex.Reset();
 		combinedVRSView.Reset();
 
@@ -260,7 +294,7 @@ namespace vr {
 		int vrsWidth = width / NV_VARIABLE_PIXEL_SHADING_TILE_WIDTH;
 		int vrsHeight = height / NV_VARIABLE_PIXEL_SHADING_TILE_HEIGHT;
 
-		Log() << "Creating combined VRS pattern texture of size " << vrsWidth << "x" << vrsHeight << std::endl;
+		Log() << "Creating combined VRS pattern texture of size " << vrsWidth << "x" << vrsHeight << "\n";
 
 		D3D11_TEXTURE2D_DESC td = {};
 		td.Width = vrsWidth;
@@ -274,7 +308,7 @@ namespace vr {
 		td.CPUAccessFlags = 0;
 		td.MiscFlags= 0;
 		td.MipLevels = 1;
-		auto data = CreateCombinedFixedFoveatedVRSPattern(vrsWidth, vrsHeight, leftProjX, leftProjY, rightProjX, rightProjY);
+		auto data = CreateCombinedFixedFoveatedVRSPattern(vrsWidth, vrsHeight, leftProjX, leftProjY, rightProjX, rightProjY, radii);
 		D3D11_SUBRESOURCE_DATA srd;
 		srd.pSysMem = data.data();
 		srd.SysMemPitch = vrsWidth;
@@ -282,11 +316,11 @@ namespace vr {
 		HRESULT result = device->CreateTexture2D( &td, &srd, combinedVRSTex.GetAddressOf() );
 		if (FAILED(result)) {
 			Reset();
-			Log() << "Failed to create combined VRS pattern texture: " << std::hex << result << std::dec << std::endl;
+			Log() << "Failed to create combined VRS pattern texture: " << std::hex << result << std::dec << "\n";
 			return;
 		}
 
-		Log() << "Creating combined shading rate resource view" << std::endl;
+		Log() << "Creating combined shading rate resource view\n";
 		NV_D3D11_SHADING_RATE_RESOURCE_VIEW_DESC vd = {};
 		vd.version = NV_D3D11_SHADING_RATE_RESOURCE_VIEW_DESC_VER;
 		vd.Format = td.Format;
@@ -295,7 +329,7 @@ namespace vr {
 		NvAPI_Status status = NvAPI_D3D11_CreateShadingRateResourceView( device.Get(), combinedVRSTex.Get(), &vd, combinedVRSView.GetAddressOf() );
 		if (status != NVAPI_OK) {
 			Reset();
-			Log() << "Failed to create combined VRS pattern view: " << status << std::endl;
+			Log() << "Failed to create combined VRS pattern view: " << status << "\n";
 			return;
 		}
 	}
@@ -304,6 +338,7 @@ namespace vr {
 		if (!initialized || (arrayVRSTex && width == arrayWidth && height == arrayHeight)) {
 			return;
 		}
+		stateTracker.ForgetView( arrayVRSView.Get() );
 		arrayVRSTex.Reset();
 		arrayVRSView.Reset();
 
@@ -312,7 +347,7 @@ namespace vr {
 		int vrsWidth = width / NV_VARIABLE_PIXEL_SHADING_TILE_WIDTH;
 		int vrsHeight = height / NV_VARIABLE_PIXEL_SHADING_TILE_HEIGHT;
 
-		Log() << "Creating array VRS pattern texture of size " << vrsWidth << "x" << vrsHeight << std::endl;
+		Log() << "Creating array VRS pattern texture of size " << vrsWidth << "x" << vrsHeight << "\n";
 
 		D3D11_TEXTURE2D_DESC td = {};
 		td.Width = vrsWidth;
@@ -329,18 +364,18 @@ namespace vr {
 		HRESULT result = device->CreateTexture2D( &td, nullptr, arrayVRSTex.GetAddressOf() );
 		if (FAILED(result)) {
 			Reset();
-			Log() << "Failed to create array VRS pattern texture: " << std::hex << result << std::dec << std::endl;
+			Log() << "Failed to create array VRS pattern texture: " << std::hex << result << std::dec << "\n";
 			return;
 		}
 
 		// array rendering is most likely a new Unity engine game, which for some reason renders upside down.
 		// so we invert the y projection center coordinate to match the upside down render.
-		auto data = CreateSingleEyeFixedFoveatedVRSPattern( vrsWidth, vrsHeight, leftProjX, 1.f - leftProjY );
+		auto data = CreateSingleEyeFixedFoveatedVRSPattern( vrsWidth, vrsHeight, leftProjX, 1.f - leftProjY, radii );
 		context->UpdateSubresource( arrayVRSTex.Get(), D3D11CalcSubresource( 0, 0, 1 ), nullptr, data.data(), vrsWidth, 0 );
-		data = CreateSingleEyeFixedFoveatedVRSPattern( vrsWidth, vrsHeight, rightProjX, 1.f - rightProjY );
+		data = CreateSingleEyeFixedFoveatedVRSPattern( vrsWidth, vrsHeight, rightProjX, 1.f - rightProjY, radii );
 		context->UpdateSubresource( arrayVRSTex.Get(), D3D11CalcSubresource( 0, 1, 1 ), nullptr, data.data(), vrsWidth, 0 );
 
-		Log() << "Creating array shading rate resource view" << std::endl;
+		Log() << "Creating array shading rate resource view\n";
 		NV_D3D11_SHADING_RATE_RESOURCE_VIEW_DESC vd = {};
 		vd.version = NV_D3D11_SHADING_RATE_RESOURCE_VIEW_DESC_VER;
 		vd.Format = td.Format;
@@ -351,7 +386,7 @@ namespace vr {
 		NvAPI_Status status = NvAPI_D3D11_CreateShadingRateResourceView( device.Get(), arrayVRSTex.Get(), &vd, arrayVRSView.GetAddressOf() );
 		if (status != NVAPI_OK) {
 			Reset();
-			Log() << "Failed to create array VRS pattern view: " << status << std::endl;
+			Log() << "Failed to create array VRS pattern view: " << status << "\n";
 			return;
 		}
 	}
@@ -4,10 +4,25 @@
 #include <wrl/client.h>
 #include "nvapi/nvapi.h"
 #include "openvr.h"
+#include "VrsStateTracker.h"
 
 namespace vr {
 	using Microsoft::WRL::ComPtr;
 
+	// Keeps NVAPI loaded while alive. Loading it the first time takes a while, so the warm-up worker holds one
+	// of these until Init, which then finds it loaded already.
+	class NvapiPreload {
+	public:
+		NvapiPreload();
+		~NvapiPreload();
+		NvapiPreload(const NvapiPreload &) = delete;
+		NvapiPreload & operator=(const NvapiPreload &) = delete;
+		bool Loaded() const { return loaded; }
+
+	private:
+		bool loaded;
+	};
+
 	class VariableRateShading {
 	public:
 		~VariableRateShading() { Reset(); }
@@ -23,17 +38,38 @@ namespace vr {
 		void ApplyArrayVRS(int width, int height, float leftProjX, float leftProjY, float rightProjX, float rightProjY);
 		void ApplySingleEyeVRS(EVREye eye, int width, int height, float projX, float projY);
 		void DisableVRS();
+		// radii of the foveation regions, as passed to the shaders; changing them rebuilds the patterns
+		void SetRadii(float inner, float mid, float outer);
+
+		// forget what we sent to the driver, e.g. because the context's state was reset
+		void InvalidateState() { stateTracker.Invalidate(); }
+		void EndFrame() { stateTracker.EndFrame(); }
+		const VrsStateTracker & StateTracker() const { return stateTracker; }
+		// replaces the driver calls, or restores the NVAPI backend if null
+		void SetBackend(VrsBackend *backend) { stateTracker.SetBackend( backend != nullptr ? backend : &nvapiBackend ); }
 
 	private:
-		VariableRateShading() {}
+		VariableRateShading() { stateTracker.SetBackend( &nvapiBackend ); }
+
+		class NvapiBackend : public VrsBackend {
+		public:
+			ComPtr<ID3D11DeviceContext> context;
+			bool BindShadingRateView(ID3D11NvShadingRateResourceView *view) override;
+			bool SetShadingRates(bool enabled) override;
+		};
+		NvapiBackend nvapiBackend;
+		VrsStateTracker stateTracker;
 
 		bool nvapiLoaded = false;
 		bool initialized = false;
+		float radii[3] = { 0.5f, 0.8f, 1.0f };
 
 		ComPtr<ID3D11Device> device;
 		ComPtr<ID3D11DeviceContext> context;
 		int singleWidth[2] = { 0, 0 };
 		int singleHeight[2] = { 0, 0 };
+		int singleCenterX[2] = { 0, 0 };
+		int singleCenterY[2] = { 0, 0 };
 		ComPtr<ID3D11Texture2D> singleEyeVRSTex[2];
 		ComPtr<ID3D11NvShadingRateResourceView> singleEyeVRSView[2];
 		int combinedWidth = 0;
@@ -45,8 +81,6 @@ namespace vr {
 		ComPtr<ID3D11Texture2D> arrayVRSTex;
 		ComPtr<ID3D11NvShadingRateResourceView> arrayVRSView;
 
-		void EnableVRS();
-
 		void SetupSingleEyeVRS(EVREye eye, int width, int height, float projX, float projY);
 		void SetupCombinedVRS(int width, int height, float leftProjX, float leftProjY, float rightProjX, float rightProjY);
 		void SetupArrayVRS(int width, int height, float leftProjX, float leftProjY, float rightProjX, float rightProjY);
@@ -0,0 +1,95 @@
+#pragma once
+#include <cstdint>
+
+struct ID3D11NvShadingRateResourceView;
+
+namespace vr {
+	// the driver calls that change VRS state, so that the transition logic does not depend on NVAPI directly
+	class VrsBackend {
+	public:
+		virtual ~VrsBackend() {}
+		virtual bool BindShadingRateView(ID3D11NvShadingRateResourceView *view) = 0;
+		// sets our foveated shading rate table for both viewports if enabled, otherwise turns VRS off
+		virtual bool SetShadingRates(bool enabled) = 0;
+	};
+
+	struct VrsCallStats {
+		uint64_t issued = 0;
+		uint64_t avoided = 0;
+	};
+
+	// Remembers the shading rate view and table we last sent to the driver, so that the VRS updates on
+	// every render target bind only reach the driver if they change something. What we sent is only
+	// trusted until the end of the frame, or until anything may have reset the context's state.
+	class VrsStateTracker {
+	public:
+		void SetBackend(VrsBackend *backend) {
+			this->backend = backend;
+			Invalidate();
+		}
+
+		bool Enable(ID3D11NvShadingRateResourceView *view) {
+			if (viewKnown && boundView == view) {
+				++frameStats.avoided;
+			} else {
+				viewKnown = false;
+				++frameStats.issued;
+				if (!backend->BindShadingRateView(view))
+					return false;
+				boundView = view;
+				viewKnown = true;
+			}
+			return SetShadingRates(true);
+		}
+
+		bool Disable() {
+			return SetShadingRates(false);
+		}
+
+		void Invalidate() {
+			viewKnown = false;
+			ratesKnown = false;
+		}
+
+		// call when a view is about to be released, as a new view could be created at the same address
+		void ForgetView(ID3D11NvShadingRateResourceView *view) {
+			if (boundView == view)
+				viewKnown = false;
+		}
+
+		void EndFrame() {
+			lastFrameStats = frameStats;
+			totalStats.issued += frameStats.issued;
+			totalStats.avoided += frameStats.avoided;
+			frameStats = VrsCallStats();
+			Invalidate();
+		}
+
+		const VrsCallStats & LastFrameStats() const { return lastFrameStats; }
+		const VrsCallStats & TotalStats() const { return totalStats; }
+
+	private:
+		VrsBackend *backend = nullptr;
+		ID3D11NvShadingRateResourceView *boundView = nullptr;
+		bool viewKnown = false;
+		bool ratesEnabled = false;
+		bool ratesKnown = false;
+		VrsCallStats frameStats;
+		VrsCallStats lastFrameStats;
+		VrsCallStats totalStats;
+
+		bool SetShadingRates(bool enabled) {
+			if (ratesKnown && ratesEnabled == enabled) {
+				++frameStats.avoided;
+				return true;
+			}
+			ratesKnown = false;
+			++frameStats.issued;
+			if (!backend->SetShadingRates(enabled))
+				return false;
+			ratesEnabled = enabled;
+			ratesKnown = true;
+			return true;
+		}
+	};
+}